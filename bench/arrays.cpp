@@ -0,0 +1,85 @@
+#include <cmath>
+#include <random>
+#include "timing.hpp"
+#include "../src/pshellscript/array.hpp"
+
+using namespace pshellscript::vm;
+
+// Keeps results alive so the loops being timed are not optimized away.
+static volatile double double_sink;
+static volatile std::int64_t integer_sink;
+
+
+int main() {
+    const std::size_t count = 10000000;
+    std::mt19937_64 random(1);
+    std::vector<double> numbers(count);
+    std::vector<std::int64_t> integers(count);
+    for (std::size_t i = 0; i < count; i++) {
+        integers[i] = std::int64_t(random() % 2000000) - 1000000;
+        numbers[i] = double(random() % 1000000) / 7.0 - 50000;
+    }
+
+    std::printf("10M elements, best of 5\n");
+
+    bench::report("sum (double)", bench::best_of(5, [&] {
+        double_sink = kernels::sum(numbers);
+    }), "loop", bench::best_of(5, [&] {
+        double total = 0;
+        for (auto number : numbers) {
+            total += number;
+        }
+        double_sink = total;
+    }));
+
+    bench::report("min (double)", bench::best_of(5, [&] {
+        double_sink = kernels::minimum(numbers);
+    }), "loop", bench::best_of(5, [&] {
+        auto smallest = numbers[0];
+        auto nan = false;
+        for (auto number : numbers) {
+            nan |= std::isnan(number);
+            smallest = std::min(smallest, number);
+        }
+        double_sink = nan ? NAN : smallest;
+    }));
+
+    std::vector<double> scaled;
+    bench::report("map * (double)", bench::best_of(5, [&] {
+        kernels::apply(kernels::Operation::Multiply, numbers, 1.5, scaled);
+    }), "loop", bench::best_of(5, [&] {
+        scaled.resize(count);
+        for (std::size_t i = 0; i < count; i++) {
+            scaled[i] = numbers[i] * 1.5;
+        }
+    }));
+
+    std::vector<std::int64_t> shifted;
+    bench::report("map + (int)", bench::best_of(5, [&] {
+        integer_sink = kernels::apply(kernels::Operation::Add, integers, 3, shifted);
+    }), "loop", bench::best_of(5, [&] {
+        shifted.resize(count);
+        auto overflow = false;
+        for (std::size_t i = 0; i < count; i++) {
+            overflow |= __builtin_add_overflow(integers[i], std::int64_t(3), &shifted[i]);
+        }
+        integer_sink = overflow;
+    }));
+
+    // Each run sorts a fresh copy; the copy is timed as well, on both sides.
+    bench::report("sort (int)", bench::best_of(3, [&] {
+        auto copy = integers;
+        kernels::sort(copy);
+    }), "std::sort", bench::best_of(3, [&] {
+        auto copy = integers;
+        std::sort(copy.begin(), copy.end());
+    }));
+
+    bench::report("sort (double)", bench::best_of(3, [&] {
+        auto copy = numbers;
+        kernels::sort(copy);
+    }), "std::sort", bench::best_of(3, [&] {
+        auto copy = numbers;
+        std::sort(copy.begin(), copy.end());
+    }));
+}
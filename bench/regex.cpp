@@ -0,0 +1,95 @@
+#include <random>
+#include <string>
+#include <vector>
+#include "timing.hpp"
+#include "../src/pshellscript/regex.hpp"
+
+using namespace pshellscript;
+
+static volatile std::size_t match_sink;
+
+
+/**
+ * Log lines that none of the patterns below match: no "upstream", no
+ * "ERROR", no GET or POST, no user number starting with 4 and no address
+ * whose last part starts with 9.
+ */
+static std::string make_log(std::size_t size) {
+    static const char* const levels[] = { "INFO", "WARN", "DEBUG" };
+    static const char* const methods[] = { "PUT", "PATCH", "DELETE", "HEAD" };
+    static const char* const paths[] = { "/index", "/api/items", "/static/app.js", "/admin" };
+    static const char* const first_digits = "12356789";
+
+    std::mt19937_64 random(1);
+    std::string log;
+    log.reserve(size + 256);
+    char line[256];
+    while (log.size() < size) {
+        auto length = std::snprintf(
+            line, sizeof(line),
+            "2026-10-19 12:%02d:%02d %s %s %s request %u served in %ums from 10.%u.%u.%u user=%c%03u\n",
+            unsigned(random() % 60), unsigned(random() % 60),
+            levels[random() % 3],
+            methods[random() % 4],
+            paths[random() % 4],
+            unsigned(random() % 100000), unsigned(random() % 1000),
+            unsigned(random() % 256), unsigned(random() % 256), unsigned(10 + random() % 80),
+            first_digits[random() % 8], unsigned(random() % 1000)
+        );
+        log.append(line, std::size_t(length));
+    }
+    return log;
+}
+
+
+int main() {
+    const std::size_t size = std::size_t(256) << 20;
+    auto log = make_log(size);
+
+    std::vector<std::string_view> lines;
+    std::size_t start = 0;
+    for (auto end = log.find('\n'); end != std::string::npos; end = log.find('\n', start)) {
+        lines.emplace_back(log.data() + start, end - start);
+        start = end + 1;
+    }
+
+    static const char* const patterns[] = {
+        "upstream timeout",
+        "ERROR [0-9]+ timeout",
+        "(GET|POST) /admin",
+        "user=4[0-9]{3}",
+        "\\d+\\.\\d+\\.\\d+\\.9",
+    };
+
+    std::printf("256 MiB of log text with no match, best of 3\n");
+    std::printf("%-24s %14s %14s\n", "pattern", "whole buffer", "line by line");
+    for (auto pattern : patterns) {
+        auto compiled = regex::Regex::compile(pattern);
+        if (compiled.is_error()) {
+            std::fprintf(stderr, "%s: %s\n", pattern, compiled.get_error().message.c_str());
+            return 1;
+        }
+        auto& regex = **compiled;
+        if (regex.search(log)) {
+            std::fprintf(stderr, "%s: matches the log text\n", pattern);
+            return 1;
+        }
+
+        auto whole = bench::best_of(3, [&] {
+            match_sink = regex.search(log);
+        });
+        auto by_line = bench::best_of(3, [&] {
+            std::size_t matches = 0;
+            for (auto line : lines) {
+                matches += regex.search(line);
+            }
+            match_sink = matches;
+        });
+
+        auto gigabytes = double(log.size()) / 1e9;
+        std::printf(
+            "%-24s %9.2f GB/s %9.2f GB/s\n",
+            pattern, gigabytes / (whole / 1000), gigabytes / (by_line / 1000)
+        );
+    }
+}
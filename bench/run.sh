@@ -0,0 +1,40 @@
+#!/bin/sh
+# Run the benchmarks in bench/ through a shell. Each bench/<name>.psh
+# labels and times its own statements with the `time` prefix, which
+# reports on standard error; what the scripts print is discarded. When
+# bash is installed, a bench/<name>.bash next to a script runs the same
+# work for comparison. Kernel benchmarks, bench/<name>.cpp, are built by
+# `make bench` as bench_<name> next to the shell and run after the
+# script of the same name.
+#
+# The numbers quoted in commit messages come from optimized builds, which
+# the kernel benchmarks need as much as the shell:
+#
+#     make clean && make bench CXXFLAGS="-O2 -std=c++17 -Wall -Werror -Wextra"
+#
+# To compare two builds, run this with each one's shell.
+#
+# Usage: bench/run.sh path/to/shell [name...]
+
+shell=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+directory=$(cd "$(dirname "$0")" && pwd)
+shift
+
+if [ $# -eq 0 ]; then
+    set -- $(cd "$directory" && ls *.psh *.cpp 2> /dev/null | sed 's/\.[a-z]*$//' | sort -u)
+fi
+
+for name in "$@"; do
+    if [ -f "$directory/$name.psh" ]; then
+        echo "== $name"
+        (cd "$directory" && "$shell" < "$name.psh" > /dev/null)
+    fi
+    if [ -f "$directory/$name.bash" ] && command -v bash > /dev/null; then
+        echo "== $name (bash)"
+        (cd "$directory" && bash "$name.bash" > /dev/null)
+    fi
+    if [ -x "$(dirname "$shell")/bench_$name" ]; then
+        echo "== $name (kernels)"
+        "$(dirname "$shell")/bench_$name"
+    fi
+done
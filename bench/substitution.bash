@@ -0,0 +1,14 @@
+# The loops of substitution.psh, for comparison.
+TIMEFORMAT='time: real %3R s, user %3U s, system %3S s'
+f() { echo "$1"; }
+g() { /bin/echo "$1"; }
+echo '10k substitutions of a script function' >&2
+time for ((i = 0; i < 10000; i++)); do v=$(f $i); done
+echo '1k substitutions of basename, program' >&2
+time for ((i = 0; i < 1000; i++)); do v=$(basename /usr/lib/libc.so .so); done
+echo '10k substitutions of printf, builtin' >&2
+time for ((i = 0; i < 10000; i++)); do v=$(printf "%d" $i); done
+echo '1k substitutions of /bin/echo' >&2
+time for ((i = 0; i < 1000; i++)); do v=$(/bin/echo $i); done
+echo '1k substitutions of a function running /bin/echo' >&2
+time for ((i = 0; i < 1000; i++)); do v=$(g $i); done
@@ -0,0 +1,132 @@
+#include <cctype>
+#include <random>
+#include <string>
+#include <vector>
+#include "timing.hpp"
+#include "../src/pshellscript/text.hpp"
+
+using namespace pshellscript;
+
+static volatile std::size_t size_sink;
+
+
+// Web server log lines, one in a thousand ending in an upstream timeout.
+static std::string make_log(std::size_t size) {
+    std::mt19937_64 random(1);
+    std::string log;
+    log.reserve(size + 256);
+    char line[256];
+    while (log.size() < size) {
+        auto length = std::snprintf(
+            line, sizeof(line),
+            "2026-10-19 12:%02d:%02d INFO request %u served in %ums from 10.0.%u.%u%s\n",
+            unsigned(random() % 60), unsigned(random() % 60),
+            unsigned(random() % 100000), unsigned(random() % 1000),
+            unsigned(random() % 256), unsigned(random() % 256),
+            random() % 1000 == 0 ? " upstream timeout" : ""
+        );
+        log.append(line, std::size_t(length));
+    }
+    return log;
+}
+
+
+static std::size_t count_std(const std::string& log, const std::string& needle) {
+    std::size_t count = 0;
+    for (auto at = log.find(needle); at != std::string::npos; at = log.find(needle, at + needle.size())) {
+        count++;
+    }
+    return count;
+}
+
+
+static std::size_t count_kernel(const std::string& log, std::string_view needle) {
+    std::size_t count = 0;
+    for (auto at = text::find(log, needle); at != std::string::npos; at = text::find(log, needle, at + needle.size())) {
+        count++;
+    }
+    return count;
+}
+
+
+static std::vector<std::string_view> split_std(const std::string& log, const std::string& separator) {
+    std::vector<std::string_view> pieces;
+    std::size_t start = 0;
+    for (auto at = log.find(separator); at != std::string::npos; at = log.find(separator, start)) {
+        pieces.emplace_back(log.data() + start, at - start);
+        start = at + separator.size();
+    }
+    pieces.emplace_back(log.data() + start, log.size() - start);
+    return pieces;
+}
+
+
+static std::string replace_std(const std::string& log, const std::string& from, const std::string& to) {
+    std::string result;
+    std::size_t start = 0;
+    for (auto at = log.find(from); at != std::string::npos; at = log.find(from, start)) {
+        result.append(log, start, at - start);
+        result += to;
+        start = at + from.size();
+    }
+    result.append(log, start, std::string::npos);
+    return result;
+}
+
+
+int main() {
+    auto log = make_log(std::size_t(16) << 20);
+    auto megabytes = double(log.size()) / 1e6;
+    auto rate = [&](double milliseconds) {
+        return megabytes / (milliseconds / 1000);
+    };
+
+    std::printf("16 MB of log text, best of 5, MB/s\n");
+    auto compare = [&](const char* label, double kernel, double baseline) {
+        std::printf("%-26s kernel %8.0f   std %8.0f\n", label, rate(kernel), rate(baseline));
+    };
+
+    for (const char* needle : { "upstream timeout", "served in 99ms", "xq" }) {
+        std::string label = std::string("find \"") + needle + "\"";
+        compare(label.c_str(), bench::best_of(5, [&] {
+            size_sink = count_kernel(log, needle);
+        }), bench::best_of(5, [&] {
+            size_sink = count_std(log, needle);
+        }));
+    }
+
+    for (const char* separator : { "\n", " in " }) {
+        std::string label = separator[0] == '\n' ? "split \"\\n\"" : std::string("split \"") + separator + "\"";
+        compare(label.c_str(), bench::best_of(5, [&] {
+            size_sink = text::split(log, separator).size();
+        }), bench::best_of(5, [&] {
+            size_sink = split_std(log, separator).size();
+        }));
+    }
+
+    compare("replace \"request\"", bench::best_of(5, [&] {
+        size_sink = text::replace(log, "request", "req").size();
+    }), bench::best_of(5, [&] {
+        size_sink = replace_std(log, "request", "req").size();
+    }));
+
+    compare("lower", bench::best_of(5, [&] {
+        size_sink = text::lower(log).size();
+    }), bench::best_of(5, [&] {
+        std::string lowered(log.size(), '\0');
+        for (std::size_t i = 0; i < log.size(); i++) {
+            lowered[i] = char(std::tolower(static_cast<unsigned char>(log[i])));
+        }
+        size_sink = lowered.size();
+    }));
+
+    compare("upper", bench::best_of(5, [&] {
+        size_sink = text::upper(log).size();
+    }), bench::best_of(5, [&] {
+        std::string raised(log.size(), '\0');
+        for (std::size_t i = 0; i < log.size(); i++) {
+            raised[i] = char(std::toupper(static_cast<unsigned char>(log[i])));
+        }
+        size_sink = raised.size();
+    }));
+}
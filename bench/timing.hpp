@@ -0,0 +1,29 @@
+#ifndef BENCH_TIMING_HPP
+#define BENCH_TIMING_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace bench {
+    // The fastest of `runs` runs of `work`, in milliseconds.
+    template<typename Work>
+    double best_of(int runs, Work work) {
+        auto best = 1e300;
+        for (int i = 0; i < runs; i++) {
+            auto started = std::chrono::steady_clock::now();
+            work();
+            std::chrono::duration<double, std::milli> taken = std::chrono::steady_clock::now() - started;
+            best = std::min(best, taken.count());
+        }
+        return best;
+    }
+
+
+    // `label  kernel 10.5 ms  baseline 18.1 ms`, the baseline named by `against`.
+    inline void report(const char* label, double kernel, const char* against, double baseline) {
+        std::printf("%-20s kernel %8.1f ms   %-9s %8.1f ms\n", label, kernel, against, baseline);
+    }
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include "result.hpp"
 #include "pshellscript/lexer.hpp"
 #include "pshellscript/tokens.hpp"
+#include "pshellscript/optimizer.hpp"
 
 namespace debug {
     inline void dump_tokens(const std::vector<pshellscript::Token>& tokens) {
@@ -14,6 +15,15 @@ namespace debug {
             std::cout << token.to_string() << '\n';
         }
     }
+
+    inline void dump_optimizer_report(const pshellscript::optimizer::Report& report) {
+        std::cerr << "inlined calls: " << report.inlined_calls
+                  << " (" << report.inlined_nodes << " nodes)\n"
+                  << "removed branches: " << report.removed_branches << '\n'
+                  << "unreachable statements: " << report.unreachable_statements << '\n'
+                  << "dead stores: " << report.dead_stores << '\n'
+                  << "common subexpressions: " << report.common_subexpressions << '\n';
+    }
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include "accounting.hpp"
+
+namespace pshellscript::accounting {
+    static int log_descriptor = -1;
+
+    // The measurements open, innermost last.
+    static std::vector<Measurement*> measurements;
+
+
+    bool set_log(int descriptor) {
+        // Programs the shell starts do not write to it, only the shell.
+        if (descriptor >= 0 && ::fcntl(descriptor, F_SETFD, FD_CLOEXEC) < 0) {
+            return false;
+        }
+        log_descriptor = descriptor;
+        return true;
+    }
+
+
+    bool logging() {
+        return log_descriptor >= 0;
+    }
+
+
+    static void append_json_string(std::string& line, std::string_view text) {
+        line += '"';
+        for (unsigned char c : text) {
+            if (c == '"' || c == '\\') {
+                line += '\\';
+                line += char(c);
+            } else if (c < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                line += escape;
+            } else {
+                line += char(c);
+            }
+        }
+        line += '"';
+    }
+
+
+    static void log(const char* kind, std::string_view command, int status, const process::Usage& usage) {
+        timespec now;
+        ::clock_gettime(CLOCK_REALTIME, &now);
+
+        std::string line = "{\"kind\":\"";
+        line += kind;
+        line += "\",\"command\":";
+        append_json_string(line, command);
+
+        char fields[256];
+        std::snprintf(
+            fields, sizeof(fields),
+            ",\"status\":%d,\"end\":%lld.%06ld,\"real\":%.6f,\"user\":%.6f,\"system\":%.6f,",
+            status, static_cast<long long>(now.tv_sec), now.tv_nsec / 1000,
+            usage.real, usage.user, usage.system
+        );
+        line += fields;
+
+        // Unknown when no program was waited for, as for a pipeline of
+        // builtins.
+        if (usage.max_resident > 0) {
+            std::snprintf(fields, sizeof(fields), "\"max_rss_kb\":%ld,", usage.max_resident);
+            line += fields;
+        } else {
+            line += "\"max_rss_kb\":null,";
+        }
+
+        std::snprintf(
+            fields, sizeof(fields),
+            "\"voluntary_switches\":%ld,\"involuntary_switches\":%ld}\n",
+            usage.voluntary_switches, usage.involuntary_switches
+        );
+        line += fields;
+
+        // One write per line, so lines from the shell and its children that
+        // share the descriptor do not interleave.
+        process::write_all(log_descriptor, line);
+    }
+
+
+    void add(const process::Usage& usage) {
+        for (auto measurement : measurements) {
+            measurement->children.add(usage);
+        }
+    }
+
+
+    void record(
+        const char* kind, std::string_view command, int status,
+        process::Usage usage, Clock::time_point started
+    ) {
+        usage.real = std::chrono::duration<double>(Clock::now() - started).count();
+        add(usage);
+
+        if (logging()) {
+            log(kind, command, status, usage);
+        }
+    }
+
+
+    void record(
+        const char* kind, const std::vector<std::string>& arguments, int status,
+        const process::Usage& usage, Clock::time_point started
+    ) {
+        std::string command;
+        if (logging()) {
+            for (const auto& argument : arguments) {
+                if (!command.empty()) {
+                    command += ' ';
+                }
+                command += argument;
+            }
+        }
+        record(kind, command, status, usage, started);
+    }
+
+
+    Measurement::Measurement() : started(Clock::now()) {
+        ::getrusage(RUSAGE_SELF, &this->own);
+        measurements.push_back(this);
+    }
+
+
+    Measurement::~Measurement() {
+        auto found = std::find(measurements.rbegin(), measurements.rend(), this);
+        if (found != measurements.rend()) {
+            measurements.erase(std::next(found).base());
+        }
+    }
+
+
+    static inline double seconds(const timeval& time) {
+        return double(time.tv_sec) + double(time.tv_usec) / 1e6;
+    }
+
+
+    process::Usage Measurement::finish() const {
+        rusage own;
+        ::getrusage(RUSAGE_SELF, &own);
+
+        auto usage = this->children;
+        usage.real = std::chrono::duration<double>(Clock::now() - this->started).count();
+        usage.user += seconds(own.ru_utime) - seconds(this->own.ru_utime);
+        usage.system += seconds(own.ru_stime) - seconds(this->own.ru_stime);
+        usage.voluntary_switches += own.ru_nvcsw - this->own.ru_nvcsw;
+        usage.involuntary_switches += own.ru_nivcsw - this->own.ru_nivcsw;
+        return usage;
+    }
+
+
+    std::string describe(const process::Usage& usage) {
+        char resident[64] = "";
+        if (usage.max_resident > 0) {
+            std::snprintf(resident, sizeof(resident), ", max RSS %ld KB", usage.max_resident);
+        }
+
+        char text[256];
+        std::snprintf(
+            text, sizeof(text),
+            "real %.3f s, user %.3f s, system %.3f s%s, "
+            "%ld voluntary and %ld involuntary context switches",
+            usage.real, usage.user, usage.system, resident,
+            usage.voluntary_switches, usage.involuntary_switches
+        );
+        return text;
+    }
+}
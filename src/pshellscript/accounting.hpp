@@ -0,0 +1,77 @@
+#ifndef ACCOUNTING_HPP
+#define ACCOUNTING_HPP
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/resource.h>
+#include "process.hpp"
+
+namespace pshellscript::accounting {
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Log a JSON line for each program and pipeline that finishes to
+     * `descriptor`, or to nothing if it is -1. Programs the shell starts do
+     * not inherit it. Returns false if it is not an open file descriptor.
+     */
+    bool set_log(int descriptor);
+
+    /**
+     * Count what a program or pipeline started at `started` used towards
+     * each open measurement, and log it as a `kind` ("command" or
+     * "pipeline") running `command`, with its status.
+     */
+    void record(
+        const char* kind, std::string_view command, int status,
+        process::Usage usage, Clock::time_point started
+    );
+    void record(
+        const char* kind, const std::vector<std::string>& arguments, int status,
+        const process::Usage& usage, Clock::time_point started
+    );
+
+    // Count what a child used towards each open measurement without logging
+    // it, as for a subshell, whose programs have already been logged.
+    void add(const process::Usage& usage);
+
+    // Whether there is a log, so callers can skip making the text for it.
+    bool logging();
+
+
+    /**
+     * Measures what is used from its creation until finish(): the time that
+     * passes, the shell's own CPU time and context switches, and what the
+     * children recorded meanwhile used. Measurements can nest.
+     */
+    class Measurement {
+        Clock::time_point started;
+        rusage own;
+        process::Usage children;
+
+        friend void record(const char*, std::string_view, int, process::Usage, Clock::time_point);
+        friend void add(const process::Usage&);
+
+    public:
+        Measurement();
+        ~Measurement();
+
+        /**
+         * What was used so far. The largest resident set is only that of
+         * the children, and 0 if none were waited for: the shell's own peak
+         * covers its whole life, not the measurement.
+         */
+        process::Usage finish() const;
+
+        Measurement(const Measurement&) = delete;
+        Measurement& operator=(const Measurement&) = delete;
+    };
+
+    // `real 0.012 s, user 0.004 s, system 0.008 s, max RSS 3712 KB, 2
+    // voluntary and 0 involuntary context switches`, leaving out the
+    // resident set when it is not known.
+    std::string describe(const process::Usage& usage);
+}
+
+#endif
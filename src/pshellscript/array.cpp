@@ -0,0 +1,489 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "array.hpp"
+
+namespace pshellscript::vm {
+    // Integers up to 2^53 in magnitude convert to a double and back unchanged.
+    static inline bool is_exact_in_double(std::int64_t integer) {
+        constexpr std::int64_t largest_exact = std::int64_t(1) << 53;
+        return integer <= largest_exact && integer >= -largest_exact;
+    }
+
+
+    std::size_t Array::size() const {
+        switch (this->storage) {
+            case Storage::Integers: return this->integers.size();
+            case Storage::Numbers: return this->numbers.size();
+            default: return this->values.size();
+        }
+    }
+
+
+    void Array::reserve(std::size_t capacity) {
+        switch (this->storage) {
+            case Storage::Integers: this->integers.reserve(capacity); break;
+            case Storage::Numbers: this->numbers.reserve(capacity); break;
+            default: this->values.reserve(capacity); break;
+        }
+    }
+
+
+    Value Array::get(std::size_t index) const {
+        switch (this->storage) {
+            case Storage::Integers: return this->integers[index];
+            case Storage::Numbers: return this->numbers[index];
+            default: return this->values[index];
+        }
+    }
+
+
+    void Array::set(std::size_t index, const Value& value) {
+        this->widen(value);
+        switch (this->storage) {
+            case Storage::Integers: {
+                this->integers[index] = std::get<std::int64_t>(value);
+                break;
+            }
+
+            case Storage::Numbers: {
+                this->numbers[index] = std::holds_alternative<double>(value)
+                    ? std::get<double>(value)
+                    : double(std::get<std::int64_t>(value));
+                break;
+            }
+
+            default: {
+                this->values[index] = value;
+                break;
+            }
+        }
+    }
+
+
+    void Array::push(const Value& value) {
+        this->widen(value);
+        switch (this->storage) {
+            case Storage::Integers: {
+                this->integers.push_back(std::get<std::int64_t>(value));
+                break;
+            }
+
+            case Storage::Numbers: {
+                this->numbers.push_back(
+                    std::holds_alternative<double>(value)
+                        ? std::get<double>(value)
+                        : double(std::get<std::int64_t>(value))
+                );
+                break;
+            }
+
+            default: {
+                this->values.push_back(value);
+                break;
+            }
+        }
+    }
+
+
+    void Array::trace(std::vector<HeapObject*>& references) const {
+        // Unboxed elements are never references.
+        for (const auto& value : this->values) {
+            if (auto object = heap::object_of(value)) {
+                references.push_back(object);
+            }
+        }
+    }
+
+
+    void Array::clear() {
+        this->storage = Storage::Integers;
+        this->integers = {};
+        this->numbers = {};
+        this->values = {};
+    }
+
+
+    void Array::widen(const Value& value) {
+        if (this->storage == Storage::Values) {
+            return;
+        }
+
+        if (std::holds_alternative<std::int64_t>(value)) {
+            auto integer = std::get<std::int64_t>(value);
+            if (this->storage == Storage::Numbers && !is_exact_in_double(integer)) {
+                this->box();
+            }
+            return;
+        }
+
+        if (!std::holds_alternative<double>(value)) {
+            this->box();
+            return;
+        }
+
+        if (this->storage == Storage::Numbers) {
+            return;
+        }
+
+        // Integers turn into numbers only if none of them would be rounded.
+        if (!std::all_of(this->integers.begin(), this->integers.end(), is_exact_in_double)) {
+            this->box();
+            return;
+        }
+
+        this->numbers.assign(this->integers.begin(), this->integers.end());
+        this->integers = std::vector<std::int64_t>();
+        this->storage = Storage::Numbers;
+    }
+
+
+    void Array::box() {
+        this->values.reserve(this->size());
+        if (this->storage == Storage::Integers) {
+            this->values.assign(this->integers.begin(), this->integers.end());
+            this->integers = std::vector<std::int64_t>();
+        } else {
+            this->values.assign(this->numbers.begin(), this->numbers.end());
+            this->numbers = std::vector<double>();
+        }
+        this->storage = Storage::Values;
+    }
+}
+
+
+namespace pshellscript::vm::kernels {
+    // Two 64-bit lanes: SSE2 on x86-64 and NEON on AArch64 are always there.
+    typedef double DoubleLanes __attribute__((vector_size(16)));
+    typedef std::int64_t IntegerLanes __attribute__((vector_size(16)));
+    typedef std::uint64_t WordLanes __attribute__((vector_size(16)));
+    constexpr std::size_t lanes = 2;
+
+    template <typename Lanes, typename Element>
+    static inline Lanes load(const Element* elements) {
+        Lanes loaded;
+        std::memcpy(&loaded, elements, sizeof(loaded));
+        return loaded;
+    }
+
+    template <typename Lanes, typename Element>
+    static inline void store(Element* elements, Lanes stored) {
+        std::memcpy(elements, &stored, sizeof(stored));
+    }
+
+
+    double sum(const std::vector<double>& numbers) {
+        const auto* data = numbers.data();
+        auto size = numbers.size();
+
+        // Two accumulators keep consecutive additions independent.
+        DoubleLanes first = { 0, 0 }, second = { 0, 0 };
+        std::size_t i = 0;
+        for (; i + 2 * lanes <= size; i += 2 * lanes) {
+            first += load<DoubleLanes>(data + i);
+            second += load<DoubleLanes>(data + i + lanes);
+        }
+
+        first += second;
+        auto total = first[0] + first[1];
+        for (; i < size; i++) {
+            total += data[i];
+        }
+        return total;
+    }
+
+
+    bool sum(const std::vector<std::int64_t>& integers, std::int64_t& total, double& rounded) {
+        // 128-bit partial sums cannot overflow, so the total is exact however
+        // the elements are ordered. SSE2 cannot detect 64-bit carries, so
+        // this adds one element at a time with add-with-carry.
+        __int128 first = 0, second = 0;
+        const auto* data = integers.data();
+        auto size = integers.size();
+        std::size_t i = 0;
+        for (; i + 2 <= size; i += 2) {
+            first += data[i];
+            second += data[i + 1];
+        }
+        if (i < size) {
+            first += data[i];
+        }
+
+        auto exact = first + second;
+        if (exact < std::numeric_limits<std::int64_t>::min() || exact > std::numeric_limits<std::int64_t>::max()) {
+            rounded = double(exact);
+            return false;
+        }
+
+        total = std::int64_t(exact);
+        return true;
+    }
+
+
+    template <bool FindMaximum>
+    static double extreme(const std::vector<double>& numbers) {
+        const auto* data = numbers.data();
+        auto size = numbers.size();
+
+        DoubleLanes best = { data[0], data[0] };
+        IntegerLanes unordered = { 0, 0 };
+        std::size_t i = 0;
+        for (; i + lanes <= size; i += lanes) {
+            auto candidate = load<DoubleLanes>(data + i);
+            unordered |= candidate != candidate;
+            best = (FindMaximum ? candidate > best : candidate < best) ? candidate : best;
+        }
+
+        auto result = FindMaximum ? std::max(best[0], best[1]) : std::min(best[0], best[1]);
+        auto has_nan = (unordered[0] | unordered[1]) != 0;
+        for (; i < size; i++) {
+            has_nan |= std::isnan(data[i]);
+            result = FindMaximum ? std::max(result, data[i]) : std::min(result, data[i]);
+        }
+
+        return has_nan ? std::numeric_limits<double>::quiet_NaN() : result;
+    }
+
+
+    // SSE2 has no 64-bit integer comparison; emulating it in vector lanes is
+    // slower than conditional moves one element at a time.
+    template <bool FindMaximum>
+    static std::int64_t extreme(const std::vector<std::int64_t>& integers) {
+        auto result = integers.front();
+        for (auto integer : integers) {
+            result = FindMaximum ? std::max(result, integer) : std::min(result, integer);
+        }
+        return result;
+    }
+
+
+    double minimum(const std::vector<double>& numbers) {
+        return extreme<false>(numbers);
+    }
+
+
+    double maximum(const std::vector<double>& numbers) {
+        return extreme<true>(numbers);
+    }
+
+
+    std::int64_t minimum(const std::vector<std::int64_t>& integers) {
+        return extreme<false>(integers);
+    }
+
+
+    std::int64_t maximum(const std::vector<std::int64_t>& integers) {
+        return extreme<true>(integers);
+    }
+
+
+    constexpr std::uint64_t sign_bit = std::uint64_t(1) << 63;
+
+
+    /**
+     * Least-significant-digit radix sort of unsigned keys, one byte per pass.
+     * Keys are first made relative to the smallest one, so only as many
+     * passes run as the spread of the keys has bytes: three for integers
+     * below 2^24 apart, whatever their sign.
+     */
+    static void radix_sort(std::uint64_t* keys, std::size_t size) {
+        if (size < 256) {
+            std::sort(keys, keys + size);
+            return;
+        }
+
+        auto [lowest, highest] = std::minmax_element(keys, keys + size);
+        auto base = *lowest;
+        auto spread = *highest - base;
+        std::size_t digits = 0;
+        while (digits < 8 && (spread >> (8 * digits)) != 0) {
+            digits++;
+        }
+
+        std::array<std::array<std::size_t, 256>, 8> counts = {};
+        for (std::size_t i = 0; i < size; i++) {
+            auto key = keys[i] -= base;
+            for (std::size_t digit = 0; digit < digits; digit++) {
+                counts[digit][(key >> (8 * digit)) & 0xff]++;
+            }
+        }
+
+        std::vector<std::uint64_t> buffer(size);
+        auto* source = keys;
+        auto* target = buffer.data();
+
+        for (std::size_t digit = 0; digit < digits; digit++) {
+            auto shift = 8 * digit;
+            auto& count = counts[digit];
+
+            std::size_t offset = 0;
+            for (auto& bucket : count) {
+                auto bucket_size = bucket;
+                bucket = offset;
+                offset += bucket_size;
+            }
+
+            for (std::size_t i = 0; i < size; i++) {
+                auto key = source[i];
+                target[count[(key >> shift) & 0xff]++] = key;
+            }
+            std::swap(source, target);
+        }
+
+        for (std::size_t i = 0; i < size; i++) {
+            keys[i] = source[i] + base;
+        }
+    }
+
+
+    // Map doubles to keys whose unsigned order is the numeric order: negative
+    // numbers have all bits flipped, the rest only the sign. Every NaN becomes
+    // the same positive NaN, which lands after infinity.
+    static inline std::uint64_t sort_key(double number) {
+        if (std::isnan(number)) {
+            number = std::numeric_limits<double>::quiet_NaN();
+        }
+
+        std::uint64_t bits;
+        std::memcpy(&bits, &number, sizeof(bits));
+        return (bits & sign_bit) ? ~bits : bits | sign_bit;
+    }
+
+
+    static inline double from_sort_key(std::uint64_t key) {
+        auto bits = (key & sign_bit) ? key & ~sign_bit : ~key;
+        double number;
+        std::memcpy(&number, &bits, sizeof(number));
+        return number;
+    }
+
+
+    void sort(std::vector<double>& numbers) {
+        std::vector<std::uint64_t> keys(numbers.size());
+        std::transform(numbers.begin(), numbers.end(), keys.begin(), sort_key);
+        radix_sort(keys.data(), keys.size());
+        std::transform(keys.begin(), keys.end(), numbers.begin(), from_sort_key);
+    }
+
+
+    void sort(std::vector<std::int64_t>& integers) {
+        // Signed and unsigned integers may alias, so the keys are made in
+        // place: flipping the sign bit turns signed order into unsigned order.
+        auto* keys = reinterpret_cast<std::uint64_t*>(integers.data());
+        auto size = integers.size();
+        for (std::size_t i = 0; i < size; i++) {
+            keys[i] ^= sign_bit;
+        }
+
+        radix_sort(keys, size);
+
+        for (std::size_t i = 0; i < size; i++) {
+            keys[i] ^= sign_bit;
+        }
+    }
+
+
+    void apply(Operation operation, const std::vector<double>& input, double operand, std::vector<double>& output) {
+        auto size = input.size();
+        output.resize(size);
+        const auto* source = input.data();
+        auto* target = output.data();
+
+        if (operation == Operation::Modulo) {
+            for (std::size_t i = 0; i < size; i++) {
+                target[i] = std::fmod(source[i], operand);
+            }
+            return;
+        }
+
+        DoubleLanes operands = { operand, operand };
+        std::size_t i = 0;
+        for (; i + lanes <= size; i += lanes) {
+            auto elements = load<DoubleLanes>(source + i);
+            switch (operation) {
+                case Operation::Add: elements += operands; break;
+                case Operation::Subtract: elements -= operands; break;
+                case Operation::Multiply: elements *= operands; break;
+                default: elements /= operands; break;
+            }
+            store(target + i, elements);
+        }
+
+        for (; i < size; i++) {
+            switch (operation) {
+                case Operation::Add: target[i] = source[i] + operand; break;
+                case Operation::Subtract: target[i] = source[i] - operand; break;
+                case Operation::Multiply: target[i] = source[i] * operand; break;
+                default: target[i] = source[i] / operand; break;
+            }
+        }
+    }
+
+
+    bool apply(
+        Operation operation,
+        const std::vector<std::int64_t>& input,
+        std::int64_t operand,
+        std::vector<std::int64_t>& output
+    ) {
+        auto size = input.size();
+        output.resize(size);
+        const auto* source = input.data();
+        auto* target = output.data();
+
+        switch (operation) {
+            case Operation::Add:
+            case Operation::Subtract: {
+                // Lanes wrap; a result whose sign disagrees with what the
+                // operands imply has overflowed.
+                auto subtract = operation == Operation::Subtract;
+                WordLanes operands = { std::uint64_t(operand), std::uint64_t(operand) };
+                WordLanes overflow = { 0, 0 };
+                std::size_t i = 0;
+                for (; i + lanes <= size; i += lanes) {
+                    auto elements = load<WordLanes>(source + i);
+                    auto results = subtract ? elements - operands : elements + operands;
+                    overflow |= subtract
+                        ? (elements ^ operands) & (elements ^ results)
+                        : (elements ^ results) & (operands ^ results);
+                    store(target + i, results);
+                }
+
+                auto overflowed = ((overflow[0] | overflow[1]) & sign_bit) != 0;
+                for (; i < size; i++) {
+                    overflowed |= subtract
+                        ? __builtin_sub_overflow(source[i], operand, &target[i])
+                        : __builtin_add_overflow(source[i], operand, &target[i]);
+                }
+                return !overflowed;
+            }
+
+            case Operation::Multiply: {
+                auto overflowed = false;
+                for (std::size_t i = 0; i < size; i++) {
+                    overflowed |= __builtin_mul_overflow(source[i], operand, &target[i]);
+                }
+                return !overflowed;
+            }
+
+            case Operation::Modulo: {
+                // x % -1 is 0, but INT64_MIN % -1 traps on x86.
+                if (operand == -1) {
+                    std::fill(output.begin(), output.end(), 0);
+                    return true;
+                }
+
+                for (std::size_t i = 0; i < size; i++) {
+                    target[i] = source[i] % operand;
+                }
+                return true;
+            }
+
+            default: {
+                return false;
+            }
+        }
+    }
+}
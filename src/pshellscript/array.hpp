@@ -0,0 +1,110 @@
+#ifndef ARRAY_HPP
+#define ARRAY_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "vm.hpp"
+#include "heap.hpp"
+
+namespace pshellscript::vm {
+    /**
+     * A growable, contiguous sequence of values. Elements are stored unboxed
+     * while they are all integers, or all numbers, so bulk operations can run
+     * over plain machine words; storing any other kind of value boxes the
+     * whole array once. An integer stored among numbers reads back as the
+     * number of the same value.
+     */
+    class Array : public HeapObject {
+    public:
+        enum class Storage { Integers, Numbers, Values };
+
+    private:
+        Storage storage = Storage::Integers;
+        std::vector<std::int64_t> integers;
+        std::vector<double> numbers;
+        std::vector<Value> values;
+
+        // Change the storage, if needed, so that it can hold `value`.
+        void widen(const Value& value);
+        void box();
+
+    public:
+        Array() = default;
+
+        inline explicit Array(std::vector<std::int64_t>&& integers)
+            : storage(Storage::Integers), integers(std::move(integers)) {}
+
+        inline explicit Array(std::vector<double>&& numbers)
+            : storage(Storage::Numbers), numbers(std::move(numbers)) {}
+
+        // For values that are neither integers nor numbers.
+        inline explicit Array(std::vector<Value>&& values)
+            : storage(Storage::Values), values(std::move(values)) {}
+
+        inline Storage get_storage() const {
+            return this->storage;
+        }
+
+        std::size_t size() const;
+        void reserve(std::size_t capacity);
+
+        Value get(std::size_t index) const;
+        void set(std::size_t index, const Value& value);
+        void push(const Value& value);
+
+        // The unboxed elements, only meaningful for the matching storage.
+        inline std::vector<std::int64_t>& get_integers() { return this->integers; }
+        inline const std::vector<std::int64_t>& get_integers() const { return this->integers; }
+        inline std::vector<double>& get_numbers() { return this->numbers; }
+        inline const std::vector<double>& get_numbers() const { return this->numbers; }
+        inline std::vector<Value>& get_values() { return this->values; }
+        inline const std::vector<Value>& get_values() const { return this->values; }
+
+        void trace(std::vector<HeapObject*>& references) const override;
+        void clear() override;
+    };
+
+
+    /**
+     * Bulk operations over unboxed elements, written with vector types where
+     * that lets them run several elements per instruction. Integer kernels
+     * report overflow instead of wrapping, leaving the caller to fall back
+     * to the element-by-element rules.
+     */
+    namespace kernels {
+        enum class Operation { Add, Subtract, Multiply, Divide, Modulo };
+
+        // Lanes are summed separately, so the result can differ in the last
+        // bits from adding the numbers left to right.
+        double sum(const std::vector<double>& numbers);
+
+        // The exact total of the integers. If it does not fit in 64 bits,
+        // returns false and stores the total rounded to a double instead.
+        bool sum(const std::vector<std::int64_t>& integers, std::int64_t& total, double& rounded);
+
+        // NaN if any element is NaN. The vectors must not be empty.
+        double minimum(const std::vector<double>& numbers);
+        double maximum(const std::vector<double>& numbers);
+        std::int64_t minimum(const std::vector<std::int64_t>& integers);
+        std::int64_t maximum(const std::vector<std::int64_t>& integers);
+
+        // Ascending order; NaN sorts after everything else.
+        void sort(std::vector<double>& numbers);
+        void sort(std::vector<std::int64_t>& integers);
+
+        // `output[i] = input[i] <operation> operand`. The operand of a
+        // division or modulo must not be zero.
+        void apply(Operation operation, const std::vector<double>& input, double operand, std::vector<double>& output);
+
+        // Only Add, Subtract, Multiply and Modulo; false if any element overflows.
+        bool apply(
+            Operation operation,
+            const std::vector<std::int64_t>& input,
+            std::int64_t operand,
+            std::vector<std::int64_t>& output
+        );
+    }
+}
+
+#endif
@@ -0,0 +1,28 @@
+#include "closure.hpp"
+
+namespace pshellscript::vm {
+    void Box::trace(std::vector<HeapObject*>& references) const {
+        if (auto object = heap::object_of(this->value)) {
+            references.push_back(object);
+        }
+    }
+
+
+    void Box::clear() {
+        this->value = undefined;
+    }
+
+
+    void Closure::trace(std::vector<HeapObject*>& references) const {
+        for (const auto& capture : this->captures) {
+            if (auto object = heap::object_of(capture)) {
+                references.push_back(object);
+            }
+        }
+    }
+
+
+    void Closure::clear() {
+        this->captures = {};
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef CLOSURE_HPP
+#define CLOSURE_HPP
+
+#include <memory>
+#include <vector>
+#include "vm.hpp"
+#include "heap.hpp"
+
+namespace pshellscript::vm {
+    /**
+     * A variable shared between a function and the closures that capture
+     * it, used only for variables that are assigned after being captured.
+     */
+    class Box : public HeapObject {
+    public:
+        Value value;
+
+        inline explicit Box(Value value) : value(std::move(value)) {}
+
+        void trace(std::vector<HeapObject*>& references) const override;
+        void clear() override;
+    };
+
+
+    /**
+     * A function value. Captures are flat: each closure holds exactly the
+     * enclosing variables its body uses, copied when it was created, or the
+     * box of ones that can change, so reading one is a single index.
+     * Functions referred to by name have no captures.
+     */
+    class Closure : public HeapObject {
+    public:
+        std::shared_ptr<const ast::FunctionDefinitionNode> definition;
+        std::vector<Value> captures;
+
+        inline explicit Closure(std::shared_ptr<const ast::FunctionDefinitionNode> definition)
+            : definition(std::move(definition)) {}
+
+        void trace(std::vector<HeapObject*>& references) const override;
+        void clear() override;
+    };
+}
+
+#endif
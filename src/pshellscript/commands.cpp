@@ -0,0 +1,710 @@
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "commands.hpp"
+#include "environment.hpp"
+#include "jobs.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "process.hpp"
+#include "vm.hpp"
+
+namespace pshellscript::commands {
+    static constexpr std::size_t chunk_size = 1 << 30;
+
+
+    // Whether a copy call failed because it cannot handle these descriptors,
+    // rather than because reading or writing failed.
+    static inline bool unsupported(int error) {
+        return error == EINVAL || error == EXDEV || error == ENOSYS || error == EOPNOTSUPP || error == EBADF;
+    }
+
+
+    static bool copy_by_reading(int input, int output) {
+        static char buffer[128 * 1024];
+        while (true) {
+            auto read = ::read(input, buffer, sizeof(buffer));
+            if (read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (read <= 0) {
+                return read == 0;
+            }
+
+            for (ssize_t written = 0; written < read; ) {
+                auto count = ::write(output, buffer + written, std::size_t(read - written));
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count < 0) {
+                    return false;
+                }
+                written += count;
+            }
+        }
+    }
+
+
+    /**
+     * Copy the rest of `input` to `output` without the data passing through
+     * the shell where the kernel allows it: copy_file_range between files,
+     * which can share blocks on filesystems that support it, then sendfile
+     * from a file to anything else, such as a pipe. Each is given up for the
+     * next on the first call it does not support. Sets errno on failure.
+     */
+    static bool copy(int input, int output) {
+        bool started = false;
+        while (true) {
+            auto copied = ::copy_file_range(input, nullptr, output, nullptr, chunk_size, 0);
+            if (copied > 0) {
+                started = true;
+                continue;
+            }
+            if (copied == 0) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (started || !unsupported(errno)) {
+                return false;
+            }
+            break;
+        }
+
+        while (true) {
+            auto copied = ::sendfile(output, input, nullptr, chunk_size);
+            if (copied > 0) {
+                started = true;
+                continue;
+            }
+            if (copied == 0) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (started || !unsupported(errno)) {
+                return false;
+            }
+            break;
+        }
+
+        return copy_by_reading(input, output);
+    }
+
+
+    // Read the rest of `input` into the output module, for a command
+    // substitution collecting it.
+    static bool copy_to_output(int input) {
+        static char buffer[128 * 1024];
+        while (true) {
+            auto read = ::read(input, buffer, sizeof(buffer));
+            if (read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (read <= 0) {
+                return read == 0;
+            }
+            output::write(std::string_view(buffer, std::size_t(read)));
+        }
+    }
+
+
+    // cat [file...]: standard input, or each file in turn, to standard output.
+    static Result<int> cat(const std::vector<std::string>& arguments) {
+        // The data goes around the output buffer, unless it is being captured.
+        auto capturing = output::capturing();
+        if (!capturing) {
+            output::flush();
+        }
+
+        int status = 0;
+        auto copy_file = [&](const std::string& name) {
+            auto input = name == "-" ? STDIN_FILENO : ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (input < 0) {
+                std::cerr << "cat: " << name << ": " << std::strerror(errno) << std::endl;
+                status = 1;
+                return;
+            }
+
+            if (!(capturing ? copy_to_output(input) : copy(input, STDOUT_FILENO))) {
+                std::cerr << "cat: " << name << ": " << std::strerror(errno) << std::endl;
+                status = 1;
+            }
+            if (input != STDIN_FILENO) {
+                ::close(input);
+            }
+        };
+
+        if (arguments.size() == 1) {
+            copy_file("-");
+        }
+        for (std::size_t i = 1; i < arguments.size(); i++) {
+            copy_file(arguments[i]);
+        }
+        return status;
+    }
+
+
+    static Result<int> true_command(const std::vector<std::string>&) {
+        return 0;
+    }
+
+
+    static Result<int> false_command(const std::vector<std::string>&) {
+        return 1;
+    }
+
+
+    // rehash: forget where commands were found on PATH.
+    static Result<int> rehash(const std::vector<std::string>&) {
+        process::forget_paths();
+        return 0;
+    }
+
+
+    // pwd: the current directory.
+    static Result<int> pwd(const std::vector<std::string>&) {
+        char directory[PATH_MAX];
+        if (::getcwd(directory, sizeof(directory)) == nullptr) {
+            std::cerr << "pwd: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        output::write_line(directory);
+        return 0;
+    }
+
+
+    /**
+     * cd [directory]: change to `directory`, HOME without one, or OLDPWD
+     * for `-`, and update PWD and OLDPWD. Relative entries on PATH now name
+     * other directories, so found commands are forgotten.
+     */
+    static Result<int> cd(const std::vector<std::string>& arguments) {
+        if (arguments.size() > 2) {
+            std::cerr << "cd: too many arguments" << std::endl;
+            return 1;
+        }
+
+        const char* directory = arguments.size() == 2 ? arguments[1].c_str() : environment::get("HOME");
+        auto previous = arguments.size() == 2 && arguments[1] == "-";
+        if (previous) {
+            directory = environment::get("OLDPWD");
+        }
+        if (directory == nullptr) {
+            std::cerr << "cd: " << (previous ? "OLDPWD" : "HOME") << " not set" << std::endl;
+            return 1;
+        }
+
+        char current[PATH_MAX];
+        auto had_current = ::getcwd(current, sizeof(current)) != nullptr;
+        if (::chdir(directory) < 0) {
+            std::cerr << "cd: " << directory << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+
+        if (had_current) {
+            environment::set("OLDPWD", current);
+        }
+        if (::getcwd(current, sizeof(current)) != nullptr) {
+            environment::set("PWD", current);
+            if (previous) {
+                output::write_line(current);
+            }
+        }
+        process::forget_paths();
+        return 0;
+    }
+
+
+    // The last component of a path, as basename(1) and dirname(1) see it:
+    // trailing slashes do not count, and "/" is its own last component.
+    static std::string_view last_component(std::string_view path, std::string_view& parent) {
+        while (path.size() > 1 && path.back() == '/') {
+            path.remove_suffix(1);
+        }
+
+        auto slash = path.rfind('/');
+        if (path == "/" || slash == std::string_view::npos) {
+            parent = path == "/" ? "/" : ".";
+            return path;
+        }
+
+        parent = path.substr(0, slash);
+        while (parent.size() > 1 && parent.back() == '/') {
+            parent.remove_suffix(1);
+        }
+        if (parent.empty()) {
+            parent = "/";
+        }
+        return path.substr(slash + 1);
+    }
+
+
+    // basename path [suffix]
+    static Result<int> base_name(const std::vector<std::string>& arguments) {
+        if (arguments.size() < 2 || arguments.size() > 3) {
+            std::cerr << "basename: expects a path and an optional suffix" << std::endl;
+            return 1;
+        }
+
+        std::string_view parent;
+        auto name = last_component(arguments[1], parent);
+        if (arguments.size() == 3) {
+            std::string_view suffix = arguments[2];
+            if (name.size() > suffix.size() && name.substr(name.size() - suffix.size()) == suffix) {
+                name.remove_suffix(suffix.size());
+            }
+        }
+
+        output::write_line(name);
+        return 0;
+    }
+
+
+    // dirname path
+    static Result<int> directory_name(const std::vector<std::string>& arguments) {
+        if (arguments.size() != 2) {
+            std::cerr << "dirname: expects a path" << std::endl;
+            return 1;
+        }
+
+        std::string_view parent;
+        last_component(arguments[1], parent);
+        output::write_line(parent);
+        return 0;
+    }
+
+
+    /**
+     * The expression of test(1), parsed by recursive descent: `-o` binds
+     * looser than `-a`, which binds looser than `!`. Where an argument could
+     * be an operator or an operand, a binary operator in second place wins,
+     * then `!`, `(` and unary operators, as POSIX has it for up to three
+     * arguments. A malformed expression has the status 2.
+     */
+    class TestExpression {
+        const std::vector<std::string>& arguments;
+        std::size_t position;
+        std::size_t end;
+
+    public:
+        std::string error;
+
+        inline TestExpression(const std::vector<std::string>& arguments, std::size_t end)
+            : arguments(arguments), position(1), end(end) {}
+
+
+        bool evaluate() {
+            if (this->position == this->end) {
+                return false;
+            }
+
+            auto result = this->disjunction();
+            if (this->error.empty() && this->position != this->end) {
+                this->error = this->arguments[this->position] + ": unexpected argument";
+            }
+            return result;
+        }
+
+    private:
+        inline bool at(const char* argument, std::size_t ahead = 0) const {
+            return this->position + ahead < this->end && this->arguments[this->position + ahead] == argument;
+        }
+
+
+        bool disjunction() {
+            auto result = this->conjunction();
+            while (this->error.empty() && this->at("-o")) {
+                this->position++;
+                result = this->conjunction() || result;
+            }
+            return result;
+        }
+
+
+        bool conjunction() {
+            auto result = this->negation();
+            while (this->error.empty() && this->at("-a")) {
+                this->position++;
+                result = this->negation() && result;
+            }
+            return result;
+        }
+
+
+        bool negation() {
+            if (this->at("!") && this->position + 1 < this->end && !is_binary(1)) {
+                this->position++;
+                return !this->negation();
+            }
+            return this->primary();
+        }
+
+
+        inline bool is_binary(std::size_t ahead) const {
+            if (this->position + ahead + 1 >= this->end) {
+                return false;
+            }
+
+            static const char* operators[] = {
+                "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef"
+            };
+            for (auto name : operators) {
+                if (this->at(name, ahead)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+
+        bool primary() {
+            if (this->position == this->end) {
+                this->error = "argument expected";
+                return false;
+            }
+
+            if (this->is_binary(1)) {
+                const auto& left = this->arguments[this->position];
+                const auto& name = this->arguments[this->position + 1];
+                const auto& right = this->arguments[this->position + 2];
+                this->position += 3;
+                return this->binary(name, left, right);
+            }
+
+            if (this->at("(") && this->position + 1 < this->end) {
+                this->position++;
+                auto result = this->disjunction();
+                if (this->error.empty() && !this->at(")")) {
+                    this->error = "')' expected";
+                }
+                this->position++;
+                return result;
+            }
+
+            const auto& argument = this->arguments[this->position];
+            if (argument.size() == 2 && argument[0] == '-' && this->position + 1 < this->end) {
+                const auto& operand = this->arguments[this->position + 1];
+                bool result = false;
+                if (this->unary(argument[1], operand, result)) {
+                    this->position += 2;
+                    return result;
+                }
+            }
+
+            this->position++;
+            return !argument.empty();
+        }
+
+
+        bool integer(const std::string& text, long long& value) {
+            char* end = nullptr;
+            errno = 0;
+            value = std::strtoll(text.c_str(), &end, 10);
+            if (text.empty() || *end != '\0' || errno != 0) {
+                this->error = text + ": integer expression expected";
+                return false;
+            }
+            return true;
+        }
+
+
+        bool binary(const std::string& name, const std::string& left, const std::string& right) {
+            if (name == "=" || name == "==") {
+                return left == right;
+            }
+            if (name == "!=") {
+                return left != right;
+            }
+            if (name == "<") {
+                return left < right;
+            }
+            if (name == ">") {
+                return left > right;
+            }
+
+            if (name == "-nt" || name == "-ot" || name == "-ef") {
+                struct stat a, b;
+                auto has_a = ::stat(left.c_str(), &a) == 0;
+                auto has_b = ::stat(right.c_str(), &b) == 0;
+                if (name == "-ef") {
+                    return has_a && has_b && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+                }
+
+                auto newer = has_a && (!has_b || a.st_mtim.tv_sec > b.st_mtim.tv_sec
+                    || (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec > b.st_mtim.tv_nsec));
+                auto older = has_b && (!has_a || b.st_mtim.tv_sec > a.st_mtim.tv_sec
+                    || (a.st_mtim.tv_sec == b.st_mtim.tv_sec && b.st_mtim.tv_nsec > a.st_mtim.tv_nsec));
+                return name == "-nt" ? newer : older;
+            }
+
+            long long a, b;
+            if (!this->integer(left, a) || !this->integer(right, b)) {
+                return false;
+            }
+            if (name == "-eq") return a == b;
+            if (name == "-ne") return a != b;
+            if (name == "-lt") return a < b;
+            if (name == "-le") return a <= b;
+            if (name == "-gt") return a > b;
+            return a >= b;
+        }
+
+
+        // Evaluate `-letter operand` into `result`, or return false if the
+        // letter is not a unary operator.
+        static bool unary(char letter, const std::string& operand, bool& result) {
+            struct stat status;
+            auto exists = [&]() { return ::stat(operand.c_str(), &status) == 0; };
+
+            switch (letter) {
+                case 'n': result = !operand.empty(); return true;
+                case 'z': result = operand.empty(); return true;
+                case 'e': result = exists(); return true;
+                case 'f': result = exists() && S_ISREG(status.st_mode); return true;
+                case 'd': result = exists() && S_ISDIR(status.st_mode); return true;
+                case 'p': result = exists() && S_ISFIFO(status.st_mode); return true;
+                case 'S': result = exists() && S_ISSOCK(status.st_mode); return true;
+                case 'b': result = exists() && S_ISBLK(status.st_mode); return true;
+                case 'c': result = exists() && S_ISCHR(status.st_mode); return true;
+                case 's': result = exists() && status.st_size > 0; return true;
+                case 'r': result = ::access(operand.c_str(), R_OK) == 0; return true;
+                case 'w': result = ::access(operand.c_str(), W_OK) == 0; return true;
+                case 'x': result = ::access(operand.c_str(), X_OK) == 0; return true;
+                case 't': result = !operand.empty() && ::isatty(std::atoi(operand.c_str())); return true;
+                case 'L':
+                case 'h': result = ::lstat(operand.c_str(), &status) == 0 && S_ISLNK(status.st_mode); return true;
+                default: return false;
+            }
+        }
+    };
+
+
+    // test expression, or [ expression ]: 0 if it holds, 1 if not.
+    static Result<int> test(const std::vector<std::string>& arguments) {
+        auto end = arguments.size();
+        if (arguments.front() == "[") {
+            if (arguments.back() != "]") {
+                std::cerr << "[: missing ']'" << std::endl;
+                return 2;
+            }
+            end--;
+        }
+
+        TestExpression expression(arguments, end);
+        auto result = expression.evaluate();
+        if (!expression.error.empty()) {
+            std::cerr << arguments.front() << ": " << expression.error << std::endl;
+            return 2;
+        }
+        return result ? 0 : 1;
+    }
+
+
+    // A backslash escape of printf's format or `%b`, at `text[position]`
+    // just after the backslash. Returns false for an unknown one.
+    static bool escape(std::string_view text, std::size_t& position, std::string& result) {
+        auto character = text[position++];
+        switch (character) {
+            case 'n': result += '\n'; return true;
+            case 't': result += '\t'; return true;
+            case 'r': result += '\r'; return true;
+            case 'a': result += '\a'; return true;
+            case 'b': result += '\b'; return true;
+            case 'f': result += '\f'; return true;
+            case 'v': result += '\v'; return true;
+            case '\\': result += '\\'; return true;
+            case '"': result += '"'; return true;
+            case '\'': result += '\''; return true;
+            default: break;
+        }
+
+        if (character >= '0' && character <= '7') {
+            int value = character - '0';
+            for (int digits = 1; digits < 3 && position < text.size() && text[position] >= '0' && text[position] <= '7'; digits++) {
+                value = value * 8 + (text[position++] - '0');
+            }
+            result += char(value);
+            return true;
+        }
+
+        position--;
+        return false;
+    }
+
+
+    // Append one value formatted by snprintf.
+    template <typename T>
+    static void append_formatted(std::string& text, const std::string& specification, T value) {
+        auto size = std::size_t(std::snprintf(nullptr, 0, specification.c_str(), value));
+        auto start = text.size();
+        text.resize(start + size + 1);
+        std::snprintf(text.data() + start, size + 1, specification.c_str(), value);
+        text.resize(start + size);
+    }
+
+
+    /**
+     * printf format [argument...]: the format's conversions (%s, %b, %c, %d,
+     * %i, %u, %o, %x, %X, %e, %f, %g and their capitals, with flags, width
+     * and precision) filled with the arguments in turn. The format is reused
+     * while arguments remain; missing ones are empty or 0.
+     */
+    static Result<int> print_formatted(const std::vector<std::string>& arguments) {
+        if (arguments.size() < 2) {
+            std::cerr << "printf: expects a format" << std::endl;
+            return 1;
+        }
+
+        std::string_view format = arguments[1];
+        std::size_t next_argument = 2;
+        int status = 0;
+        std::string text;
+        auto argument = [&]() -> const std::string* {
+            return next_argument < arguments.size() ? &arguments[next_argument++] : nullptr;
+        };
+
+        do {
+            auto first_argument = next_argument;
+            for (std::size_t i = 0; i < format.size(); ) {
+                auto character = format[i++];
+                if (character == '\\' && i < format.size()) {
+                    if (!escape(format, i, text)) {
+                        text += '\\';
+                    }
+                    continue;
+                }
+                if (character != '%') {
+                    text += character;
+                    continue;
+                }
+                if (i < format.size() && format[i] == '%') {
+                    text += '%';
+                    i++;
+                    continue;
+                }
+
+                // The flags, width and precision are passed on to snprintf.
+                auto start = i - 1;
+                while (i < format.size() && std::strchr("-+ #0", format[i]) != nullptr) {
+                    i++;
+                }
+                while (i < format.size() && ((format[i] >= '0' && format[i] <= '9') || format[i] == '.')) {
+                    i++;
+                }
+                if (i == format.size()) {
+                    std::cerr << "printf: missing conversion in " << format.substr(start) << std::endl;
+                    return 1;
+                }
+
+                auto conversion = format[i++];
+                std::string specification(format.substr(start, i - start - 1));
+                const auto* value = argument();
+                std::string empty;
+                const auto& operand = value ? *value : empty;
+
+                switch (conversion) {
+                    case 's': {
+                        if (specification.size() == 1) {
+                            text += operand;
+                        } else {
+                            append_formatted(text, specification + 's', operand.c_str());
+                        }
+                        break;
+                    }
+
+                    case 'b': {
+                        for (std::size_t j = 0; j < operand.size(); ) {
+                            if (operand[j++] != '\\' || j == operand.size() || !escape(operand, j, text)) {
+                                text += operand[j - 1];
+                            }
+                        }
+                        break;
+                    }
+
+                    case 'c': {
+                        if (!operand.empty()) {
+                            text += operand.front();
+                        }
+                        break;
+                    }
+
+                    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+                        char* end = nullptr;
+                        errno = 0;
+                        auto number = operand.empty() ? 0 : std::strtoll(operand.c_str(), &end, 0);
+                        if (!operand.empty() && (*end != '\0' || errno != 0)) {
+                            std::cerr << "printf: " << operand << ": invalid number" << std::endl;
+                            status = 1;
+                        }
+                        append_formatted(text, specification + "ll" + conversion, number);
+                        break;
+                    }
+
+                    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+                        char* end = nullptr;
+                        errno = 0;
+                        auto number = operand.empty() ? 0.0 : std::strtod(operand.c_str(), &end);
+                        if (!operand.empty() && (*end != '\0' || errno != 0)) {
+                            std::cerr << "printf: " << operand << ": invalid number" << std::endl;
+                            status = 1;
+                        }
+                        append_formatted(text, specification + conversion, number);
+                        break;
+                    }
+
+                    default: {
+                        std::cerr << "printf: %" << conversion << ": invalid conversion" << std::endl;
+                        return 1;
+                    }
+                }
+            }
+
+            // A format without conversions is printed once.
+            if (next_argument == first_argument) {
+                break;
+            }
+        } while (next_argument < arguments.size());
+
+        output::write(text);
+        return status;
+    }
+
+
+    static const std::unordered_map<std::string, Builtin> builtins = {
+        { "cat", cat },
+        { "cd", cd },
+        { "pwd", pwd },
+        { "true", true_command },
+        { "false", false_command },
+        { "test", test },
+        { "[", test },
+        { "printf", print_formatted },
+        { "basename", base_name },
+        { "dirname", directory_name },
+        { "rehash", rehash },
+        { "jobs", jobs::list },
+        { "wait", jobs::wait },
+        { "fg", jobs::foreground },
+        { "bg", jobs::background },
+        { "kill", jobs::kill },
+        { "parallel", parallel::run },
+        { "export", vm::export_variables },
+    };
+
+
+    Builtin find(const std::string& name) {
+        auto found = builtins.find(name);
+        return found == builtins.end() ? nullptr : found->second;
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef COMMANDS_HPP
+#define COMMANDS_HPP
+
+#include <string>
+#include <vector>
+#include "../result.hpp"
+
+namespace pshellscript::commands {
+    /**
+     * A command the shell runs itself instead of starting a program. It is
+     * found after script functions and before the executables on PATH. It
+     * works on the shell's file descriptors 0 to 2, which are redirected
+     * while it runs as a program's would be, and returns its exit status.
+     * `arguments[0]` is its name.
+     */
+    using Builtin = Result<int> (*)(const std::vector<std::string>& arguments);
+
+    // The builtin command called `name`, or null if there is none.
+    Builtin find(const std::string& name);
+}
+
+#endif
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string_view>
+#include "dictionary.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace pshellscript::vm {
+    // Tags of slots without an entry. Both have the sign bit set, which a
+    // tag taken from a hash never does.
+    constexpr std::int8_t empty_tag = -128;
+    constexpr std::int8_t removed_tag = -2;
+
+    constexpr std::size_t group_size = 16;
+
+
+    /**
+     * Bit i of each mask is set if tag i of the sixteen starting at `group`
+     * qualifies. With SSE2 a whole group is compared in one instruction.
+     */
+    static inline std::uint32_t match_tag(const std::int8_t* group, std::int8_t tag) {
+#if defined(__SSE2__)
+        auto tags = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return std::uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag))));
+#else
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < group_size; i++) {
+            mask |= std::uint32_t(group[i] == tag) << i;
+        }
+        return mask;
+#endif
+    }
+
+
+    // Slots that are empty or removed.
+    static inline std::uint32_t match_free(const std::int8_t* group) {
+#if defined(__SSE2__)
+        return std::uint32_t(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < group_size; i++) {
+            mask |= std::uint32_t(group[i] < 0) << i;
+        }
+        return mask;
+#endif
+    }
+
+
+    // Spread the bits of a hash so that both the tag, taken from the low
+    // bits, and the group, taken from the ones above, depend on all of them.
+    static inline std::uint64_t mix(std::uint64_t hash) {
+        auto product = static_cast<unsigned __int128>(hash) * 0x9e3779b97f4a7c15ULL;
+        return std::uint64_t(product) ^ std::uint64_t(product >> 64);
+    }
+
+
+    // A double that equals an integer is the same key as that integer.
+    static inline bool is_integral(double number) {
+        constexpr double limit = 9223372036854775808.0;
+        return std::trunc(number) == number && number >= -limit && number < limit;
+    }
+
+
+    static inline std::uint64_t hash_key(const Value& key) {
+        if (const auto* integer = std::get_if<std::int64_t>(&key)) {
+            return mix(std::uint64_t(*integer));
+        }
+
+        if (const auto* string = std::get_if<std::string>(&key)) {
+            return mix(std::hash<std::string_view>()(*string));
+        }
+
+        if (std::holds_alternative<double>(key)) {
+            auto number = std::get<double>(key);
+            if (is_integral(number)) {
+                return mix(std::uint64_t(std::int64_t(number)));
+            }
+            return mix(std::hash<double>()(number) ^ 0x9e3779b97f4a7c15ULL);
+        }
+
+        return mix(std::get<bool>(key) ? 0x5bd1e995ULL : 0x1b873593ULL);
+    }
+
+
+    static inline bool keys_equal(const Value& stored, const Value& key) {
+        if (stored.index() == key.index()) {
+            if (const auto* integer = std::get_if<std::int64_t>(&key)) {
+                return *std::get_if<std::int64_t>(&stored) == *integer;
+            }
+            if (const auto* string = std::get_if<std::string>(&key)) {
+                return *std::get_if<std::string>(&stored) == *string;
+            }
+            return stored == key;
+        }
+
+        // Stored keys that are whole numbers are always integers.
+        if (std::holds_alternative<std::int64_t>(stored) && std::holds_alternative<double>(key)) {
+            auto number = std::get<double>(key);
+            return is_integral(number) && std::int64_t(number) == std::get<std::int64_t>(stored);
+        }
+        return false;
+    }
+
+
+    bool Dictionary::is_key(const Value& value) {
+        if (std::holds_alternative<double>(value)) {
+            return !std::isnan(std::get<double>(value));
+        }
+
+        return std::holds_alternative<std::string>(value)
+            || std::holds_alternative<std::int64_t>(value)
+            || std::holds_alternative<bool>(value);
+    }
+
+
+    /**
+     * Groups are probed in triangular order, which visits every group once
+     * when their number is a power of two. A group with an empty slot ends
+     * the search, since an insertion would have stopped there.
+     */
+    std::size_t Dictionary::find_slot(const Value& key, std::uint64_t hash) const {
+        if (this->groups.empty()) {
+            return 0;
+        }
+
+        auto tag = std::int8_t(hash & 0x7f);
+        auto group_mask = this->groups.size() - 1;
+        auto group = std::size_t(hash >> 7) & group_mask;
+
+        for (std::size_t probe = 1; probe <= group_mask + 1; probe++) {
+            const auto& slots = this->groups[group];
+            for (auto matches = match_tag(slots.tags, tag); matches != 0; matches &= matches - 1) {
+                auto index = std::size_t(__builtin_ctz(matches));
+                const auto& entry = this->entries[slots.positions[index]];
+                if (entry.hash == hash && keys_equal(entry.key, key)) {
+                    return group * group_size + index;
+                }
+            }
+
+            if (match_tag(slots.tags, empty_tag) != 0) {
+                break;
+            }
+            group = (group + probe) & group_mask;
+        }
+        return this->slot_count();
+    }
+
+
+    // The first empty or removed slot along the probe sequence of `hash`.
+    std::size_t Dictionary::free_slot(std::uint64_t hash) const {
+        auto group_mask = this->groups.size() - 1;
+        auto group = std::size_t(hash >> 7) & group_mask;
+
+        for (std::size_t probe = 1; ; probe++) {
+            auto matches = match_free(this->groups[group].tags);
+            if (matches != 0) {
+                return group * group_size + std::size_t(__builtin_ctz(matches));
+            }
+            group = (group + probe) & group_mask;
+        }
+    }
+
+
+    /**
+     * Drop removed entries and reinsert the rest into a table of `slots`
+     * slots, using the stored hashes.
+     */
+    void Dictionary::rebuild(std::size_t slots) {
+        if (this->live_entries != this->entries.size()) {
+            // Entries before the first removed one stay where they are; a
+            // self-move would leave a string key empty.
+            std::size_t kept = 0;
+            for (auto& entry : this->entries) {
+                if (!entry.removed) {
+                    if (&entry != &this->entries[kept]) {
+                        this->entries[kept] = std::move(entry);
+                    }
+                    kept++;
+                }
+            }
+            this->entries.resize(kept);
+        }
+
+        Group empty_group;
+        std::fill(std::begin(empty_group.tags), std::end(empty_group.tags), empty_tag);
+        std::fill(std::begin(empty_group.positions), std::end(empty_group.positions), 0);
+        this->groups.assign(slots / group_size, empty_group);
+
+        for (std::size_t i = 0; i < this->entries.size(); i++) {
+            auto slot = this->free_slot(this->entries[i].hash);
+            this->fill(slot, this->entries[i].hash, std::uint32_t(i));
+        }
+        this->used_slots = this->entries.size();
+    }
+
+
+    const Value* Dictionary::find(const Value& key) const {
+        auto slot = this->find_slot(key, hash_key(key));
+        if (slot == this->slot_count()) {
+            return nullptr;
+        }
+        return &this->entries[this->position(slot)].value;
+    }
+
+
+    Value& Dictionary::insert(const Value& key) {
+        auto hash = hash_key(key);
+        auto slot = this->find_slot(key, hash);
+        if (slot != this->slot_count()) {
+            return this->entries[this->position(slot)].value;
+        }
+
+        // Keep at least one slot in eight free so probing stays short. When
+        // removed slots make up much of the table, rebuilding at the same
+        // size reclaims them.
+        auto slots = this->slot_count();
+        if ((this->used_slots + 1) * 8 > slots * 7) {
+            auto needed = std::max(slots, group_size);
+            while ((this->live_entries + 1) * 16 > needed * 7) {
+                needed *= 2;
+            }
+            this->rebuild(needed);
+        }
+
+        slot = this->free_slot(hash);
+        if (this->tag(slot) == empty_tag) {
+            this->used_slots++;
+        }
+        this->fill(slot, hash, std::uint32_t(this->entries.size()));
+        this->live_entries++;
+
+        auto stored = key;
+        if (std::holds_alternative<double>(key) && is_integral(std::get<double>(key))) {
+            stored = std::int64_t(std::get<double>(key));
+        }
+        this->entries.push_back({ hash, std::move(stored), undefined, false });
+        return this->entries.back().value;
+    }
+
+
+    bool Dictionary::remove(const Value& key) {
+        auto slot = this->find_slot(key, hash_key(key));
+        if (slot == this->slot_count()) {
+            return false;
+        }
+
+        auto& entry = this->entries[this->position(slot)];
+        entry.key = undefined;
+        entry.value = undefined;
+        entry.removed = true;
+        this->tag(slot) = removed_tag;
+        this->live_entries--;
+
+        // Removing the newest entry needs no tombstone in the order.
+        if (this->position(slot) + 1 == this->entries.size()) {
+            this->entries.pop_back();
+        }
+        return true;
+    }
+
+
+    // Keys are never references.
+    void Dictionary::trace(std::vector<HeapObject*>& references) const {
+        for (const auto& entry : this->entries) {
+            if (auto object = heap::object_of(entry.value)) {
+                references.push_back(object);
+            }
+        }
+    }
+
+
+    void Dictionary::clear() {
+        this->entries = {};
+        this->groups = {};
+        this->live_entries = 0;
+        this->used_slots = 0;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef DICTIONARY_HPP
+#define DICTIONARY_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "vm.hpp"
+#include "heap.hpp"
+
+namespace pshellscript::vm {
+    /**
+     * A hash map from strings, booleans or numbers to values that remembers
+     * insertion order. Entries are kept in a dense vector in the order they
+     * were added; an open-addressing table of one-byte tags and entry
+     * positions, probed sixteen tags at a time, finds them. Each entry keeps
+     * the hash of its key, so growing the table never hashes a key again.
+     *
+     * Keys compare like `==`: 1 and 1.0 are the same key, and whole numbers
+     * are stored as integers.
+     */
+    class Dictionary : public HeapObject {
+    public:
+        struct Entry {
+            std::uint64_t hash;
+            Value key;
+            Value value;
+            bool removed;
+        };
+
+    private:
+        // Insertion order, including removed entries until the next rebuild.
+        std::vector<Entry> entries;
+
+        // Slots come in groups of sixteen, each with a tag that is empty,
+        // removed, or the low seven bits of the hash of the entry at
+        // `positions[i]`. Keeping a group's tags next to its positions means
+        // a probe that matches usually reads no further cache line.
+        struct Group {
+            std::int8_t tags[16];
+            std::uint32_t positions[16];
+        };
+        std::vector<Group> groups;
+
+        inline std::size_t slot_count() const {
+            return this->groups.size() * 16;
+        }
+
+        inline std::int8_t& tag(std::size_t slot) {
+            return this->groups[slot / 16].tags[slot % 16];
+        }
+
+        inline std::uint32_t position(std::size_t slot) const {
+            return this->groups[slot / 16].positions[slot % 16];
+        }
+
+        inline void fill(std::size_t slot, std::uint64_t hash, std::uint32_t position) {
+            this->groups[slot / 16].tags[slot % 16] = std::int8_t(hash & 0x7f);
+            this->groups[slot / 16].positions[slot % 16] = position;
+        }
+
+        std::size_t live_entries = 0;
+        std::size_t used_slots = 0;
+
+        // The slot holding `key`, or the number of slots if there is none.
+        std::size_t find_slot(const Value& key, std::uint64_t hash) const;
+        std::size_t free_slot(std::uint64_t hash) const;
+        void rebuild(std::size_t slots);
+
+    public:
+        // Whether `value` can be a key: a string, a boolean or a number other than NaN.
+        static bool is_key(const Value& value);
+
+        inline std::size_t size() const {
+            return this->live_entries;
+        }
+
+        // The value stored under `key`, or nullptr. `key` must pass is_key.
+        const Value* find(const Value& key) const;
+
+        inline Value* find(const Value& key) {
+            return const_cast<Value*>(static_cast<const Dictionary*>(this)->find(key));
+        }
+
+        // The value stored under `key`, added as undefined if the key is new.
+        // The reference is valid until the next insertion.
+        Value& insert(const Value& key);
+
+        // Returns false if the key was not present.
+        bool remove(const Value& key);
+
+        // Entries in insertion order. Entries marked `removed` must be skipped.
+        inline const std::vector<Entry>& get_entries() const {
+            return this->entries;
+        }
+
+        void trace(std::vector<HeapObject*>& references) const override;
+        void clear() override;
+    };
+}
+
+#endif
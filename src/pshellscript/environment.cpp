@@ -0,0 +1,143 @@
+#include <set>
+#include <unordered_map>
+#include "environment.hpp"
+
+extern char** environ;
+
+namespace pshellscript::environment {
+    struct Block {
+        // Shared with the blocks copied from this one until one replaces it.
+        std::vector<std::shared_ptr<const std::string>> entries;
+
+        // The entries' text, and nullptr.
+        std::vector<char*> pointers = { nullptr };
+
+        std::unordered_map<std::string, std::size_t> positions;
+        // Ordered with a transparent comparator, so exports() can look up a
+        // string_view without building a string.
+        std::set<std::string, std::less<>> exported;
+    };
+
+    static Snapshot current;
+    static std::uint64_t changes = 0;
+
+
+    static Block& read() {
+        if (current == nullptr) {
+            current = std::make_shared<Block>();
+            for (auto variable = environ; *variable != nullptr; variable++) {
+                std::string entry = *variable;
+                auto separator = entry.find('=');
+                if (separator == std::string::npos || current->positions.count(entry.substr(0, separator))) {
+                    continue;
+                }
+                current->positions.emplace(entry.substr(0, separator), current->entries.size());
+                current->entries.push_back(std::make_shared<const std::string>(std::move(entry)));
+                current->pointers.insert(current->pointers.end() - 1, const_cast<char*>(current->entries.back()->c_str()));
+            }
+        }
+        return *current;
+    }
+
+
+    // The block, copied first if a snapshot shares it.
+    static Block& write() {
+        read();
+        if (current.use_count() > 1) {
+            current = std::make_shared<Block>(*current);
+        }
+        changes++;
+        return *current;
+    }
+
+
+    const char* get(const std::string& name) {
+        const auto& block = read();
+        auto position = block.positions.find(name);
+        if (position == block.positions.end()) {
+            return nullptr;
+        }
+        return block.entries[position->second]->c_str() + name.size() + 1;
+    }
+
+
+    void set(const std::string& name, const std::string& value) {
+        auto& block = write();
+        auto entry = std::make_shared<const std::string>(name + "=" + value);
+        auto text = const_cast<char*>(entry->c_str());
+
+        auto position = block.positions.find(name);
+        if (position != block.positions.end()) {
+            block.entries[position->second] = std::move(entry);
+            block.pointers[position->second] = text;
+            return;
+        }
+
+        block.positions.emplace(name, block.entries.size());
+        block.entries.push_back(std::move(entry));
+        block.pointers.back() = text;
+        block.pointers.push_back(nullptr);
+    }
+
+
+    void unset(const std::string& name) {
+        if (read().positions.count(name) == 0) {
+            return;
+        }
+
+        // The last entry takes the place of the one removed.
+        auto& block = write();
+        auto position = block.positions.find(name);
+        auto index = position->second;
+        block.positions.erase(position);
+        auto last = block.entries.size() - 1;
+        if (index != last) {
+            const auto& moved = *block.entries[last];
+            block.positions[moved.substr(0, moved.find('='))] = index;
+            block.entries[index] = std::move(block.entries[last]);
+            block.pointers[index] = block.pointers[last];
+        }
+        block.entries.pop_back();
+        block.pointers.pop_back();
+        block.pointers.back() = nullptr;
+    }
+
+
+    char* const* block() {
+        return read().pointers.data();
+    }
+
+
+    std::uint64_t version() {
+        return changes;
+    }
+
+
+    void export_variable(const std::string& name) {
+        if (!read().exported.count(name)) {
+            write().exported.insert(name);
+        }
+    }
+
+
+    bool exports(std::string_view name) {
+        const auto& block = read();
+        return !block.exported.empty() && block.exported.count(name) > 0;
+    }
+
+
+    Snapshot snapshot() {
+        read();
+        return current;
+    }
+
+
+    bool restore(Snapshot snapshot) {
+        if (snapshot == current) {
+            return false;
+        }
+        current = std::move(snapshot);
+        changes++;
+        return true;
+    }
+}
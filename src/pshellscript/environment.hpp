@@ -0,0 +1,48 @@
+#ifndef ENVIRONMENT_HPP
+#define ENVIRONMENT_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pshellscript::environment {
+    /**
+     * The environment programs are started with, read from the shell's own
+     * on first use. It is kept as a ready-made envp array, and a change
+     * replaces or adds the one entry it touches, so starting a program does
+     * not build anything. Snapshots share it, and it is copied at the first
+     * change while they do; the strings themselves are never copied.
+     */
+    const char* get(const std::string& name);
+    void set(const std::string& name, const std::string& value);
+    void unset(const std::string& name);
+
+    // The "NAME=value" entries, ending with nullptr, for posix_spawn.
+    char* const* block();
+
+    // Bumped by every change, so that what was read from the environment
+    // can be kept until it changes.
+    std::uint64_t version();
+
+    /**
+     * Mark a name as exported: assigning the script variable of that name
+     * sets it in the environment too. exports() is fast while nothing is
+     * exported, as it is checked on every assignment to a global.
+     */
+    void export_variable(const std::string& name);
+    bool exports(std::string_view name);
+
+
+    // The environment as it was at some point, with what was exported then.
+    struct Block;
+    using Snapshot = std::shared_ptr<Block>;
+
+    Snapshot snapshot();
+
+    // Go back to a snapshot. Returns whether anything changed since.
+    bool restore(Snapshot snapshot);
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include <chrono>
+#include "heap.hpp"
+#include "array.hpp"
+#include "dictionary.hpp"
+#include "closure.hpp"
+
+namespace pshellscript::vm {
+    /**
+     * Tracks every heap object in one of two generations. New objects start
+     * young; objects that survive a collection become old. Young objects are
+     * collected after every `young_threshold` allocations, and the old ones
+     * as well once the old generation has doubled since the last full
+     * collection, so a growing heap is traced a bounded number of times.
+     *
+     * Roots are not enumerated. An object's references from outside the
+     * generations being collected are its reference count minus the
+     * references other collected objects hold to it; this counts the
+     * Registry, the value stack and the frames, and also the values the
+     * evaluator holds while it computes an expression.
+     */
+    class Heap {
+        static constexpr std::size_t young_threshold = 10000;
+
+        std::vector<HeapObject*> young;
+        std::vector<HeapObject*> old;
+        std::size_t allocations_since_collection = 0;
+        std::size_t promoted_since_full_collection = 0;
+        std::size_t old_objects_after_full_collection = 0;
+        bool collecting = false;
+
+        HeapStatistics statistics;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        void add(HeapObject& object, bool old);
+
+    public:
+        void track(HeapObject& object);
+        void untrack(HeapObject& object);
+        std::size_t collect(bool full);
+        HeapStatistics get_statistics() const;
+    };
+
+
+    static Heap objects;
+
+
+    HeapObject::~HeapObject() {
+        if (this->tracked) {
+            objects.untrack(*this);
+        }
+    }
+
+
+    void Heap::add(HeapObject& object, bool old) {
+        auto& generation = old ? this->old : this->young;
+        object.index = generation.size();
+        object.old = old;
+        generation.push_back(&object);
+    }
+
+
+    void Heap::track(HeapObject& object) {
+        this->add(object, false);
+        object.tracked = true;
+        this->statistics.allocations++;
+
+        if (++this->allocations_since_collection >= young_threshold && !this->collecting) {
+            auto full = this->promoted_since_full_collection > this->old_objects_after_full_collection;
+            this->collect(full);
+        }
+    }
+
+
+    void Heap::untrack(HeapObject& object) {
+        auto& generation = object.old ? this->old : this->young;
+        generation[object.index] = generation.back();
+        generation[object.index]->index = object.index;
+        generation.pop_back();
+        object.tracked = false;
+    }
+
+
+    /**
+     * Free the cycles that nothing outside them refers to. Survivors are
+     * promoted to the old generation.
+     */
+    std::size_t Heap::collect(bool full) {
+        auto started = std::chrono::steady_clock::now();
+        this->collecting = true;
+
+        std::vector<HeapObject*> members;
+        if (full) {
+            members = std::move(this->old);
+            this->old = {};
+        }
+        members.insert(members.end(), this->young.begin(), this->young.end());
+        this->young.clear();
+
+        for (std::size_t i = 0; i < members.size(); i++) {
+            members[i]->index = i;
+            members[i]->collecting = true;
+            members[i]->reachable = false;
+            members[i]->references_from_outside = members[i]->weak_from_this().use_count();
+        }
+
+        // The references of members[i] are edges[first_edge[i]] up to
+        // edges[first_edge[i + 1]], recorded so that each object is traced once.
+        std::vector<HeapObject*> edges;
+        std::vector<std::size_t> first_edge(members.size() + 1);
+        for (std::size_t i = 0; i < members.size(); i++) {
+            first_edge[i] = edges.size();
+            members[i]->trace(edges);
+        }
+        first_edge[members.size()] = edges.size();
+
+        for (auto reference : edges) {
+            if (reference->collecting) {
+                reference->references_from_outside--;
+            }
+        }
+
+        // Everything reachable from an object referenced from outside is live.
+        std::vector<std::size_t> pending;
+        for (std::size_t i = 0; i < members.size(); i++) {
+            if (members[i]->references_from_outside > 0) {
+                members[i]->reachable = true;
+                pending.push_back(i);
+            }
+        }
+
+        while (!pending.empty()) {
+            auto member = pending.back();
+            pending.pop_back();
+
+            for (auto edge = first_edge[member]; edge < first_edge[member + 1]; edge++) {
+                auto reference = edges[edge];
+                if (reference->collecting && !reference->reachable) {
+                    reference->reachable = true;
+                    pending.push_back(reference->index);
+                }
+            }
+        }
+
+        // Holding the garbage keeps it alive while its references are
+        // dropped, so that no object is freed while another still points to it.
+        // Until then it stays in the young generation.
+        std::vector<std::shared_ptr<HeapObject>> garbage;
+        std::size_t promoted = 0;
+        for (auto member : members) {
+            member->collecting = false;
+            if (member->reachable) {
+                promoted += !member->old;
+                this->add(*member, true);
+            } else {
+                garbage.push_back(member->shared_from_this());
+                this->add(*member, false);
+            }
+        }
+
+        for (const auto& object : garbage) {
+            object->clear();
+        }
+        auto freed = garbage.size();
+        garbage.clear();
+
+        this->statistics.promoted += promoted;
+        this->promoted_since_full_collection = full ? 0 : this->promoted_since_full_collection + promoted;
+        if (full) {
+            this->old_objects_after_full_collection = this->old.size();
+        }
+        this->allocations_since_collection = 0;
+        this->collecting = false;
+
+        std::chrono::duration<double, std::milli> pause = std::chrono::steady_clock::now() - started;
+        this->statistics.collected += freed;
+        this->statistics.total_pause_ms += pause.count();
+        this->statistics.longest_pause_ms = std::max(this->statistics.longest_pause_ms, pause.count());
+        if (full) {
+            this->statistics.full_collections++;
+        } else {
+            this->statistics.young_collections++;
+        }
+        return freed;
+    }
+
+
+    HeapStatistics Heap::get_statistics() const {
+        auto statistics = this->statistics;
+        statistics.young_objects = this->young.size();
+        statistics.old_objects = this->old.size();
+        statistics.seconds_running = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - this->start
+        ).count();
+        return statistics;
+    }
+
+
+    namespace heap {
+        void track(HeapObject& object) {
+            objects.track(object);
+        }
+
+
+        std::size_t collect() {
+            return objects.collect(true);
+        }
+
+
+        HeapStatistics statistics() {
+            return objects.get_statistics();
+        }
+
+
+        HeapObject* object_of(const Value& value) {
+            if (std::holds_alternative<std::shared_ptr<Array>>(value)) {
+                return std::get<std::shared_ptr<Array>>(value).get();
+            }
+
+            if (std::holds_alternative<std::shared_ptr<Dictionary>>(value)) {
+                return std::get<std::shared_ptr<Dictionary>>(value).get();
+            }
+
+            if (std::holds_alternative<std::shared_ptr<Closure>>(value)) {
+                return std::get<std::shared_ptr<Closure>>(value).get();
+            }
+
+            if (std::holds_alternative<std::shared_ptr<Box>>(value)) {
+                return std::get<std::shared_ptr<Box>>(value).get();
+            }
+            return nullptr;
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "vm.hpp"
+
+namespace pshellscript::vm {
+    /**
+     * A value that can hold references to other values. Such values are
+     * freed by reference counting as soon as nothing uses them, except when
+     * they form a cycle; the collector finds those and breaks them.
+     *
+     * Objects are only tracked once they are owned by a shared_ptr, so they
+     * must be created with make_object.
+     */
+    class HeapObject : public std::enable_shared_from_this<HeapObject> {
+        friend class Heap;
+
+        // Where the object is in its generation's list.
+        std::size_t index = 0;
+        bool old = false;
+        bool tracked = false;
+
+        // Scratch state of the collection in progress.
+        bool collecting = false;
+        bool reachable = false;
+        long references_from_outside = 0;
+
+    public:
+        HeapObject() = default;
+        HeapObject(const HeapObject&) = delete;
+        HeapObject& operator=(const HeapObject&) = delete;
+        virtual ~HeapObject();
+
+        // Append every heap object this one references directly, once per reference.
+        virtual void trace(std::vector<HeapObject*>& references) const = 0;
+
+        // Drop every reference this object holds. Only called on garbage.
+        virtual void clear() = 0;
+    };
+
+
+    struct HeapStatistics {
+        std::uint64_t allocations = 0;
+        std::uint64_t young_collections = 0;
+        std::uint64_t full_collections = 0;
+        std::uint64_t collected = 0;
+        std::uint64_t promoted = 0;
+        std::size_t young_objects = 0;
+        std::size_t old_objects = 0;
+        double total_pause_ms = 0;
+        double longest_pause_ms = 0;
+        double seconds_running = 0;
+    };
+
+
+    namespace heap {
+        // Start tracking an object that was just created. May run a collection.
+        void track(HeapObject& object);
+
+        // Collect garbage cycles among all objects, returning how many were freed.
+        std::size_t collect();
+
+        HeapStatistics statistics();
+
+        // The object a value refers to, or nullptr for values that are not on the heap.
+        HeapObject* object_of(const Value& value);
+    }
+
+
+    template <typename Object, typename... Arguments>
+    inline std::shared_ptr<Object> make_object(Arguments&&... arguments) {
+        auto object = std::make_shared<Object>(std::forward<Arguments>(arguments)...);
+        heap::track(*object);
+        return object;
+    }
+}
+
+#endif
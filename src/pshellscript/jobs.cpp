@@ -0,0 +1,778 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "jobs.hpp"
+#include "output.hpp"
+
+namespace pshellscript::jobs {
+    enum class State { Running, Stopped, Done };
+
+    struct Job {
+        // The job's first process, which leads its process group.
+        pid_t pid;
+
+        // A pidfd that becomes readable when the process exits, or -1 if
+        // none could be opened.
+        int descriptor;
+
+        std::string command;
+        State state = State::Running;
+
+        // Once done: the exit status, and the signal that ended it, if any.
+        int status = 0;
+        int signal = 0;
+
+        // When it was last started or stopped. The latest is the current job.
+        std::uint64_t touched = 0;
+
+        // Whether it is waiting in `changed` to be reported.
+        bool changed = false;
+    };
+
+    static std::unordered_map<int, Job> table;
+
+    // The numbers of jobs not done yet, by process, for SIGCHLD.
+    static std::unordered_map<pid_t, int> numbers;
+
+    // Jobs that finished or stopped since the last report, in that order.
+    static std::vector<int> changed;
+
+    static int next_number = 1;
+    static std::uint64_t clock = 0;
+    static std::size_t running = 0;
+
+    // Jobs without a pidfd, which are checked on every SIGCHLD instead.
+    static std::size_t unwatched = 0;
+
+    static bool has_terminal = false;
+
+    // The pidfds and the signalfd. The prompt waits on a second set holding
+    // the first and standard input, unless the input is a regular file,
+    // which epoll refuses as it never blocks.
+    static int events = -1;
+    static int signals = -1;
+    static int prompt_events = -1;
+    static bool input_pollable = false;
+
+    // Job numbers start at 1, leaving 0 for the signalfd.
+    static constexpr std::uint64_t signal_event = 0;
+    static constexpr std::uint64_t job_event = 0;
+    static constexpr std::uint64_t input_event = 1;
+
+    // Standard input read but not yet returned as lines.
+    static LineReader input(STDIN_FILENO);
+
+
+    static bool watch(int set, int descriptor, std::uint64_t data) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = data;
+        return ::epoll_ctl(set, EPOLL_CTL_ADD, descriptor, &event) == 0;
+    }
+
+
+    void start() {
+        has_terminal = ::isatty(STDIN_FILENO);
+
+        // The shell takes the terminal back from a job it ran in the
+        // foreground while it is itself in the background.
+        if (has_terminal) {
+            std::signal(SIGTTOU, SIG_IGN);
+        }
+
+        sigset_t child;
+        sigemptyset(&child);
+        sigaddset(&child, SIGCHLD);
+        ::sigprocmask(SIG_BLOCK, &child, nullptr);
+        signals = ::signalfd(-1, &child, SFD_NONBLOCK | SFD_CLOEXEC);
+
+        events = ::epoll_create1(EPOLL_CLOEXEC);
+        watch(events, signals, signal_event);
+
+        prompt_events = ::epoll_create1(EPOLL_CLOEXEC);
+        watch(prompt_events, events, job_event);
+        input_pollable = watch(prompt_events, STDIN_FILENO, input_event);
+    }
+
+
+    bool interactive() {
+        return has_terminal;
+    }
+
+
+    // Allow as many descriptors as the system does, for a pidfd per job.
+    static bool raise_descriptor_limit() {
+        rlimit limit;
+        if (::getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == limit.rlim_max) {
+            return false;
+        }
+        limit.rlim_cur = limit.rlim_max;
+        return ::setrlimit(RLIMIT_NOFILE, &limit) == 0;
+    }
+
+
+    static int open_pidfd(pid_t pid) {
+        auto descriptor = int(::syscall(SYS_pidfd_open, pid, 0));
+        if (descriptor < 0 && errno == EMFILE && raise_descriptor_limit()) {
+            descriptor = int(::syscall(SYS_pidfd_open, pid, 0));
+        }
+        return descriptor;
+    }
+
+
+    static void set_state(Job& job, State state) {
+        if (job.state == State::Running) {
+            running--;
+        }
+        if (state == State::Running) {
+            running++;
+        }
+        job.state = state;
+    }
+
+
+    static void notify(int number, Job& job) {
+        if (!job.changed) {
+            job.changed = true;
+            changed.push_back(number);
+        }
+    }
+
+
+    // Stop watching a job that is done.
+    static void release(Job& job) {
+        if (job.descriptor >= 0) {
+            // Removed explicitly: a forked child may still hold a copy of
+            // the pidfd, which would keep it in the set.
+            ::epoll_ctl(events, EPOLL_CTL_DEL, job.descriptor, nullptr);
+            ::close(job.descriptor);
+            job.descriptor = -1;
+        } else {
+            unwatched--;
+        }
+        numbers.erase(job.pid);
+    }
+
+
+    // Apply what waitid reported about a job.
+    static void record(int number, Job& job, const siginfo_t& info) {
+        switch (info.si_code) {
+            case CLD_CONTINUED: {
+                set_state(job, State::Running);
+                return;
+            }
+
+            case CLD_STOPPED: {
+                set_state(job, State::Stopped);
+                job.touched = ++clock;
+                break;
+            }
+
+            default: {
+                set_state(job, State::Done);
+                if (info.si_code == CLD_EXITED) {
+                    job.status = info.si_status;
+                } else {
+                    job.signal = info.si_status;
+                    job.status = 128 + info.si_status;
+                }
+                release(job);
+                break;
+            }
+        }
+        notify(number, job);
+    }
+
+
+    // Wait for a change of the kinds in `options` to a job, blocking unless
+    // WNOHANG is among them. Only that process is looked at.
+    static bool collect(int number, Job& job, int options) {
+        siginfo_t info = {};
+        int result = 0;
+        do {
+            result = job.descriptor >= 0
+                ? ::waitid(P_PIDFD, id_t(job.descriptor), &info, options)
+                : ::waitid(P_PID, id_t(job.pid), &info, options);
+        } while (result < 0 && errno == EINTR);
+
+        if (result < 0 || info.si_pid == 0) {
+            return false;
+        }
+        record(number, job, info);
+        return true;
+    }
+
+
+    static void update(int number, int options) {
+        auto found = table.find(number);
+        if (found != table.end() && found->second.state != State::Done) {
+            collect(number, found->second, options | WNOHANG);
+        }
+    }
+
+
+    // Forget a job that is done, without reporting it.
+    static void remove(int number) {
+        auto found = table.find(number);
+        if (found->second.changed) {
+            changed.erase(std::find(changed.begin(), changed.end(), number));
+        }
+        table.erase(found);
+        if (table.empty()) {
+            next_number = 1;
+        }
+    }
+
+
+    /**
+     * A SIGCHLD arrives for every child that exits, stops or continues,
+     * jobs or not. Exits of jobs are left to their pidfds; for a stop or a
+     * continue, only the process it names is asked. Signals of one kind
+     * that arrive together are merged, so a stop can be missed here; `jobs`
+     * asks every job again.
+     */
+    static void handle_signals() {
+        signalfd_siginfo received[64];
+        while (true) {
+            auto size = ::read(signals, received, sizeof(received));
+            if (size <= 0) {
+                break;
+            }
+
+            for (std::size_t i = 0; i < std::size_t(size) / sizeof(signalfd_siginfo); i++) {
+                auto code = received[i].ssi_code;
+                if (code != CLD_STOPPED && code != CLD_CONTINUED) {
+                    continue;
+                }
+                auto found = numbers.find(pid_t(received[i].ssi_pid));
+                if (found != numbers.end()) {
+                    update(found->second, WSTOPPED | WCONTINUED);
+                }
+            }
+        }
+
+        if (unwatched > 0) {
+            for (auto& [number, job] : table) {
+                if (job.descriptor < 0 && job.state != State::Done) {
+                    collect(number, job, WEXITED | WNOHANG);
+                }
+            }
+        }
+    }
+
+
+    // Handle the job events that arrive within `timeout` milliseconds, or
+    // the first to arrive if it is -1, and any others pending by then.
+    static bool dispatch(int timeout) {
+        epoll_event ready[64];
+        int count = 0;
+        do {
+            count = ::epoll_wait(events, ready, 64, timeout);
+            for (int i = 0; i < count; i++) {
+                if (ready[i].data.u64 == signal_event) {
+                    handle_signals();
+                } else {
+                    update(int(ready[i].data.u64), WEXITED);
+                }
+            }
+            timeout = 0;
+        } while (count == 64);
+        return count >= 0 || errno == EINTR;
+    }
+
+
+    int event_descriptor() {
+        return events;
+    }
+
+
+    void handle_events() {
+        dispatch(0);
+    }
+
+
+    int add(pid_t pid, const std::string& command) {
+        auto number = next_number++;
+        Job job { pid, open_pidfd(pid), command };
+        if (job.descriptor < 0 || !watch(events, job.descriptor, std::uint64_t(number))) {
+            unwatched++;
+        }
+        job.touched = ++clock;
+        running++;
+
+        numbers[pid] = number;
+        table.emplace(number, std::move(job));
+        std::cerr << "[" << number << "] " << pid << std::endl;
+        return number;
+    }
+
+
+    void leave() {
+        for (auto& [number, job] : table) {
+            if (job.descriptor >= 0) {
+                ::close(job.descriptor);
+            }
+        }
+        table.clear();
+        numbers.clear();
+        changed.clear();
+        running = 0;
+        unwatched = 0;
+
+        // Closed, not removed from the sets, which the shell shares.
+        for (auto* descriptor : { &signals, &events, &prompt_events }) {
+            if (*descriptor >= 0) {
+                ::close(*descriptor);
+                *descriptor = -1;
+            }
+        }
+
+        sigset_t child;
+        sigemptyset(&child);
+        sigaddset(&child, SIGCHLD);
+        ::sigprocmask(SIG_UNBLOCK, &child, nullptr);
+        std::signal(SIGTTOU, SIG_DFL);
+    }
+
+
+    static void wait_for_input() {
+        if (!input_pollable) {
+            dispatch(0);
+            return;
+        }
+
+        while (true) {
+            epoll_event ready[2];
+            auto count = ::epoll_wait(prompt_events, ready, 2, -1);
+            if (count < 0 && errno != EINTR) {
+                return;
+            }
+
+            auto has_input = false;
+            for (int i = 0; i < count; i++) {
+                if (ready[i].data.u64 == input_event) {
+                    has_input = true;
+                } else {
+                    dispatch(0);
+                }
+            }
+            if (has_input) {
+                return;
+            }
+        }
+    }
+
+
+    bool take_line(LineReader& reader, std::string& line) {
+        auto newline = reader.text.find('\n', reader.consumed);
+        if (newline != std::string::npos) {
+            line.assign(reader.text, reader.consumed, newline - reader.consumed);
+            reader.consumed = newline + 1;
+            return true;
+        }
+
+        if (!reader.ended || reader.consumed == reader.text.size()) {
+            return false;
+        }
+        line.assign(reader.text, reader.consumed);
+        reader.consumed = reader.text.size();
+        return true;
+    }
+
+
+    void fill(LineReader& reader) {
+        static constexpr std::size_t chunk_size = 64 * 1024;
+        reader.text.erase(0, reader.consumed);
+        reader.consumed = 0;
+
+        auto size = reader.text.size();
+        reader.text.resize(size + chunk_size);
+        auto count = ::read(reader.descriptor, reader.text.data() + size, chunk_size);
+        reader.text.resize(size + std::size_t(std::max<ssize_t>(count, 0)));
+        if (count == 0 || (count < 0 && errno != EINTR && errno != EAGAIN)) {
+            reader.ended = true;
+        }
+    }
+
+
+    bool read_line(std::string& line) {
+        while (!take_line(input, line)) {
+            if (input.ended) {
+                return false;
+            }
+            wait_for_input();
+            fill(input);
+        }
+        return true;
+    }
+
+
+    // The current job, `%+`, and the previous one, `%-`, or 0: those last
+    // started or stopped among the jobs not done.
+    static std::pair<int, int> current_jobs() {
+        std::pair<int, int> current { 0, 0 };
+        std::uint64_t latest = 0;
+        std::uint64_t before = 0;
+        for (const auto& [number, job] : table) {
+            if (job.state == State::Done) {
+                continue;
+            }
+            if (job.touched > latest) {
+                current.second = current.first;
+                before = latest;
+                current.first = number;
+                latest = job.touched;
+            } else if (job.touched > before) {
+                current.second = number;
+                before = job.touched;
+            }
+        }
+        return current;
+    }
+
+
+    // A job as `jobs` lists it: `[1]+  Running                 sleep 5 &`.
+    static std::string describe(int number, const Job& job, std::pair<int, int> current) {
+        std::string state;
+        switch (job.state) {
+            case State::Running: {
+                state = "Running";
+                break;
+            }
+
+            case State::Stopped: {
+                state = "Stopped";
+                break;
+            }
+
+            case State::Done: {
+                if (job.signal != 0) {
+                    state = ::strsignal(job.signal);
+                } else if (job.status != 0) {
+                    state = "Exit " + std::to_string(job.status);
+                } else {
+                    state = "Done";
+                }
+                break;
+            }
+        }
+
+        auto mark = number == current.first ? '+' : number == current.second ? '-' : ' ';
+        auto line = "[" + std::to_string(number) + "]" + mark + "  " + state;
+        line.append(state.size() < 24 ? 24 - state.size() : 1, ' ');
+        line += job.command;
+        if (job.state == State::Running) {
+            line += " &";
+        }
+        return line;
+    }
+
+
+    void report() {
+        dispatch(0);
+        if (changed.empty()) {
+            return;
+        }
+
+        auto current = current_jobs();
+        for (auto number : changed) {
+            auto& job = table.at(number);
+            job.changed = false;
+            std::cerr << describe(number, job, current) << "\n";
+        }
+        std::cerr.flush();
+
+        for (auto number : changed) {
+            auto found = table.find(number);
+            if (found->second.state == State::Done) {
+                table.erase(found);
+            }
+        }
+        changed.clear();
+        if (table.empty()) {
+            next_number = 1;
+        }
+    }
+
+
+    Result<int> list(const std::vector<std::string>& arguments) {
+        if (arguments.size() > 1) {
+            std::cerr << "jobs: expects no arguments" << std::endl;
+            return 1;
+        }
+
+        // Catch up on exits, and on stops whose signals were merged.
+        dispatch(0);
+        std::vector<int> listed;
+        for (const auto& [number, job] : table) {
+            listed.push_back(number);
+        }
+        std::sort(listed.begin(), listed.end());
+        for (auto number : listed) {
+            update(number, WSTOPPED | WCONTINUED);
+        }
+
+        auto current = current_jobs();
+        for (auto number : listed) {
+            output::write_line(describe(number, table.at(number), current));
+        }
+
+        // Jobs listed here are not reported again.
+        for (auto number : listed) {
+            table.at(number).changed = false;
+            if (table.at(number).state == State::Done) {
+                remove(number);
+            }
+        }
+        changed.clear();
+        return 0;
+    }
+
+
+    /**
+     * The job `spec` names, as `%n` or `n`, `%%` or `%+` for the current job
+     * and `%-` for the previous one, or the current job without one. Prints
+     * why and returns 0 if there is no such job.
+     */
+    static int find_job(const char* command, const std::vector<std::string>& arguments) {
+        if (arguments.size() > 2) {
+            std::cerr << command << ": too many arguments" << std::endl;
+            return 0;
+        }
+
+        auto current = current_jobs();
+        if (arguments.size() == 1) {
+            if (current.first == 0) {
+                std::cerr << command << ": no current job" << std::endl;
+            }
+            return current.first;
+        }
+
+        const auto& spec = arguments[1];
+        if (spec == "%%" || spec == "%+" || spec == "%-") {
+            auto number = spec == "%-" ? current.second : current.first;
+            if (number == 0) {
+                std::cerr << command << ": " << spec << ": no such job" << std::endl;
+            }
+            return number;
+        }
+
+        const char* digits = spec.c_str() + (spec.front() == '%' ? 1 : 0);
+        char* end = nullptr;
+        auto number = std::strtol(digits, &end, 10);
+        if (*digits == '\0' || *end != '\0' || table.count(int(number)) == 0) {
+            std::cerr << command << ": " << spec << ": no such job" << std::endl;
+            return 0;
+        }
+        return int(number);
+    }
+
+
+    // Wait for a job to finish, forget it and return its status.
+    static int finish(int number) {
+        auto& job = table.at(number);
+        if (job.state != State::Done && !collect(number, job, WEXITED)) {
+            // Reaped elsewhere; nothing more can be learned about it.
+            set_state(job, State::Done);
+            job.status = 127;
+            release(job);
+        }
+
+        auto status = job.status;
+        remove(number);
+        return status;
+    }
+
+
+    Result<int> wait(const std::vector<std::string>& arguments) {
+        if (arguments.size() == 1) {
+            while (running > 0 && dispatch(-1)) {
+            }
+
+            std::vector<int> done;
+            for (const auto& [number, job] : table) {
+                if (job.state == State::Done) {
+                    done.push_back(number);
+                }
+            }
+            for (auto number : done) {
+                remove(number);
+            }
+            return 0;
+        }
+
+        int status = 0;
+        for (std::size_t i = 1; i < arguments.size(); i++) {
+            const auto& spec = arguments[i];
+            int number = 0;
+            if (spec.front() == '%') {
+                number = find_job("wait", { arguments[0], spec });
+            } else {
+                auto pid = pid_t(std::atol(spec.c_str()));
+                auto found = numbers.find(pid);
+                if (found != numbers.end()) {
+                    number = found->second;
+                }
+                for (auto job = table.begin(); number == 0 && job != table.end(); job++) {
+                    if (job->second.pid == pid) {
+                        number = job->first;
+                    }
+                }
+                if (number == 0) {
+                    std::cerr << "wait: pid " << spec << " is not a child of this shell" << std::endl;
+                }
+            }
+
+            status = number == 0 ? 127 : finish(number);
+        }
+        return status;
+    }
+
+
+    Result<int> foreground(const std::vector<std::string>& arguments) {
+        auto number = find_job("fg", arguments);
+        if (number == 0) {
+            return 1;
+        }
+
+        auto& job = table.at(number);
+        output::write_line(job.command);
+        output::flush();
+        if (job.state == State::Done) {
+            return finish(number);
+        }
+
+        if (has_terminal) {
+            ::tcsetpgrp(STDIN_FILENO, job.pid);
+        }
+        if (job.state == State::Stopped) {
+            ::kill(-job.pid, SIGCONT);
+            set_state(job, State::Running);
+        }
+
+        auto collected = collect(number, job, WEXITED | WSTOPPED);
+        if (has_terminal) {
+            ::tcsetpgrp(STDIN_FILENO, ::getpgrp());
+        }
+
+        if (collected && job.state == State::Stopped) {
+            std::cerr << "\n";
+            report();
+            return 128 + SIGTSTP;
+        }
+        return finish(number);
+    }
+
+
+    // A signal by number, or by name with or without its SIG prefix; 0 if
+    // there is no such signal.
+    static int parse_signal(const std::string& name) {
+        char* end = nullptr;
+        auto number = std::strtol(name.c_str(), &end, 10);
+        if (!name.empty() && *end == '\0') {
+            return number > 0 && number < NSIG ? int(number) : 0;
+        }
+
+        auto abbreviation = name.compare(0, 3, "SIG") == 0 ? name.substr(3) : name;
+        for (int signal = 1; signal < NSIG; signal++) {
+            const auto* known = ::sigabbrev_np(signal);
+            if (known != nullptr && abbreviation == known) {
+                return signal;
+            }
+        }
+        return 0;
+    }
+
+
+    Result<int> kill(const std::vector<std::string>& arguments) {
+        std::size_t first = 1;
+        int signal = SIGTERM;
+        if (arguments.size() > 1 && arguments[1].size() > 1 && arguments[1].front() == '-') {
+            signal = parse_signal(arguments[1].substr(1));
+            if (signal == 0) {
+                std::cerr << "kill: " << arguments[1].substr(1) << ": invalid signal" << std::endl;
+                return 1;
+            }
+            first = 2;
+        }
+        if (first == arguments.size()) {
+            std::cerr << "kill: expects a job or a process" << std::endl;
+            return 1;
+        }
+
+        // An empty argument would otherwise read as process 0, the shell's
+        // own process group.
+        for (auto i = first; i < arguments.size(); i++) {
+            if (arguments[i].empty()) {
+                std::cerr << "kill: usage: kill [-signal] %job | pid ..." << std::endl;
+                return 1;
+            }
+        }
+
+        int status = 0;
+        for (auto i = first; i < arguments.size(); i++) {
+            const auto& target = arguments[i];
+            pid_t pid = 0;
+            Job* job = nullptr;
+            if (target.front() == '%') {
+                auto number = find_job("kill", { arguments[0], target });
+                if (number == 0) {
+                    status = 1;
+                    continue;
+                }
+                job = &table.at(number);
+                pid = -job->pid;
+            } else {
+                char* end = nullptr;
+                pid = pid_t(std::strtol(target.c_str(), &end, 10));
+                if (*end != '\0') {
+                    std::cerr << "kill: " << target << ": not a job or a process" << std::endl;
+                    status = 1;
+                    continue;
+                }
+            }
+
+            if (::kill(pid, signal) < 0) {
+                std::cerr << "kill: " << target << ": " << std::strerror(errno) << std::endl;
+                status = 1;
+                continue;
+            }
+
+            // A stopped job would only act on the signal once continued.
+            if (job != nullptr && job->state == State::Stopped && signal != SIGSTOP && signal != SIGTSTP) {
+                ::kill(pid, SIGCONT);
+            }
+        }
+        return status;
+    }
+
+
+    Result<int> background(const std::vector<std::string>& arguments) {
+        auto number = find_job("bg", arguments);
+        if (number == 0) {
+            return 1;
+        }
+
+        auto& job = table.at(number);
+        if (job.state != State::Stopped) {
+            std::cerr << "bg: job " << number << " already in background" << std::endl;
+            return 0;
+        }
+
+        ::kill(-job.pid, SIGCONT);
+        set_state(job, State::Running);
+        output::write_line("[" + std::to_string(number) + "] " + job.command + " &");
+        return 0;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef JOBS_HPP
+#define JOBS_HPP
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "../result.hpp"
+
+namespace pshellscript::jobs {
+    /**
+     * Set up the event loop the prompt waits in. SIGCHLD is blocked and
+     * read from a signalfd, each job's exit is watched through a pidfd, and
+     * both sit in one epoll set together with standard input, so a job
+     * that ends is reaped while the shell waits for a line, with work for
+     * that job alone.
+     */
+    void start();
+
+    // Whether standard input is a terminal. Jobs read it only then, and are
+    // stopped by the terminal if they do so in the background.
+    bool interactive();
+
+    /**
+     * Take a started process, which leads a process group of its own, as a
+     * job running `command`, and announce it as `[number] pid`. Returns the
+     * job's number.
+     */
+    int add(pid_t pid, const std::string& command);
+
+    // In a child forked from the shell: drop the shell's jobs and event
+    // loop, and give it back the signals the shell blocks or ignores.
+    void leave();
+
+    /**
+     * Read the next line of standard input into `line`, without its newline,
+     * handling job events until one is there. Returns false at the end of
+     * the input.
+     */
+    bool read_line(std::string& line);
+
+    // A descriptor read a chunk at a time, and split into lines. What was
+    // read but not yet taken is `text` from `consumed` on.
+    struct LineReader {
+        int descriptor;
+        std::string text;
+        std::size_t consumed = 0;
+        bool ended = false;
+
+        inline LineReader(int descriptor) : descriptor(descriptor) {}
+    };
+
+    /**
+     * Take the next line `reader` holds into `line`, without its newline: a
+     * whole one, or what is left once its input ended. Returns false when
+     * there is none yet, or none left if `reader.ended`.
+     */
+    bool take_line(LineReader& reader, std::string& line);
+
+    // Read a chunk into `reader`, waiting for one if the descriptor has
+    // nothing yet, and note the end of its input.
+    void fill(LineReader& reader);
+
+    // The epoll set that signals job events, for code that waits on other
+    // descriptors to watch as well, and handle the events pending in it.
+    int event_descriptor();
+    void handle_events();
+
+    // Print, on standard error, the jobs that finished or stopped since the
+    // last report, and forget the finished ones.
+    void report();
+
+    // `jobs`: list the jobs and their states.
+    Result<int> list(const std::vector<std::string>& arguments);
+
+    // `wait [%job | pid]...`: wait for the jobs given, or all running jobs,
+    // and return the status of the last one.
+    Result<int> wait(const std::vector<std::string>& arguments);
+
+    // `fg [%job]`: continue a job, or the current one, with the terminal,
+    // and wait for it to finish or stop.
+    Result<int> foreground(const std::vector<std::string>& arguments);
+
+    // `kill [-signal] (%job | pid)...`: send a signal, SIGTERM by default, to
+    // the processes of jobs or to processes.
+    Result<int> kill(const std::vector<std::string>& arguments);
+
+    // `bg [%job]`: continue a stopped job in the background.
+    Result<int> background(const std::vector<std::string>& arguments);
+}
+
+#endif
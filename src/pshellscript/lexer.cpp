@@ -10,12 +10,39 @@ namespace pshellscript::lexer {
         long current_position = 0;
         long start_position = 0;
         std::vector<Token> tokens;
+        std::vector<Error> errors;
+
+        // Braces opened since the echo statement being lexed started, or -1
+        // outside one.
+        long echo_depth = -1;
+
+        // The parentheses and braces open at this point, innermost last. The
+        // parenthesis of a command substitution or a subshell is a '$'.
+        std::vector<char> nesting;
+
+        // Where the statement being lexed started, for the text of a
+        // background job.
+        long statement_start = 0;
+
+        // The number of tokens when the last command's words, or subshell,
+        // ended, so that a `&&` or `||` right after it chains another one.
+        long command_end = -1;
+
+        // Substitutions, subshells and interpolations being lexed, each
+        // nested in the one before, up to the limit the parser has too.
+        static constexpr long max_depth = 256;
+        long depth = 0;
 
 
         inline LexerState(const std::string& source)
             : source(source), tokens() { }
 
 
+        inline void error(const std::string& message) {
+            this->errors.push_back(Error(message));
+        }
+
+
         inline bool has_next() const {
             return std::size_t(this->current_position) < this->source.length();
         }
@@ -42,19 +69,61 @@ namespace pshellscript::lexer {
         }
 
 
+        // Whether the previous token ended a statement or opened a block,
+        // so that a name here may be a command. The ';' of a for loop's
+        // header does not count.
+        inline bool at_statement_start() const {
+            if (this->tokens.empty()) {
+                return true;
+            }
+            if (!this->nesting.empty() && this->nesting.back() == '(') {
+                return false;
+            }
+
+            auto type = this->tokens.back().type;
+            return type == Token::Type::SemiColon
+                || type == Token::Type::SubstitutionStart
+                || type == Token::Type::SubshellStart
+                || type == Token::Type::Pipe
+                || type == Token::Type::Background
+                || type == Token::Type::Time
+                || type == Token::Type::LeftBrace
+                || type == Token::Type::RightBrace
+                || ((type == Token::Type::AndAnd || type == Token::Type::OrOr)
+                    && long(this->tokens.size()) - 1 == this->command_end);
+        }
+
+
         void scan_token();
         void scan_number();
         void scan_keyword();
+        bool starts_command() const;
+        bool starts_timed() const;
+        bool starts_subshell() const;
+        bool ends_statement() const;
+        void scan_path_command();
+        void scan_command_words();
+        void scan_word();
+        bool redirection_at(std::size_t position) const;
+        bool redirects_echo() const;
+        void scan_redirection();
         void scan_string();
+        void scan_interpolated_expression();
+        void scan_statements(Token::Type type, const char* unterminated);
+        void scan_substitution();
+        void scan_subshell();
         void scan_variable();
+        void scan_background();
     };
 
 
     static std::map<std::string, Token::Type> keywords = {
         CREATE_KEYWORD("function", Token::Type::Function),
+        CREATE_KEYWORD("memoize", Token::Type::Memoize),
         CREATE_KEYWORD("if", Token::Type::If),
         CREATE_KEYWORD("else", Token::Type::Else),
         CREATE_KEYWORD("for", Token::Type::For),
+        CREATE_KEYWORD("in", Token::Type::In),
         CREATE_KEYWORD("return", Token::Type::Return),
         CREATE_KEYWORD("echo", Token::Type::Echo),
         CREATE_KEYWORD("true", Token::Type::True),
@@ -62,12 +131,31 @@ namespace pshellscript::lexer {
     };
 
 
+    // Characters that end a command's word, outside quotes.
+    static inline bool ends_word(char character) {
+        switch (character) {
+            case ';': case '}': case ')': case '|': case '&': case '<': case '>':
+            case ' ': case '\t': case '\n': case '\r': case '\0': {
+                return true;
+            }
+
+            default: {
+                return false;
+            }
+        }
+    }
+
+
     void LexerState::scan_token() {
         auto character = this->next();
 
         switch (character) {
             case ';': {
+                if (this->echo_depth == 0) {
+                    this->echo_depth = -1;
+                }
                 this->append_token(Token::Type::SemiColon);
+                this->statement_start = this->current_position;
                 break;
             }
             case '+': {
@@ -116,17 +204,37 @@ namespace pshellscript::lexer {
                 break;
             }
 
+            case ':': {
+                this->append_token(Token::Type::Colon);
+                break;
+            }
+
 
             case '/': {
+                if (this->at_statement_start() && !ends_word(this->peek()) && this->peek() != '=') {
+                    this->scan_path_command();
+                    break;
+                }
+                if (this->peek() == '=') {
+                    this->next();
+                    this->append_token(Token::Type::SlashEqual);
+                    break;
+                }
                 this->append_token(Token::Type::Slash);
                 break;
             }
 
             case '=': {
                 if (this->peek() == '=') {
+                    this->next();
                     this->append_token(Token::Type::EqualEqual);
                     break;
                 }
+                if (this->peek() == '~') {
+                    this->next();
+                    this->append_token(Token::Type::EqualTilde);
+                    break;
+                }
                 this->append_token(Token::Type::Equal);
                 break;
             }
@@ -152,12 +260,17 @@ namespace pshellscript::lexer {
             }
 
             case '>': {
+                if (this->redirects_echo()) {
+                    this->current_position--;
+                    this->scan_redirection();
+                    break;
+                }
                 if (this->peek() == '=') {
                     this->next();
                     this->append_token(Token::Type::GreaterEqual);
                     break;
                 }
-                this->append_token(Token::Type::GreaterEqual);
+                this->append_token(Token::Type::Greater);
                 break;
             }
 
@@ -167,7 +280,7 @@ namespace pshellscript::lexer {
                     this->append_token(Token::Type::AndAnd);
                     break;
                 }
-                // Error
+                this->scan_background();
                 break;
             }
 
@@ -177,31 +290,60 @@ namespace pshellscript::lexer {
                     this->append_token(Token::Type::OrOr);
                     break;
                 }
-                // Error
+                if (this->echo_depth == 0) {
+                    this->echo_depth = -1;
+                }
+                this->append_token(Token::Type::Pipe);
                 break;
             }
 
             case '(': {
+                if (this->at_statement_start() && this->starts_subshell()) {
+                    this->scan_subshell();
+                    break;
+                }
+                this->nesting.push_back('(');
                 this->append_token(Token::Type::LeftParen);
                 break;
             }
 
             case ')': {
+                if (!this->nesting.empty() && this->nesting.back() == '(') {
+                    this->nesting.pop_back();
+                }
                 this->append_token(Token::Type::RightParen);
                 break;
             }
 
             case '{': {
+                if (this->echo_depth >= 0) {
+                    this->echo_depth++;
+                }
+                this->nesting.push_back('{');
                 this->append_token(Token::Type::LeftBrace);
+                this->statement_start = this->current_position;
                 break;
             }
 
             case '}': {
+                if (this->echo_depth >= 0) {
+                    this->echo_depth--;
+                }
+                if (!this->nesting.empty() && this->nesting.back() == '{') {
+                    this->nesting.pop_back();
+                }
                 this->append_token(Token::Type::RightBrace);
+                this->statement_start = this->current_position;
                 break;
             }
 
             case '[': {
+                // `[ expression ]` is the test command.
+                if (this->at_statement_start() && (this->peek() == ' ' || this->peek() == '\t')) {
+                    this->append_token(Token::Type::Command);
+                    this->scan_command_words();
+                    break;
+                }
                 this->append_token(Token::Type::LeftBracket);
                 break;
             }
@@ -217,17 +359,28 @@ namespace pshellscript::lexer {
             }
 
             case '$': {
+                if (this->peek() == '(') {
+                    this->next();
+                    this->scan_substitution();
+                    break;
+                }
                 this->scan_variable();
                 break;
             }
 
             default: {
+                // `./program` or `../program`.
+                if (character == '.' && this->at_statement_start() && (this->peek() == '/' || this->peek() == '.')) {
+                    this->scan_path_command();
+                    break;
+                }
+
                 if (std::isdigit(int(character))) {
                     this->scan_number();
                     break;
                 }
 
-                if (std::isalpha(int(character))) {
+                if (std::isalpha(int(character)) || character == '_') {
                     this->scan_keyword();
                     break;
                 }
@@ -241,34 +394,220 @@ namespace pshellscript::lexer {
             this->next();
         }
 
-        if (this->has_next() && this->peek() == '.') {
+        // Without a fractional part the literal is an integer.
+        if (!this->has_next() || this->peek() != '.') {
+            this->append_token(Token::Type::Integer);
+            return;
+        }
+
+        this->next();
+        while (this->has_next() && std::isdigit(this->peek())) {
             this->next();
-            while (this->has_next() && std::isdigit(this->peek())) {
-                this->next();
-            }
         }
 
         this->append_token(Token::Type::Number);
     }
 
 
+    static inline bool is_name_character(char character) {
+        return std::isalnum(int(character)) || character == '_';
+    }
+
+
+    /**
+     * A string is split around `$name`, `${expression}` and `$(commands)`; a
+     * '$' followed by anything else is kept as is, and `\$` is a literal '$'.
+     * Strings without any are a single String token, as they always were.
+     */
     void LexerState::scan_string() {
+        std::string segment;
+        bool interpolated = false;
+        bool escaped = false;
+
         while (this->has_next() && this->peek() != '"') {
-            this->next();
+            auto character = this->next();
+            if (character == '\\' && this->peek() == '$') {
+                this->next();
+                segment += '$';
+                escaped = true;
+                continue;
+            }
+
+            auto starts_name = std::isalpha(int(this->peek())) || this->peek() == '_';
+            if (character != '$' || !(starts_name || this->peek() == '{' || this->peek() == '(')) {
+                segment += character;
+                continue;
+            }
+
+            auto type = interpolated ? Token::Type::InterpolationPart : Token::Type::InterpolationStart;
+            this->tokens.push_back(Token(type, segment));
+            segment.clear();
+            interpolated = true;
+
+            if (this->peek() == '{') {
+                this->next();
+                this->scan_interpolated_expression();
+                if (!this->errors.empty()) {
+                    return;
+                }
+            } else if (this->peek() == '(') {
+                this->next();
+                this->scan_substitution();
+                if (!this->errors.empty()) {
+                    return;
+                }
+            } else {
+                this->start_position = this->current_position - 1;
+                this->scan_variable();
+            }
         }
 
-        if (this->has_next()) {
-            this->next();
+        if (!this->has_next()) {
+            this->error("Unterminated string");
+            return;
+        }
+        this->next();
+
+        if (interpolated) {
+            this->tokens.push_back(Token(Token::Type::InterpolationEnd, segment));
+        } else if (escaped) {
+            this->tokens.push_back(Token(Token::Type::String, "\"" + segment + "\""));
+        } else {
             this->append_token(Token::Type::String);
+        }
+    }
+
+
+    // Lex the tokens of `${...}` up to the brace that closes it.
+    void LexerState::scan_interpolated_expression() {
+        if (this->depth == max_depth) {
+            this->error("Maximum recursion depth exceeded");
+            return;
+        }
+
+        // A '>' inside is a comparison even in an echo statement.
+        auto echo_depth = this->echo_depth;
+        this->echo_depth = -1;
+        this->depth++;
+
+        long depth = 0;
+        while (this->errors.empty()) {
+            while (this->has_next() && std::isspace(int(this->peek()))) {
+                this->next();
+            }
+
+            if (!this->has_next()) {
+                this->error("Unterminated interpolation");
+                return;
+            }
+
+            if (this->peek() == '}' && depth == 0) {
+                this->next();
+                this->echo_depth = echo_depth;
+                this->depth--;
+                return;
+            }
+
+            depth += this->peek() == '{';
+            depth -= this->peek() == '}';
+            this->start_position = this->current_position;
+            this->scan_token();
+        }
+    }
+
+
+    // Lex statements up to the parenthesis that closes them, with the one
+    // that opens them taken. They start as a line does.
+    void LexerState::scan_statements(Token::Type type, const char* unterminated) {
+        if (this->depth == max_depth) {
+            this->error("Maximum recursion depth exceeded");
             return;
         }
 
-        // this->tokens.push_back(Error("Unterminated string"));
+        this->append_token(type);
+        this->depth++;
+        auto echo_depth = this->echo_depth;
+        auto statement_start = this->statement_start;
+        this->echo_depth = -1;
+        this->statement_start = this->current_position;
+        this->nesting.push_back('$');
+
+        while (this->errors.empty()) {
+            while (this->has_next() && std::isspace(int(this->peek()))) {
+                this->next();
+            }
+
+            if (!this->has_next()) {
+                this->error(unterminated);
+                return;
+            }
+
+            if (this->peek() == ')' && this->nesting.back() == '$') {
+                this->next();
+                this->nesting.pop_back();
+                this->tokens.push_back(Token(Token::Type::RightParen, ")"));
+                this->echo_depth = echo_depth;
+                this->statement_start = statement_start;
+                this->depth--;
+                return;
+            }
+
+            this->start_position = this->current_position;
+            this->scan_token();
+        }
+    }
+
+
+    // Lex the statements of `$(...)`, with the '$(' taken.
+    void LexerState::scan_substitution() {
+        this->start_position = this->current_position - 2;
+        this->scan_statements(Token::Type::SubstitutionStart, "Unterminated command substitution");
+    }
+
+
+    // A lone '&', taken, ends a statement to run in the background. The
+    // statement's source, without surrounding spaces, is the lexeme.
+    void LexerState::scan_background() {
+        if (this->echo_depth == 0) {
+            this->echo_depth = -1;
+        }
+
+        auto start = std::size_t(this->statement_start);
+        auto end = std::size_t(this->current_position - 1);
+        while (start < end && std::isspace(int(this->source[start]))) {
+            start++;
+        }
+        while (end > start && std::isspace(int(this->source[end - 1]))) {
+            end--;
+        }
+
+        this->tokens.push_back(Token(Token::Type::Background, this->source.substr(start, end - start)));
+        this->statement_start = this->current_position;
+    }
+
+
+    // Lex the statements of `( ... )`, with the '(' taken, and the
+    // redirections after it.
+    void LexerState::scan_subshell() {
+        this->scan_statements(Token::Type::SubshellStart, "Unterminated subshell");
+
+        while (this->errors.empty()) {
+            while (this->has_next() && (this->peek() == ' ' || this->peek() == '\t')) {
+                this->next();
+            }
+
+            this->start_position = this->current_position;
+            if (!this->redirection_at(std::size_t(this->current_position))) {
+                this->command_end = long(this->tokens.size());
+                return;
+            }
+            this->scan_redirection();
+        }
     }
 
 
     void LexerState::scan_variable() {
-        while (this->has_next() && std::isalpha(int(this->peek()))) {
+        while (this->has_next() && is_name_character(this->peek())) {
             this->next();
         }
         this->append_token(Token::Type::Variable);
@@ -276,7 +615,7 @@ namespace pshellscript::lexer {
 
 
     void LexerState::scan_keyword() {
-        while (this->has_next() && std::isalpha(int(this->peek()))) {
+        while (this->has_next() && is_name_character(this->peek())) {
             this->next();
         }
 
@@ -284,24 +623,413 @@ namespace pshellscript::lexer {
         auto keyword = this->source.substr(this->start_position, lexeme_length);
 
         if (!keywords.count(keyword)) {
+            // `time` followed by a statement times it, as in other shells.
+            if (keyword == "time" && this->at_statement_start() && this->starts_timed()) {
+                this->append_token(Token::Type::Time);
+                return;
+            }
+
+            if (this->at_statement_start() && this->starts_command()) {
+                this->append_token(Token::Type::Command);
+                this->scan_command_words();
+                return;
+            }
+
             this->append_token(Token::Type::Identifier);
             return;
         }
 
         auto keyword_type = keywords[keyword];
+        if (keyword_type == Token::Type::Echo && this->at_statement_start()) {
+            this->echo_depth = 0;
+        }
+
+        // `true` or `false` alone as a statement runs the command, setting
+        // the status.
+        auto is_boolean = keyword_type == Token::Type::True || keyword_type == Token::Type::False;
+        if (is_boolean && this->at_statement_start() && this->ends_statement()) {
+            this->append_token(Token::Type::Command);
+            this->scan_command_words();
+            return;
+        }
         this->append_token(keyword_type);
     }
 
 
-    std::vector<Token> scan_tokens(const std::string& source) {
+    /**
+     * A name at the start of a statement is a command unless what follows
+     * makes it part of an expression: a call's '(', a dictionary key's ':'
+     * or the end of an argument list or index. A ')' closing a command
+     * substitution or a subshell ends the command instead.
+     */
+    bool LexerState::starts_command() const {
+        auto position = std::size_t(this->current_position);
+        while (position < this->source.size() && (this->source[position] == ' ' || this->source[position] == '\t')) {
+            position++;
+        }
+
+        if (position == this->source.size()) {
+            return true;
+        }
+
+        switch (this->source[position]) {
+            case ')': {
+                return !this->nesting.empty() && this->nesting.back() == '$';
+            }
+
+            case '(': case ':': case ',': case ']': case '=': {
+                return false;
+            }
+
+            default: {
+                return true;
+            }
+        }
+    }
+
+
+    /**
+     * Whether `time` just taken at the start of a statement is followed by
+     * one: something that is not the end of the statement, and would make
+     * a name a command, or a '(' after a space, which opens a subshell
+     * rather than a call.
+     */
+    bool LexerState::starts_timed() const {
+        auto position = std::size_t(this->current_position);
+        while (position < this->source.size() && (this->source[position] == ' ' || this->source[position] == '\t')) {
+            position++;
+        }
+
+        auto spaced = position > std::size_t(this->current_position);
+        if (position < this->source.size() && this->source[position] == '(') {
+            return spaced;
+        }
+        return this->starts_command() && !this->ends_statement();
+    }
+
+
+    /**
+     * Whether the '(' just taken at the start of a statement opens a
+     * subshell rather than an expression: what follows it starts with a
+     * path, `[ `, a statement keyword, a function definition, or a name
+     * that would be a command.
+     */
+    bool LexerState::starts_subshell() const {
+        auto position = std::size_t(this->current_position);
+        while (position < this->source.size() && (this->source[position] == ' ' || this->source[position] == '\t')) {
+            position++;
+        }
+        if (position == this->source.size()) {
+            return false;
+        }
+
+        auto first = this->source[position];
+        auto second = position + 1 < this->source.size() ? this->source[position + 1] : '\0';
+        if (first == '/' || (first == '.' && (second == '/' || second == '.')) || (first == '[' && (second == ' ' || second == '\t'))) {
+            return true;
+        }
+        if (!std::isalpha(int(first)) && first != '_') {
+            return false;
+        }
+
+        auto end = position;
+        while (end < this->source.size() && is_name_character(this->source[end])) {
+            end++;
+        }
+
+        auto keyword = keywords.find(this->source.substr(position, end - position));
+        while (end < this->source.size() && (this->source[end] == ' ' || this->source[end] == '\t')) {
+            end++;
+        }
+
+        if (keyword != keywords.end()) {
+            switch (keyword->second) {
+                case Token::Type::Echo: case Token::Type::If: case Token::Type::For: case Token::Type::Return: {
+                    return true;
+                }
+
+                // A definition, but not a function literal.
+                case Token::Type::Function: {
+                    return end < this->source.size() && this->source[end] != '(';
+                }
+
+                default: {
+                    return false;
+                }
+            }
+        }
+
+        if (end == this->source.size()) {
+            return true;
+        }
+
+        switch (this->source[end]) {
+            case '(': case ':': case ',': case ']': case '=': {
+                return false;
+            }
+
+            default: {
+                return true;
+            }
+        }
+    }
+
+
+    // Whether nothing but a separator, a pipe, a redirection or the `&&` or
+    // `||` of a chain follows.
+    bool LexerState::ends_statement() const {
+        auto position = std::size_t(this->current_position);
+        while (position < this->source.size() && (this->source[position] == ' ' || this->source[position] == '\t')) {
+            position++;
+        }
+
+        if (position == this->source.size()) {
+            return true;
+        }
+
+        auto character = this->source[position];
+        return character == ';' || character == '}' || character == '\n'
+            || character == '|' || character == '&'
+            || this->redirection_at(position);
+    }
+
+
+    // A command named by its path, such as `/bin/ls`, is never an expression.
+    void LexerState::scan_path_command() {
+        while (this->has_next() && !ends_word(this->peek())) {
+            this->next();
+        }
+        this->append_token(Token::Type::Command);
+        this->scan_command_words();
+    }
+
+
+    // Lex a command's arguments, up to the separator that ends the command.
+    void LexerState::scan_command_words() {
+        while (this->errors.empty()) {
+            while (this->has_next() && std::isspace(int(this->peek()))) {
+                this->next();
+            }
+
+            this->start_position = this->current_position;
+            if (this->redirection_at(std::size_t(this->current_position))) {
+                this->scan_redirection();
+                continue;
+            }
+
+            if (!this->has_next() || ends_word(this->peek())) {
+                this->command_end = long(this->tokens.size());
+                return;
+            }
+            this->scan_word();
+        }
+    }
+
+
+    // Whether a redirection, optionally preceded by the descriptor it
+    // applies to, starts at `position` among a command's words.
+    bool LexerState::redirection_at(std::size_t position) const {
+        if (position < this->source.size() && std::isdigit(int(this->source[position]))) {
+            position++;
+        }
+        return position < this->source.size() && (this->source[position] == '<' || this->source[position] == '>');
+    }
+
+
+    /**
+     * After an echo statement's expression, `>>` always redirects it, and
+     * `>` does when a bare file name follows: a path, or a name that is not
+     * a keyword or a call. Anything else keeps `>` a comparison, so that
+     * `echo 2 > 1` and `echo $a > $b` mean what they always did. `>&2`
+     * sends the text to standard error. Called with the first '>' taken.
+     */
+    bool LexerState::redirects_echo() const {
+        if (this->echo_depth != 0) {
+            return false;
+        }
+
+        auto position = std::size_t(this->current_position);
+        if (position < this->source.size() && (this->source[position] == '>' || this->source[position] == '&')) {
+            return true;
+        }
+
+        while (position < this->source.size() && (this->source[position] == ' ' || this->source[position] == '\t')) {
+            position++;
+        }
+        if (position == this->source.size()) {
+            return false;
+        }
+
+        auto first = this->source[position];
+        if (first == '/' || first == '.') {
+            return true;
+        }
+        if (!std::isalpha(int(first)) && first != '_') {
+            return false;
+        }
+
+        auto end = position;
+        while (end < this->source.size() && is_name_character(this->source[end])) {
+            end++;
+        }
+        if (keywords.count(this->source.substr(position, end - position))) {
+            return false;
+        }
+        while (end < this->source.size() && (this->source[end] == ' ' || this->source[end] == '\t')) {
+            end++;
+        }
+        return end == this->source.size() || this->source[end] != '(';
+    }
+
+
+    // Lex a redirection operator, and the file it names unless it copies
+    // another descriptor.
+    void LexerState::scan_redirection() {
+        this->start_position = this->current_position;
+        if (std::isdigit(int(this->peek()))) {
+            this->next();
+        }
+
+        auto direction = this->next();
+        if (direction == '>' && this->peek() == '>') {
+            this->next();
+        }
+
+        bool duplicates = false;
+        if (this->peek() == '&') {
+            this->next();
+            if (!std::isdigit(int(this->peek()))) {
+                this->error("Expected a file descriptor after '&'");
+                return;
+            }
+            this->next();
+            duplicates = true;
+        }
+        this->append_token(Token::Type::Redirect);
+
+        if (duplicates) {
+            return;
+        }
+
+        while (this->has_next() && (this->peek() == ' ' || this->peek() == '\t')) {
+            this->next();
+        }
+        if (!this->has_next() || ends_word(this->peek())) {
+            this->error("Expected a file to redirect to");
+            return;
+        }
+        this->start_position = this->current_position;
+        this->scan_word();
+    }
+
+
+    /**
+     * Lex one argument of a command. A double-quoted argument is a string as
+     * it is anywhere else, and a single-quoted one is taken literally. A bare
+     * word ends at whitespace or a separator; `\` keeps the character after
+     * it as it is, and `$name`, `${expression}` and `$(commands)` are
+     * interpolated. A word that is only `$name` is lexed as the variable, so
+     * that an array passed that way can become one argument per element; a
+     * substitution is always one argument.
+     */
+    void LexerState::scan_word() {
+        if (this->peek() == '"') {
+            this->next();
+            this->scan_string();
+            return;
+        }
+
+        if (this->peek() == '\'') {
+            this->next();
+            auto start = std::size_t(this->current_position);
+            while (this->has_next() && this->peek() != '\'') {
+                this->next();
+            }
+            if (!this->has_next()) {
+                this->error("Unterminated string");
+                return;
+            }
+            this->tokens.push_back(Token(Token::Type::Word, this->source.substr(start, this->current_position - start)));
+            this->next();
+            return;
+        }
+
+        std::string segment;
+        bool interpolated = false;
+
+        while (this->has_next() && !ends_word(this->peek()) && this->peek() != '"' && this->peek() != '\'') {
+            auto character = this->next();
+            if (character == '\\' && this->has_next()) {
+                segment += this->next();
+                continue;
+            }
+
+            // `{}`, parallel's placeholder, is part of the word rather than
+            // a '}' that ends it.
+            if (character == '{' && this->peek() == '}') {
+                segment += character;
+                segment += this->next();
+                continue;
+            }
+
+            auto starts_name = std::isalpha(int(this->peek())) || this->peek() == '_';
+            if (character != '$' || !(starts_name || this->peek() == '{' || this->peek() == '(')) {
+                segment += character;
+                continue;
+            }
+
+            if (!interpolated && segment.empty() && starts_name) {
+                auto name_end = std::size_t(this->current_position);
+                while (name_end < this->source.size() && is_name_character(this->source[name_end])) {
+                    name_end++;
+                }
+                if (name_end == this->source.size() || ends_word(this->source[name_end])) {
+                    this->start_position = this->current_position - 1;
+                    this->scan_variable();
+                    return;
+                }
+            }
+
+            auto type = interpolated ? Token::Type::InterpolationPart : Token::Type::InterpolationStart;
+            this->tokens.push_back(Token(type, segment));
+            segment.clear();
+            interpolated = true;
+
+            if (this->peek() == '{') {
+                this->next();
+                this->scan_interpolated_expression();
+                if (!this->errors.empty()) {
+                    return;
+                }
+            } else if (this->peek() == '(') {
+                this->next();
+                this->scan_substitution();
+                if (!this->errors.empty()) {
+                    return;
+                }
+            } else {
+                this->start_position = this->current_position - 1;
+                this->scan_variable();
+            }
+        }
+
+        auto type = interpolated ? Token::Type::InterpolationEnd : Token::Type::Word;
+        this->tokens.push_back(Token(type, segment));
+    }
+
+
+    Result<std::vector<Token>> scan_tokens(const std::string& source) {
         LexerState state(source);
 
-        while (state.has_next()) {
+        while (state.has_next() && state.errors.empty()) {
             state.scan_token();
             state.start_position = state.current_position;
         }
 
-        return state.tokens;
+        if (!state.errors.empty()) {
+            return state.errors.front();
+        }
+        return std::move(state.tokens);
     }
 
 };
\ No newline at end of file
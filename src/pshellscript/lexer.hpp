@@ -8,7 +8,7 @@
 #include "../result.hpp"
 
 namespace pshellscript::lexer {
-    std::vector<Token> scan_tokens(const std::string& source);
+    Result<std::vector<Token>> scan_tokens(const std::string& source);
 }
 
 #endif
\ No newline at end of file
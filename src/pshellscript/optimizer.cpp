@@ -0,0 +1,1819 @@
+#include <set>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include "optimizer.hpp"
+
+namespace pshellscript::optimizer {
+    static std::unique_ptr<ast::BaseNode> make_binary(
+        ast::NodeType type,
+        std::unique_ptr<ast::BaseNode> left,
+        std::unique_ptr<ast::BaseNode> right
+    ) {
+        using Type = ast::NodeType;
+        switch (type) {
+            case Type::AddExpression: {
+                return std::make_unique<ast::AdditionNode>(std::move(left), std::move(right));
+            }
+
+            case Type::SubtractExpression: {
+                return std::make_unique<ast::SubtractionNode>(std::move(left), std::move(right));
+            }
+
+            case Type::MultiplyExpression: {
+                return std::make_unique<ast::MultiplicationNode>(std::move(left), std::move(right));
+            }
+
+            case Type::DivideExpression: {
+                return std::make_unique<ast::DivisionNode>(std::move(left), std::move(right));
+            }
+
+            case Type::ModuloExpression: {
+                return std::make_unique<ast::ModuloNode>(std::move(left), std::move(right));
+            }
+
+            case Type::AndExpression: {
+                return std::make_unique<ast::AndNode>(std::move(left), std::move(right));
+            }
+
+            case Type::OrExpression: {
+                return std::make_unique<ast::OrNode>(std::move(left), std::move(right));
+            }
+
+            case Type::LessExpression: {
+                return std::make_unique<ast::LessNode>(std::move(left), std::move(right));
+            }
+
+            case Type::LessEqualExpression: {
+                return std::make_unique<ast::LessEqualNode>(std::move(left), std::move(right));
+            }
+
+            case Type::GreaterExpression: {
+                return std::make_unique<ast::GreaterNode>(std::move(left), std::move(right));
+            }
+
+            case Type::GreaterEqualExpression: {
+                return std::make_unique<ast::GreaterEqualNode>(std::move(left), std::move(right));
+            }
+
+            case Type::EqualityExpression: {
+                return std::make_unique<ast::EqualityNode>(std::move(left), std::move(right));
+            }
+
+            case Type::InequalityExpression: {
+                return std::make_unique<ast::InequalityNode>(std::move(left), std::move(right));
+            }
+
+            case Type::MatchExpression: {
+                return std::make_unique<ast::MatchNode>(std::move(left), std::move(right));
+            }
+
+            case Type::AssignmentExpression: {
+                return std::make_unique<ast::AssignmentNode>(std::move(left), std::move(right));
+            }
+
+            case Type::PlusEqualExpression: {
+                return std::make_unique<ast::PlusEqualNode>(std::move(left), std::move(right));
+            }
+
+            case Type::MinusEqualExpression: {
+                return std::make_unique<ast::MinusEqualNode>(std::move(left), std::move(right));
+            }
+
+            case Type::TimesEqualExpression: {
+                return std::make_unique<ast::TimesEqualNode>(std::move(left), std::move(right));
+            }
+
+            case Type::DivideEqualExpression: {
+                return std::make_unique<ast::DivideEqualNode>(std::move(left), std::move(right));
+            }
+
+            case Type::ModuloEqualExpression: {
+                return std::make_unique<ast::ModuloEqualNode>(std::move(left), std::move(right));
+            }
+
+            case Type::IndexExpression: {
+                return std::make_unique<ast::IndexNode>(std::move(left), std::move(right));
+            }
+
+            default: {
+                return nullptr;
+            }
+        }
+    }
+
+
+    static std::unique_ptr<ast::StatementListNode> clone_block(const ast::StatementListNode& block, int slot_offset) {
+        std::vector<std::unique_ptr<ast::BaseNode>> statements;
+        statements.reserve(block.statements.size());
+
+        for (const auto& statement : block.statements) {
+            statements.push_back(clone(statement.get(), slot_offset));
+        }
+
+        return std::make_unique<ast::StatementListNode>(std::move(statements));
+    }
+
+
+    static std::unique_ptr<ast::VariableNode> clone_variable(const ast::VariableNode& variable, int slot_offset) {
+        auto slot = variable.slot >= 0 ? variable.slot + slot_offset : -1;
+        auto copy = std::make_unique<ast::VariableNode>(variable.name, slot);
+        copy->capture = variable.capture;
+        copy->boxed = variable.boxed;
+        return copy;
+    }
+
+
+    static std::unique_ptr<ast::ArgListNode> clone_arguments(const ast::ArgListNode& arguments, int slot_offset) {
+        std::vector<std::unique_ptr<ast::BaseNode>> copies;
+        for (const auto& argument : arguments.arguments) {
+            copies.push_back(clone(argument.get(), slot_offset));
+        }
+        return std::make_unique<ast::ArgListNode>(std::move(copies));
+    }
+
+
+    static std::unique_ptr<ast::FunctionCallNode> clone_call(const ast::FunctionCallNode& call, int slot_offset) {
+        return std::make_unique<ast::FunctionCallNode>(
+            std::make_unique<ast::IdentifierNode>(call.name->name),
+            clone_arguments(*call.arguments, slot_offset)
+        );
+    }
+
+
+    std::unique_ptr<ast::BaseNode> clone(const ast::BaseNode* node, int slot_offset) {
+        using Type = ast::NodeType;
+        if (node == nullptr) {
+            return nullptr;
+        }
+
+        switch (node->type) {
+            case Type::Number: {
+                return std::make_unique<ast::NumberNode>(dynamic_cast<const ast::NumberNode*>(node)->value);
+            }
+
+            case Type::Integer: {
+                return std::make_unique<ast::IntegerNode>(dynamic_cast<const ast::IntegerNode*>(node)->value);
+            }
+
+            case Type::String: {
+                return std::make_unique<ast::StringNode>(dynamic_cast<const ast::StringNode*>(node)->value);
+            }
+
+            case Type::Boolean: {
+                return std::make_unique<ast::BooleanNode>(dynamic_cast<const ast::BooleanNode*>(node)->value);
+            }
+
+            case Type::Variable: {
+                return clone_variable(*dynamic_cast<const ast::VariableNode*>(node), slot_offset);
+            }
+
+            case Type::Identifier: {
+                return std::make_unique<ast::IdentifierNode>(dynamic_cast<const ast::IdentifierNode*>(node)->name);
+            }
+
+            case Type::StatementList: {
+                return clone_block(*dynamic_cast<const ast::StatementListNode*>(node), slot_offset);
+            }
+
+            case Type::Interpolation: {
+                auto interpolation = dynamic_cast<const ast::InterpolationNode*>(node);
+                std::vector<std::unique_ptr<ast::BaseNode>> values;
+                for (const auto& value : interpolation->values) {
+                    values.push_back(clone(value.get(), slot_offset));
+                }
+                auto segments = interpolation->segments;
+                return std::make_unique<ast::InterpolationNode>(std::move(segments), std::move(values));
+            }
+
+            case Type::ArrayLiteral: {
+                std::vector<std::unique_ptr<ast::BaseNode>> elements;
+                for (const auto& element : dynamic_cast<const ast::ArrayLiteralNode*>(node)->elements) {
+                    elements.push_back(clone(element.get(), slot_offset));
+                }
+                return std::make_unique<ast::ArrayLiteralNode>(std::move(elements));
+            }
+
+            case Type::DictionaryLiteral: {
+                auto literal = dynamic_cast<const ast::DictionaryLiteralNode*>(node);
+                std::vector<std::unique_ptr<ast::BaseNode>> keys;
+                std::vector<std::unique_ptr<ast::BaseNode>> values;
+                for (std::size_t i = 0; i < literal->keys.size(); i++) {
+                    keys.push_back(clone(literal->keys[i].get(), slot_offset));
+                    values.push_back(clone(literal->values[i].get(), slot_offset));
+                }
+                return std::make_unique<ast::DictionaryLiteralNode>(std::move(keys), std::move(values));
+            }
+
+            case Type::ForEachLoop: {
+                auto loop = dynamic_cast<const ast::ForEachNode*>(node);
+                return std::make_unique<ast::ForEachNode>(
+                    clone_variable(*loop->variable, slot_offset),
+                    clone(loop->iterable.get(), slot_offset),
+                    clone_block(*loop->body, slot_offset)
+                );
+            }
+
+            case Type::ForLoop: {
+                auto loop = dynamic_cast<const ast::ForLoopNode*>(node);
+                return std::make_unique<ast::ForLoopNode>(
+                    clone(loop->initialization.get(), slot_offset),
+                    clone(loop->condition.get(), slot_offset),
+                    clone(loop->update.get(), slot_offset),
+                    clone_block(*loop->body, slot_offset)
+                );
+            }
+
+            case Type::IfStatement: {
+                auto branch = dynamic_cast<const ast::IfStatementNode*>(node);
+                return std::make_unique<ast::IfStatementNode>(
+                    clone(branch->condition.get(), slot_offset),
+                    clone_block(*branch->body, slot_offset),
+                    clone(branch->else_clause.get(), slot_offset)
+                );
+            }
+
+            case Type::FunctionDefinition: {
+                // A nested definition owns its frame, so its slots stay put.
+                auto definition = dynamic_cast<const ast::FunctionDefinitionNode*>(node);
+                std::vector<std::unique_ptr<ast::VariableNode>> parameters;
+                for (const auto& parameter : definition->parameters->parameters) {
+                    parameters.push_back(clone_variable(*parameter, 0));
+                }
+
+                auto copy = std::make_unique<ast::FunctionDefinitionNode>(
+                    definition->name,
+                    std::make_unique<ast::ParamListNode>(std::move(parameters)),
+                    clone_block(*definition->body, 0)
+                );
+                copy->memoize = definition->memoize;
+                copy->frame_size = definition->frame_size;
+                copy->boxed_slots = definition->boxed_slots;
+                return copy;
+            }
+
+            case Type::FunctionLiteral: {
+                // The body keeps its own frame, but captures taken from a
+                // frame slot move with the enclosing function's slots.
+                auto literal = dynamic_cast<const ast::FunctionLiteralNode*>(node);
+                auto captures = literal->captures;
+                for (auto& capture : captures) {
+                    if (!capture.from_capture) {
+                        capture.index += slot_offset;
+                    }
+                }
+
+                auto definition = clone(literal->definition.get(), 0);
+                return std::make_unique<ast::FunctionLiteralNode>(
+                    std::shared_ptr<ast::FunctionDefinitionNode>(
+                        dynamic_cast<ast::FunctionDefinitionNode*>(definition.release())
+                    ),
+                    std::move(captures)
+                );
+            }
+
+            case Type::ValueCall: {
+                auto call = dynamic_cast<const ast::ValueCallNode*>(node);
+                return std::make_unique<ast::ValueCallNode>(
+                    clone(call->callee.get(), slot_offset),
+                    clone_arguments(*call->arguments, slot_offset)
+                );
+            }
+
+            case Type::EchoStatement: {
+                auto echo = dynamic_cast<const ast::EchoStatementNode*>(node);
+                return std::make_unique<ast::EchoStatementNode>(clone(echo->argument.get(), slot_offset));
+            }
+
+            case Type::Command: {
+                auto command = dynamic_cast<const ast::CommandNode*>(node);
+                std::vector<std::unique_ptr<ast::BaseNode>> arguments;
+                for (const auto& argument : command->arguments) {
+                    arguments.push_back(clone(argument.get(), slot_offset));
+                }
+                return std::make_unique<ast::CommandNode>(command->name, std::move(arguments));
+            }
+
+            case Type::Pipeline: {
+                std::vector<std::unique_ptr<ast::BaseNode>> stages;
+                for (const auto& stage : dynamic_cast<const ast::PipelineNode*>(node)->stages) {
+                    stages.push_back(clone(stage.get(), slot_offset));
+                }
+                return std::make_unique<ast::PipelineNode>(std::move(stages));
+            }
+
+            case Type::Substitution: {
+                auto substitution = dynamic_cast<const ast::SubstitutionNode*>(node);
+                return std::make_unique<ast::SubstitutionNode>(clone_block(*substitution->body, slot_offset));
+            }
+
+            case Type::Subshell: {
+                auto subshell = dynamic_cast<const ast::SubshellNode*>(node);
+                return std::make_unique<ast::SubshellNode>(clone_block(*subshell->body, slot_offset));
+            }
+
+            case Type::Background: {
+                auto background = dynamic_cast<const ast::BackgroundNode*>(node);
+                return std::make_unique<ast::BackgroundNode>(clone(background->statement.get(), slot_offset), background->command);
+            }
+
+            case Type::Timed: {
+                auto timed = dynamic_cast<const ast::TimedNode*>(node);
+                return std::make_unique<ast::TimedNode>(clone(timed->statement.get(), slot_offset));
+            }
+
+            case Type::Chain: {
+                auto chain = dynamic_cast<const ast::ChainNode*>(node);
+                return std::make_unique<ast::ChainNode>(
+                    clone(chain->left.get(), slot_offset), clone(chain->right.get(), slot_offset), chain->on_success
+                );
+            }
+
+            case Type::Redirection: {
+                auto redirected = dynamic_cast<const ast::RedirectionNode*>(node);
+                std::vector<ast::Redirection> redirections;
+                for (const auto& redirection : redirected->redirections) {
+                    redirections.push_back(ast::Redirection {
+                        redirection.kind,
+                        redirection.descriptor,
+                        redirection.source,
+                        clone(redirection.target.get(), slot_offset)
+                    });
+                }
+                return std::make_unique<ast::RedirectionNode>(
+                    clone(redirected->statement.get(), slot_offset),
+                    std::move(redirections)
+                );
+            }
+
+            case Type::ReturnStatement: {
+                auto statement = dynamic_cast<const ast::ReturnStatementNode*>(node);
+                return std::make_unique<ast::ReturnStatementNode>(clone(statement->argument.get(), slot_offset));
+            }
+
+            case Type::FunctionCall: {
+                return clone_call(*dynamic_cast<const ast::FunctionCallNode*>(node), slot_offset);
+            }
+
+            case Type::InlinedCall: {
+                auto inlined = dynamic_cast<const ast::InlinedCallNode*>(node);
+                return std::make_unique<ast::InlinedCallNode>(
+                    clone_call(*inlined->call, slot_offset),
+                    inlined->callee,
+                    clone_block(*inlined->body, slot_offset),
+                    inlined->base_slot + slot_offset,
+                    inlined->slot_count
+                );
+            }
+
+            case Type::LogicalNegationExpression: {
+                auto unary = dynamic_cast<const ast::UnaryExpressionNode*>(node);
+                return std::make_unique<ast::NotExpressionNode>(clone(unary->argument.get(), slot_offset));
+            }
+
+            case Type::ArithmeticNegationExpression: {
+                auto unary = dynamic_cast<const ast::UnaryExpressionNode*>(node);
+                return std::make_unique<ast::NegationExpressionNode>(clone(unary->argument.get(), slot_offset));
+            }
+
+            default: {
+                auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(node);
+                if (binary == nullptr) {
+                    return nullptr;
+                }
+
+                return make_binary(
+                    binary->type,
+                    clone(binary->left_argument.get(), slot_offset),
+                    clone(binary->right_argument.get(), slot_offset)
+                );
+            }
+        }
+    }
+
+
+    void for_each_child(const ast::BaseNode& node, const std::function<void(const ast::BaseNode*)>& visit) {
+        using Type = ast::NodeType;
+        switch (node.type) {
+            case Type::StatementList: {
+                for (const auto& statement : dynamic_cast<const ast::StatementListNode&>(node).statements) {
+                    visit(statement.get());
+                }
+                return;
+            }
+
+            case Type::ForLoop: {
+                auto& loop = dynamic_cast<const ast::ForLoopNode&>(node);
+                visit(loop.initialization.get());
+                visit(loop.condition.get());
+                visit(loop.update.get());
+                visit(loop.body.get());
+                return;
+            }
+
+            case Type::ForEachLoop: {
+                auto& loop = dynamic_cast<const ast::ForEachNode&>(node);
+                visit(loop.variable.get());
+                visit(loop.iterable.get());
+                visit(loop.body.get());
+                return;
+            }
+
+            case Type::Interpolation: {
+                for (const auto& value : dynamic_cast<const ast::InterpolationNode&>(node).values) {
+                    visit(value.get());
+                }
+                return;
+            }
+
+            case Type::ArrayLiteral: {
+                for (const auto& element : dynamic_cast<const ast::ArrayLiteralNode&>(node).elements) {
+                    visit(element.get());
+                }
+                return;
+            }
+
+            case Type::DictionaryLiteral: {
+                auto& literal = dynamic_cast<const ast::DictionaryLiteralNode&>(node);
+                for (std::size_t i = 0; i < literal.keys.size(); i++) {
+                    visit(literal.keys[i].get());
+                    visit(literal.values[i].get());
+                }
+                return;
+            }
+
+            case Type::IfStatement: {
+                auto& branch = dynamic_cast<const ast::IfStatementNode&>(node);
+                visit(branch.condition.get());
+                visit(branch.body.get());
+                visit(branch.else_clause.get());
+                return;
+            }
+
+            case Type::FunctionDefinition: {
+                visit(dynamic_cast<const ast::FunctionDefinitionNode&>(node).body.get());
+                return;
+            }
+
+            case Type::FunctionLiteral: {
+                visit(dynamic_cast<const ast::FunctionLiteralNode&>(node).definition->body.get());
+                return;
+            }
+
+            case Type::EchoStatement: {
+                visit(dynamic_cast<const ast::EchoStatementNode&>(node).argument.get());
+                return;
+            }
+
+            case Type::Command: {
+                for (const auto& argument : dynamic_cast<const ast::CommandNode&>(node).arguments) {
+                    visit(argument.get());
+                }
+                return;
+            }
+
+            case Type::Pipeline: {
+                for (const auto& stage : dynamic_cast<const ast::PipelineNode&>(node).stages) {
+                    visit(stage.get());
+                }
+                return;
+            }
+
+            case Type::Substitution: {
+                visit(dynamic_cast<const ast::SubstitutionNode&>(node).body.get());
+                return;
+            }
+
+            case Type::Subshell: {
+                visit(dynamic_cast<const ast::SubshellNode&>(node).body.get());
+                return;
+            }
+
+            case Type::Background: {
+                visit(dynamic_cast<const ast::BackgroundNode&>(node).statement.get());
+                return;
+            }
+
+            case Type::Timed: {
+                visit(dynamic_cast<const ast::TimedNode&>(node).statement.get());
+                return;
+            }
+
+            case Type::Chain: {
+                auto& chain = dynamic_cast<const ast::ChainNode&>(node);
+                visit(chain.left.get());
+                visit(chain.right.get());
+                return;
+            }
+
+            case Type::Redirection: {
+                auto& redirected = dynamic_cast<const ast::RedirectionNode&>(node);
+                visit(redirected.statement.get());
+                for (const auto& redirection : redirected.redirections) {
+                    visit(redirection.target.get());
+                }
+                return;
+            }
+
+            case Type::ReturnStatement: {
+                visit(dynamic_cast<const ast::ReturnStatementNode&>(node).argument.get());
+                return;
+            }
+
+            case Type::FunctionCall: {
+                for (const auto& argument : dynamic_cast<const ast::FunctionCallNode&>(node).arguments->arguments) {
+                    visit(argument.get());
+                }
+                return;
+            }
+
+            case Type::ValueCall: {
+                auto& call = dynamic_cast<const ast::ValueCallNode&>(node);
+                visit(call.callee.get());
+                for (const auto& argument : call.arguments->arguments) {
+                    visit(argument.get());
+                }
+                return;
+            }
+
+            case Type::InlinedCall: {
+                auto& inlined = dynamic_cast<const ast::InlinedCallNode&>(node);
+                visit(inlined.call.get());
+                visit(inlined.body.get());
+                return;
+            }
+
+            case Type::LogicalNegationExpression:
+            case Type::ArithmeticNegationExpression: {
+                visit(dynamic_cast<const ast::UnaryExpressionNode&>(node).argument.get());
+                return;
+            }
+
+            default: {
+                auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(&node);
+                if (binary != nullptr) {
+                    visit(binary->left_argument.get());
+                    visit(binary->right_argument.get());
+                }
+                return;
+            }
+        }
+    }
+
+
+    std::size_t count_nodes(const ast::BaseNode* node) {
+        if (node == nullptr) {
+            return 0;
+        }
+
+        std::size_t count = 1;
+        for_each_child(*node, [&](const ast::BaseNode* child) {
+            count += count_nodes(child);
+        });
+        return count;
+    }
+
+
+    static void collect_callees(const ast::BaseNode* node, std::set<std::string>& callees) {
+        if (node == nullptr) {
+            return;
+        }
+
+        if (node->type == ast::NodeType::FunctionCall) {
+            callees.insert(dynamic_cast<const ast::FunctionCallNode*>(node)->name->name);
+        }
+
+        for_each_child(*node, [&](const ast::BaseNode* child) {
+            collect_callees(child, callees);
+        });
+    }
+
+
+    static bool contains_definition(const ast::BaseNode* node) {
+        if (node == nullptr) {
+            return false;
+        }
+
+        if (node->type == ast::NodeType::FunctionDefinition || node->type == ast::NodeType::FunctionLiteral) {
+            return true;
+        }
+
+        bool found = false;
+        for_each_child(*node, [&](const ast::BaseNode* child) {
+            found = found || contains_definition(child);
+        });
+        return found;
+    }
+
+
+    /**
+     * Decide the truth of a condition that does not depend on run-time state,
+     * using the same rules as the VM. Returns false if it is not constant.
+     */
+    static bool constant_truth(const ast::BaseNode* node, bool& truth) {
+        using Type = ast::NodeType;
+        if (node == nullptr) {
+            return false;
+        }
+
+        switch (node->type) {
+            case Type::Boolean: {
+                truth = dynamic_cast<const ast::BooleanNode*>(node)->value;
+                return true;
+            }
+
+            case Type::Number: {
+                truth = dynamic_cast<const ast::NumberNode*>(node)->value != 0;
+                return true;
+            }
+
+            case Type::Integer: {
+                truth = dynamic_cast<const ast::IntegerNode*>(node)->value != 0;
+                return true;
+            }
+
+            case Type::String: {
+                truth = !dynamic_cast<const ast::StringNode*>(node)->value.empty();
+                return true;
+            }
+
+            case Type::LogicalNegationExpression: {
+                bool inner = false;
+                if (!constant_truth(dynamic_cast<const ast::UnaryExpressionNode*>(node)->argument.get(), inner)) {
+                    return false;
+                }
+                truth = !inner;
+                return true;
+            }
+
+            default: {
+                return false;
+            }
+        }
+    }
+
+
+    static inline bool is_assignment(const ast::BaseNode* node) {
+        using Type = ast::NodeType;
+        if (node == nullptr) {
+            return false;
+        }
+
+        switch (node->type) {
+            case Type::AssignmentExpression:
+            case Type::PlusEqualExpression:
+            case Type::MinusEqualExpression:
+            case Type::TimesEqualExpression:
+            case Type::DivideEqualExpression:
+            case Type::ModuloEqualExpression: {
+                return true;
+            }
+
+            default: {
+                return false;
+            }
+        }
+    }
+
+
+    /**
+     * The local variable a plain `$x = ...` statement stores to, if any.
+     */
+    static const ast::VariableNode* local_store_target(const ast::BaseNode* node) {
+        if (node == nullptr || node->type != ast::NodeType::AssignmentExpression) {
+            return nullptr;
+        }
+
+        auto target = dynamic_cast<const ast::BinaryExpressionNode*>(node)->left_argument.get();
+        if (target == nullptr || target->type != ast::NodeType::Variable) {
+            return nullptr;
+        }
+
+        // A closure may read a boxed variable at any time.
+        auto variable = dynamic_cast<const ast::VariableNode*>(target);
+        return variable->slot >= 0 && !variable->boxed ? variable : nullptr;
+    }
+
+
+    /**
+     * Whether evaluating an expression can neither fail nor change anything.
+     * Arithmetic and comparisons are excluded since they throw on bad operands.
+     */
+    static bool is_inert(const ast::BaseNode* node) {
+        using Type = ast::NodeType;
+        if (node == nullptr) {
+            return true;
+        }
+
+        switch (node->type) {
+            case Type::Number:
+            case Type::Integer:
+            case Type::String:
+            case Type::Boolean:
+            case Type::Variable: {
+                return true;
+            }
+
+            case Type::LogicalNegationExpression: {
+                return is_inert(dynamic_cast<const ast::UnaryExpressionNode*>(node)->argument.get());
+            }
+
+            case Type::AndExpression:
+            case Type::OrExpression:
+            case Type::EqualityExpression:
+            case Type::InequalityExpression: {
+                auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(node);
+                return is_inert(binary->left_argument.get()) && is_inert(binary->right_argument.get());
+            }
+
+            default: {
+                return false;
+            }
+        }
+    }
+
+
+    static void count_local_reads(const ast::BaseNode* node, std::map<int, std::size_t>& reads) {
+        if (node == nullptr || node->type == ast::NodeType::FunctionDefinition) {
+            return;
+        }
+
+        if (node->type == ast::NodeType::Variable) {
+            auto variable = dynamic_cast<const ast::VariableNode*>(node);
+            if (variable->slot >= 0) {
+                reads[variable->slot]++;
+            }
+            return;
+        }
+
+        // A literal reads the slots it captures when it is evaluated; its
+        // body has a frame of its own.
+        if (node->type == ast::NodeType::FunctionLiteral) {
+            for (const auto& capture : dynamic_cast<const ast::FunctionLiteralNode*>(node)->captures) {
+                if (!capture.from_capture) {
+                    reads[capture.index]++;
+                }
+            }
+            return;
+        }
+
+        if (is_assignment(node)) {
+            // The target of a plain assignment is written, not read; compound
+            // assignments read it first. Storing into an element reads the
+            // variable holding the array.
+            auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(node);
+            auto target = binary->left_argument.get();
+            if (node->type != ast::NodeType::AssignmentExpression || (target && target->type != ast::NodeType::Variable)) {
+                count_local_reads(target, reads);
+            }
+            count_local_reads(binary->right_argument.get(), reads);
+            return;
+        }
+
+        for_each_child(*node, [&](const ast::BaseNode* child) {
+            count_local_reads(child, reads);
+        });
+    }
+
+
+    static bool reads_local(const ast::BaseNode* node, int slot) {
+        std::map<int, std::size_t> reads;
+        count_local_reads(node, reads);
+        return reads.count(slot) != 0;
+    }
+
+
+    struct DeadCodeEliminator {
+        Report& report;
+
+        // Reads of each local slot anywhere in the function being simplified.
+        std::map<int, std::size_t> local_reads;
+
+
+        inline DeadCodeEliminator(Report& report) : report(report) {}
+
+
+        /**
+         * Whether the local stored by statement `index` is overwritten before
+         * anything reads it, or the function returns first.
+         */
+        bool is_overwritten(const ast::StatementListNode& block, std::size_t index, int slot) const {
+            for (auto i = index + 1; i < block.statements.size(); i++) {
+                auto statement = block.statements[i].get();
+
+                auto target = local_store_target(statement);
+                if (target != nullptr && target->slot == slot) {
+                    auto value = dynamic_cast<const ast::BinaryExpressionNode*>(statement)->right_argument.get();
+                    return !reads_local(value, slot);
+                }
+
+                if (reads_local(statement, slot)) {
+                    return false;
+                }
+
+                if (statement && statement->type == ast::NodeType::ReturnStatement) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+
+        /**
+         * Replace an if statement whose condition is constant by the branch
+         * that will run, which may be nothing.
+         */
+        std::unique_ptr<ast::BaseNode> fold_branch(std::unique_ptr<ast::BaseNode> node) {
+            while (node && node->type == ast::NodeType::IfStatement) {
+                auto& branch = dynamic_cast<ast::IfStatementNode&>(*node);
+                bool truth = false;
+                if (!constant_truth(branch.condition.get(), truth)) {
+                    break;
+                }
+
+                this->report.removed_branches++;
+                node = truth ? std::move(branch.body) : std::move(branch.else_clause);
+            }
+
+            return node;
+        }
+
+
+        void simplify_children(ast::BaseNode& statement) {
+            switch (statement.type) {
+                case ast::NodeType::ForLoop: {
+                    this->simplify(*dynamic_cast<ast::ForLoopNode&>(statement).body);
+                    return;
+                }
+
+                case ast::NodeType::ForEachLoop: {
+                    this->simplify(*dynamic_cast<ast::ForEachNode&>(statement).body);
+                    return;
+                }
+
+                case ast::NodeType::IfStatement: {
+                    auto& branch = dynamic_cast<ast::IfStatementNode&>(statement);
+                    this->simplify(*branch.body);
+                    branch.else_clause = this->fold_branch(std::move(branch.else_clause));
+                    if (branch.else_clause) {
+                        this->simplify_children(*branch.else_clause);
+                    }
+                    return;
+                }
+
+                case ast::NodeType::StatementList: {
+                    this->simplify(dynamic_cast<ast::StatementListNode&>(statement));
+                    return;
+                }
+
+                default: {
+                    return;
+                }
+            }
+        }
+
+
+        void simplify(ast::StatementListNode& block) {
+            std::vector<std::unique_ptr<ast::BaseNode>> statements;
+            bool returned = false;
+
+            std::function<void(std::unique_ptr<ast::BaseNode>)> append = [&](std::unique_ptr<ast::BaseNode> statement) {
+                if (returned) {
+                    this->report.unreachable_statements++;
+                    return;
+                }
+
+                statement = this->fold_branch(std::move(statement));
+                if (statement == nullptr) {
+                    return;
+                }
+
+                // The surviving branch of a folded if is spliced into this list.
+                if (statement->type == ast::NodeType::StatementList) {
+                    for (auto& inner : dynamic_cast<ast::StatementListNode&>(*statement).statements) {
+                        append(std::move(inner));
+                    }
+                    return;
+                }
+
+                this->simplify_children(*statement);
+                returned = statement->type == ast::NodeType::ReturnStatement;
+                statements.push_back(std::move(statement));
+            };
+
+            for (auto& statement : block.statements) {
+                if (statement == nullptr) {
+                    statements.push_back(std::move(statement));
+                    continue;
+                }
+                append(std::move(statement));
+            }
+
+            block.statements = std::move(statements);
+            this->remove_dead_stores(block);
+        }
+
+
+        void remove_dead_stores(ast::StatementListNode& block) {
+            for (std::size_t i = 0; i < block.statements.size(); i++) {
+                auto target = local_store_target(block.statements[i].get());
+                if (target == nullptr) {
+                    continue;
+                }
+
+                auto slot = target->slot;
+                if (this->local_reads.count(slot) && !this->is_overwritten(block, i, slot)) {
+                    continue;
+                }
+
+                // Keep evaluating the value unless doing so can have no effect.
+                auto& store = dynamic_cast<ast::BinaryExpressionNode&>(*block.statements[i]);
+                auto value = std::move(store.right_argument);
+                this->report.dead_stores++;
+
+                if (is_inert(value.get())) {
+                    block.statements.erase(block.statements.begin() + i);
+                    i--;
+                } else {
+                    block.statements[i] = std::move(value);
+                }
+            }
+        }
+    };
+
+
+    /**
+     * Remove branches that can never run, statements after a return, and
+     * stores to locals that are never read. Function definitions nested in
+     * the block are left alone; their bodies are simplified separately.
+     */
+    static void eliminate_dead_code(ast::StatementListNode& block, Report& report) {
+        DeadCodeEliminator eliminator(report);
+        count_local_reads(&block, eliminator.local_reads);
+        eliminator.simplify(block);
+    }
+
+
+    // An expression found while walking a statement in evaluation order.
+    struct Occurrence {
+        std::unique_ptr<ast::BaseNode>* node;
+        std::string key;
+        std::size_t size;
+        bool conditional;
+    };
+
+
+    /**
+     * Textual identity of a side-effect-free expression built from literals,
+     * variables and operators, or "" if the expression does not qualify.
+     */
+    static std::string expression_key(const ast::BaseNode* node) {
+        using Type = ast::NodeType;
+        if (node == nullptr) {
+            return "";
+        }
+
+        std::stringstream stream;
+        switch (node->type) {
+            case Type::Number: {
+                stream << "n" << std::hexfloat << dynamic_cast<const ast::NumberNode*>(node)->value;
+                return stream.str();
+            }
+
+            case Type::Integer: {
+                stream << "i" << dynamic_cast<const ast::IntegerNode*>(node)->value;
+                return stream.str();
+            }
+
+            case Type::String: {
+                const auto& value = dynamic_cast<const ast::StringNode*>(node)->value;
+                stream << "s" << value.size() << ":" << value;
+                return stream.str();
+            }
+
+            case Type::Boolean: {
+                return dynamic_cast<const ast::BooleanNode*>(node)->value ? "t" : "f";
+            }
+
+            case Type::Variable: {
+                auto variable = dynamic_cast<const ast::VariableNode*>(node);
+                stream << "v" << variable->name << "@" << variable->slot << "^" << variable->capture;
+                return stream.str();
+            }
+
+            case Type::LogicalNegationExpression:
+            case Type::ArithmeticNegationExpression: {
+                auto unary = dynamic_cast<const ast::UnaryExpressionNode*>(node);
+                auto argument = expression_key(unary->argument.get());
+                if (argument.empty()) {
+                    return "";
+                }
+                stream << "(" << unary->lexeme << " " << argument << ")";
+                return stream.str();
+            }
+
+            case Type::AddExpression:
+            case Type::SubtractExpression:
+            case Type::MultiplyExpression:
+            case Type::DivideExpression:
+            case Type::ModuloExpression:
+            case Type::LessExpression:
+            case Type::LessEqualExpression:
+            case Type::GreaterExpression:
+            case Type::GreaterEqualExpression:
+            case Type::EqualityExpression:
+            case Type::InequalityExpression:
+            case Type::MatchExpression:
+            case Type::AndExpression:
+            case Type::OrExpression: {
+                auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(node);
+                auto left = expression_key(binary->left_argument.get());
+                auto right = expression_key(binary->right_argument.get());
+                if (left.empty() || right.empty()) {
+                    return "";
+                }
+                stream << "(" << binary->lexeme << " " << left << " " << right << ")";
+                return stream.str();
+            }
+
+            default: {
+                return "";
+            }
+        }
+    }
+
+
+    /**
+     * List the expressions of a statement in the order they finish
+     * evaluating, marking the ones that might not run every time the
+     * statement does. Function definitions are not entered.
+     */
+    static void collect_occurrences(
+        std::unique_ptr<ast::BaseNode>& node,
+        bool conditional,
+        std::vector<Occurrence>& occurrences
+    ) {
+        using Type = ast::NodeType;
+        if (node == nullptr) {
+            return;
+        }
+
+        auto collect_block = [&](std::unique_ptr<ast::StatementListNode>& block) {
+            for (auto& statement : block->statements) {
+                collect_occurrences(statement, true, occurrences);
+            }
+        };
+
+        switch (node->type) {
+            case Type::FunctionDefinition:
+            case Type::FunctionLiteral:
+            case Type::Identifier:
+            case Type::Variable: {
+                return;
+            }
+
+            case Type::StatementList: {
+                for (auto& statement : dynamic_cast<ast::StatementListNode&>(*node).statements) {
+                    collect_occurrences(statement, conditional, occurrences);
+                }
+                return;
+            }
+
+            case Type::ForLoop: {
+                auto& loop = dynamic_cast<ast::ForLoopNode&>(*node);
+                collect_occurrences(loop.initialization, conditional, occurrences);
+                collect_occurrences(loop.condition, true, occurrences);
+                collect_block(loop.body);
+                collect_occurrences(loop.update, true, occurrences);
+                return;
+            }
+
+            case Type::ForEachLoop: {
+                auto& loop = dynamic_cast<ast::ForEachNode&>(*node);
+                collect_occurrences(loop.iterable, conditional, occurrences);
+                collect_block(loop.body);
+                return;
+            }
+
+            case Type::Interpolation: {
+                for (auto& value : dynamic_cast<ast::InterpolationNode&>(*node).values) {
+                    collect_occurrences(value, conditional, occurrences);
+                }
+                return;
+            }
+
+            case Type::ArrayLiteral: {
+                for (auto& element : dynamic_cast<ast::ArrayLiteralNode&>(*node).elements) {
+                    collect_occurrences(element, conditional, occurrences);
+                }
+                return;
+            }
+
+            case Type::DictionaryLiteral: {
+                auto& literal = dynamic_cast<ast::DictionaryLiteralNode&>(*node);
+                for (std::size_t i = 0; i < literal.keys.size(); i++) {
+                    collect_occurrences(literal.keys[i], conditional, occurrences);
+                    collect_occurrences(literal.values[i], conditional, occurrences);
+                }
+                return;
+            }
+
+            case Type::IfStatement: {
+                auto& branch = dynamic_cast<ast::IfStatementNode&>(*node);
+                collect_occurrences(branch.condition, conditional, occurrences);
+                collect_block(branch.body);
+                collect_occurrences(branch.else_clause, true, occurrences);
+                return;
+            }
+
+            case Type::EchoStatement: {
+                collect_occurrences(dynamic_cast<ast::EchoStatementNode&>(*node).argument, conditional, occurrences);
+                return;
+            }
+
+            case Type::Command: {
+                for (auto& argument : dynamic_cast<ast::CommandNode&>(*node).arguments) {
+                    collect_occurrences(argument, conditional, occurrences);
+                }
+                return;
+            }
+
+            case Type::Pipeline: {
+                for (auto& stage : dynamic_cast<ast::PipelineNode&>(*node).stages) {
+                    collect_occurrences(stage, conditional, occurrences);
+                }
+                return;
+            }
+
+            case Type::Substitution: {
+                collect_block(dynamic_cast<ast::SubstitutionNode&>(*node).body);
+                return;
+            }
+
+            case Type::Subshell: {
+                collect_block(dynamic_cast<ast::SubshellNode&>(*node).body);
+                return;
+            }
+
+            case Type::Background: {
+                collect_occurrences(dynamic_cast<ast::BackgroundNode&>(*node).statement, true, occurrences);
+                return;
+            }
+
+            case Type::Timed: {
+                collect_occurrences(dynamic_cast<ast::TimedNode&>(*node).statement, conditional, occurrences);
+                return;
+            }
+
+            case Type::Chain: {
+                // The right side runs depending on the left one's status.
+                auto& chain = dynamic_cast<ast::ChainNode&>(*node);
+                collect_occurrences(chain.left, conditional, occurrences);
+                collect_occurrences(chain.right, true, occurrences);
+                return;
+            }
+
+            case Type::Redirection: {
+                auto& redirected = dynamic_cast<ast::RedirectionNode&>(*node);
+                collect_occurrences(redirected.statement, conditional, occurrences);
+                for (auto& redirection : redirected.redirections) {
+                    collect_occurrences(redirection.target, conditional, occurrences);
+                }
+                return;
+            }
+
+            case Type::ReturnStatement: {
+                collect_occurrences(dynamic_cast<ast::ReturnStatementNode&>(*node).argument, conditional, occurrences);
+                return;
+            }
+
+            case Type::FunctionCall: {
+                for (auto& argument : dynamic_cast<ast::FunctionCallNode&>(*node).arguments->arguments) {
+                    collect_occurrences(argument, conditional, occurrences);
+                }
+                return;
+            }
+
+            case Type::ValueCall: {
+                auto& call = dynamic_cast<ast::ValueCallNode&>(*node);
+                collect_occurrences(call.callee, conditional, occurrences);
+                for (auto& argument : call.arguments->arguments) {
+                    collect_occurrences(argument, conditional, occurrences);
+                }
+                return;
+            }
+
+            case Type::InlinedCall: {
+                auto& inlined = dynamic_cast<ast::InlinedCallNode&>(*node);
+                for (auto& argument : inlined.call->arguments->arguments) {
+                    collect_occurrences(argument, conditional, occurrences);
+                }
+                collect_block(inlined.body);
+                return;
+            }
+
+            case Type::LogicalNegationExpression:
+            case Type::ArithmeticNegationExpression: {
+                collect_occurrences(dynamic_cast<ast::UnaryExpressionNode&>(*node).argument, conditional, occurrences);
+                break;
+            }
+
+            default: {
+                auto binary = dynamic_cast<ast::BinaryExpressionNode*>(node.get());
+                if (binary == nullptr) {
+                    return;
+                }
+
+                if (is_assignment(node.get())) {
+                    // The value is evaluated before the store.
+                    collect_occurrences(binary->right_argument, conditional, occurrences);
+                    if (binary->left_argument && binary->left_argument->type != Type::Variable) {
+                        collect_occurrences(binary->left_argument, conditional, occurrences);
+                    }
+                    return;
+                }
+
+                // The right side of && and || is skipped by short-circuiting.
+                auto short_circuits = node->type == Type::AndExpression || node->type == Type::OrExpression;
+                collect_occurrences(binary->left_argument, conditional, occurrences);
+                collect_occurrences(binary->right_argument, conditional || short_circuits, occurrences);
+                break;
+            }
+        }
+
+        auto key = expression_key(node.get());
+        if (!key.empty()) {
+            occurrences.push_back(Occurrence { &node, key, count_nodes(node.get()), conditional });
+        }
+    }
+
+
+    static void collect_reads(const ast::BaseNode* node, std::set<std::pair<std::string, int>>& variables) {
+        if (node == nullptr) {
+            return;
+        }
+
+        if (node->type == ast::NodeType::Variable) {
+            auto variable = dynamic_cast<const ast::VariableNode*>(node);
+            variables.emplace(variable->name, variable->slot);
+            return;
+        }
+
+        for_each_child(*node, [&](const ast::BaseNode* child) {
+            collect_reads(child, variables);
+        });
+    }
+
+
+    /**
+     * Whether running a node may change any of `variables`. Calls count as
+     * writes to every variable: they can assign globals, and can grow an
+     * array a local refers to, which changes whether the local is truthy.
+     */
+    static bool may_write(const ast::BaseNode* node, const std::set<std::pair<std::string, int>>& variables) {
+        using Type = ast::NodeType;
+        if (node == nullptr || node->type == Type::FunctionDefinition || node->type == Type::FunctionLiteral) {
+            return false;
+        }
+
+        // A command may run a script function.
+        auto is_call = node->type == Type::FunctionCall || node->type == Type::InlinedCall
+            || node->type == Type::ValueCall || node->type == Type::Command;
+        if (is_call) {
+            return !variables.empty();
+        }
+
+        if (is_assignment(node)) {
+            auto target = dynamic_cast<const ast::BinaryExpressionNode*>(node)->left_argument.get();
+            if (target && target->type == ast::NodeType::Variable) {
+                auto variable = dynamic_cast<const ast::VariableNode*>(target);
+                if (variables.count({ variable->name, variable->slot })) {
+                    return true;
+                }
+            }
+        }
+
+        if (node->type == ast::NodeType::ForEachLoop) {
+            auto& variable = *dynamic_cast<const ast::ForEachNode*>(node)->variable;
+            if (variables.count({ variable.name, variable.slot })) {
+                return true;
+            }
+        }
+
+        bool writes = false;
+        for_each_child(*node, [&](const ast::BaseNode* child) {
+            writes = writes || may_write(child, variables);
+        });
+        return writes;
+    }
+
+
+    /**
+     * Whether a statement changes `variables` before it finishes evaluating
+     * its value. A top-level assignment stores only after its value is
+     * computed, so only the value side counts.
+     */
+    static bool may_write_while_evaluating(const ast::BaseNode* statement, const std::set<std::pair<std::string, int>>& variables) {
+        if (is_assignment(statement)) {
+            auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(statement);
+            auto target = binary->left_argument.get();
+            if (target && target->type == ast::NodeType::Variable) {
+                return may_write(binary->right_argument.get(), variables);
+            }
+        }
+        return may_write(statement, variables);
+    }
+
+
+    struct SubexpressionEliminator {
+        Report& report;
+        std::size_t& frame_size;
+
+
+        inline SubexpressionEliminator(Report& report, std::size_t& frame_size)
+            : report(report), frame_size(frame_size) {}
+
+
+        /**
+         * Try to save the value of `candidate`, the first unconditional
+         * evaluation of its expression in statement `index`, and reuse it for
+         * later evaluations until one of its variables may change.
+         */
+        bool reuse(ast::StatementListNode& block, std::size_t index, const Occurrence& candidate,
+                   const std::vector<Occurrence>& occurrences) {
+            std::set<std::pair<std::string, int>> variables;
+            collect_reads(candidate.node->get(), variables);
+
+            std::vector<std::unique_ptr<ast::BaseNode>*> repeats;
+            auto statement = block.statements[index].get();
+
+            if (!may_write_while_evaluating(statement, variables)) {
+                auto after_candidate = false;
+                for (const auto& occurrence : occurrences) {
+                    if (occurrence.node == candidate.node) {
+                        after_candidate = true;
+                    } else if (after_candidate && occurrence.key == candidate.key) {
+                        repeats.push_back(occurrence.node);
+                    }
+                }
+            }
+
+            if (!may_write(statement, variables)) {
+                for (auto i = index + 1; i < block.statements.size(); i++) {
+                    if (may_write(block.statements[i].get(), variables)) {
+                        break;
+                    }
+
+                    std::vector<Occurrence> later;
+                    collect_occurrences(block.statements[i], false, later);
+                    for (const auto& occurrence : later) {
+                        if (occurrence.key == candidate.key) {
+                            repeats.push_back(occurrence.node);
+                        }
+                    }
+                }
+            }
+
+            if (repeats.empty()) {
+                return false;
+            }
+
+            auto slot = int(this->frame_size++);
+            auto name = "%cse" + std::to_string(slot);
+
+            for (auto repeat : repeats) {
+                *repeat = std::make_unique<ast::VariableNode>(name, slot);
+            }
+
+            *candidate.node = std::make_unique<ast::AssignmentNode>(
+                std::make_unique<ast::VariableNode>(name, slot),
+                std::move(*candidate.node)
+            );
+
+            this->report.common_subexpressions += repeats.size();
+            return true;
+        }
+
+
+        void eliminate(ast::StatementListNode& block) {
+            for (std::size_t index = 0; index < block.statements.size(); index++) {
+                auto changed = true;
+                while (changed) {
+                    changed = false;
+
+                    std::vector<Occurrence> occurrences;
+                    collect_occurrences(block.statements[index], false, occurrences);
+
+                    // Larger expressions first, so `($a * $b) + 1` is saved
+                    // whole rather than just `$a * $b`.
+                    std::vector<const Occurrence*> candidates;
+                    std::set<std::string> seen;
+                    for (const auto& occurrence : occurrences) {
+                        auto is_operator = occurrence.size > 1;
+                        if (is_operator && !occurrence.conditional && seen.insert(occurrence.key).second) {
+                            candidates.push_back(&occurrence);
+                        }
+                    }
+
+                    std::stable_sort(candidates.begin(), candidates.end(), [](auto left, auto right) {
+                        return left->size > right->size;
+                    });
+
+                    for (auto candidate : candidates) {
+                        if (this->reuse(block, index, *candidate, occurrences)) {
+                            changed = true;
+                            break;
+                        }
+                    }
+                }
+
+                this->eliminate_nested(block.statements[index].get());
+            }
+        }
+
+
+        void eliminate_nested(ast::BaseNode* statement) {
+            if (statement == nullptr) {
+                return;
+            }
+
+            switch (statement->type) {
+                case ast::NodeType::ForLoop: {
+                    this->eliminate(*dynamic_cast<ast::ForLoopNode*>(statement)->body);
+                    return;
+                }
+
+                case ast::NodeType::ForEachLoop: {
+                    this->eliminate(*dynamic_cast<ast::ForEachNode*>(statement)->body);
+                    return;
+                }
+
+                case ast::NodeType::IfStatement: {
+                    auto branch = dynamic_cast<ast::IfStatementNode*>(statement);
+                    this->eliminate(*branch->body);
+                    this->eliminate_nested(branch->else_clause.get());
+                    return;
+                }
+
+                case ast::NodeType::StatementList: {
+                    this->eliminate(*dynamic_cast<ast::StatementListNode*>(statement));
+                    return;
+                }
+
+                default: {
+                    return;
+                }
+            }
+        }
+    };
+
+
+    /**
+     * Compute repeated pure subexpressions once, saving the first result in a
+     * new frame slot. Function definitions nested in the block are left alone.
+     */
+    static void eliminate_common_subexpressions(ast::StatementListNode& block, std::size_t& frame_size, Report& report) {
+        SubexpressionEliminator eliminator(report, frame_size);
+        eliminator.eliminate(block);
+    }
+
+
+    struct Inliner {
+        FunctionTable functions;
+        const Options& options;
+        Report& report;
+        std::size_t budget;
+
+        // Frame that slots for inlined arguments are taken from.
+        std::size_t* frame_size;
+
+
+        inline Inliner(const FunctionTable& functions, const Options& options, Report& report, std::size_t* frame_size)
+            : functions(functions),
+              options(options),
+              report(report),
+              budget(options.inline_growth_budget),
+              frame_size(frame_size) {}
+
+
+        /**
+         * Whether a function can reach itself through the functions currently
+         * visible.
+         */
+        bool is_recursive(const std::string& name) const {
+            std::set<std::string> visited;
+            std::vector<std::string> pending = { name };
+
+            while (!pending.empty()) {
+                auto current = pending.back();
+                pending.pop_back();
+
+                auto function = this->functions.find(current);
+                if (function == this->functions.end()) {
+                    continue;
+                }
+
+                std::set<std::string> callees;
+                collect_callees(function->second->body.get(), callees);
+                for (const auto& callee : callees) {
+                    if (callee == name) {
+                        return true;
+                    }
+                    if (visited.insert(callee).second) {
+                        pending.push_back(callee);
+                    }
+                }
+            }
+
+            return false;
+        }
+
+
+        std::shared_ptr<const ast::FunctionDefinitionNode> inline_target(const ast::FunctionCallNode& call) const {
+            auto function = this->functions.find(call.name->name);
+            if (function == this->functions.end()) {
+                return nullptr;
+            }
+
+            auto callee = function->second;
+            auto size = count_nodes(callee->body.get());
+            auto inlinable = (
+                !callee->memoize &&
+                call.arguments->arguments.size() == callee->parameters->parameters.size() &&
+                size <= this->options.inline_size_limit &&
+                size <= this->budget &&
+                !contains_definition(callee->body.get()) &&
+                !this->is_recursive(callee->name)
+            );
+
+            return inlinable ? callee : nullptr;
+        }
+
+
+        void rewrite(std::unique_ptr<ast::BaseNode>& node) {
+            using Type = ast::NodeType;
+            if (node == nullptr) {
+                return;
+            }
+
+            switch (node->type) {
+                case Type::StatementList: {
+                    this->rewrite_block(dynamic_cast<ast::StatementListNode&>(*node));
+                    return;
+                }
+
+                case Type::ForLoop: {
+                    auto& loop = dynamic_cast<ast::ForLoopNode&>(*node);
+                    this->rewrite(loop.initialization);
+                    this->rewrite(loop.condition);
+                    this->rewrite(loop.update);
+                    this->rewrite_block(*loop.body);
+                    return;
+                }
+
+                case Type::ForEachLoop: {
+                    auto& loop = dynamic_cast<ast::ForEachNode&>(*node);
+                    this->rewrite(loop.iterable);
+                    this->rewrite_block(*loop.body);
+                    return;
+                }
+
+                case Type::Interpolation: {
+                    for (auto& value : dynamic_cast<ast::InterpolationNode&>(*node).values) {
+                        this->rewrite(value);
+                    }
+                    return;
+                }
+
+                case Type::ArrayLiteral: {
+                    for (auto& element : dynamic_cast<ast::ArrayLiteralNode&>(*node).elements) {
+                        this->rewrite(element);
+                    }
+                    return;
+                }
+
+                case Type::DictionaryLiteral: {
+                    auto& literal = dynamic_cast<ast::DictionaryLiteralNode&>(*node);
+                    for (std::size_t i = 0; i < literal.keys.size(); i++) {
+                        this->rewrite(literal.keys[i]);
+                        this->rewrite(literal.values[i]);
+                    }
+                    return;
+                }
+
+                case Type::IfStatement: {
+                    auto& branch = dynamic_cast<ast::IfStatementNode&>(*node);
+                    this->rewrite(branch.condition);
+                    this->rewrite_block(*branch.body);
+                    this->rewrite(branch.else_clause);
+                    return;
+                }
+
+                case Type::FunctionDefinition: {
+                    this->rewrite_function(dynamic_cast<ast::FunctionDefinitionNode&>(*node));
+                    return;
+                }
+
+                case Type::FunctionLiteral: {
+                    this->rewrite_function(*dynamic_cast<ast::FunctionLiteralNode&>(*node).definition);
+                    return;
+                }
+
+                case Type::ValueCall: {
+                    auto& call = dynamic_cast<ast::ValueCallNode&>(*node);
+                    this->rewrite(call.callee);
+                    for (auto& argument : call.arguments->arguments) {
+                        this->rewrite(argument);
+                    }
+                    return;
+                }
+
+                case Type::EchoStatement: {
+                    this->rewrite(dynamic_cast<ast::EchoStatementNode&>(*node).argument);
+                    return;
+                }
+
+                case Type::Command: {
+                    for (auto& argument : dynamic_cast<ast::CommandNode&>(*node).arguments) {
+                        this->rewrite(argument);
+                    }
+                    return;
+                }
+
+                case Type::Pipeline: {
+                    for (auto& stage : dynamic_cast<ast::PipelineNode&>(*node).stages) {
+                        this->rewrite(stage);
+                    }
+                    return;
+                }
+
+                case Type::Substitution: {
+                    this->rewrite_block(*dynamic_cast<ast::SubstitutionNode&>(*node).body);
+                    return;
+                }
+
+                case Type::Subshell: {
+                    this->rewrite_block(*dynamic_cast<ast::SubshellNode&>(*node).body);
+                    return;
+                }
+
+                case Type::Background: {
+                    this->rewrite(dynamic_cast<ast::BackgroundNode&>(*node).statement);
+                    return;
+                }
+
+                case Type::Timed: {
+                    this->rewrite(dynamic_cast<ast::TimedNode&>(*node).statement);
+                    return;
+                }
+
+                case Type::Chain: {
+                    auto& chain = dynamic_cast<ast::ChainNode&>(*node);
+                    this->rewrite(chain.left);
+                    this->rewrite(chain.right);
+                    return;
+                }
+
+                case Type::Redirection: {
+                    auto& redirected = dynamic_cast<ast::RedirectionNode&>(*node);
+                    this->rewrite(redirected.statement);
+                    for (auto& redirection : redirected.redirections) {
+                        this->rewrite(redirection.target);
+                    }
+                    return;
+                }
+
+                case Type::ReturnStatement: {
+                    this->rewrite(dynamic_cast<ast::ReturnStatementNode&>(*node).argument);
+                    return;
+                }
+
+                case Type::FunctionCall: {
+                    auto& call = dynamic_cast<ast::FunctionCallNode&>(*node);
+                    for (auto& argument : call.arguments->arguments) {
+                        this->rewrite(argument);
+                    }
+                    this->inline_call(node);
+                    return;
+                }
+
+                case Type::InlinedCall: {
+                    return;
+                }
+
+                case Type::LogicalNegationExpression:
+                case Type::ArithmeticNegationExpression: {
+                    this->rewrite(dynamic_cast<ast::UnaryExpressionNode&>(*node).argument);
+                    return;
+                }
+
+                default: {
+                    auto binary = dynamic_cast<ast::BinaryExpressionNode*>(node.get());
+                    if (binary != nullptr) {
+                        this->rewrite(binary->left_argument);
+                        this->rewrite(binary->right_argument);
+                    }
+                    return;
+                }
+            }
+        }
+
+
+        void rewrite_block(ast::StatementListNode& block) {
+            for (auto& statement : block.statements) {
+                this->rewrite(statement);
+            }
+        }
+
+
+        void rewrite_function(ast::FunctionDefinitionNode& definition) {
+            // Calls to the function's own name inside its body refer to the
+            // definition being parsed, not an older one of the same name.
+            auto shadowed = this->functions.find(definition.name);
+            std::shared_ptr<const ast::FunctionDefinitionNode> previous;
+            if (shadowed != this->functions.end()) {
+                previous = shadowed->second;
+                this->functions.erase(shadowed);
+            }
+
+            auto enclosing_frame = this->frame_size;
+            this->frame_size = &definition.frame_size;
+            this->rewrite_block(*definition.body);
+            this->frame_size = enclosing_frame;
+
+            eliminate_dead_code(*definition.body, this->report);
+            eliminate_common_subexpressions(*definition.body, definition.frame_size, this->report);
+
+            if (previous != nullptr) {
+                this->functions[definition.name] = previous;
+            }
+        }
+
+
+        /**
+         * Replace a call with a copy of the callee's body whose parameters
+         * live in fresh slots of the caller's frame.
+         */
+        void inline_call(std::unique_ptr<ast::BaseNode>& node) {
+            auto& call = dynamic_cast<ast::FunctionCallNode&>(*node);
+            auto callee = this->inline_target(call);
+            if (callee == nullptr) {
+                return;
+            }
+
+            // A copy missing nodes clone() does not know is not inlined.
+            auto base_slot = int(*this->frame_size);
+            auto body = clone_block(*callee->body, base_slot);
+            auto size = count_nodes(body.get());
+            if (size != count_nodes(callee->body.get())) {
+                return;
+            }
+
+            auto slot_count = callee->frame_size;
+            *this->frame_size += slot_count;
+            this->budget -= std::min(size, this->budget);
+            this->report.inlined_calls++;
+            this->report.inlined_nodes += size;
+
+            auto original = std::unique_ptr<ast::FunctionCallNode>(
+                dynamic_cast<ast::FunctionCallNode*>(node.release())
+            );
+
+            node = std::make_unique<ast::InlinedCallNode>(
+                std::move(original),
+                std::move(callee),
+                std::move(body),
+                base_slot,
+                slot_count
+            );
+        }
+    };
+
+
+    Report optimize(
+        ast::StatementListNode& program,
+        const FunctionTable& functions,
+        std::size_t& frame_size,
+        const Options& options
+    ) {
+        Report report;
+        Inliner inliner(functions, options, report, &frame_size);
+
+        for (auto& statement : program.statements) {
+            inliner.rewrite(statement);
+
+            // Top-level definitions are in effect for the rest of the program.
+            if (statement && statement->type == ast::NodeType::FunctionDefinition) {
+                auto definition = dynamic_cast<const ast::FunctionDefinitionNode*>(statement.get());
+                inliner.functions[definition->name] = std::shared_ptr<const ast::FunctionDefinitionNode>(
+                    std::shared_ptr<const ast::FunctionDefinitionNode>(), definition
+                );
+            }
+        }
+
+        eliminate_dead_code(program, report);
+        eliminate_common_subexpressions(program, frame_size, report);
+        return report;
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <map>
+#include <string>
+#include <memory>
+#include <functional>
+#include "parser.hpp"
+
+namespace pshellscript::optimizer {
+    using namespace parser;
+
+    // Functions a program can see before it starts running, by name. Entries
+    // for functions defined by the program itself do not own their node.
+    using FunctionTable = std::map<std::string, std::shared_ptr<const ast::FunctionDefinitionNode>>;
+
+
+    struct Options {
+        // Largest callee body, in AST nodes, that will be inlined.
+        std::size_t inline_size_limit = 48;
+
+        // Total number of AST nodes inlining may add to one program.
+        std::size_t inline_growth_budget = 4096;
+    };
+
+
+    struct Report {
+        std::size_t inlined_calls = 0;
+        std::size_t inlined_nodes = 0;
+
+        // If statements whose condition was a constant, leaving one branch.
+        std::size_t removed_branches = 0;
+
+        // Statements that could never run because they follow a return.
+        std::size_t unreachable_statements = 0;
+
+        // Assignments to locals whose value was never read.
+        std::size_t dead_stores = 0;
+
+        // Repeated evaluations replaced by a read of an earlier result.
+        std::size_t common_subexpressions = 0;
+    };
+
+
+    /**
+     * Deep-copy a subtree. Frame slots of local variables are shifted by
+     * `slot_offset`, except inside nested function definitions, which own
+     * their frames. Nodes of a kind it does not know are left out, so the
+     * copy has fewer nodes than the original.
+     */
+    std::unique_ptr<ast::BaseNode> clone(const ast::BaseNode* node, int slot_offset = 0);
+
+    std::size_t count_nodes(const ast::BaseNode* node);
+
+    // Call `visit` on every direct child of a node, including empty ones.
+    void for_each_child(const ast::BaseNode& node, const std::function<void(const ast::BaseNode*)>& visit);
+
+    /**
+     * Optimize a program in place before it runs: inline small functions,
+     * drop branches and stores that can have no effect, and compute repeated
+     * pure subexpressions once. `functions` are the functions already
+     * defined; definitions at the top level of the program become visible to
+     * the statements after them. Slots the top level needs for inlined calls
+     * and saved subexpressions are added to `frame_size`.
+     */
+    Report optimize(
+        ast::StatementListNode& program,
+        const FunctionTable& functions,
+        std::size_t& frame_size,
+        const Options& options = Options()
+    );
+}
+
+#endif
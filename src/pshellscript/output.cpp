@@ -0,0 +1,157 @@
+#include <array>
+#include <charconv>
+#include <cerrno>
+#include <cmath>
+#include <iostream>
+#include <unistd.h>
+#include "output.hpp"
+
+namespace pshellscript::output {
+    static constexpr std::size_t buffer_capacity = 64 * 1024;
+
+    struct Buffer {
+        int descriptor;
+        std::size_t size = 0;
+        std::array<char, buffer_capacity> data;
+
+        inline Buffer(int descriptor) : descriptor(descriptor) {}
+    };
+
+    static Buffer standard_output(STDOUT_FILENO);
+    static Buffer file_output(-1);
+    static Buffer* current = &standard_output;
+    static std::string* captured = nullptr;
+
+
+    static void write_all(int descriptor, const char* data, std::size_t size) {
+        while (size > 0) {
+            auto written = ::write(descriptor, data, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // Nowhere left to report it; drop the output like a closed pipe.
+                return;
+            }
+
+            data += written;
+            size -= std::size_t(written);
+        }
+    }
+
+
+    static void flush(Buffer& buffer) {
+        write_all(buffer.descriptor, buffer.data.data(), buffer.size);
+        buffer.size = 0;
+    }
+
+
+    void flush() {
+        // Whatever the shell printed through std::cout came first.
+        std::cout.flush();
+
+        flush(file_output);
+        flush(standard_output);
+    }
+
+
+    void write_to(int descriptor) {
+        if (file_output.descriptor != descriptor) {
+            flush(file_output);
+            file_output.descriptor = descriptor;
+        }
+        current = &file_output;
+    }
+
+
+    void write_to_standard_output() {
+        current = &standard_output;
+    }
+
+
+    std::string* capture(std::string* text) {
+        auto previous = captured;
+        captured = text;
+        return previous;
+    }
+
+
+    bool capturing() {
+        return captured != nullptr;
+    }
+
+
+    void write(std::string_view text) {
+        if (captured != nullptr && current == &standard_output) {
+            captured->append(text);
+            return;
+        }
+
+        auto& buffer = *current;
+        if (buffer.size + text.size() > buffer_capacity) {
+            if (&buffer == &standard_output) {
+                std::cout.flush();
+            }
+            flush(buffer);
+
+            // Too large to be worth copying into the buffer.
+            if (text.size() >= buffer_capacity) {
+                write_all(buffer.descriptor, text.data(), text.size());
+                return;
+            }
+        }
+
+        text.copy(buffer.data.data() + buffer.size, text.size());
+        buffer.size += text.size();
+    }
+
+
+    void write_line(std::string_view text) {
+        write(text);
+        write("\n");
+    }
+
+
+    // Whole numbers below 2^53 are exact, and printing them in full reads
+    // better than the shorter "1e+06".
+    static constexpr double largest_exact_integer = 9007199254740992.0;
+
+
+    std::string_view to_digits(double number, NumberDigits& digits) {
+        auto is_exact_integer = number == std::trunc(number) && std::fabs(number) < largest_exact_integer;
+        auto result = is_exact_integer
+            ? std::to_chars(digits.data(), digits.data() + digits.size(), number, std::chars_format::fixed)
+            : std::to_chars(digits.data(), digits.data() + digits.size(), number);
+        return std::string_view(digits.data(), std::size_t(result.ptr - digits.data()));
+    }
+
+
+    std::string_view to_digits(std::int64_t number, NumberDigits& digits) {
+        auto result = std::to_chars(digits.data(), digits.data() + digits.size(), number);
+        return std::string_view(digits.data(), std::size_t(result.ptr - digits.data()));
+    }
+
+
+    void write_number(double number) {
+        NumberDigits digits;
+        write(to_digits(number, digits));
+    }
+
+
+    void write_number(std::int64_t number) {
+        NumberDigits digits;
+        write(to_digits(number, digits));
+    }
+
+
+    std::string format_number(double number) {
+        NumberDigits digits;
+        return std::string(to_digits(number, digits));
+    }
+
+
+    std::string format_number(std::int64_t number) {
+        NumberDigits digits;
+        return std::string(to_digits(number, digits));
+    }
+}
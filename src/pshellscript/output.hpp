@@ -0,0 +1,57 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+namespace pshellscript::output {
+    /**
+     * Append to the script output buffer, which is written to standard output
+     * in large chunks. Anything written to std::cout must be preceded by a
+     * flush() to keep the two in order.
+     */
+    void write(std::string_view text);
+    void write_line(std::string_view text);
+    void write_number(double number);
+    void write_number(std::int64_t number);
+
+    // Write the buffers out.
+    void flush();
+
+    /**
+     * Send what is written from now on to `descriptor` instead, through a
+     * buffer of its own, until write_to_standard_output(). Echo statements
+     * redirected to a file write this way; consecutive ones to the same file
+     * share the buffer, so a loop that appends a line at a time still writes
+     * in large chunks. Flush before closing the descriptor.
+     */
+    void write_to(int descriptor);
+    void write_to_standard_output();
+
+    /**
+     * Append what is written for standard output to `text` from now on,
+     * rather than buffering it for the descriptor, or stop with nullptr.
+     * Command substitution collects script output this way without a pipe.
+     * Returns the string captured into before.
+     */
+    std::string* capture(std::string* text);
+    bool capturing();
+
+    /**
+     * Format a number with the fewest digits that read back as the same
+     * double, e.g. 0.1 + 0.2 becomes "0.30000000000000004".
+     */
+    std::string format_number(double number);
+    std::string format_number(std::int64_t number);
+
+    // Long enough for any number in its shortest form.
+    using NumberDigits = std::array<char, 32>;
+
+    // Format a number as format_number does, into `digits` rather than a new string.
+    std::string_view to_digits(double number, NumberDigits& digits);
+    std::string_view to_digits(std::int64_t number, NumberDigits& digits);
+}
+
+#endif
@@ -0,0 +1,437 @@
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "parallel.hpp"
+#include "accounting.hpp"
+#include "jobs.hpp"
+#include "output.hpp"
+#include "process.hpp"
+
+namespace pshellscript::parallel {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::size_t limit = 0;
+        bool fail_fast = false;
+        bool timings = false;
+        std::vector<std::string> command;
+        std::vector<std::string> inputs;
+        bool reads_inputs = true;
+    };
+
+
+    // A run of the program for one input.
+    struct Task {
+        std::vector<std::string> arguments;
+        pid_t pid = -1;
+
+        // A pidfd for its exit, and the read ends of the pipes its standard
+        // output and error go to, each -1 once done with.
+        int descriptor = -1;
+        int output = -1;
+        int errors = -1;
+
+        std::string output_text;
+        std::string error_text;
+
+        bool exited = false;
+        bool finished = false;
+        int status = 0;
+        Clock::time_point started;
+        Clock::duration elapsed {};
+    };
+
+
+    // What an epoll event is about: the task's index times 4, plus one of
+    // these. The job event loop's set and the input are watched too.
+    enum Event : std::uint64_t { exit_event, output_event, error_event };
+    static constexpr std::uint64_t job_event = UINT64_MAX;
+    static constexpr std::uint64_t input_event = UINT64_MAX - 1;
+
+
+    static bool parse_options(const std::vector<std::string>& arguments, Options& options) {
+        std::size_t i = 1;
+        for (; i < arguments.size(); i++) {
+            const auto& argument = arguments[i];
+            if (argument == "-j" && i + 1 < arguments.size()) {
+                char* end = nullptr;
+                auto limit = std::strtoul(arguments[i + 1].c_str(), &end, 10);
+                if (*end != '\0' || limit == 0) {
+                    std::cerr << "parallel: " << arguments[i + 1] << ": invalid number of runs" << std::endl;
+                    return false;
+                }
+                options.limit = limit;
+                i++;
+            } else if (argument == "--fail-fast") {
+                options.fail_fast = true;
+            } else if (argument == "--timings") {
+                options.timings = true;
+            } else {
+                break;
+            }
+        }
+
+        for (; i < arguments.size(); i++) {
+            if (arguments[i] == ":::") {
+                options.reads_inputs = false;
+                options.inputs.assign(arguments.begin() + long(i) + 1, arguments.end());
+                break;
+            }
+            options.command.push_back(arguments[i]);
+        }
+
+        if (options.command.empty()) {
+            std::cerr << "parallel: expects a program to run" << std::endl;
+            return false;
+        }
+        if (options.limit == 0) {
+            auto processors = ::sysconf(_SC_NPROCESSORS_ONLN);
+            options.limit = processors > 0 ? std::size_t(processors) : 1;
+        }
+        return true;
+    }
+
+
+    // The program's arguments with `{}` replaced by the input, or the input
+    // added at the end.
+    static std::vector<std::string> task_arguments(const std::vector<std::string>& command, const std::string& input) {
+        std::vector<std::string> arguments;
+        auto replaced = false;
+        for (const auto& argument : command) {
+            auto& added = arguments.emplace_back();
+            std::size_t start = 0;
+            for (auto found = argument.find("{}"); found != std::string::npos; found = argument.find("{}", start)) {
+                added.append(argument, start, found - start);
+                added += input;
+                start = found + 2;
+                replaced = true;
+            }
+            added.append(argument, start);
+        }
+
+        if (!replaced) {
+            arguments.push_back(input);
+        }
+        return arguments;
+    }
+
+
+    static bool watch(int set, int descriptor, std::uint64_t data) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = data;
+        return ::epoll_ctl(set, EPOLL_CTL_ADD, descriptor, &event) == 0;
+    }
+
+
+    /**
+     * Start a task with its output going into pipes watched by `set`. A
+     * program that cannot be started finishes the task at once, with the
+     * message as its error output and status 127.
+     */
+    static void start(Task& task, std::size_t index, int set, const process::Redirections& input) {
+        task.started = Clock::now();
+        auto output = process::open_pipe();
+        auto errors = output.is_error() ? output : process::open_pipe();
+        if (errors.is_error()) {
+            if (!output.is_error()) {
+                ::close(output->read);
+                ::close(output->write);
+            }
+            task.error_text = "parallel: " + errors.get_error().message + "\n";
+            task.status = 127;
+            task.exited = task.finished = true;
+            return;
+        }
+
+        auto redirections = input;
+        redirections.push_back(process::Redirection { STDOUT_FILENO, output->write });
+        redirections.push_back(process::Redirection { STDERR_FILENO, errors->write });
+        auto pid = process::start(task.arguments, redirections);
+        ::close(output->write);
+        ::close(errors->write);
+
+        if (pid.is_error()) {
+            ::close(output->read);
+            ::close(errors->read);
+            task.error_text = "parallel: " + pid.get_error().message + "\n";
+            task.status = 127;
+            task.exited = task.finished = true;
+            return;
+        }
+
+        task.pid = *pid;
+        task.output = output->read;
+        task.errors = errors->read;
+        for (auto descriptor : { task.output, task.errors }) {
+            ::fcntl(descriptor, F_SETFL, ::fcntl(descriptor, F_GETFL) | O_NONBLOCK);
+        }
+        watch(set, task.output, index * 4 + output_event);
+        watch(set, task.errors, index * 4 + error_event);
+
+        // Without a pidfd, the exit is waited for once both pipes are closed.
+        task.descriptor = int(::syscall(SYS_pidfd_open, task.pid, 0));
+        if (task.descriptor >= 0) {
+            watch(set, task.descriptor, index * 4 + exit_event);
+        }
+    }
+
+
+    // Read what is in a pipe, closing it at its end.
+    static void drain(int& descriptor, std::string& text) {
+        static char buffer[64 * 1024];
+        while (descriptor >= 0) {
+            auto count = ::read(descriptor, buffer, sizeof(buffer));
+            if (count > 0) {
+                text.append(buffer, std::size_t(count));
+                continue;
+            }
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count < 0 && errno == EAGAIN) {
+                return;
+            }
+            process::close_descriptor(descriptor);
+        }
+    }
+
+
+    // Collect a task's status and what it used, and log it as a command.
+    static void collect(Task& task) {
+        process::Usage usage;
+        task.status = process::wait(task.pid, &usage);
+        task.exited = true;
+        task.elapsed = Clock::now() - task.started;
+        accounting::record("command", task.arguments, task.status, usage, task.started);
+    }
+
+
+    static void reap(Task& task) {
+        // Only look, leaving the reaping to wait4, which reports the usage.
+        siginfo_t info = {};
+        if (::waitid(P_PIDFD, id_t(task.descriptor), &info, WEXITED | WNOHANG | WNOWAIT) < 0 || info.si_pid == 0) {
+            return;
+        }
+
+        collect(task);
+        process::close_descriptor(task.descriptor);
+    }
+
+
+    static void handle(Task& task, Event event) {
+        switch (event) {
+            case exit_event: {
+                reap(task);
+                break;
+            }
+
+            case output_event: {
+                drain(task.output, task.output_text);
+                break;
+            }
+
+            case error_event: {
+                drain(task.errors, task.error_text);
+                break;
+            }
+        }
+
+        if (!task.exited && task.descriptor < 0 && task.output < 0 && task.errors < 0) {
+            collect(task);
+        }
+        task.finished = task.exited && task.output < 0 && task.errors < 0;
+    }
+
+
+    // Pass on what a finished task wrote, and how long it took.
+    static void write_task(std::size_t index, Task& task, bool timings) {
+        output::write(task.output_text);
+        if (task.error_text.empty() && !timings) {
+            return;
+        }
+
+        output::flush();
+        process::write_all(STDERR_FILENO, task.error_text);
+        if (timings) {
+            char line[64];
+            std::snprintf(
+                line, sizeof(line), "parallel: [%zu] %.3f s, status %d:",
+                index + 1, std::chrono::duration<double>(task.elapsed).count(), task.status
+            );
+            std::string timing = line;
+            for (const auto& argument : task.arguments) {
+                timing += ' ';
+                timing += argument;
+            }
+            timing += '\n';
+            process::write_all(STDERR_FILENO, timing);
+        }
+    }
+
+
+    // Stop the tasks still running and reap them, when the runs cannot be
+    // waited for any more.
+    static void abandon(std::deque<Task>& tasks) {
+        for (auto& task : tasks) {
+            if (task.pid > 0 && !task.exited) {
+                ::kill(task.pid, SIGTERM);
+            }
+        }
+        for (auto& task : tasks) {
+            if (task.pid > 0 && !task.exited) {
+                process::wait(task.pid, nullptr);
+                task.exited = true;
+            }
+            process::close_descriptor(task.descriptor);
+            process::close_descriptor(task.output);
+            process::close_descriptor(task.errors);
+        }
+    }
+
+
+    /**
+     * Inputs read from standard input start runs as their lines arrive. The
+     * input is watched with the runs, unless it is a regular file, which
+     * epoll refuses as it never blocks and which is read as runs need it.
+     */
+    Result<int> run(const std::vector<std::string>& arguments) {
+        Options options;
+        if (!parse_options(arguments, options)) {
+            return 1;
+        }
+
+        auto set = ::epoll_create1(EPOLL_CLOEXEC);
+        if (set < 0) {
+            return Error(std::string("Cannot create an epoll set: ") + std::strerror(errno));
+        }
+        if (jobs::event_descriptor() >= 0) {
+            watch(set, jobs::event_descriptor(), job_event);
+        }
+
+        // The runs cannot share the shell's input with it when it holds the
+        // inputs.
+        jobs::LineReader reader(STDIN_FILENO);
+        reader.ended = !options.reads_inputs;
+        auto input_pollable = options.reads_inputs && watch(set, STDIN_FILENO, input_event);
+        process::Redirections input;
+        int nothing = -1;
+        if (options.reads_inputs) {
+            nothing = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+            input.push_back(process::Redirection { STDIN_FILENO, nothing });
+        }
+
+        std::deque<Task> tasks;
+        for (const auto& argument : options.inputs) {
+            tasks.emplace_back().arguments = task_arguments(options.command, argument);
+        }
+
+        // Add a task for the next line of input, reading more of a file if
+        // none is there yet.
+        auto next_input = [&]() {
+            std::string line;
+            while (!jobs::take_line(reader, line)) {
+                if (reader.ended || input_pollable) {
+                    return false;
+                }
+                jobs::fill(reader);
+            }
+            tasks.emplace_back().arguments = task_arguments(options.command, line);
+            return true;
+        };
+
+        std::size_t started = 0;
+        std::size_t written = 0;
+        std::size_t running = 0;
+        auto failing = false;
+        int failure = 0;
+
+        // A task counts as running until it has finished and been looked at.
+        auto finish = [&](Task& task) {
+            running--;
+            if (task.status != 0 && !failing && options.fail_fast) {
+                failing = true;
+                failure = task.status;
+                for (auto& other : tasks) {
+                    if (other.pid > 0 && !other.exited) {
+                        ::kill(other.pid, SIGTERM);
+                    }
+                }
+            }
+        };
+
+        while (true) {
+            while (!failing && running < options.limit && (started < tasks.size() || next_input())) {
+                auto& task = tasks[started];
+                start(task, started, set, input);
+                started++;
+                running++;
+                if (task.finished) {
+                    finish(task);
+                }
+            }
+
+            for (; written < started && tasks[written].finished; written++) {
+                auto& task = tasks[written];
+                write_task(written, task, options.timings);
+                if (task.status != 0 && failure == 0) {
+                    failure = task.status;
+                }
+                task.output_text = std::string();
+                task.error_text = std::string();
+            }
+
+            auto inputs_left = !failing && (started < tasks.size() || !reader.ended);
+            if (running == 0 && !inputs_left) {
+                break;
+            }
+
+            epoll_event ready[64];
+            auto count = ::epoll_wait(set, ready, 64, -1);
+            for (int i = 0; i < count; i++) {
+                auto data = ready[i].data.u64;
+                if (data == job_event) {
+                    jobs::handle_events();
+                    continue;
+                }
+                if (data == input_event) {
+                    jobs::fill(reader);
+                    if (reader.ended) {
+                        ::epoll_ctl(set, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+                    }
+                    continue;
+                }
+
+                auto& task = tasks[data / 4];
+                if (!task.finished) {
+                    handle(task, Event(data % 4));
+                    if (task.finished) {
+                        finish(task);
+                    }
+                }
+            }
+            if (count < 0 && errno != EINTR) {
+                auto error = errno;
+                abandon(tasks);
+                ::close(set);
+                process::close_descriptor(nothing);
+                return Error(std::string("Cannot wait for the runs: ") + std::strerror(error));
+            }
+        }
+
+        ::close(set);
+        process::close_descriptor(nothing);
+        return failure;
+    }
+}
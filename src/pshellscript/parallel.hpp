@@ -0,0 +1,25 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <string>
+#include <vector>
+#include "../result.hpp"
+
+namespace pshellscript::parallel {
+    /**
+     * `parallel [-j count] [--fail-fast] [--timings] program [arguments...]
+     * [::: inputs...]`: run the program once per input, `count` at a time,
+     * the number of processors by default. Without `:::`, the inputs are the
+     * lines of standard input. Each input replaces `{}` in the arguments, or
+     * is added after them if there is none.
+     *
+     * What each run writes is collected and passed on whole, in the order of
+     * the inputs. `--fail-fast` starts nothing more once a run fails and
+     * ends those still running. `--timings` follows each run's output with
+     * how long it took, on standard error. The status is that of the run
+     * that failed first, or 0.
+     */
+    Result<int> run(const std::vector<std::string>& arguments);
+}
+
+#endif
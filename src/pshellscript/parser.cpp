@@ -1,4 +1,8 @@
 #include <sstream>
+#include <cctype>
+#include <string_view>
+#include <charconv>
+#include <algorithm>
 #include "parser.hpp"
 
 namespace pshellscript::parser::ast {
@@ -9,6 +13,11 @@ namespace pshellscript::parser::ast {
     }
 
 
+    std::string IntegerNode::to_string() const {
+        return std::to_string(this->value);
+    }
+
+
     std::string StringNode::to_string() const {
         std::stringstream stream;
         stream << "\"" << this->value << "\"";
@@ -16,6 +25,19 @@ namespace pshellscript::parser::ast {
     }
 
 
+    std::string InterpolationNode::to_string() const {
+        std::stringstream stream;
+
+        stream << "(interpolate \"" << this->segments.front() << "\"";
+        for (std::size_t i = 0; i < this->values.size(); i++) {
+            stream << " " << this->values[i]->to_string() << " \"" << this->segments[i + 1] << "\"";
+        }
+        stream << ")";
+
+        return stream.str();
+    }
+
+
     std::string BooleanNode::to_string() const {
         std::stringstream stream;
         stream << (this->value ? "true" : "false");
@@ -37,6 +59,33 @@ namespace pshellscript::parser::ast {
     }
 
 
+    std::string ArrayLiteralNode::to_string() const {
+        std::stringstream stream;
+
+        stream << "(array ";
+        for (const auto& element : this->elements) {
+            stream << (element ? element->to_string() : "") << ", ";
+        }
+        stream << ")";
+
+        return stream.str();
+    }
+
+
+    std::string DictionaryLiteralNode::to_string() const {
+        std::stringstream stream;
+
+        stream << "(dictionary ";
+        for (std::size_t i = 0; i < this->keys.size(); i++) {
+            stream << (this->keys[i] ? this->keys[i]->to_string() : "") << ": "
+                << (this->values[i] ? this->values[i]->to_string() : "") << ", ";
+        }
+        stream << ")";
+
+        return stream.str();
+    }
+
+
     std::string StatementListNode::to_string() const {
         std::stringstream stream;
 
@@ -66,6 +115,22 @@ namespace pshellscript::parser::ast {
     }
 
 
+    std::string ForEachNode::to_string() const {
+        std::stringstream stream;
+
+        stream
+            << "(for "
+            << this->variable->to_string()
+            << " in "
+            << this->iterable->to_string()
+            << " "
+            << this->body->to_string()
+            << ')';
+
+        return stream.str();
+    }
+
+
     std::string IfStatementNode::to_string() const {
         std::stringstream stream;
 
@@ -75,6 +140,7 @@ namespace pshellscript::parser::ast {
             << this->condition->to_string()
             << "]"
             << this->body->to_string()
+            << (this->else_clause ? " else " + this->else_clause->to_string() : "")
             << ")";
 
         return stream.str();
@@ -96,7 +162,7 @@ namespace pshellscript::parser::ast {
         std::stringstream stream;
 
         stream 
-            << "(function " 
+            << (this->memoize ? "(memoize function " : "(function ")
             << this->name
             << "[" 
             << this->parameters->to_string()
@@ -108,6 +174,19 @@ namespace pshellscript::parser::ast {
     }
 
 
+    std::string FunctionLiteralNode::to_string() const {
+        std::stringstream stream;
+
+        stream << "(closure [";
+        for (const auto& capture : this->captures) {
+            stream << capture.name << ", ";
+        }
+        stream << "] " << this->definition->to_string() << ")";
+
+        return stream.str();
+    }
+
+
     std::string EchoStatementNode::to_string() const {
         return (
             std::stringstream() 
@@ -128,6 +207,74 @@ namespace pshellscript::parser::ast {
     }
 
 
+    std::string CommandNode::to_string() const {
+        std::stringstream stream;
+        stream << "(command " << this->name;
+        for (const auto& argument : this->arguments) {
+            stream << " " << argument->to_string();
+        }
+        stream << ")";
+
+        return stream.str();
+    }
+
+
+    std::string PipelineNode::to_string() const {
+        std::stringstream stream;
+        stream << "(pipeline";
+        for (const auto& stage : this->stages) {
+            stream << " " << stage->to_string();
+        }
+        stream << ")";
+
+        return stream.str();
+    }
+
+
+    std::string SubstitutionNode::to_string() const {
+        return "(substitution " + this->body->to_string() + ")";
+    }
+
+
+    std::string SubshellNode::to_string() const {
+        return "(subshell " + this->body->to_string() + ")";
+    }
+
+
+    std::string BackgroundNode::to_string() const {
+        return "(background " + this->statement->to_string() + ")";
+    }
+
+
+    std::string TimedNode::to_string() const {
+        return "(time " + this->statement->to_string() + ")";
+    }
+
+
+    std::string ChainNode::to_string() const {
+        return std::string(this->on_success ? "(&& " : "(|| ") + this->left->to_string() + " " + this->right->to_string() + ")";
+    }
+
+
+    std::string RedirectionNode::to_string() const {
+        static const char* operators[] = { "<", ">", ">>", ">&" };
+
+        std::stringstream stream;
+        stream << "(redirect " << this->statement->to_string();
+        for (const auto& redirection : this->redirections) {
+            stream << " " << redirection.descriptor << operators[int(redirection.kind)];
+            if (redirection.target) {
+                stream << redirection.target->to_string();
+            } else {
+                stream << redirection.source;
+            }
+        }
+        stream << ")";
+
+        return stream.str();
+    }
+
+
     std::string BinaryExpressionNode::to_string() const {
         std::stringstream stream;
 
@@ -181,17 +328,59 @@ namespace pshellscript::parser::ast {
 
         return stream.str();
     }
+
+
+    std::string ValueCallNode::to_string() const {
+        std::stringstream stream;
+
+        stream
+            << "(call "
+            << this->callee->to_string()
+            << " ("
+            << this->arguments->to_string()
+            << " ))";
+
+        return stream.str();
+    }
+
+
+    std::string InlinedCallNode::to_string() const {
+        std::stringstream stream;
+
+        stream
+            << "(inline "
+            << this->call->name->to_string()
+            << " ("
+            << this->call->arguments->to_string()
+            << " ) {"
+            << this->body->to_string()
+            << "})";
+
+        return stream.str();
+    }
 }
 
 namespace pshellscript::parser {
-    std::unique_ptr<ast::StatementListNode> Parser::parse() {
+    Result<std::unique_ptr<ast::StatementListNode>> Parser::parse() {
         std::vector<std::unique_ptr<ast::BaseNode>> program;
 
         while (this->has_next()) {
+            auto start = this->token_number;
             auto statement = this->statement();
+
+            // A token that cannot start a statement would otherwise never
+            // be consumed.
+            if (this->token_number == start && this->has_next()) {
+                this->error("Unexpected '" + this->token_stream[start].lexeme + "'");
+                break;
+            }
+
             program.push_back(std::move(statement));
         }
 
+        if (!this->errors.empty()) {
+            return this->errors.front();
+        }
         return std::make_unique<ast::StatementListNode>(std::move(program));
     }
 
@@ -223,10 +412,23 @@ namespace pshellscript::parser {
     }
 
 
+    inline static bool is_assignment_operation(Token::Type type) {
+        return (
+            type == Token::Type::Equal ||
+            type == Token::Type::PlusEqual ||
+            type == Token::Type::MinusEqual ||
+            type == Token::Type::AsteriskEqual ||
+            type == Token::Type::SlashEqual ||
+            type == Token::Type::ModuloEqual
+        );
+    }
+
+
     inline static bool is_equality_operation(Token::Type type) {
         return (
             type == Token::Type::EqualEqual ||
-            type == Token::Type::BangEqual
+            type == Token::Type::BangEqual ||
+            type == Token::Type::EqualTilde
         );
     }
 
@@ -316,6 +518,13 @@ namespace pshellscript::parser {
                 );
             }
 
+            case Type::EqualTilde: {
+                return std::make_unique<ast::MatchNode>(
+                    std::move(left_side), 
+                    std::move(right_side)
+                );
+            }
+
             case Type::Equal: {
                 return std::make_unique<ast::AssignmentNode>(
                     std::move(left_side), 
@@ -337,6 +546,41 @@ namespace pshellscript::parser {
                 );
             }
 
+            case Type::PlusEqual: {
+                return std::make_unique<ast::PlusEqualNode>(
+                    std::move(left_side), 
+                    std::move(right_side)
+                );
+            }
+
+            case Type::MinusEqual: {
+                return std::make_unique<ast::MinusEqualNode>(
+                    std::move(left_side), 
+                    std::move(right_side)
+                );
+            }
+
+            case Type::AsteriskEqual: {
+                return std::make_unique<ast::TimesEqualNode>(
+                    std::move(left_side), 
+                    std::move(right_side)
+                );
+            }
+
+            case Type::SlashEqual: {
+                return std::make_unique<ast::DivideEqualNode>(
+                    std::move(left_side), 
+                    std::move(right_side)
+                );
+            }
+
+            case Type::ModuloEqual: {
+                return std::make_unique<ast::ModuloEqualNode>(
+                    std::move(left_side), 
+                    std::move(right_side)
+                );
+            }
+
             default: {
                 return nullptr;
             }
@@ -345,13 +589,58 @@ namespace pshellscript::parser {
 
 
     std::unique_ptr<ast::BaseNode> Parser::statement() {
+        if (this->depth == max_depth) {
+            return this->error("Maximum recursion depth exceeded");
+        }
+
+        this->depth++;
+        auto statement = this->simple_statement();
+        if (this->peek_type() == Token::Type::Pipe) {
+            statement = this->pipeline(std::move(statement));
+        }
+        while (this->peek_type() == Token::Type::AndAnd || this->peek_type() == Token::Type::OrOr) {
+            statement = this->chain(std::move(statement));
+        }
+        if (this->peek_type() == Token::Type::Background) {
+            statement = this->background(std::move(statement));
+        }
+
+        // Statements may optionally be separated by ';'.
+        if (this->peek_type() == Token::Type::SemiColon) {
+            this->next();
+        }
+
+        this->depth--;
+        return statement;
+    }
+
+
+    std::unique_ptr<ast::BaseNode> Parser::simple_statement() {
         using Type = Token::Type;
         auto type = this->peek_type();
         switch (type) {
             case Type::Function: {
+                // `function (` starts a function literal used as an expression.
+                if (this->peek_type(1) == Type::LeftParen) {
+                    return expression();
+                }
                 return this->function_definition();
             }
 
+            case Type::Memoize: {
+                // Skip 'memoize'.
+                this->next();
+                if (this->peek_type() != Type::Function) {
+                    return this->error("Expected 'function' after 'memoize'");
+                }
+
+                auto definition = this->function_definition();
+                if (definition != nullptr) {
+                    definition->memoize = true;
+                }
+                return definition;
+            }
+
             case Type::Echo: {
                 return this->echo_statement();
             }
@@ -368,6 +657,18 @@ namespace pshellscript::parser {
                 return this->for_loop();
             }
 
+            case Type::Command: {
+                return this->command();
+            }
+
+            case Type::SubshellStart: {
+                return this->subshell();
+            }
+
+            case Type::Time: {
+                return this->timed();
+            }
+
             default: {
                 return expression();
             }
@@ -375,39 +676,46 @@ namespace pshellscript::parser {
     }
 
 
-    std::unique_ptr<ast::ForLoopNode> Parser::for_loop() {
+    std::unique_ptr<ast::BaseNode> Parser::for_loop() {
         // Skip 'for.
         this->next();
 
         if (this->peek_type() != Token::Type::LeftParen) {
-            throw std::runtime_error("Expected '('");
+            return this->error<ast::ForLoopNode>("Expected '('");
         } else {
             this->next();
         }
 
+        // `for ($x in ...)` iterates over an array instead.
+        auto after_variable = std::size_t(this->token_number + 1);
+        if (this->peek_type() == Token::Type::Variable && after_variable < this->token_stream.size()
+                && this->token_stream[after_variable].type == Token::Type::In) {
+            return this->for_each_loop();
+        }
+
         auto assignment = this->assignment();
         if (this->peek_type() != Token::Type::SemiColon) {
-            throw std::runtime_error("Expected ';'");
+            return this->error<ast::ForLoopNode>("Expected ';'");
         } else {
             this->next();
         }
 
         auto condition = this->expression();
         if (this->peek_type() != Token::Type::SemiColon) {
-            throw std::runtime_error("Expected ';'");
+            return this->error<ast::ForLoopNode>("Expected ';'");
         } else {
             this->next();
         }
 
         auto update = this->assignment();
         if (this->peek_type() != Token::Type::RightParen) {
-            throw std::runtime_error("Expected ')'");
+            return this->error<ast::ForLoopNode>("Expected ')'");
         } else {
             this->next();
         }
 
         if (this->peek_type() != Token::Type::LeftBrace) {
-            throw std::runtime_error("Expected '{'");
+            return this->error<ast::ForLoopNode>("Expected '{'");
         } else {
             this->next();
         }
@@ -418,7 +726,7 @@ namespace pshellscript::parser {
         }
 
         if (this->peek_type() != Token::Type::RightBrace) {
-            throw std::runtime_error("Expected '}'");
+            return this->error<ast::ForLoopNode>("Expected '}'");
         } else {
             this->next();
         }
@@ -432,13 +740,52 @@ namespace pshellscript::parser {
     }
 
 
+    std::unique_ptr<ast::ForEachNode> Parser::for_each_loop() {
+        auto variable = this->variable();
+        this->mark_assigned(variable.get());
+
+        // Skip 'in'.
+        this->next();
+
+        auto iterable = this->expression();
+        if (this->peek_type() != Token::Type::RightParen) {
+            return this->error<ast::ForEachNode>("Expected ')'");
+        } else {
+            this->next();
+        }
+
+        if (this->peek_type() != Token::Type::LeftBrace) {
+            return this->error<ast::ForEachNode>("Expected '{'");
+        } else {
+            this->next();
+        }
+
+        std::vector<std::unique_ptr<ast::BaseNode>> body_statements;
+        while (this->has_next() && this->peek_type() != Token::Type::RightBrace) {
+            body_statements.push_back(this->statement());
+        }
+
+        if (this->peek_type() != Token::Type::RightBrace) {
+            return this->error<ast::ForEachNode>("Expected '}'");
+        } else {
+            this->next();
+        }
+
+        return std::make_unique<ast::ForEachNode>(
+            std::move(variable),
+            std::move(iterable),
+            std::make_unique<ast::StatementListNode>(std::move(body_statements))
+        );
+    }
+
+
     std::unique_ptr<ast::IfStatementNode> Parser::if_statement() {
         // Skip 'if'.
         this->next();
 
         // Skip '('
         if (this->peek_type() != Token::Type::LeftParen) {
-            throw std::runtime_error("Expected '('");
+            return this->error<ast::IfStatementNode>("Expected '('");
         } else {
             this->next();
         }
@@ -448,14 +795,14 @@ namespace pshellscript::parser {
 
         // Skip ')'
         if (this->peek_type() != Token::Type::RightParen) {
-            throw std::runtime_error("Expected ')'");
+            return this->error<ast::IfStatementNode>("Expected ')'");
         } else {
             this->next();
         }
 
         // Skip '{'
         if (this->peek_type() != Token::Type::LeftBrace) {
-            throw std::runtime_error("Expected '{'");
+            return this->error<ast::IfStatementNode>("Expected '{'");
         } else {
             this->next();
         }
@@ -467,7 +814,7 @@ namespace pshellscript::parser {
         
         // Skip '}'
         if (this->peek_type() != Token::Type::RightBrace) {
-            throw std::runtime_error("Expected '}'");
+            return this->error<ast::IfStatementNode>("Expected '}'");
         } else {
             this->next();
         }
@@ -475,16 +822,53 @@ namespace pshellscript::parser {
         return std::make_unique<ast::IfStatementNode>(
             std::move(condition),
             std::make_unique<ast::StatementListNode>(std::move(body_statements)),
-            nullptr
+            this->else_clause()
         );
     }
 
 
+    std::unique_ptr<ast::BaseNode> Parser::else_clause() {
+        if (this->peek_type() != Token::Type::Else) {
+            return nullptr;
+        }
+
+        // Skip 'else'.
+        this->next();
+
+        // An 'else if' chains another if statement.
+        if (this->peek_type() == Token::Type::If) {
+            return this->if_statement();
+        }
+
+        // Skip '{'
+        if (this->peek_type() != Token::Type::LeftBrace) {
+            return this->error("Expected '{'");
+        } else {
+            this->next();
+        }
+
+        std::vector<std::unique_ptr<ast::BaseNode>> body_statements;
+        while (this->has_next() && this->peek_type() != Token::Type::RightBrace) {
+            body_statements.push_back(this->statement());
+        }
+
+        // Skip '}'
+        if (this->peek_type() != Token::Type::RightBrace) {
+            return this->error("Expected '}'");
+        } else {
+            this->next();
+        }
+
+        return std::make_unique<ast::StatementListNode>(std::move(body_statements));
+    }
+
+
     std::unique_ptr<ast::ParamListNode> Parser::param_list() {
         std::vector<std::unique_ptr<ast::VariableNode>> params;
 
         while (this->has_next() && this->peek_type() != Token::Type::RightParen) {
-            auto param = this->variable();
+            // Not resolved: a parameter shadows any variable of the same name.
+            auto param = std::make_unique<ast::VariableNode>(this->next().lexeme);
             params.push_back(std::move(param));
 
             // Skip comma separator
@@ -502,15 +886,45 @@ namespace pshellscript::parser {
         this->next();
 
         // Get the function name.
-        if (this->peek_type() != Token::Type::Function) {
-            throw std::runtime_error("Expected an identifier.");
+        if (this->peek_type() != Token::Type::Identifier) {
+            return this->error<ast::FunctionDefinitionNode>("Expected an identifier.");
         }
 
         auto name = this->next();
 
+        auto enclosing_scopes = std::move(this->scopes);
+        this->scopes.clear();
+        auto definition = this->function_signature_and_body(name.lexeme);
+        this->scopes = std::move(enclosing_scopes);
+        return definition;
+    }
+
+
+    std::unique_ptr<ast::FunctionLiteralNode> Parser::function_literal() {
+        // Skip function keyword.
+        this->next();
+
+        auto definition = this->function_signature_and_body("");
+        if (definition == nullptr) {
+            return nullptr;
+        }
+
+        auto captures = std::move(this->scopes.back().captures);
+        this->scopes.pop_back();
+        return std::make_unique<ast::FunctionLiteralNode>(std::move(definition), std::move(captures));
+    }
+
+
+    /**
+     * Parse `($a, $b) { ... }` into a new scope pushed onto `scopes`, which
+     * the caller pops. Parameters get frame slots in declaration order.
+     * In a literal, a variable declared by an enclosing function is
+     * captured from it; every other variable is global.
+     */
+    std::unique_ptr<ast::FunctionDefinitionNode> Parser::function_signature_and_body(const std::string& name) {
         // Skip the opening parenthesis.
         if (this->peek_type() != Token::Type::LeftParen) {
-            throw std::runtime_error("Expected '('");
+            return this->error<ast::FunctionDefinitionNode>("Expected '('");
         } else {
             this->next();
         }
@@ -518,16 +932,28 @@ namespace pshellscript::parser {
         // Get the list of parameters.
         auto param_list = this->param_list();
 
+        this->scopes.emplace_back();
+        auto& locals = this->scopes.back().locals;
+        for (auto& parameter : param_list->parameters) {
+            if (locals.count(parameter->name)) {
+                return this->error<ast::FunctionDefinitionNode>("Duplicate parameter " + parameter->name);
+            }
+
+            parameter->slot = int(locals.size());
+            locals.emplace(parameter->name, Local { parameter->slot, false, false, {} });
+        }
+        auto frame_size = locals.size();
+
         // Skip the closing parenthesis.
         if (this->peek_type() != Token::Type::RightParen) {
-            throw std::runtime_error("Expected ')'");
+            return this->error<ast::FunctionDefinitionNode>("Expected ')'");
         } else {
             this->next();
         }
 
         // Skip the first curly brace.
         if (this->peek_type() != Token::Type::LeftBrace) {
-            throw std::runtime_error("Expected '{'");
+            return this->error<ast::FunctionDefinitionNode>("Expected '{'");
         } else {
             this->next();
         }
@@ -539,26 +965,110 @@ namespace pshellscript::parser {
 
         // Skip the closing curly brace.
         if (this->peek_type() != Token::Type::RightBrace) {
-            throw std::runtime_error("Expected '}'");
+            return this->error<ast::FunctionDefinitionNode>("Expected '}'");
         } else {
             this->next();
         }
 
-        return std::make_unique<ast::FunctionDefinitionNode>(
-            name.lexeme,
+        auto definition = std::make_unique<ast::FunctionDefinitionNode>(
+            name,
             std::move(param_list),
             std::make_unique<ast::StatementListNode>(std::move(body_statements))
         );
+        definition->frame_size = frame_size;
+
+        // Every use of a parameter is known now, including the ones in nested
+        // literals. A closure can copy a parameter that never changes, but
+        // one that is assigned anywhere must be shared through a box.
+        for (auto& [parameter_name, local] : this->scopes.back().locals) {
+            if (!local.captured || !local.assigned) {
+                continue;
+            }
+
+            definition->boxed_slots.push_back(local.slot);
+            for (auto use : local.uses) {
+                use->boxed = true;
+            }
+        }
+        std::sort(definition->boxed_slots.begin(), definition->boxed_slots.end());
+        return definition;
+    }
+
+
+    /**
+     * Find the parameter `name` refers to in function `depth` of `scopes`,
+     * capturing it through every literal in between, or return nullptr if
+     * it is a global. `index` is set to a frame slot or a capture index.
+     */
+    Parser::Local* Parser::resolve(std::size_t depth, const std::string& name, bool& is_capture, int& index) {
+        auto& scope = this->scopes[depth];
+
+        auto local = scope.locals.find(name);
+        if (local != scope.locals.end()) {
+            is_capture = false;
+            index = local->second.slot;
+            return &local->second;
+        }
+
+        auto captured = scope.capture_indices.find(name);
+        if (captured != scope.capture_indices.end()) {
+            is_capture = true;
+            index = captured->second;
+            return scope.capture_origins[std::size_t(index)];
+        }
+
+        if (depth == 0) {
+            return nullptr;
+        }
+
+        bool from_capture = false;
+        int from_index = -1;
+        auto origin = this->resolve(depth - 1, name, from_capture, from_index);
+        if (origin == nullptr) {
+            return nullptr;
+        }
+
+        origin->captured = true;
+        is_capture = true;
+        index = int(scope.captures.size());
+        scope.capture_indices.emplace(name, index);
+        scope.captures.push_back({ name, from_capture, from_index });
+        scope.capture_origins.push_back(origin);
+        return origin;
+    }
+
+
+    // Record that a variable is stored to, which decides whether it is boxed.
+    void Parser::mark_assigned(const ast::BaseNode* target) {
+        if (target == nullptr || target->type != ast::NodeType::Variable || this->scopes.empty()) {
+            return;
+        }
+
+        bool is_capture = false;
+        int index = -1;
+        auto name = dynamic_cast<const ast::VariableNode*>(target)->name;
+        auto origin = this->resolve(this->scopes.size() - 1, name, is_capture, index);
+        if (origin != nullptr) {
+            origin->assigned = true;
+        }
     }
 
 
     std::unique_ptr<ast::BaseNode> Parser::expression() {
-        return this->assignment();
+        if (this->depth == max_depth) {
+            return this->error("Maximum recursion depth exceeded");
+        }
+
+        this->depth++;
+        auto expression = this->assignment();
+        this->depth--;
+        return expression;
     }
 
     std::unique_ptr<ast::BaseNode> Parser::return_statement() {
         this->next();
-        if (!this->has_next()) {
+        auto type = this->peek_type();
+        if (!this->has_next() || type == Token::Type::SemiColon || type == Token::Type::RightBrace) {
             return std::make_unique<ast::ReturnStatementNode>(nullptr);
         }
 
@@ -570,38 +1080,241 @@ namespace pshellscript::parser {
     std::unique_ptr<ast::BaseNode> Parser::echo_statement() {
         this->next();
         auto operand = this->expression();
-        return std::make_unique<ast::EchoStatementNode>(std::move(operand));
+        std::unique_ptr<ast::BaseNode> echo = std::make_unique<ast::EchoStatementNode>(std::move(operand));
+
+        std::vector<ast::Redirection> redirections;
+        while (this->peek_type() == Token::Type::Redirect) {
+            if (!this->redirection(redirections)) {
+                return nullptr;
+            }
+        }
+
+        if (redirections.empty()) {
+            return echo;
+        }
+        return std::make_unique<ast::RedirectionNode>(std::move(echo), std::move(redirections));
+    }
+
+
+    // Redirections may come anywhere among a command's arguments.
+    std::unique_ptr<ast::BaseNode> Parser::command() {
+        auto name = this->next().lexeme;
+        std::vector<std::unique_ptr<ast::BaseNode>> arguments;
+        std::vector<ast::Redirection> redirections;
+
+        while (this->has_next()) {
+            if (this->peek_type() == Token::Type::Redirect) {
+                if (!this->redirection(redirections)) {
+                    return nullptr;
+                }
+                continue;
+            }
+
+            auto argument = this->command_argument();
+            if (argument == nullptr) {
+                break;
+            }
+            arguments.push_back(std::move(argument));
+        }
+
+        std::unique_ptr<ast::BaseNode> command = std::make_unique<ast::CommandNode>(name, std::move(arguments));
+        if (redirections.empty()) {
+            return command;
+        }
+        return std::make_unique<ast::RedirectionNode>(std::move(command), std::move(redirections));
+    }
+
+
+    // A word, string or variable given to a command, or null if the next
+    // token is none of them.
+    std::unique_ptr<ast::BaseNode> Parser::command_argument() {
+        switch (this->peek_type()) {
+            case Token::Type::Word: {
+                return std::make_unique<ast::StringNode>(this->next().lexeme);
+            }
+
+            case Token::Type::String: {
+                return this->string();
+            }
+
+            case Token::Type::InterpolationStart: {
+                return this->interpolation();
+            }
+
+            case Token::Type::Variable: {
+                return this->variable();
+            }
+
+            default: {
+                return nullptr;
+            }
+        }
+    }
+
+
+    // Parse a Redirect token and the file it names, if any.
+    bool Parser::redirection(std::vector<ast::Redirection>& redirections) {
+        std::string_view lexeme = this->next().lexeme;
+
+        ast::Redirection redirection;
+        redirection.descriptor = lexeme.front() == '<' ? 0 : 1;
+        if (std::isdigit(int(lexeme.front()))) {
+            redirection.descriptor = lexeme.front() - '0';
+            lexeme.remove_prefix(1);
+        }
+
+        if (lexeme.back() != '>' && lexeme.back() != '<' && std::isdigit(int(lexeme.back()))) {
+            redirection.kind = ast::Redirection::Kind::Duplicate;
+            redirection.source = lexeme.back() - '0';
+        } else if (lexeme == "<") {
+            redirection.kind = ast::Redirection::Kind::Input;
+        } else if (lexeme == ">>") {
+            redirection.kind = ast::Redirection::Kind::Append;
+        } else {
+            redirection.kind = ast::Redirection::Kind::Output;
+        }
+
+        if (redirection.kind != ast::Redirection::Kind::Duplicate) {
+            redirection.target = this->command_argument();
+            if (redirection.target == nullptr) {
+                this->error("Expected a file to redirect to");
+                return false;
+            }
+        }
+
+        redirections.push_back(std::move(redirection));
+        return true;
+    }
+
+
+    static inline bool can_be_piped(const ast::BaseNode* node) {
+        if (node != nullptr && node->type == ast::NodeType::Redirection) {
+            node = static_cast<const ast::RedirectionNode*>(node)->statement.get();
+        }
+        return node != nullptr && (
+            node->type == ast::NodeType::Command
+            || node->type == ast::NodeType::EchoStatement
+            || node->type == ast::NodeType::Subshell
+        );
+    }
+
+
+    std::unique_ptr<ast::BaseNode> Parser::pipeline(std::unique_ptr<ast::BaseNode> first) {
+        std::vector<std::unique_ptr<ast::BaseNode>> stages;
+        stages.push_back(std::move(first));
+
+        while (this->peek_type() == Token::Type::Pipe) {
+            if (!can_be_piped(stages.back().get())) {
+                return this->error("Only commands, echo and subshells can be piped");
+            }
+
+            // Skip '|'.
+            this->next();
+            stages.push_back(this->simple_statement());
+        }
+
+        if (!can_be_piped(stages.back().get())) {
+            return this->error("Only commands, echo and subshells can be piped");
+        }
+        return std::make_unique<ast::PipelineNode>(std::move(stages));
+    }
+
+
+    // Whether a statement is a command, or made of commands, as a job or a
+    // chain's side.
+    static inline bool runs_commands(const ast::BaseNode* node) {
+        return can_be_piped(node) || (node != nullptr && (
+            node->type == ast::NodeType::Pipeline
+            || node->type == ast::NodeType::Timed
+            || node->type == ast::NodeType::Chain
+        ));
+    }
+
+
+    std::unique_ptr<ast::BaseNode> Parser::chain(std::unique_ptr<ast::BaseNode> left_side) {
+        auto& operation = this->next();
+        if (!runs_commands(left_side.get())) {
+            return this->error("Only commands, echo, subshells and pipelines can be chained with '" + operation.lexeme + "'");
+        }
+
+        auto right_side = this->simple_statement();
+        if (this->peek_type() == Token::Type::Pipe) {
+            right_side = this->pipeline(std::move(right_side));
+        }
+        if (right_side == nullptr) {
+            return nullptr;
+        }
+        if (!runs_commands(right_side.get())) {
+            return this->error("Expected a command after '" + operation.lexeme + "'");
+        }
+
+        auto on_success = operation.type == Token::Type::AndAnd;
+        return std::make_unique<ast::ChainNode>(std::move(left_side), std::move(right_side), on_success);
+    }
+
+
+    std::unique_ptr<ast::BaseNode> Parser::background(std::unique_ptr<ast::BaseNode> statement) {
+        auto& token = this->next();
+        if (!runs_commands(statement.get())) {
+            return this->error("Only commands, echo, subshells and pipelines can run in the background");
+        }
+        return std::make_unique<ast::BackgroundNode>(std::move(statement), token.lexeme);
+    }
+
+
+    std::unique_ptr<ast::BaseNode> Parser::timed() {
+        // Skip 'time'.
+        this->next();
+
+        auto statement = this->simple_statement();
+        if (this->peek_type() == Token::Type::Pipe) {
+            statement = this->pipeline(std::move(statement));
+        }
+        if (statement == nullptr) {
+            return nullptr;
+        }
+        return std::make_unique<ast::TimedNode>(std::move(statement));
     }
 
 
     std::unique_ptr<ast::BaseNode> Parser::assignment() {
         std::unique_ptr<ast::BaseNode> left_side = this->disjunction();
-        while (this->has_next() && this->peek_type() == Token::Type::Equal) {
+        while (this->has_next() && is_assignment_operation(this->peek_type())) {
             auto operation = this->next();
             auto right_side = this->disjunction();
 
-            left_side = create_operator_node(
-                operation.type, 
-                std::move(left_side), 
-                std::move(right_side)
-            );
+            this->mark_assigned(left_side.get());
+            left_side = this->binary(operation, std::move(left_side), std::move(right_side));
         }
 
         return left_side;
     }
 
 
+    // An operator node, or an error if either operand could not be parsed,
+    // so that no node reaches the VM with a missing operand.
+    std::unique_ptr<ast::BaseNode> Parser::binary(
+        const Token& operation,
+        std::unique_ptr<ast::BaseNode> left_side,
+        std::unique_ptr<ast::BaseNode> right_side
+    ) {
+        if (left_side == nullptr) {
+            return this->error("Expected an expression before '" + operation.lexeme + "'");
+        }
+        if (right_side == nullptr) {
+            return this->error("Expected an expression after '" + operation.lexeme + "'");
+        }
+        return create_operator_node(operation.type, std::move(left_side), std::move(right_side));
+    }
+
+
     std::unique_ptr<ast::BaseNode> Parser::disjunction() {
         auto left_side = this->conjunction();
         while (this->has_next() && this->peek_type() == Token::Type::OrOr) {
             auto operation = this->next();
             auto right_side = this->conjunction();
 
-            left_side = create_operator_node(
-                operation.type, 
-                std::move(left_side), 
-                std::move(right_side)
-            );
+            left_side = this->binary(operation, std::move(left_side), std::move(right_side));
         }
 
         return left_side;
@@ -614,11 +1327,7 @@ namespace pshellscript::parser {
             auto operation = this->next();
             auto right_side = this->equality();
 
-            left_side = create_operator_node(
-                operation.type, 
-                std::move(left_side), 
-                std::move(right_side)
-            );
+            left_side = this->binary(operation, std::move(left_side), std::move(right_side));
         }
 
         return left_side;
@@ -631,11 +1340,7 @@ namespace pshellscript::parser {
             auto operation = this->next();
             auto right_side = this->comparison();
 
-            left_side = create_operator_node(
-                operation.type, 
-                std::move(left_side), 
-                std::move(right_side)
-            );
+            left_side = this->binary(operation, std::move(left_side), std::move(right_side));
         }
 
         return left_side;
@@ -648,11 +1353,7 @@ namespace pshellscript::parser {
             auto operation = this->next();
             auto right_side = this->term();
 
-            left_side = create_operator_node(
-                operation.type, 
-                std::move(left_side), 
-                std::move(right_side)
-            );
+            left_side = this->binary(operation, std::move(left_side), std::move(right_side));
         }
 
         return left_side;
@@ -665,11 +1366,7 @@ namespace pshellscript::parser {
             auto operation = this->next();
             auto right_side = this->factor();
 
-            left_side = create_operator_node(
-                operation.type, 
-                std::move(left_side), 
-                std::move(right_side)
-            );
+            left_side = this->binary(operation, std::move(left_side), std::move(right_side));
         }
 
         return left_side;
@@ -682,11 +1379,7 @@ namespace pshellscript::parser {
             auto operation = this->next();
             auto right_side = this->unary();
 
-            left_side = create_operator_node(
-                operation.type, 
-                std::move(left_side), 
-                std::move(right_side)
-            );
+            left_side = this->binary(operation, std::move(left_side), std::move(right_side));
         }
 
         return left_side;
@@ -700,18 +1393,66 @@ namespace pshellscript::parser {
         switch (token_type) {
             case Type::Bang: {
                 this->next();
-                return std::make_unique<ast::NotExpressionNode>(this->primary());
+                auto operand = this->postfix();
+                if (operand == nullptr) {
+                    return this->error("Expected an expression after '!'");
+                }
+                return std::make_unique<ast::NotExpressionNode>(std::move(operand));
             }
 
             case Type::Minus: {
                 this->next();
-                return std::make_unique<ast::NegationExpressionNode>(this->primary());
+                auto operand = this->postfix();
+                if (operand == nullptr) {
+                    return this->error("Expected an expression after '-'");
+                }
+                return std::make_unique<ast::NegationExpressionNode>(std::move(operand));
             }
 
             default: {
-                return this->primary();
+                return this->postfix();
+            }
+        }
+    }
+
+
+    std::unique_ptr<ast::BaseNode> Parser::postfix() {
+        auto operand = this->primary();
+
+        while (operand != nullptr) {
+            if (this->peek_type() == Token::Type::LeftParen) {
+                // Skip '('.
+                this->next();
+
+                auto args = this->arg_list();
+                if (this->peek_type() != Token::Type::RightParen) {
+                    return this->error("Expected ')'.");
+                } else {
+                    this->next();
+                }
+
+                operand = std::make_unique<ast::ValueCallNode>(std::move(operand), std::move(args));
+                continue;
+            }
+
+            if (this->peek_type() != Token::Type::LeftBracket) {
+                break;
+            }
+
+            // Skip '['.
+            this->next();
+
+            auto index = this->expression();
+            if (this->peek_type() != Token::Type::RightBracket) {
+                return this->error("Expected ']'");
+            } else {
+                this->next();
             }
+
+            operand = std::make_unique<ast::IndexNode>(std::move(operand), std::move(index));
         }
+
+        return operand;
     }
 
 
@@ -721,7 +1462,7 @@ namespace pshellscript::parser {
 
         switch (token_type) {
             case Type::Eof: {
-                throw std::runtime_error("Expected an expression.");
+                return this->error("Expected an expression.");
             }
 
             case Type::True:
@@ -729,7 +1470,8 @@ namespace pshellscript::parser {
                 return this->boolean();
             }
 
-            case Type::Number: {
+            case Type::Number:
+            case Type::Integer: {
                 return this->number();
             }
 
@@ -737,22 +1479,44 @@ namespace pshellscript::parser {
                 return this->string();
             }
 
+            case Type::InterpolationStart: {
+                return this->interpolation();
+            }
+
+            case Type::SubstitutionStart: {
+                return this->substitution();
+            }
+
             case Type::Variable: {
                 return this->variable();
             }
 
             case Type::Identifier: {
+                // A function name on its own is the function as a value.
+                if (this->peek_type(1) != Type::LeftParen) {
+                    return std::make_unique<ast::IdentifierNode>(this->next().lexeme);
+                }
                 return this->function_call();
             }
 
+            case Type::Function: {
+                return this->function_literal();
+            }
+
             case Type::LeftParen: {
                 return this->parentheses();
             }
 
+            case Type::LeftBracket: {
+                return this->array_literal();
+            }
+
+            case Type::LeftBrace: {
+                return this->dictionary_literal();
+            }
+
             default: {
-                // Returns nullptr. For example, if a user calls a function that takes
-                // one argument without passing the argument, null gets passed instead.
-                return nullptr;
+                return this->error("Expected an expression");
             }
         }
     }
@@ -760,7 +1524,7 @@ namespace pshellscript::parser {
 
     std::unique_ptr<ast::FunctionCallNode> Parser::function_call() {
         if (this->peek_type() != Token::Type::Identifier) {
-            throw std::runtime_error("Expected an identifier.");
+            return this->error<ast::FunctionCallNode>("Expected an identifier.");
         }
 
         auto name = std::make_unique<ast::IdentifierNode>(
@@ -768,18 +1532,18 @@ namespace pshellscript::parser {
         );
 
         if (this->peek_type() != Token::Type::LeftParen) {
-            throw std::runtime_error("Expected '('.");
+            return this->error<ast::FunctionCallNode>("Expected '('.");
         } else {
             this->next();
         }
 
         if (!this->has_next()) {
-            throw std::runtime_error("Expected an expression.");
+            return this->error<ast::FunctionCallNode>("Expected an expression.");
         }
 
         auto args = this->arg_list();
         if (this->peek_type() != Token::Type::RightParen) {
-            throw std::runtime_error("Expected ')'.");
+            return this->error<ast::FunctionCallNode>("Expected ')'.");
         } else {
             this->next();
         }
@@ -813,13 +1577,16 @@ namespace pshellscript::parser {
         auto last = this->next();
 
         if (!this->has_next()) {
-            throw std::runtime_error("Expected an expression after " + last.lexeme);
+            return this->error("Expected an expression after " + last.lexeme);
         }
 
         auto inner_expression = this->expression();
+        if (inner_expression == nullptr) {
+            return nullptr;
+        }
 
-        if (!this->has_next()) {
-            throw std::runtime_error("Expected ')'.");
+        if (this->peek_type() != Token::Type::RightParen) {
+            return this->error("Expected ')'.");
         }
 
         this->next();
@@ -827,10 +1594,84 @@ namespace pshellscript::parser {
     }
 
 
+    std::unique_ptr<ast::ArrayLiteralNode> Parser::array_literal() {
+        // Skip '['.
+        this->next();
+
+        std::vector<std::unique_ptr<ast::BaseNode>> elements;
+        while (this->has_next() && this->peek_type() != Token::Type::RightBracket) {
+            auto start = this->token_number;
+            elements.push_back(this->expression());
+
+            // Skip comma separator
+            if (this->peek_type() == Token::Type::Comma) {
+                this->next();
+            } else if (this->token_number == start) {
+                break;
+            }
+        }
+
+        if (this->peek_type() != Token::Type::RightBracket) {
+            return this->error<ast::ArrayLiteralNode>("Expected ']'");
+        } else {
+            this->next();
+        }
+
+        return std::make_unique<ast::ArrayLiteralNode>(std::move(elements));
+    }
+
+
+    std::unique_ptr<ast::DictionaryLiteralNode> Parser::dictionary_literal() {
+        // Skip '{'.
+        this->next();
+
+        std::vector<std::unique_ptr<ast::BaseNode>> keys;
+        std::vector<std::unique_ptr<ast::BaseNode>> values;
+        while (this->has_next() && this->peek_type() != Token::Type::RightBrace) {
+            auto key = this->expression();
+            if (this->peek_type() != Token::Type::Colon) {
+                return this->error<ast::DictionaryLiteralNode>("Expected ':'");
+            } else {
+                this->next();
+            }
+
+            auto start = this->token_number;
+            keys.push_back(std::move(key));
+            values.push_back(this->expression());
+
+            // Skip comma separator
+            if (this->peek_type() == Token::Type::Comma) {
+                this->next();
+            } else if (this->token_number == start) {
+                break;
+            }
+        }
+
+        if (this->peek_type() != Token::Type::RightBrace) {
+            return this->error<ast::DictionaryLiteralNode>("Expected '}'");
+        } else {
+            this->next();
+        }
+
+        return std::make_unique<ast::DictionaryLiteralNode>(std::move(keys), std::move(values));
+    }
+
+
     std::unique_ptr<ast::VariableNode> Parser::variable() {
         auto& token = this->next();
-        auto prefixed_name = token.lexeme;
-        return std::make_unique<ast::VariableNode>(prefixed_name);
+        auto variable = std::make_unique<ast::VariableNode>(token.lexeme);
+        if (this->scopes.empty()) {
+            return variable;
+        }
+
+        bool is_capture = false;
+        int index = -1;
+        auto origin = this->resolve(this->scopes.size() - 1, variable->name, is_capture, index);
+        if (origin != nullptr) {
+            (is_capture ? variable->capture : variable->slot) = index;
+            origin->uses.push_back(variable.get());
+        }
+        return variable;
     }
 
 
@@ -842,8 +1683,98 @@ namespace pshellscript::parser {
     }
 
 
-    std::unique_ptr<ast::NumberNode> Parser::number() {
+    std::unique_ptr<ast::BaseNode> Parser::interpolation() {
+        std::vector<std::string> segments = { this->next().lexeme };
+        std::vector<std::unique_ptr<ast::BaseNode>> values;
+
+        while (true) {
+            auto value = this->expression();
+            if (value == nullptr) {
+                return this->error("Expected an expression in string interpolation");
+            }
+            values.push_back(std::move(value));
+
+            auto type = this->peek_type();
+            if (type != Token::Type::InterpolationPart && type != Token::Type::InterpolationEnd) {
+                return this->error("Expected the end of an interpolated expression");
+            }
+
+            segments.push_back(this->next().lexeme);
+            if (type == Token::Type::InterpolationEnd) {
+                break;
+            }
+        }
+
+        return std::make_unique<ast::InterpolationNode>(std::move(segments), std::move(values));
+    }
+
+
+    std::unique_ptr<ast::BaseNode> Parser::substitution() {
+        // Skip '$('.
+        this->next();
+
+        std::vector<std::unique_ptr<ast::BaseNode>> statements;
+        while (this->has_next() && this->peek_type() != Token::Type::RightParen) {
+            statements.push_back(this->statement());
+        }
+
+        if (this->peek_type() != Token::Type::RightParen) {
+            return this->error("Expected ')'");
+        }
+        this->next();
+
+        return std::make_unique<ast::SubstitutionNode>(
+            std::make_unique<ast::StatementListNode>(std::move(statements))
+        );
+    }
+
+
+    // `(statements)`, and the redirections after it.
+    std::unique_ptr<ast::BaseNode> Parser::subshell() {
+        // Skip '('.
+        this->next();
+
+        std::vector<std::unique_ptr<ast::BaseNode>> statements;
+        while (this->has_next() && this->peek_type() != Token::Type::RightParen) {
+            statements.push_back(this->statement());
+        }
+
+        if (this->peek_type() != Token::Type::RightParen) {
+            return this->error("Expected ')'");
+        }
+        this->next();
+
+        std::unique_ptr<ast::BaseNode> subshell = std::make_unique<ast::SubshellNode>(
+            std::make_unique<ast::StatementListNode>(std::move(statements))
+        );
+
+        std::vector<ast::Redirection> redirections;
+        while (this->peek_type() == Token::Type::Redirect) {
+            if (!this->redirection(redirections)) {
+                return nullptr;
+            }
+        }
+
+        if (redirections.empty()) {
+            return subshell;
+        }
+        return std::make_unique<ast::RedirectionNode>(std::move(subshell), std::move(redirections));
+    }
+
+
+    std::unique_ptr<ast::BaseNode> Parser::number() {
         auto& token = this->next();
+
+        // Integer literals too large for 64 bits become doubles.
+        if (token.type == Token::Type::Integer) {
+            std::int64_t integer_value = 0;
+            const auto* end = token.lexeme.data() + token.lexeme.size();
+            auto result = std::from_chars(token.lexeme.data(), end, integer_value);
+            if (result.ec == std::errc() && result.ptr == end) {
+                return std::make_unique<ast::IntegerNode>(integer_value);
+            }
+        }
+
         auto numeric_value = std::stod(token.lexeme);
         return std::make_unique<ast::NumberNode>(numeric_value);
     }
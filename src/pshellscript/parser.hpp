@@ -1,36 +1,48 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include <map>
 #include <string>
 #include <memory>
 #include <vector>
+#include <cstdint>
 #include "../result.hpp"
 #include "tokens.hpp"
 
 
+namespace pshellscript::vm {
+    struct Function;
+    struct Builtin;
+}
+
+
 namespace pshellscript::parser::ast {
     enum class NodeType {
         StatementList,
 
-        Number, String, Boolean, Variable,
-        Identifier,
+        Number, Integer, String, Interpolation, Boolean, Variable,
+        Identifier, ArrayLiteral, DictionaryLiteral,
 
-        ForLoop, IfStatement, ElseClause,
-        FunctionDefinition,
-        EchoStatement, ReturnStatement,
+        ForLoop, ForEachLoop, IfStatement, ElseClause,
+        FunctionDefinition, FunctionLiteral,
+        EchoStatement, ReturnStatement, Command, Pipeline, Redirection, Substitution,
+        Subshell, Background, Timed, Chain,
 
         AndExpression, OrExpression, EqualityExpression,
         ComparisonExpression, AddExpression, SubtractExpression,
         MultiplyExpression, DivideExpression, ModuloExpression,
         LogicalNegationExpression, ArithmeticNegationExpression,
-        FunctionCall, ParamList, ArgList,
+        FunctionCall, ValueCall, ParamList, ArgList,
         LessExpression, LessEqualExpression, 
         GreaterExpression, GreaterEqualExpression,
         PlusEqualExpression, MinusEqualExpression,
         TimesEqualExpression, DivideEqualExpression,
         ModuloEqualExpression,
         InequalityExpression,
-        AssignmentExpression
+        MatchExpression,
+        AssignmentExpression,
+        IndexExpression,
+        InlinedCall
     };
 
 
@@ -67,6 +79,16 @@ namespace pshellscript::parser::ast {
     };
 
 
+    struct IntegerNode : public BaseNode {
+        std::int64_t value;
+
+        inline IntegerNode(std::int64_t value)
+            : BaseNode(NodeType::Integer), value(value) {}
+
+        std::string to_string() const override;
+    };
+
+
     struct StringNode : public BaseNode {
         std::string value;
 
@@ -77,6 +99,34 @@ namespace pshellscript::parser::ast {
     };
 
 
+    // `"a $x b ${...}"`, planned at parse time: `segments` surround `values`,
+    // with one more segment than values, and their total length is known.
+    struct InterpolationNode : public BaseNode {
+        std::vector<std::string> segments;
+        std::vector<std::unique_ptr<BaseNode>> values;
+        std::size_t segments_length = 0;
+
+        // Every value is a plain variable, so reading them cannot run code.
+        bool reads_only_variables = true;
+
+        inline InterpolationNode(
+            std::vector<std::string>&& segments,
+            std::vector<std::unique_ptr<BaseNode>>&& values
+        ) : BaseNode(NodeType::Interpolation),
+            segments(std::move(segments)),
+            values(std::move(values)) {
+            for (const auto& segment : this->segments) {
+                this->segments_length += segment.size();
+            }
+            for (const auto& value : this->values) {
+                this->reads_only_variables = this->reads_only_variables && value->type == NodeType::Variable;
+            }
+        }
+
+        std::string to_string() const override;
+    };
+
+
     struct BooleanNode : public BaseNode {
         bool value;
 
@@ -90,8 +140,19 @@ namespace pshellscript::parser::ast {
     struct VariableNode : public BaseNode {
         std::string name;
 
-        inline VariableNode(const std::string& name)
-            : BaseNode(NodeType::Variable), name(name) {}
+        // Index into the enclosing function's frame, or -1 for a global.
+        int slot;
+
+        // Index into the captures of the running closure, or -1 if the
+        // variable is not captured from an enclosing function.
+        int capture = -1;
+
+        // Whether the slot or capture holds a box shared with closures,
+        // which is the case when the variable is both captured and assigned.
+        bool boxed = false;
+
+        inline VariableNode(const std::string& name, int slot = -1)
+            : BaseNode(NodeType::Variable), name(name), slot(slot) {}
 
         std::string to_string() const override;
     };
@@ -107,11 +168,56 @@ namespace pshellscript::parser::ast {
     };
 
 
+    struct ArrayLiteralNode : public BaseNode {
+        std::vector<std::unique_ptr<BaseNode>> elements;
+
+        inline ArrayLiteralNode(std::vector<std::unique_ptr<BaseNode>>&& elements)
+            : BaseNode(NodeType::ArrayLiteral), elements(std::move(elements)) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // `{key: value, ...}`; `keys[i]` pairs with `values[i]`.
+    struct DictionaryLiteralNode : public BaseNode {
+        std::vector<std::unique_ptr<BaseNode>> keys;
+        std::vector<std::unique_ptr<BaseNode>> values;
+
+        inline DictionaryLiteralNode(
+            std::vector<std::unique_ptr<BaseNode>>&& keys,
+            std::vector<std::unique_ptr<BaseNode>>&& values
+        ) : BaseNode(NodeType::DictionaryLiteral),
+            keys(std::move(keys)),
+            values(std::move(values)) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // Shape of a numeric induction loop such as `for ($i = 0; $i < $n; $i += 1)`.
+    // The VM fills this in the first time a loop runs so that later runs of the
+    // same loop can skip straight to the native counter.
+    struct CountedLoop {
+        enum class State { Unanalyzed, Generic, Counted };
+
+        State state = State::Unanalyzed;
+        const VariableNode* variable = nullptr;
+        const BaseNode* start = nullptr;
+        const BaseNode* bound = nullptr;
+        NodeType comparison = NodeType::LessExpression;
+        double step = 0;
+        bool integer_step = false;
+        bool body_reads_variable = false;
+        bool body_has_calls = false;
+    };
+
+
     struct ForLoopNode : public BaseNode {
         std::unique_ptr<BaseNode> initialization;
         std::unique_ptr<BaseNode> condition;
         std::unique_ptr<BaseNode> update;
         std::unique_ptr<StatementListNode> body;
+        mutable CountedLoop counted_loop;
 
         inline ForLoopNode(
             std::unique_ptr<BaseNode> initialization,
@@ -128,6 +234,26 @@ namespace pshellscript::parser::ast {
     };
 
 
+    // `for ($x in $array) { ... }` runs the body once per element, in order.
+    // Over a dictionary, it runs once per key, in insertion order.
+    struct ForEachNode : public BaseNode {
+        std::unique_ptr<VariableNode> variable;
+        std::unique_ptr<BaseNode> iterable;
+        std::unique_ptr<StatementListNode> body;
+
+        inline ForEachNode(
+            std::unique_ptr<VariableNode> variable,
+            std::unique_ptr<BaseNode> iterable,
+            std::unique_ptr<StatementListNode> body
+        ) : BaseNode(NodeType::ForEachLoop),
+            variable(std::move(variable)),
+            iterable(std::move(iterable)),
+            body(std::move(body)) {}
+
+        std::string to_string() const override;
+    };
+
+
     struct IfStatementNode : public BaseNode {
         std::unique_ptr<BaseNode> condition;
         std::unique_ptr<StatementListNode> body;
@@ -161,6 +287,13 @@ namespace pshellscript::parser::ast {
         std::string name;
         std::unique_ptr<ParamListNode> parameters;
         std::unique_ptr<StatementListNode> body;
+        bool memoize = false;
+
+        // Number of slots a call needs in its frame.
+        std::size_t frame_size = 0;
+
+        // Parameters that are moved into a box when a call starts.
+        std::vector<int> boxed_slots;
 
         inline FunctionDefinitionNode(
             const std::string& name,
@@ -175,6 +308,32 @@ namespace pshellscript::parser::ast {
     };
 
 
+    // `function ($x) { ... }` as an expression. Evaluating it creates a
+    // closure with a flat copy of the enclosing variables its body uses:
+    // `captures[i]` is read from the running frame, or from the running
+    // closure's own captures, and becomes capture i of the new closure.
+    struct FunctionLiteralNode : public BaseNode {
+        struct Capture {
+            std::string name;
+            bool from_capture;
+            int index;
+        };
+
+        // Owned apart from the program, since closures can outlive it.
+        std::shared_ptr<FunctionDefinitionNode> definition;
+        std::vector<Capture> captures;
+
+        inline FunctionLiteralNode(
+            std::shared_ptr<FunctionDefinitionNode> definition,
+            std::vector<Capture>&& captures
+        ) : BaseNode(NodeType::FunctionLiteral),
+            definition(std::move(definition)),
+            captures(std::move(captures)) {}
+
+        std::string to_string() const override;
+    };
+
+
     struct EchoStatementNode : public BaseNode {
         std::unique_ptr<BaseNode> argument;
 
@@ -195,6 +354,138 @@ namespace pshellscript::parser::ast {
     };
 
 
+    // `name arguments...` as a statement: runs the script function of that
+    // name, or else the executable found on PATH. Its value is the exit status.
+    struct CommandNode : public BaseNode {
+        std::string name;
+        std::vector<std::unique_ptr<BaseNode>> arguments;
+
+        inline CommandNode(
+            const std::string& name,
+            std::vector<std::unique_ptr<BaseNode>>&& arguments
+        ) : BaseNode(NodeType::Command),
+            name(name),
+            arguments(std::move(arguments)) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // `a | b | c`: commands, or echo statements, that run at the same time,
+    // each one's output being the next one's input.
+    struct PipelineNode : public BaseNode {
+        std::vector<std::unique_ptr<BaseNode>> stages;
+
+        inline PipelineNode(std::vector<std::unique_ptr<BaseNode>>&& stages)
+            : BaseNode(NodeType::Pipeline), stages(std::move(stages)) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // One of `< file`, `> file`, `>> file` or `>&2`, with the descriptor
+    // it applies to.
+    struct Redirection {
+        enum class Kind { Input, Output, Append, Duplicate };
+
+        Kind kind;
+        int descriptor;
+        // The descriptor copied by a Duplicate.
+        int source = -1;
+        // The file's name, for the others.
+        std::unique_ptr<BaseNode> target;
+    };
+
+
+    // `$(statements)`: what the statements write to standard output, as a
+    // string without its trailing newlines. They run as a subshell's do,
+    // and the VM decides in the same way whether they need a process.
+    struct SubstitutionNode : public BaseNode {
+        std::unique_ptr<StatementListNode> body;
+
+        mutable std::uint64_t version = 0;
+        mutable bool needs_process = false;
+
+        inline SubstitutionNode(std::unique_ptr<StatementListNode> body)
+            : BaseNode(NodeType::Substitution), body(std::move(body)) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // `(statements)`: the statements run with their own copy of the shell's
+    // variables, functions, working directory and environment, which is
+    // dropped when they finish. The VM decides, and remembers while the
+    // functions stay the same, whether they need a process of their own.
+    struct SubshellNode : public BaseNode {
+        std::unique_ptr<StatementListNode> body;
+
+        mutable std::uint64_t version = 0;
+        mutable bool needs_process = false;
+
+        inline SubshellNode(std::unique_ptr<StatementListNode> body)
+            : BaseNode(NodeType::Subshell), body(std::move(body)) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // `time statement`: runs the statement, then reports the time it took
+    // and what it and the programs it ran used.
+    struct TimedNode : public BaseNode {
+        std::unique_ptr<BaseNode> statement;
+
+        inline TimedNode(std::unique_ptr<BaseNode> statement)
+            : BaseNode(NodeType::Timed), statement(std::move(statement)) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // `left && right` or `left || right`: commands, pipelines or subshells,
+    // the right one run only when the left one's status is 0, or is not.
+    struct ChainNode : public BaseNode {
+        std::unique_ptr<BaseNode> left;
+        std::unique_ptr<BaseNode> right;
+        bool on_success;
+
+        inline ChainNode(std::unique_ptr<BaseNode> left, std::unique_ptr<BaseNode> right, bool on_success)
+            : BaseNode(NodeType::Chain), left(std::move(left)), right(std::move(right)), on_success(on_success) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // `statement &`: a command, pipeline or subshell started as a job, which
+    // runs while the shell goes on. `command` is its source, as `jobs` lists it.
+    struct BackgroundNode : public BaseNode {
+        std::unique_ptr<BaseNode> statement;
+        std::string command;
+
+        inline BackgroundNode(std::unique_ptr<BaseNode> statement, const std::string& command)
+            : BaseNode(NodeType::Background), statement(std::move(statement)), command(command) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // A command, echo statement or subshell with its descriptors redirected, applied
+    // in order while it runs.
+    struct RedirectionNode : public BaseNode {
+        std::unique_ptr<BaseNode> statement;
+        std::vector<Redirection> redirections;
+
+        inline RedirectionNode(
+            std::unique_ptr<BaseNode> statement,
+            std::vector<Redirection>&& redirections
+        ) : BaseNode(NodeType::Redirection),
+            statement(std::move(statement)),
+            redirections(std::move(redirections)) {}
+
+        std::string to_string() const override;
+    };
+
+
     struct BinaryExpressionNode : public BaseNode {
         std::unique_ptr<BaseNode> left_argument;
         std::unique_ptr<BaseNode> right_argument;
@@ -383,6 +674,20 @@ namespace pshellscript::parser::ast {
     };
 
 
+    // `text =~ pattern`: whether a regular expression matches the text.
+    struct MatchNode : public BinaryExpressionNode {
+        inline MatchNode(
+            std::unique_ptr<BaseNode> left_argument,
+            std::unique_ptr<BaseNode> right_argument
+        ) : BinaryExpressionNode(
+            NodeType::MatchExpression,
+            "=~",
+            std::move(left_argument),
+            std::move(right_argument)
+        ) {}
+    };
+
+
     struct AssignmentNode : public BinaryExpressionNode {
         inline AssignmentNode(
             std::unique_ptr<BaseNode> left_argument,
@@ -396,6 +701,85 @@ namespace pshellscript::parser::ast {
     };
 
 
+    struct PlusEqualNode : public BinaryExpressionNode {
+        inline PlusEqualNode(
+            std::unique_ptr<BaseNode> left_argument,
+            std::unique_ptr<BaseNode> right_argument
+        ) : BinaryExpressionNode(
+            NodeType::PlusEqualExpression,
+            "+=",
+            std::move(left_argument),
+            std::move(right_argument)
+        ) {}
+    };
+
+
+    struct MinusEqualNode : public BinaryExpressionNode {
+        inline MinusEqualNode(
+            std::unique_ptr<BaseNode> left_argument,
+            std::unique_ptr<BaseNode> right_argument
+        ) : BinaryExpressionNode(
+            NodeType::MinusEqualExpression,
+            "-=",
+            std::move(left_argument),
+            std::move(right_argument)
+        ) {}
+    };
+
+
+    struct TimesEqualNode : public BinaryExpressionNode {
+        inline TimesEqualNode(
+            std::unique_ptr<BaseNode> left_argument,
+            std::unique_ptr<BaseNode> right_argument
+        ) : BinaryExpressionNode(
+            NodeType::TimesEqualExpression,
+            "*=",
+            std::move(left_argument),
+            std::move(right_argument)
+        ) {}
+    };
+
+
+    struct DivideEqualNode : public BinaryExpressionNode {
+        inline DivideEqualNode(
+            std::unique_ptr<BaseNode> left_argument,
+            std::unique_ptr<BaseNode> right_argument
+        ) : BinaryExpressionNode(
+            NodeType::DivideEqualExpression,
+            "/=",
+            std::move(left_argument),
+            std::move(right_argument)
+        ) {}
+    };
+
+
+    struct ModuloEqualNode : public BinaryExpressionNode {
+        inline ModuloEqualNode(
+            std::unique_ptr<BaseNode> left_argument,
+            std::unique_ptr<BaseNode> right_argument
+        ) : BinaryExpressionNode(
+            NodeType::ModuloEqualExpression,
+            "%=",
+            std::move(left_argument),
+            std::move(right_argument)
+        ) {}
+    };
+
+
+    // `$array[$index]`; the left argument is the indexed expression.
+    struct IndexNode : public BinaryExpressionNode {
+        inline IndexNode(
+            std::unique_ptr<BaseNode> left_argument,
+            std::unique_ptr<BaseNode> right_argument
+        ) : BinaryExpressionNode(
+            NodeType::IndexExpression,
+            "[]",
+            std::move(left_argument),
+            std::move(right_argument)
+        ) {}
+    };
+
+
     struct UnaryExpressionNode : public BaseNode {
         std::unique_ptr<BaseNode> argument;
         std::string lexeme;
@@ -416,7 +800,7 @@ namespace pshellscript::parser::ast {
         inline NotExpressionNode(
             std::unique_ptr<BaseNode> argument
         ) : UnaryExpressionNode(
-            NodeType::AndExpression, 
+            NodeType::LogicalNegationExpression, 
             std::move(argument), 
             "!"
         ) {}
@@ -444,9 +828,21 @@ namespace pshellscript::parser::ast {
     };
 
 
+    // Callee of a call site as resolved by the VM on its first run. The entry
+    // is only trusted while `version` matches the registry's function version,
+    // which changes whenever any function is (re)defined.
+    struct CallSiteCache {
+        std::uint64_t version = 0;
+        vm::Function* function = nullptr;
+        const vm::Builtin* builtin = nullptr;
+        std::size_t frame_size = 0;
+    };
+
+
     struct FunctionCallNode : public BaseNode {
         std::unique_ptr<IdentifierNode> name;
         std::unique_ptr<ArgListNode> arguments;
+        mutable CallSiteCache cache;
 
         inline FunctionCallNode(
             std::unique_ptr<IdentifierNode> name,
@@ -457,6 +853,54 @@ namespace pshellscript::parser::ast {
 
         std::string to_string() const override;
     };
+
+
+    // `$callback(...)`: a call to whatever function value `callee` evaluates to.
+    struct ValueCallNode : public BaseNode {
+        std::unique_ptr<BaseNode> callee;
+        std::unique_ptr<ArgListNode> arguments;
+
+        inline ValueCallNode(
+            std::unique_ptr<BaseNode> callee,
+            std::unique_ptr<ArgListNode> arguments
+        ) : BaseNode(NodeType::ValueCall),
+            callee(std::move(callee)),
+            arguments(std::move(arguments)) {}
+
+        std::string to_string() const override;
+    };
+
+
+    // A call whose callee body has been copied in place by the optimizer. The
+    // arguments are stored into `slot_count` caller frame slots starting at
+    // `base_slot`, which the copied body uses as its parameters. If the callee
+    // has been redefined since, the original call runs instead. Holding on to
+    // the callee keeps its address from being reused by a later definition.
+    struct InlinedCallNode : public BaseNode {
+        std::unique_ptr<FunctionCallNode> call;
+        std::shared_ptr<const FunctionDefinitionNode> callee;
+        std::unique_ptr<StatementListNode> body;
+        int base_slot;
+        std::size_t slot_count;
+
+        mutable std::uint64_t version = 0;
+        mutable bool callee_is_current = false;
+
+        inline InlinedCallNode(
+            std::unique_ptr<FunctionCallNode> call,
+            std::shared_ptr<const FunctionDefinitionNode> callee,
+            std::unique_ptr<StatementListNode> body,
+            int base_slot,
+            std::size_t slot_count
+        ) : BaseNode(NodeType::InlinedCall),
+            call(std::move(call)),
+            callee(std::move(callee)),
+            body(std::move(body)),
+            base_slot(base_slot),
+            slot_count(slot_count) {}
+
+        std::string to_string() const override;
+    };
 }
 
 
@@ -467,9 +911,40 @@ namespace pshellscript::parser {
         std::vector<Error> errors;
         long token_number = 0;
 
-
-        inline std::unique_ptr<ast::BaseNode> error(const std::string& message) {
-            this->errors.push_back(message);
+        // A parameter of a function being parsed, and what the resolver has
+        // seen done to it so far.
+        struct Local {
+            int slot;
+            bool captured = false;
+            bool assigned = false;
+            std::vector<ast::VariableNode*> uses;
+        };
+
+        // The variables a function being parsed can see without going
+        // through the globals: its parameters, and the variables of
+        // enclosing functions it has captured so far.
+        struct Scope {
+            std::map<std::string, Local> locals;
+            std::map<std::string, int> capture_indices;
+            std::vector<ast::FunctionLiteralNode::Capture> captures;
+            std::vector<Local*> capture_origins;
+        };
+
+        // Function literals being parsed, each nested in the one before. A
+        // named function starts a new chain, since it is defined globally and
+        // cannot see the variables of the function it appears in.
+        std::vector<Scope> scopes;
+
+        // Statements and expressions being parsed, each nested in the one
+        // before, up to a limit that keeps deeply nested source from
+        // overflowing the native stack.
+        static constexpr int max_depth = 256;
+        int depth = 0;
+
+
+        template <typename Node = ast::BaseNode>
+        inline std::unique_ptr<Node> error(const std::string& message) {
+            this->errors.push_back(Error(message));
             return nullptr;
         }
         
@@ -479,31 +954,51 @@ namespace pshellscript::parser {
         }
 
 
+        // Parsing stops at the first error: the rest of the input looks
+        // empty, so every rule unwinds without consuming more tokens.
         inline bool has_next() {
-            return size_t(this->token_number) < this->token_stream.size();
+            return this->errors.empty() && size_t(this->token_number) < this->token_stream.size();
         }
 
 
-        inline Token::Type peek_type() {
-            if (!this->has_next()) {
+        inline Token::Type peek_type(long ahead = 0) {
+            if (!this->has_next() || std::size_t(this->token_number + ahead) >= this->token_stream.size()) {
                 return Token::Type::Eof;
             } else {
-                auto token = this->token_stream[this->token_number];
+                auto token = this->token_stream[this->token_number + ahead];
                 return token.type;
             }
         }
 
 
         std::unique_ptr<ast::BaseNode> statement();
-        std::unique_ptr<ast::ForLoopNode> for_loop();
+        std::unique_ptr<ast::BaseNode> simple_statement();
+        std::unique_ptr<ast::BaseNode> for_loop();
+        std::unique_ptr<ast::ForEachNode> for_each_loop();
         std::unique_ptr<ast::IfStatementNode> if_statement();
         std::unique_ptr<ast::BaseNode> else_clause();
         std::unique_ptr<ast::FunctionDefinitionNode> function_definition();
+        std::unique_ptr<ast::FunctionLiteralNode> function_literal();
+        std::unique_ptr<ast::FunctionDefinitionNode> function_signature_and_body(const std::string& name);
         std::unique_ptr<ast::ParamListNode> param_list();
+        Local* resolve(std::size_t depth, const std::string& name, bool& is_capture, int& index);
+        void mark_assigned(const ast::BaseNode* target);
         std::unique_ptr<ast::BaseNode> echo_statement();
         std::unique_ptr<ast::BaseNode> return_statement();
+        std::unique_ptr<ast::BaseNode> command();
+        std::unique_ptr<ast::BaseNode> command_argument();
+        bool redirection(std::vector<ast::Redirection>& redirections);
+        std::unique_ptr<ast::BaseNode> pipeline(std::unique_ptr<ast::BaseNode> first);
+        std::unique_ptr<ast::BaseNode> chain(std::unique_ptr<ast::BaseNode> left_side);
+        std::unique_ptr<ast::BaseNode> background(std::unique_ptr<ast::BaseNode> statement);
+        std::unique_ptr<ast::BaseNode> timed();
         std::unique_ptr<ast::BaseNode> expression();
         std::unique_ptr<ast::BaseNode> assignment();
+        std::unique_ptr<ast::BaseNode> binary(
+            const Token& operation,
+            std::unique_ptr<ast::BaseNode> left_side,
+            std::unique_ptr<ast::BaseNode> right_side
+        );
         std::unique_ptr<ast::BaseNode> disjunction();
         std::unique_ptr<ast::BaseNode> conjunction();
         std::unique_ptr<ast::BaseNode> equality();
@@ -511,20 +1006,26 @@ namespace pshellscript::parser {
         std::unique_ptr<ast::BaseNode> term();
         std::unique_ptr<ast::BaseNode> factor();
         std::unique_ptr<ast::BaseNode> unary();
+        std::unique_ptr<ast::BaseNode> postfix();
         std::unique_ptr<ast::BaseNode> primary();
-        std::unique_ptr<ast::NumberNode> number();
+        std::unique_ptr<ast::BaseNode> number();
         std::unique_ptr<ast::StringNode> string();
+        std::unique_ptr<ast::BaseNode> interpolation();
+        std::unique_ptr<ast::BaseNode> substitution();
+        std::unique_ptr<ast::BaseNode> subshell();
         std::unique_ptr<ast::VariableNode> variable();
         std::unique_ptr<ast::ArgListNode> arg_list();
         std::unique_ptr<ast::FunctionCallNode> function_call();
         std::unique_ptr<ast::BaseNode> parentheses();
+        std::unique_ptr<ast::ArrayLiteralNode> array_literal();
+        std::unique_ptr<ast::DictionaryLiteralNode> dictionary_literal();
         std::unique_ptr<ast::BooleanNode> boolean();
 
     public:
         inline Parser(const std::vector<Token>& token_stream)
                 : token_stream(token_stream) {}
 
-        std::unique_ptr<ast::StatementListNode> parse();
+        Result<std::unique_ptr<ast::StatementListNode>> parse();
     };
 }
 
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "process.hpp"
+#include "environment.hpp"
+
+
+namespace pshellscript::process {
+    // Command names mapped to the executables they were found at, and the
+    // PATH they were found on.
+    static std::unordered_map<std::string, std::string> paths;
+    static std::string searched_path;
+
+
+    static bool is_executable(const std::string& path) {
+        struct stat status;
+        return ::stat(path.c_str(), &status) == 0 && S_ISREG(status.st_mode) && ::access(path.c_str(), X_OK) == 0;
+    }
+
+
+    // Look through each directory on PATH in order; an empty entry is the
+    // current directory.
+    static bool search_path(const std::string& name, std::string& found) {
+        std::string_view directories = searched_path;
+        while (true) {
+            auto end = directories.find(':');
+            auto directory = directories.substr(0, end);
+
+            found.assign(directory.empty() ? "." : directory);
+            found += '/';
+            found += name;
+            if (is_executable(found)) {
+                return true;
+            }
+
+            if (end == std::string_view::npos) {
+                return false;
+            }
+            directories.remove_prefix(end + 1);
+        }
+    }
+
+
+    Result<std::string> find_executable(const std::string& name) {
+        if (name.find('/') != std::string::npos) {
+            return name;
+        }
+
+        const char* path = environment::get("PATH");
+        if (path == nullptr) {
+            path = "/usr/local/bin:/usr/bin:/bin";
+        }
+        if (searched_path != path) {
+            paths.clear();
+            searched_path = path;
+        }
+
+        auto cached = paths.find(name);
+        if (cached != paths.end()) {
+            return cached->second;
+        }
+
+        std::string found;
+        if (!search_path(name, found)) {
+            return Error("Command not found: " + name);
+        }
+        paths.emplace(name, found);
+        return found;
+    }
+
+
+    void forget_paths() {
+        paths.clear();
+    }
+
+
+    static int spawn_program(
+        const std::string& path,
+        const std::vector<std::string>& arguments,
+        const Redirections& redirections,
+        bool own_group,
+        pid_t& pid
+    ) {
+        std::vector<char*> argv;
+        argv.reserve(arguments.size() + 1);
+        for (const auto& argument : arguments) {
+            argv.push_back(const_cast<char*>(argument.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        for (const auto& redirection : redirections) {
+            posix_spawn_file_actions_adddup2(&actions, redirection.source, redirection.target);
+        }
+
+        // The shell ignores SIGPIPE so that writing to a pipe whose reader has
+        // gone fails instead of killing it, and SIGTTOU to take the terminal
+        // back from a job; it blocks SIGCHLD to read it from a signalfd.
+        // Programs expect the defaults.
+        posix_spawnattr_t attributes;
+        posix_spawnattr_init(&attributes);
+        sigset_t defaults;
+        sigemptyset(&defaults);
+        sigaddset(&defaults, SIGPIPE);
+        sigaddset(&defaults, SIGTTOU);
+        posix_spawnattr_setsigdefault(&attributes, &defaults);
+        sigset_t mask;
+        ::sigprocmask(SIG_SETMASK, nullptr, &mask);
+        sigdelset(&mask, SIGCHLD);
+        posix_spawnattr_setsigmask(&attributes, &mask);
+
+        short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+        if (own_group) {
+            posix_spawnattr_setpgroup(&attributes, 0);
+            flags |= POSIX_SPAWN_SETPGROUP;
+        }
+        posix_spawnattr_setflags(&attributes, flags);
+
+        auto error = ::posix_spawn(&pid, path.c_str(), &actions, &attributes, argv.data(), environment::block());
+        posix_spawnattr_destroy(&attributes);
+        posix_spawn_file_actions_destroy(&actions);
+        return error;
+    }
+
+
+    static Result<pid_t> start(const std::vector<std::string>& arguments, const Redirections& redirections, bool own_group) {
+        const auto& name = arguments.front();
+        auto path = find_executable(name);
+        if (path.is_error()) {
+            return path.get_error();
+        }
+
+        pid_t pid = 0;
+        auto error = spawn_program(*path, arguments, redirections, own_group, pid);
+
+        // The program may have moved since it was found; look for it again.
+        if (error == ENOENT && paths.erase(name) != 0) {
+            path = find_executable(name);
+            if (path.is_error()) {
+                return path.get_error();
+            }
+            error = spawn_program(*path, arguments, redirections, own_group, pid);
+        }
+
+        if (error != 0) {
+            return Error("Cannot run " + name + ": " + std::strerror(error));
+        }
+        return pid;
+    }
+
+
+    Result<pid_t> start(const std::vector<std::string>& arguments, const Redirections& redirections) {
+        return start(arguments, redirections, false);
+    }
+
+
+    Result<pid_t> start_job(const std::vector<std::string>& arguments, const Redirections& redirections) {
+        return start(arguments, redirections, true);
+    }
+
+
+    void Usage::add(const Usage& other) {
+        this->real += other.real;
+        this->user += other.user;
+        this->system += other.system;
+        this->max_resident = std::max(this->max_resident, other.max_resident);
+        this->voluntary_switches += other.voluntary_switches;
+        this->involuntary_switches += other.involuntary_switches;
+    }
+
+
+    static inline double seconds(const timeval& time) {
+        return double(time.tv_sec) + double(time.tv_usec) / 1e6;
+    }
+
+
+    int wait(pid_t pid, Usage* usage) {
+        int status = 0;
+        rusage resources;
+        while (::wait4(pid, &status, 0, &resources) < 0) {
+            if (errno != EINTR) {
+                return 127;
+            }
+        }
+
+        if (usage != nullptr) {
+            usage->user = seconds(resources.ru_utime);
+            usage->system = seconds(resources.ru_stime);
+            usage->max_resident = resources.ru_maxrss;
+            usage->voluntary_switches = resources.ru_nvcsw;
+            usage->involuntary_switches = resources.ru_nivcsw;
+        }
+
+        if (WIFSIGNALED(status)) {
+            return 128 + WTERMSIG(status);
+        }
+        return WEXITSTATUS(status);
+    }
+
+
+    Result<int> run(const std::vector<std::string>& arguments) {
+        auto pid = start(arguments);
+        if (pid.is_error()) {
+            return pid.get_error();
+        }
+        return wait(*pid);
+    }
+
+
+    static std::size_t pipe_size = 0;
+
+
+    void set_pipe_size(std::size_t size) {
+        pipe_size = size;
+    }
+
+
+    std::size_t get_pipe_size() {
+        return pipe_size;
+    }
+
+
+    Result<Pipe> open_pipe() {
+        int ends[2];
+        if (::pipe2(ends, O_CLOEXEC) < 0) {
+            return Error(std::string("Cannot open a pipe: ") + std::strerror(errno));
+        }
+
+        // Larger buffers mean fewer context switches between the stages. The
+        // kernel caps the size for unprivileged users; the pipe still works
+        // with the default if it refuses.
+        if (pipe_size != 0) {
+            ::fcntl(ends[1], F_SETPIPE_SZ, int(pipe_size));
+        }
+        return Pipe { ends[0], ends[1] };
+    }
+
+
+    Result<int> open_file(const std::string& path, int flags) {
+        auto descriptor = ::open(path.c_str(), flags | O_CLOEXEC, 0666);
+        if (descriptor < 0) {
+            return Error("Cannot open " + path + ": " + std::strerror(errno));
+        }
+        return descriptor;
+    }
+
+
+    void read_all(int descriptor, std::string& text) {
+        auto size = text.size();
+        while (true) {
+            if (size == text.size()) {
+                text.resize(size < 4096 ? 4096 : size * 2);
+            }
+
+            auto count = ::read(descriptor, text.data() + size, text.size() - size);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                break;
+            }
+            size += std::size_t(count);
+        }
+        text.resize(size);
+    }
+
+
+    void write_all(int descriptor, std::string_view text) {
+        while (!text.empty()) {
+            auto count = ::write(descriptor, text.data(), text.size());
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return;
+            }
+            text.remove_prefix(std::size_t(count));
+        }
+    }
+
+
+    void close_descriptor(int& descriptor) {
+        if (descriptor >= 0) {
+            ::close(descriptor);
+            descriptor = -1;
+        }
+    }
+
+
+    Redirected::Redirected(const Redirections& redirections) {
+        for (const auto& redirection : redirections) {
+            // Kept above the standard streams, and out of programs started meanwhile.
+            auto copy = ::fcntl(redirection.target, F_DUPFD_CLOEXEC, 10);
+            this->saved.push_back(Redirection { redirection.target, copy });
+            ::dup2(redirection.source, redirection.target);
+        }
+    }
+
+
+    Redirected::~Redirected() {
+        for (auto redirection = this->saved.rbegin(); redirection != this->saved.rend(); redirection++) {
+            if (redirection->source < 0) {
+                ::close(redirection->target);
+                continue;
+            }
+            ::dup2(redirection->source, redirection->target);
+            ::close(redirection->source);
+        }
+    }
+}
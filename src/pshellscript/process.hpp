@@ -0,0 +1,120 @@
+#ifndef PROCESS_HPP
+#define PROCESS_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <sys/types.h>
+#include "../result.hpp"
+
+namespace pshellscript::process {
+    /**
+     * The file `name` runs from: `name` itself if it contains a '/', and
+     * otherwise the first executable of that name in the directories on
+     * PATH. Found paths are kept in a table until PATH changes or
+     * forget_paths() is called, so running a command again does not search
+     * the directories again. Names that are not found are not remembered.
+     */
+    Result<std::string> find_executable(const std::string& name);
+
+    // Empty the table of found paths, as `rehash` does.
+    void forget_paths();
+
+
+    // File descriptor `target` of a command is to be a copy of `source`.
+    struct Redirection {
+        int target;
+        int source;
+    };
+
+    using Redirections = std::vector<Redirection>;
+
+
+    /**
+     * Find and start `arguments[0]`, the rest being its arguments. The child
+     * shares the shell's environment and file descriptors 0 to 2, apart from
+     * those redirected. posix_spawn starts it without copying the shell's
+     * page tables, as fork would.
+     */
+    Result<pid_t> start(const std::vector<std::string>& arguments, const Redirections& redirections = {});
+
+    // Start a program as start() does, leading a process group of its own,
+    // as a background job.
+    Result<pid_t> start_job(const std::vector<std::string>& arguments, const Redirections& redirections);
+
+    /**
+     * Resources a child used, as wait4 reports them: CPU time in seconds,
+     * its largest resident set in kilobytes and its context switches, with
+     * those of the children it waited for in turn. `real` is the time that
+     * passed, which callers measure themselves.
+     */
+    struct Usage {
+        double real = 0;
+        double user = 0;
+        double system = 0;
+        // In KB; 0 when no child it covers was waited for.
+        long max_resident = 0;
+        long voluntary_switches = 0;
+        long involuntary_switches = 0;
+
+        // Add another's times and switches, keeping the larger resident set.
+        void add(const Usage& other);
+    };
+
+    // Wait for a child to finish, returning its exit status, or 128 plus the
+    // signal that ended it, and what it used into `usage` if given.
+    int wait(pid_t pid, Usage* usage = nullptr);
+
+    // Start `arguments[0]` and wait for it.
+    Result<int> run(const std::vector<std::string>& arguments);
+
+
+    // Both ends of a pipe. They are closed when a program is started.
+    struct Pipe {
+        int read;
+        int write;
+    };
+
+    // A new pipe, with the buffer size set by set_pipe_size if there is one.
+    Result<Pipe> open_pipe();
+
+    // Open a file for a redirection, with open(2) flags. The descriptor is
+    // closed in programs started later unless they are given it.
+    Result<int> open_file(const std::string& path, int flags);
+
+    // Read `descriptor` to its end, straight into the spare room of `text`,
+    // which grows as it fills.
+    void read_all(int descriptor, std::string& text);
+
+    // Write all of `text` to `descriptor`, stopping early if it cannot be
+    // written to, as when the reader of a pipe has gone.
+    void write_all(int descriptor, std::string_view text);
+
+    // Closes `descriptor` unless it is -1, and sets it to -1.
+    void close_descriptor(int& descriptor);
+
+    // The buffer size of pipes opened from now on; 0 keeps the kernel's.
+    void set_pipe_size(std::size_t size);
+    std::size_t get_pipe_size();
+
+
+    /**
+     * Point some of the shell's own file descriptors elsewhere for as long
+     * as this lives, for script code that runs as part of a pipeline or with
+     * its output redirected. Programs it starts inherit the redirections.
+     */
+    class Redirected {
+        // Each target, and a copy of what it was before, or -1 if it was closed.
+        std::vector<Redirection> saved;
+
+    public:
+        explicit Redirected(const Redirections& redirections);
+        ~Redirected();
+
+        Redirected(const Redirected&) = delete;
+        Redirected& operator=(const Redirected&) = delete;
+    };
+}
+
+#endif
@@ -0,0 +1,1080 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include "regex.hpp"
+
+namespace pshellscript::regex {
+    constexpr std::uint8_t matching_flag = 1;
+    constexpr std::uint8_t dead_flag = 2;
+    constexpr std::uint8_t restart_flag = 4;
+
+    constexpr std::uint32_t at_begin_marker = std::numeric_limits<std::uint32_t>::max();
+
+    // Repetition bounds and program size are limited so that a short
+    // pattern cannot expand to an enormous program.
+    constexpr int maximum_repetition = 1000;
+    constexpr std::size_t maximum_instructions = 50000;
+
+    // Memory the transitions of one pattern's DFA may use before the cache
+    // is emptied and rebuilt from the state the search is in.
+    constexpr std::size_t dfa_cache_bytes = 1 << 20;
+
+
+    struct Expression {
+        enum class Kind { Empty, Bytes, Concatenation, Alternation, Repetition, Begin, End };
+
+        Kind kind;
+        std::bitset<256> bytes;
+        std::vector<std::unique_ptr<Expression>> children;
+        int minimum = 0;
+        int maximum = -1;
+        bool lazy = false;
+
+        inline explicit Expression(Kind kind) : kind(kind) {}
+    };
+
+
+    using ExpressionPointer = std::unique_ptr<Expression>;
+
+
+    static inline ExpressionPointer make_bytes(const std::bitset<256>& bytes) {
+        auto expression = std::make_unique<Expression>(Expression::Kind::Bytes);
+        expression->bytes = bytes;
+        return expression;
+    }
+
+
+    // The byte of a set with exactly one member, or -1.
+    static inline int single_byte(const std::bitset<256>& set) {
+        if (set.count() != 1) {
+            return -1;
+        }
+        for (int byte = 0; byte < 256; byte++) {
+            if (set.test(std::size_t(byte))) {
+                return byte;
+            }
+        }
+        return -1;
+    }
+
+
+    static inline int hex_digit(char character) {
+        if (character >= '0' && character <= '9') return character - '0';
+        if (character >= 'a' && character <= 'f') return character - 'a' + 10;
+        if (character >= 'A' && character <= 'F') return character - 'A' + 10;
+        return -1;
+    }
+
+
+    class PatternParser {
+        std::string_view pattern;
+        std::size_t position = 0;
+
+        inline bool has_next() const {
+            return this->position < this->pattern.size();
+        }
+
+        inline char peek() const {
+            return this->pattern[this->position];
+        }
+
+        inline Error error(const std::string& reason) const {
+            return Error("Invalid regular expression: " + reason);
+        }
+
+        Result<ExpressionPointer> alternation();
+        Result<ExpressionPointer> concatenation();
+        Result<ExpressionPointer> repetition();
+        Result<ExpressionPointer> atom();
+        Result<std::bitset<256>> escape();
+        Result<std::bitset<256>> bracket();
+        Result<bool> quantifier(int& minimum, int& maximum);
+        bool bounds(int& minimum, int& maximum);
+
+    public:
+        inline explicit PatternParser(std::string_view pattern) : pattern(pattern) {}
+
+        Result<ExpressionPointer> parse();
+    };
+
+
+    Result<ExpressionPointer> PatternParser::parse() {
+        auto expression = this->alternation();
+        if (expression.is_error()) {
+            return expression;
+        }
+
+        // Only an unmatched ')' stops the top-level alternation early.
+        if (this->has_next()) {
+            return this->error("unmatched )");
+        }
+        return expression;
+    }
+
+
+    Result<ExpressionPointer> PatternParser::alternation() {
+        auto first = this->concatenation();
+        if (first.is_error() || !this->has_next() || this->peek() != '|') {
+            return first;
+        }
+
+        auto alternatives = std::make_unique<Expression>(Expression::Kind::Alternation);
+        alternatives->children.push_back(std::move(*first));
+        while (this->has_next() && this->peek() == '|') {
+            this->position++;
+            auto next = this->concatenation();
+            if (next.is_error()) {
+                return next;
+            }
+            alternatives->children.push_back(std::move(*next));
+        }
+        return ExpressionPointer(std::move(alternatives));
+    }
+
+
+    Result<ExpressionPointer> PatternParser::concatenation() {
+        auto sequence = std::make_unique<Expression>(Expression::Kind::Concatenation);
+        while (this->has_next() && this->peek() != '|' && this->peek() != ')') {
+            auto item = this->repetition();
+            if (item.is_error()) {
+                return item;
+            }
+            sequence->children.push_back(std::move(*item));
+        }
+
+        if (sequence->children.empty()) {
+            return std::make_unique<Expression>(Expression::Kind::Empty);
+        }
+        if (sequence->children.size() == 1) {
+            return std::move(sequence->children.front());
+        }
+        return ExpressionPointer(std::move(sequence));
+    }
+
+
+    Result<ExpressionPointer> PatternParser::repetition() {
+        auto next = this->peek();
+        if (next == '*' || next == '+' || next == '?') {
+            return this->error("nothing to repeat");
+        }
+
+        auto item = this->atom();
+        if (item.is_error()) {
+            return item;
+        }
+
+        auto expression = std::move(*item);
+        int minimum = 0;
+        int maximum = 0;
+        for (;;) {
+            auto found = this->quantifier(minimum, maximum);
+            if (found.is_error()) {
+                return found.get_error();
+            }
+            if (!*found) {
+                break;
+            }
+
+            auto kind = expression->kind;
+            if (kind == Expression::Kind::Begin || kind == Expression::Kind::End) {
+                return this->error("nothing to repeat");
+            }
+
+            auto repeated = std::make_unique<Expression>(Expression::Kind::Repetition);
+            repeated->minimum = minimum;
+            repeated->maximum = maximum;
+            if (this->has_next() && this->peek() == '?') {
+                this->position++;
+                repeated->lazy = true;
+            }
+            repeated->children.push_back(std::move(expression));
+            expression = std::move(repeated);
+        }
+        return expression;
+    }
+
+
+    // `{n}`, `{n,}` or `{n,m}` starting at the current '{'. Anything else
+    // is not a quantifier and leaves the position unchanged.
+    bool PatternParser::bounds(int& minimum, int& maximum) {
+        auto cursor = this->position + 1;
+        auto number = [&](int& value) {
+            auto start = cursor;
+            value = 0;
+            while (cursor < this->pattern.size() && std::isdigit(int(this->pattern[cursor]))) {
+                value = std::min(value * 10 + (this->pattern[cursor] - '0'), maximum_repetition + 1);
+                cursor++;
+            }
+            return cursor > start;
+        };
+
+        if (!number(minimum)) {
+            return false;
+        }
+
+        maximum = minimum;
+        if (cursor < this->pattern.size() && this->pattern[cursor] == ',') {
+            cursor++;
+            if (!number(maximum)) {
+                maximum = -1;
+            }
+        }
+
+        if (cursor >= this->pattern.size() || this->pattern[cursor] != '}') {
+            return false;
+        }
+        this->position = cursor + 1;
+        return true;
+    }
+
+
+    Result<bool> PatternParser::quantifier(int& minimum, int& maximum) {
+        if (!this->has_next()) {
+            return false;
+        }
+
+        switch (this->peek()) {
+            case '*': minimum = 0; maximum = -1; break;
+            case '+': minimum = 1; maximum = -1; break;
+            case '?': minimum = 0; maximum = 1; break;
+
+            case '{': {
+                if (!this->bounds(minimum, maximum)) {
+                    return false;
+                }
+                if (minimum > maximum_repetition || maximum > maximum_repetition) {
+                    return this->error("repetition count too large");
+                }
+                if (maximum >= 0 && maximum < minimum) {
+                    return this->error("repetition bounds out of order");
+                }
+                return true;
+            }
+
+            default: return false;
+        }
+
+        this->position++;
+        return true;
+    }
+
+
+    Result<ExpressionPointer> PatternParser::atom() {
+        auto character = this->pattern[this->position++];
+        switch (character) {
+            case '(': {
+                if (this->pattern.substr(this->position, 2) == "?:") {
+                    this->position += 2;
+                } else if (this->has_next() && this->peek() == '?') {
+                    return this->error("unsupported group");
+                }
+
+                auto inner = this->alternation();
+                if (inner.is_error()) {
+                    return inner;
+                }
+                if (!this->has_next() || this->peek() != ')') {
+                    return this->error("missing )");
+                }
+                this->position++;
+                return inner;
+            }
+
+            case '[': {
+                auto set = this->bracket();
+                if (set.is_error()) {
+                    return set.get_error();
+                }
+                return make_bytes(*set);
+            }
+
+            case '.': {
+                std::bitset<256> set;
+                set.set();
+                set.reset('\n');
+                return make_bytes(set);
+            }
+
+            case '^': {
+                return std::make_unique<Expression>(Expression::Kind::Begin);
+            }
+
+            case '$': {
+                return std::make_unique<Expression>(Expression::Kind::End);
+            }
+
+            case '\\': {
+                auto set = this->escape();
+                if (set.is_error()) {
+                    return set.get_error();
+                }
+                return make_bytes(*set);
+            }
+
+            default: {
+                std::bitset<256> set;
+                set.set(std::uint8_t(character));
+                return make_bytes(set);
+            }
+        }
+    }
+
+
+    // The bytes matched by the escape after a backslash.
+    Result<std::bitset<256>> PatternParser::escape() {
+        if (!this->has_next()) {
+            return this->error("trailing \\");
+        }
+
+        std::bitset<256> set;
+        auto character = this->pattern[this->position++];
+        switch (character) {
+            case 'd': case 'D': {
+                for (auto byte = '0'; byte <= '9'; byte++) {
+                    set.set(std::uint8_t(byte));
+                }
+                break;
+            }
+
+            case 'w': case 'W': {
+                for (int byte = 0; byte < 128; byte++) {
+                    if (std::isalnum(byte) || byte == '_') {
+                        set.set(std::size_t(byte));
+                    }
+                }
+                break;
+            }
+
+            case 's': case 'S': {
+                for (auto byte : { ' ', '\t', '\n', '\r', '\f', '\v' }) {
+                    set.set(std::uint8_t(byte));
+                }
+                break;
+            }
+
+            case 'n': set.set('\n'); return set;
+            case 't': set.set('\t'); return set;
+            case 'r': set.set('\r'); return set;
+            case 'f': set.set('\f'); return set;
+            case 'v': set.set('\v'); return set;
+            case '0': set.set(0); return set;
+
+            case 'x': {
+                if (this->position + 2 > this->pattern.size()) {
+                    return this->error("incomplete \\x escape");
+                }
+                auto high = hex_digit(this->pattern[this->position]);
+                auto low = hex_digit(this->pattern[this->position + 1]);
+                if (high < 0 || low < 0) {
+                    return this->error("incomplete \\x escape");
+                }
+                this->position += 2;
+                set.set(std::size_t(high * 16 + low));
+                return set;
+            }
+
+            default: {
+                if (std::isalnum(int(std::uint8_t(character)))) {
+                    return this->error(std::string("unknown escape \\") + character);
+                }
+                set.set(std::uint8_t(character));
+                return set;
+            }
+        }
+
+        // The upper-case forms match everything the lower-case ones do not.
+        if (std::isupper(int(character))) {
+            set.flip();
+        }
+        return set;
+    }
+
+
+    // A class after its '['. A ']' right at the start is a member.
+    Result<std::bitset<256>> PatternParser::bracket() {
+        bool negated = this->has_next() && this->peek() == '^';
+        if (negated) {
+            this->position++;
+        }
+
+        std::bitset<256> set;
+        for (bool first = true; ; first = false) {
+            if (!this->has_next()) {
+                return this->error("missing ]");
+            }
+
+            auto character = this->pattern[this->position++];
+            if (character == ']' && !first) {
+                break;
+            }
+
+            std::bitset<256> item;
+            if (character == '\\') {
+                auto escaped = this->escape();
+                if (escaped.is_error()) {
+                    return escaped;
+                }
+                item = *escaped;
+            } else {
+                item.set(std::uint8_t(character));
+            }
+
+            auto low = single_byte(item);
+            auto is_range = low >= 0
+                && this->position + 1 < this->pattern.size()
+                && this->peek() == '-'
+                && this->pattern[this->position + 1] != ']';
+            if (!is_range) {
+                set |= item;
+                continue;
+            }
+
+            this->position++;
+            auto end = this->pattern[this->position++];
+            int high = std::uint8_t(end);
+            if (end == '\\') {
+                auto escaped = this->escape();
+                if (escaped.is_error()) {
+                    return escaped;
+                }
+                high = single_byte(*escaped);
+            }
+            if (high < low) {
+                return this->error("invalid range in class");
+            }
+            for (auto byte = low; byte <= high; byte++) {
+                set.set(std::size_t(byte));
+            }
+        }
+
+        if (negated) {
+            set.flip();
+        }
+        return set;
+    }
+
+
+    /**
+     * Append the bytes every match of `expression` starts with. Returns
+     * whether they are all of it, so that the caller may continue with
+     * what follows.
+     */
+    static bool literal_prefix(const Expression& expression, std::string& prefix) {
+        switch (expression.kind) {
+            case Expression::Kind::Empty: {
+                return true;
+            }
+
+            case Expression::Kind::Bytes: {
+                auto byte = single_byte(expression.bytes);
+                if (byte < 0) {
+                    return false;
+                }
+                prefix += char(byte);
+                return true;
+            }
+
+            case Expression::Kind::Concatenation: {
+                for (const auto& child : expression.children) {
+                    if (!literal_prefix(*child, prefix)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            case Expression::Kind::Repetition: {
+                if (expression.minimum == 0) {
+                    return false;
+                }
+
+                // `x{n}` is n copies of x; otherwise only the first is certain.
+                std::string once;
+                auto complete = literal_prefix(*expression.children.front(), once);
+                if (!complete || expression.maximum != expression.minimum) {
+                    prefix += once;
+                    return false;
+                }
+                for (auto i = 0; i < expression.minimum; i++) {
+                    prefix += once;
+                }
+                return true;
+            }
+
+            default: {
+                return false;
+            }
+        }
+    }
+
+
+    /**
+     * Append the instructions for `expression`, which continue at the
+     * instruction after them. Returns false if the program grows too large.
+     */
+    bool Regex::emit(const Expression& expression) {
+        using Op = Instruction::Op;
+        if (this->program.size() > maximum_instructions) {
+            return false;
+        }
+
+        auto here = [this]() {
+            return std::uint32_t(this->program.size());
+        };
+
+        // A split that prefers `preferred`, or the other branch if lazy.
+        auto split = [&](std::size_t at, std::uint32_t preferred, std::uint32_t other) {
+            if (expression.lazy) {
+                std::swap(preferred, other);
+            }
+            this->program[at] = { Op::Split, other, preferred };
+        };
+
+        switch (expression.kind) {
+            case Expression::Kind::Empty: {
+                return true;
+            }
+
+            case Expression::Kind::Bytes: {
+                auto found = std::find(this->sets.begin(), this->sets.end(), expression.bytes);
+                auto index = std::uint32_t(found - this->sets.begin());
+                if (found == this->sets.end()) {
+                    this->sets.push_back(expression.bytes);
+                }
+                this->program.push_back({ Op::Bytes, index, here() + 1 });
+                return true;
+            }
+
+            case Expression::Kind::Begin: {
+                this->uses_begin = true;
+                this->program.push_back({ Op::Begin, 0, here() + 1 });
+                return true;
+            }
+
+            case Expression::Kind::End: {
+                this->program.push_back({ Op::End, 0, here() + 1 });
+                return true;
+            }
+
+            case Expression::Kind::Concatenation: {
+                for (const auto& child : expression.children) {
+                    if (!this->emit(*child)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            case Expression::Kind::Alternation: {
+                const auto& children = expression.children;
+                std::vector<std::size_t> jumps;
+                for (std::size_t i = 0; i + 1 < children.size(); i++) {
+                    auto at = this->program.size();
+                    this->program.push_back({ Op::Split, 0, here() + 1 });
+                    if (!this->emit(*children[i])) {
+                        return false;
+                    }
+                    jumps.push_back(this->program.size());
+                    this->program.push_back({ Op::Jump, 0, 0 });
+                    this->program[at].argument = here();
+                }
+
+                if (!this->emit(*children.back())) {
+                    return false;
+                }
+                for (auto jump : jumps) {
+                    this->program[jump].next = here();
+                }
+                return true;
+            }
+
+            case Expression::Kind::Repetition: {
+                const auto& body = *expression.children.front();
+                auto unbounded = expression.maximum < 0;
+
+                // With no upper bound the last required copy loops back on itself.
+                auto copies = expression.minimum - (unbounded && expression.minimum > 0 ? 1 : 0);
+                for (auto i = 0; i < copies; i++) {
+                    if (!this->emit(body)) {
+                        return false;
+                    }
+                }
+
+                if (unbounded && expression.minimum > 0) {
+                    auto loop = here();
+                    if (!this->emit(body)) {
+                        return false;
+                    }
+                    this->program.push_back({ Op::Split, 0, 0 });
+                    split(this->program.size() - 1, loop, here());
+                    return true;
+                }
+
+                if (unbounded) {
+                    auto at = this->program.size();
+                    this->program.push_back({ Op::Split, 0, 0 });
+                    if (!this->emit(body)) {
+                        return false;
+                    }
+                    this->program.push_back({ Op::Jump, 0, std::uint32_t(at) });
+                    split(at, std::uint32_t(at + 1), here());
+                    return true;
+                }
+
+                std::vector<std::size_t> optional;
+                for (auto i = expression.minimum; i < expression.maximum; i++) {
+                    optional.push_back(this->program.size());
+                    this->program.push_back({ Op::Split, 0, 0 });
+                    if (!this->emit(body)) {
+                        return false;
+                    }
+                }
+                for (auto at : optional) {
+                    split(at, std::uint32_t(at + 1), here());
+                }
+                return true;
+            }
+        }
+        return true;
+    }
+
+
+    // Split the bytes into the classes no set tells apart.
+    void Regex::find_byte_classes() {
+        this->byte_classes.fill(0);
+        this->class_count = 1;
+
+        for (const auto& set : this->sets) {
+            std::vector<int> refined(this->class_count * 2, -1);
+            std::size_t count = 0;
+            for (std::size_t byte = 0; byte < 256; byte++) {
+                auto& target = refined[this->byte_classes[byte] * 2 + set.test(byte)];
+                if (target < 0) {
+                    target = int(count++);
+                }
+                this->byte_classes[byte] = std::uint8_t(target);
+            }
+            this->class_count = count;
+        }
+    }
+
+
+    Result<std::shared_ptr<Regex>> Regex::compile(std::string_view pattern) {
+        PatternParser parser(pattern);
+        auto expression = parser.parse();
+        if (expression.is_error()) {
+            return expression.get_error();
+        }
+
+        std::shared_ptr<Regex> regex(new Regex());
+        if (!regex->emit(**expression)) {
+            return Error("Invalid regular expression: pattern is too large");
+        }
+        regex->program.push_back({ Instruction::Op::Match, 0, 0 });
+
+        regex->literal = literal_prefix(**expression, regex->prefix);
+        regex->find_byte_classes();
+        regex->find_start_bytes();
+
+        auto state_bytes = regex->class_count * sizeof(std::int32_t) + 64;
+        regex->maximum_states = std::max<std::size_t>(16, dfa_cache_bytes / state_bytes);
+        regex->reset_states();
+        return regex;
+    }
+
+
+    std::size_t Regex::SetHash::operator()(const std::vector<std::uint32_t>& set) const {
+        std::uint64_t hash = 0xcbf29ce484222325ULL;
+        for (auto member : set) {
+            hash = (hash ^ member) * 0x100000001b3ULL;
+        }
+        return std::size_t(hash);
+    }
+
+
+    /**
+     * The instructions that can be reached from `pending` without reading a
+     * byte, keeping those that read one or match. `$` is kept unless the
+     * text has ended, when it is followed like `^` is at its start.
+     */
+    std::vector<std::uint32_t> Regex::closure(std::vector<std::uint32_t> pending, bool at_begin, bool at_end) const {
+        using Op = Instruction::Op;
+        std::vector<bool> seen(this->program.size());
+        std::vector<std::uint32_t> set;
+
+        while (!pending.empty()) {
+            auto at = pending.back();
+            pending.pop_back();
+            if (seen[at]) {
+                continue;
+            }
+            seen[at] = true;
+
+            const auto& instruction = this->program[at];
+            switch (instruction.op) {
+                case Op::Bytes:
+                case Op::Match: {
+                    set.push_back(at);
+                    break;
+                }
+
+                case Op::Split: {
+                    pending.push_back(instruction.argument);
+                    pending.push_back(instruction.next);
+                    break;
+                }
+
+                case Op::Jump: {
+                    pending.push_back(instruction.next);
+                    break;
+                }
+
+                case Op::Begin: {
+                    if (at_begin) {
+                        pending.push_back(instruction.next);
+                    }
+                    break;
+                }
+
+                case Op::End: {
+                    if (at_end) {
+                        pending.push_back(instruction.next);
+                    } else {
+                        set.push_back(at);
+                    }
+                    break;
+                }
+            }
+        }
+
+        std::sort(set.begin(), set.end());
+        return set;
+    }
+
+
+    std::int32_t Regex::add_state(std::vector<std::uint32_t> set, bool at_begin) {
+        at_begin = at_begin && this->uses_begin;
+        if (at_begin) {
+            set.push_back(at_begin_marker);
+        }
+
+        auto found = this->state_ids.find(set);
+        if (found != this->state_ids.end()) {
+            return found->second;
+        }
+
+        std::uint8_t flags = set.empty() ? dead_flag : 0;
+        std::vector<std::uint32_t> members;
+        for (auto at : set) {
+            if (at == at_begin_marker) {
+                continue;
+            }
+            if (this->program[at].op == Instruction::Op::Match) {
+                flags |= matching_flag;
+            }
+            members.push_back(at);
+        }
+
+        auto at_end = this->closure(std::move(members), at_begin, true);
+        auto matches_at_end = std::any_of(at_end.begin(), at_end.end(), [this](std::uint32_t at) {
+            return this->program[at].op == Instruction::Op::Match;
+        });
+
+        auto state = std::int32_t(this->state_sets.size());
+        this->state_flags.push_back(flags);
+        this->state_matches_at_end.push_back(matches_at_end);
+        this->transitions.resize(this->transitions.size() + this->class_count, -1);
+        this->state_ids.emplace(set, state);
+        this->state_sets.push_back(std::move(set));
+        return state;
+    }
+
+
+    // Empty the DFA cache, keeping only the states a search starts from.
+    void Regex::reset_states() {
+        if (!this->state_sets.empty()) {
+            this->cache_resets++;
+        }
+        this->state_ids.clear();
+        this->state_sets.clear();
+        this->state_flags.clear();
+        this->state_matches_at_end.clear();
+        this->transitions.clear();
+
+        this->initial_state = this->add_state(this->closure({ 0 }, true, false), true);
+        this->restart_state = this->add_state(this->closure({ 0 }, false, false), false);
+        if (this->skips && this->state_flags[this->restart_state] == 0) {
+            this->state_flags[this->restart_state] = restart_flag;
+        }
+    }
+
+
+    /**
+     * The state after `state` reads `byte`, built and recorded the first time
+     * it is needed. A match may also start after every byte. When the cache
+     * is full it is emptied first, and the transition is not recorded.
+     */
+    std::int32_t Regex::transition(std::int32_t state, std::uint8_t byte) {
+        std::vector<std::uint32_t> pending;
+        for (auto at : this->state_sets[state]) {
+            if (at == at_begin_marker) {
+                continue;
+            }
+            const auto& instruction = this->program[at];
+            if (instruction.op == Instruction::Op::Bytes && this->sets[instruction.argument].test(byte)) {
+                pending.push_back(instruction.next);
+            }
+        }
+        pending.push_back(0);
+
+        auto set = this->closure(std::move(pending), false, false);
+        if (this->state_ids.find(set) == this->state_ids.end() && this->state_sets.size() >= this->maximum_states) {
+            this->reset_states();
+            return this->add_state(std::move(set), false);
+        }
+
+        auto next = this->add_state(std::move(set), false);
+        auto offset = std::int32_t(std::size_t(next) * this->class_count);
+        this->transitions[std::size_t(state) * this->class_count + this->byte_classes[byte]] =
+            this->state_flags[next] != 0 ? -2 - offset : offset;
+        return next;
+    }
+
+
+    void Regex::find_start_bytes() {
+        constexpr std::size_t maximum_start_bytes = 16;
+
+        // A pattern that can match without reading a byte matches anywhere.
+        std::bitset<256> start;
+        for (auto at : this->closure({ 0 }, false, false)) {
+            if (this->program[at].op == Instruction::Op::Match) {
+                return;
+            }
+            if (this->program[at].op == Instruction::Op::Bytes) {
+                start |= this->sets[this->program[at].argument];
+            }
+        }
+
+        for (std::size_t byte = 0; byte < 256; byte++) {
+            this->start_bytes[byte] = start.test(byte);
+        }
+        this->skips = !this->prefix.empty() || start.count() <= maximum_start_bytes;
+    }
+
+
+    /**
+     * The next position at or after `position` where a match could start:
+     * an occurrence of the prefix, or else a byte that starts one. Returns
+     * nullptr if there is none before `end`.
+     */
+    const char* Regex::skip_ahead(const char* position, const char* end) const {
+        if (this->prefix.empty()) {
+            while (position != end && !this->start_bytes[std::uint8_t(*position)]) {
+                position++;
+            }
+            return position != end ? position : nullptr;
+        }
+
+        if (this->prefix.size() == 1) {
+            return static_cast<const char*>(std::memchr(position, this->prefix[0], std::size_t(end - position)));
+        }
+        return static_cast<const char*>(
+            memmem(position, std::size_t(end - position), this->prefix.data(), this->prefix.size())
+        );
+    }
+
+
+    bool Regex::search(std::string_view text) {
+        auto position = text.data();
+        auto end = position + text.size();
+        if (this->literal) {
+            return this->prefix.empty() || this->skip_ahead(position, end) != nullptr;
+        }
+
+        const auto* classes = this->byte_classes.data();
+        auto state = this->initial_state;
+        for (;;) {
+            auto flags = this->state_flags[state];
+            if (flags != 0) {
+                if (flags & matching_flag) {
+                    return true;
+                }
+                if (flags & dead_flag) {
+                    return false;
+                }
+
+                // No match is under way, so bytes that cannot start one
+                // lead back to this state and can be skipped.
+                position = this->skip_ahead(position, end);
+                if (position == nullptr) {
+                    return this->state_matches_at_end[state];
+                }
+            }
+
+            // Follow built transitions between ordinary states, by offset.
+            const auto* table = this->transitions.data();
+            auto offset = std::int32_t(std::size_t(state) * this->class_count);
+            std::int32_t next = 0;
+            while (position != end) {
+                next = table[offset + classes[std::uint8_t(*position)]];
+                if (next < 0) {
+                    break;
+                }
+                offset = next;
+                position++;
+            }
+
+            state = std::int32_t(std::size_t(offset) / this->class_count);
+            if (position == end) {
+                return this->state_matches_at_end[state];
+            }
+
+            auto byte = std::uint8_t(*position++);
+            state = next == -1
+                ? this->transition(state, byte)
+                : std::int32_t(std::size_t(-2 - next) / this->class_count);
+        }
+    }
+
+
+    /**
+     * A Pike VM: every thread of the NFA advances one byte at a time, kept
+     * in order of preference, so the first to match wins and the ones after
+     * it can be dropped.
+     */
+    bool Regex::find(std::string_view text, std::size_t& start, std::size_t& end) const {
+        using Op = Instruction::Op;
+        if (this->literal) {
+            auto found = this->prefix.empty()
+                ? text.data()
+                : this->skip_ahead(text.data(), text.data() + text.size());
+            if (found == nullptr) {
+                return false;
+            }
+            start = std::size_t(found - text.data());
+            end = start + this->prefix.size();
+            return true;
+        }
+
+        struct Thread {
+            std::uint32_t at;
+            std::size_t start;
+        };
+        std::vector<Thread> current;
+        std::vector<Thread> next;
+        std::vector<std::uint32_t> pending;
+
+        // Threads are added at most once per position.
+        std::vector<std::size_t> added(this->program.size(), std::numeric_limits<std::size_t>::max());
+        auto add = [&](std::vector<Thread>& threads, std::uint32_t at, std::size_t start, std::size_t position) {
+            pending.push_back(at);
+            while (!pending.empty()) {
+                at = pending.back();
+                pending.pop_back();
+                if (added[at] == position) {
+                    continue;
+                }
+                added[at] = position;
+
+                const auto& instruction = this->program[at];
+                switch (instruction.op) {
+                    case Op::Bytes:
+                    case Op::Match: {
+                        threads.push_back({ at, start });
+                        break;
+                    }
+
+                    case Op::Split: {
+                        pending.push_back(instruction.argument);
+                        pending.push_back(instruction.next);
+                        break;
+                    }
+
+                    case Op::Jump: {
+                        pending.push_back(instruction.next);
+                        break;
+                    }
+
+                    case Op::Begin: {
+                        if (position == 0) {
+                            pending.push_back(instruction.next);
+                        }
+                        break;
+                    }
+
+                    case Op::End: {
+                        if (position == text.size()) {
+                            pending.push_back(instruction.next);
+                        }
+                        break;
+                    }
+                }
+            }
+        };
+
+        bool matched = false;
+        for (std::size_t position = 0; ; position++) {
+            if (!matched) {
+                // `^` may let a match start at the beginning that could not elsewhere.
+                if (current.empty() && this->skips && (position > 0 || !this->uses_begin)) {
+                    auto found = this->skip_ahead(text.data() + position, text.data() + text.size());
+                    position = found != nullptr ? std::size_t(found - text.data()) : text.size();
+                }
+                add(current, 0, position, position);
+            }
+
+            if (current.empty()) {
+                if (matched || position == text.size()) {
+                    break;
+                }
+                continue;
+            }
+
+            next.clear();
+            for (const auto& thread : current) {
+                const auto& instruction = this->program[thread.at];
+                if (instruction.op == Op::Match) {
+                    matched = true;
+                    start = thread.start;
+                    end = position;
+                    break;
+                }
+
+                if (position < text.size() && this->sets[instruction.argument].test(std::uint8_t(text[position]))) {
+                    add(next, instruction.next, thread.start, position + 1);
+                }
+            }
+
+            if (position == text.size()) {
+                break;
+            }
+            std::swap(current, next);
+        }
+        return matched;
+    }
+
+
+    Result<std::shared_ptr<Regex>> cached(const std::string& pattern) {
+        constexpr std::size_t maximum_patterns = 256;
+        static std::unordered_map<std::string, std::shared_ptr<Regex>> compiled;
+
+        auto found = compiled.find(pattern);
+        if (found != compiled.end()) {
+            return found->second;
+        }
+
+        auto regex = Regex::compile(pattern);
+        if (regex.is_error()) {
+            return regex;
+        }
+
+        // Scripts rarely use many patterns; one that builds them from data
+        // starts over rather than growing the cache without bound.
+        if (compiled.size() >= maximum_patterns) {
+            compiled.clear();
+        }
+        compiled.emplace(pattern, *regex);
+        return regex;
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef REGEX_HPP
+#define REGEX_HPP
+
+#include <array>
+#include <bitset>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include "../result.hpp"
+
+namespace pshellscript::regex {
+    struct Expression;
+
+
+    /**
+     * A compiled regular expression over bytes. Patterns support literals,
+     * `.`, classes such as `[a-z]` and `\d`, groups, `|`, `^`, `$` and the
+     * quantifiers `*`, `+`, `?` and `{m,n}`, which may be made lazy with a
+     * trailing `?`. There is no backtracking, so matching is linear in the
+     * length of the text for every pattern.
+     *
+     * A pattern is compiled to an NFA program. `search` runs it as a DFA
+     * whose states are built the first time a byte leads to them and kept in
+     * a cache of bounded size; `find` runs the NFA directly to report where
+     * the leftmost match is. Whenever no match is in progress, both skip to
+     * the next occurrence of the pattern's literal prefix, or if it has none,
+     * to the next of the few bytes a match can start with.
+     */
+    class Regex {
+        struct Instruction {
+            enum class Op : std::uint8_t { Bytes, Split, Jump, Begin, End, Match };
+
+            Op op;
+            // Bytes: index in `sets`. Split: the less preferred branch.
+            std::uint32_t argument;
+            std::uint32_t next;
+        };
+
+        std::vector<Instruction> program;
+        std::vector<std::bitset<256>> sets;
+        bool uses_begin = false;
+
+        // Every match starts with `prefix`; if `literal`, it is the whole pattern.
+        std::string prefix;
+        bool literal = false;
+
+        // The bytes a match can start with, and whether they are few enough
+        // to be worth looking for one at a time when there is no prefix.
+        std::array<bool, 256> start_bytes{};
+        bool skips = false;
+
+        // Bytes that every set treats alike share a class, and DFA states
+        // have one transition per class.
+        std::array<std::uint8_t, 256> byte_classes{};
+        std::size_t class_count = 1;
+
+        struct SetHash {
+            std::size_t operator()(const std::vector<std::uint32_t>& set) const;
+        };
+
+        // The lazy DFA. A state is the sorted set of instructions the NFA
+        // could be at, followed by `at_begin_marker` for the state at the
+        // start of the text when the pattern uses `^`.
+        std::unordered_map<std::vector<std::uint32_t>, std::int32_t, SetHash> state_ids;
+        std::vector<std::vector<std::uint32_t>> state_sets;
+        std::vector<std::uint8_t> state_flags;
+        std::vector<std::uint8_t> state_matches_at_end;
+
+        // Indexed by a state's offset, its index times the class count,
+        // plus a byte's class. An entry is the next state's offset, or for
+        // a state that matches, is dead or skips ahead, -2 minus its offset,
+        // so the search only leaves its inner loop on a negative entry. -1
+        // marks a transition that has not been built yet.
+        std::vector<std::int32_t> transitions;
+        std::size_t maximum_states = 0;
+        std::int32_t initial_state = 0;
+        std::int32_t restart_state = 0;
+        std::size_t cache_resets = 0;
+
+        Regex() = default;
+
+        bool emit(const Expression& expression);
+        void find_byte_classes();
+
+        std::vector<std::uint32_t> closure(std::vector<std::uint32_t> pending, bool at_begin, bool at_end) const;
+        std::int32_t add_state(std::vector<std::uint32_t> set, bool at_begin);
+        void reset_states();
+        std::int32_t transition(std::int32_t state, std::uint8_t byte);
+        void find_start_bytes();
+        const char* skip_ahead(const char* position, const char* end) const;
+
+    public:
+        static Result<std::shared_ptr<Regex>> compile(std::string_view pattern);
+
+        // Whether the pattern matches anywhere in `text`.
+        bool search(std::string_view text);
+
+        // The leftmost match, preferring the earlier branch of `|` and the
+        // longer repetition unless it is lazy, as in Perl.
+        bool find(std::string_view text, std::size_t& start, std::size_t& end) const;
+
+        inline std::size_t get_cache_resets() const {
+            return this->cache_resets;
+        }
+    };
+
+
+    // The compiled form of `pattern`, compiled once and reused by later calls.
+    Result<std::shared_ptr<Regex>> cached(const std::string& pattern);
+}
+
+#endif
@@ -0,0 +1,249 @@
+#include <cstring>
+#include <cstdint>
+#include "text.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define TEXT_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace pshellscript::text {
+#if defined(__x86_64__)
+    static inline bool has_avx2() {
+        static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+        return supported;
+    }
+#endif
+
+
+    /**
+     * Find a needle of at least two bytes by comparing its first and last
+     * bytes against a block of candidate positions at once, and only
+     * comparing the rest where both match. `position` is where the block
+     * loop stopped; the caller finishes the tail.
+     */
+#if defined(__x86_64__)
+    TEXT_AVX2 static std::size_t find_blocks_avx2(
+        const char* text, std::size_t size, std::string_view needle, std::size_t& position
+    ) {
+        auto last = needle.size() - 1;
+        auto first_bytes = _mm256_set1_epi8(needle.front());
+        auto last_bytes = _mm256_set1_epi8(needle.back());
+
+        for (; position + last + 32 <= size; position += 32) {
+            auto starts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + position));
+            auto ends = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + position + last));
+            auto matches = std::uint32_t(_mm256_movemask_epi8(_mm256_and_si256(
+                _mm256_cmpeq_epi8(starts, first_bytes),
+                _mm256_cmpeq_epi8(ends, last_bytes)
+            )));
+
+            for (; matches != 0; matches &= matches - 1) {
+                auto candidate = position + std::size_t(__builtin_ctz(matches));
+                if (std::memcmp(text + candidate + 1, needle.data() + 1, last - 1) == 0) {
+                    return candidate;
+                }
+            }
+        }
+        return std::string_view::npos;
+    }
+#endif
+
+
+#if defined(__SSE2__)
+    static std::size_t find_blocks_sse2(
+        const char* text, std::size_t size, std::string_view needle, std::size_t& position
+    ) {
+        auto last = needle.size() - 1;
+        auto first_bytes = _mm_set1_epi8(needle.front());
+        auto last_bytes = _mm_set1_epi8(needle.back());
+
+        for (; position + last + 16 <= size; position += 16) {
+            auto starts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + position));
+            auto ends = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + position + last));
+            auto matches = std::uint32_t(_mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(starts, first_bytes),
+                _mm_cmpeq_epi8(ends, last_bytes)
+            )));
+
+            for (; matches != 0; matches &= matches - 1) {
+                auto candidate = position + std::size_t(__builtin_ctz(matches));
+                if (std::memcmp(text + candidate + 1, needle.data() + 1, last - 1) == 0) {
+                    return candidate;
+                }
+            }
+        }
+        return std::string_view::npos;
+    }
+#endif
+
+
+    std::size_t find(std::string_view text, std::string_view needle, std::size_t from) {
+        if (from > text.size() || needle.size() > text.size() - from) {
+            return std::string_view::npos;
+        }
+        if (needle.empty()) {
+            return from;
+        }
+
+        // glibc's memchr is already vectorized.
+        if (needle.size() == 1) {
+            auto found = std::memchr(text.data() + from, needle.front(), text.size() - from);
+            return found ? std::size_t(static_cast<const char*>(found) - text.data()) : std::string_view::npos;
+        }
+
+        auto position = from;
+        auto found = std::string_view::npos;
+#if defined(__x86_64__)
+        if (has_avx2()) {
+            found = find_blocks_avx2(text.data(), text.size(), needle, position);
+        }
+#endif
+#if defined(__SSE2__)
+        if (found == std::string_view::npos) {
+            found = find_blocks_sse2(text.data(), text.size(), needle, position);
+        }
+#endif
+        if (found != std::string_view::npos) {
+            return found;
+        }
+        return text.find(needle, position);
+    }
+
+
+    std::vector<std::string_view> split(std::string_view text, std::string_view separator) {
+        std::vector<std::string_view> pieces;
+        std::size_t start = 0;
+        for (;;) {
+            auto found = find(text, separator, start);
+            if (found == std::string_view::npos) {
+                break;
+            }
+            pieces.push_back(text.substr(start, found - start));
+            start = found + separator.size();
+        }
+        pieces.push_back(text.substr(start));
+        return pieces;
+    }
+
+
+    std::string replace(std::string_view text, std::string_view from, std::string_view to) {
+        std::vector<std::size_t> occurrences;
+        for (auto found = find(text, from); found != std::string_view::npos; ) {
+            occurrences.push_back(found);
+            found = find(text, from, found + from.size());
+        }
+
+        std::string result;
+        result.reserve(text.size() - occurrences.size() * from.size() + occurrences.size() * to.size());
+
+        std::size_t start = 0;
+        for (auto occurrence : occurrences) {
+            result.append(text.data() + start, occurrence - start);
+            result.append(to);
+            start = occurrence + from.size();
+        }
+        result.append(text.data() + start, text.size() - start);
+        return result;
+    }
+
+
+    static inline bool is_space(char character) {
+        return character == ' ' || (character >= '\t' && character <= '\r');
+    }
+
+
+    std::string_view trim(std::string_view text) {
+        std::size_t start = 0;
+        auto end = text.size();
+        while (start < end && is_space(text[start])) {
+            start++;
+        }
+        while (end > start && is_space(text[end - 1])) {
+            end--;
+        }
+        return text.substr(start, end - start);
+    }
+
+
+    /**
+     * Change the case of ASCII letters. A byte is in ['A', 'Z'] if, shifted
+     * so that 'A' becomes the lowest signed byte, it compares below the
+     * lowest plus 26; toggling 0x20 changes its case.
+     */
+    template <char First>
+    static inline char change_case(char character) {
+        return std::uint8_t(character - First) < 26 ? char(character ^ 0x20) : character;
+    }
+
+
+#if defined(__x86_64__)
+    template <char First>
+    TEXT_AVX2 static std::size_t change_case_avx2(const char* input, std::size_t size, char* output) {
+        auto shift = _mm256_set1_epi8(char(First + 128));
+        auto limit = _mm256_set1_epi8(char(-128 + 26));
+        auto bit = _mm256_set1_epi8(0x20);
+
+        std::size_t position = 0;
+        for (; position + 32 <= size; position += 32) {
+            auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + position));
+            auto letters = _mm256_cmpgt_epi8(limit, _mm256_sub_epi8(bytes, shift));
+            bytes = _mm256_xor_si256(bytes, _mm256_and_si256(letters, bit));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + position), bytes);
+        }
+        return position;
+    }
+#endif
+
+
+#if defined(__SSE2__)
+    template <char First>
+    static std::size_t change_case_sse2(const char* input, std::size_t size, char* output) {
+        auto shift = _mm_set1_epi8(char(First + 128));
+        auto limit = _mm_set1_epi8(char(-128 + 26));
+        auto bit = _mm_set1_epi8(0x20);
+
+        std::size_t position = 0;
+        for (; position + 16 <= size; position += 16) {
+            auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + position));
+            auto letters = _mm_cmplt_epi8(_mm_sub_epi8(bytes, shift), limit);
+            bytes = _mm_xor_si128(bytes, _mm_and_si128(letters, bit));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + position), bytes);
+        }
+        return position;
+    }
+#endif
+
+
+    template <char First>
+    static std::string convert_case(std::string_view text) {
+        std::string result(text.size(), '\0');
+        std::size_t position = 0;
+#if defined(__x86_64__)
+        if (has_avx2()) {
+            position = change_case_avx2<First>(text.data(), text.size(), result.data());
+        }
+#endif
+#if defined(__SSE2__)
+        position += change_case_sse2<First>(text.data() + position, text.size() - position, result.data() + position);
+#endif
+        for (; position < text.size(); position++) {
+            result[position] = change_case<First>(text[position]);
+        }
+        return result;
+    }
+
+
+    std::string lower(std::string_view text) {
+        return convert_case<'A'>(text);
+    }
+
+
+    std::string upper(std::string_view text) {
+        return convert_case<'a'>(text);
+    }
+}
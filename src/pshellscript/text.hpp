@@ -0,0 +1,35 @@
+#ifndef TEXT_HPP
+#define TEXT_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+namespace pshellscript::text {
+    /**
+     * String kernels behind the string builtins. Where the processor has
+     * them, they compare 32 bytes at a time with AVX2 or 16 with SSE2,
+     * chosen when the program starts, and fall back to plain loops
+     * otherwise. Text is treated as bytes; only ASCII letters change case.
+     */
+
+    // The position of the first `needle` in `text` at or after `from`, or npos.
+    std::size_t find(std::string_view text, std::string_view needle, std::size_t from = 0);
+
+    // The pieces of `text` between occurrences of `separator`, which must
+    // not be empty. They point into `text`.
+    std::vector<std::string_view> split(std::string_view text, std::string_view separator);
+
+    // `text` with every occurrence of `from`, which must not be empty,
+    // replaced by `to`, built in one allocation.
+    std::string replace(std::string_view text, std::string_view from, std::string_view to);
+
+    // `text` without leading and trailing whitespace.
+    std::string_view trim(std::string_view text);
+
+    std::string lower(std::string_view text);
+    std::string upper(std::string_view text);
+}
+
+#endif
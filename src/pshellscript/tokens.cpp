@@ -25,6 +25,11 @@ namespace pshellscript {
                 break;
             }
 
+            case Type::Colon: {
+                stream << "Colon";
+                break;
+            }
+
             case Type::True: {
                 stream << "Boolean(true)";
                 break;
@@ -85,11 +90,31 @@ namespace pshellscript {
                 break;
             }
 
+            case Type::Integer: {
+                stream << "Integer";
+                break;
+            }
+
             case Type::String: {
                 stream << "String";
                 break;
             }
 
+            case Type::InterpolationStart: {
+                stream << "InterpolationStart";
+                break;
+            }
+
+            case Type::InterpolationPart: {
+                stream << "InterpolationPart";
+                break;
+            }
+
+            case Type::InterpolationEnd: {
+                stream << "InterpolationEnd";
+                break;
+            }
+
             case Type::Equal: {
                 stream << "Equal";
                 break;
@@ -100,11 +125,56 @@ namespace pshellscript {
                 break;
             }
 
+            case Type::EqualTilde: {
+                stream << "EqualTilde";
+                break;
+            }
+
             case Type::Bang: {
                 stream << "BangEqual";
                 break;
             }
 
+            case Type::Pipe: {
+                stream << "Pipe";
+                break;
+            }
+
+            case Type::Command: {
+                stream << "Command";
+                break;
+            }
+
+            case Type::Word: {
+                stream << "Word";
+                break;
+            }
+
+            case Type::Redirect: {
+                stream << "Redirect";
+                break;
+            }
+
+            case Type::SubstitutionStart: {
+                stream << "SubstitutionStart";
+                break;
+            }
+
+            case Type::SubshellStart: {
+                stream << "SubshellStart";
+                break;
+            }
+
+            case Type::Background: {
+                stream << "Background";
+                break;
+            }
+
+            case Type::Time: {
+                stream << "Time";
+                break;
+            }
+
             case Type::Eof: {
                 stream << "Eof";
                 break;
@@ -140,6 +210,11 @@ namespace pshellscript {
                 break;
             }
 
+            case Type::Memoize: {
+                stream << "Memoize";
+                break;
+            }
+
             case Type::If: {
                 stream << "If";
                 break;
@@ -160,6 +235,11 @@ namespace pshellscript {
                 break;
             }
 
+            case Type::In: {
+                stream << "In";
+                break;
+            }
+
             case Type::Variable: {
                 stream << "Variable";
                 break;
@@ -8,19 +8,48 @@ namespace pshellscript {
         enum class Type {
             Plus, PlusEqual, Minus, MinusEqual, 
             Slash, SlashEqual, Asterisk, AsteriskEqual,
-            Comma, Modulo, ModuloEqual,
+            Comma, Colon, Modulo, ModuloEqual,
 
-            Equal, EqualEqual, Bang, BangEqual,
+            Equal, EqualEqual, EqualTilde, Bang, BangEqual,
             Less, LessEqual, Greater, GreaterEqual,
-            AndAnd, OrOr, SemiColon,
+            AndAnd, OrOr, SemiColon, Pipe,
 
-            Function, If, Else, For, Variable, Identifier,
+            Function, Memoize, If, Else, For, In, Variable, Identifier,
             Return, Echo, False, True,
 
             LeftParen, RightParen, LeftBrace, RightBrace, 
             LeftBracket, RightBracket,
 
-            String, Number,
+            String, Number, Integer,
+
+            // `"a $x b ${...} c"` is lexed as InterpolationStart("a "), the
+            // tokens of $x, InterpolationPart(" b "), the tokens inside the
+            // braces, then InterpolationEnd(" c").
+            InterpolationStart, InterpolationPart, InterpolationEnd,
+
+            // `name word...` at the start of a statement runs a command: the
+            // name is a Command token, and each plain argument a Word.
+            // Quoted and `$` arguments are lexed as in expressions.
+            Command, Word,
+
+            // `>`, `>>`, `<`, `2>` or `2>&1` in a command, or after an echo
+            // statement; the file, if any, follows as an argument would.
+            Redirect,
+
+            // `$(` starts a command substitution: the tokens of its
+            // statements follow, then the RightParen that closes it.
+            SubstitutionStart,
+
+            // A `(` that starts a statement and is followed by a command
+            // starts a subshell, lexed in the same way.
+            SubshellStart,
+
+            // A `&` that sends the statement before it to the background.
+            // Its lexeme is the statement's source, shown in the job table.
+            Background,
+
+            // `time` before a statement, which reports what running it used.
+            Time,
 
             Eof
         };
@@ -1,171 +1,4455 @@
+#include <array>
 #include <exception>
 #include <iostream>
 #include <algorithm>
 #include <memory>
 #include <sstream>
+#include <thread>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 #include "vm.hpp"
+#include "array.hpp"
+#include "dictionary.hpp"
+#include "closure.hpp"
+#include "heap.hpp"
+#include "output.hpp"
+#include "regex.hpp"
+#include "text.hpp"
+#include "process.hpp"
+#include "commands.hpp"
+#include "jobs.hpp"
+#include "accounting.hpp"
+#include "environment.hpp"
 
 namespace pshellscript::vm {
+    static Registry registry;
+    static std::vector<Frame> frames;
+    static std::vector<Value> stack;
+
+    // Calls nested deeper than this fail rather than overflow the native
+    // stack, which each one grows by a few kilobytes.
+    static constexpr std::size_t max_call_depth = 1000;
+
+    // The program currently executing. Function definitions alias it so their
+    // bodies outlive the line they were typed on.
+    static std::shared_ptr<const ast::StatementListNode> current_program;
+    static optimizer::Report last_report;
+
+    // The exit status of the last command the current line ran.
+    static int last_status = 0;
+
+    // The file the last echo statement redirected to one was written to,
+    // kept open until something else could touch it, so that a loop
+    // appending a line at a time to a file writes through one buffer.
+    struct EchoFile {
+        std::string path;
+        int descriptor = -1;
+    };
+
+    static EchoFile echo_file;
+
+
+    static Result<Value> memo_stats(const std::vector<Value>& arguments);
+    static Result<Value> length(const std::vector<Value>& arguments);
+    static Result<Value> push(const std::vector<Value>& arguments);
+    static Result<Value> range(const std::vector<Value>& arguments);
+    static Result<Value> sum(const std::vector<Value>& arguments);
+    static Result<Value> minimum(const std::vector<Value>& arguments);
+    static Result<Value> maximum(const std::vector<Value>& arguments);
+    static Result<Value> map_elements(const std::vector<Value>& arguments);
+    static Result<Value> sort_elements(const std::vector<Value>& arguments);
+    static Result<Value> has_key(const std::vector<Value>& arguments);
+    static Result<Value> get_value(const std::vector<Value>& arguments);
+    static Result<Value> remove_key(const std::vector<Value>& arguments);
+    static Result<Value> keys(const std::vector<Value>& arguments);
+    static Result<Value> values(const std::vector<Value>& arguments);
+    static Result<Value> collect_garbage(const std::vector<Value>& arguments);
+    static Result<Value> gc_stats(const std::vector<Value>& arguments);
+    static Result<Value> match_pattern(const std::vector<Value>& arguments);
+    static Result<Value> find_text(const std::vector<Value>& arguments);
+    static Result<Value> contains_text(const std::vector<Value>& arguments);
+    static Result<Value> starts_with(const std::vector<Value>& arguments);
+    static Result<Value> split_text(const std::vector<Value>& arguments);
+    static Result<Value> replace_text(const std::vector<Value>& arguments);
+    static Result<Value> trim_text(const std::vector<Value>& arguments);
+    static Result<Value> lower_text(const std::vector<Value>& arguments);
+    static Result<Value> upper_text(const std::vector<Value>& arguments);
+    static Result<Value> rehash(const std::vector<Value>& arguments);
+    static Result<Value> set_pipe_size(const std::vector<Value>& arguments);
+
+    // Builtins that only read their arguments are pure; ones that create or
+    // change an array or dictionary are not, since both are shared by reference.
+    static const std::map<std::string, Builtin> builtins = {
+        { "memo_stats", { memo_stats, false } },
+        { "len", { length, true } },
+        { "push", { push, false } },
+        { "range", { range, false } },
+        { "sum", { sum, true } },
+        { "min", { minimum, true } },
+        { "max", { maximum, true } },
+        { "map", { map_elements, false } },
+        { "sort", { sort_elements, false } },
+        { "has", { has_key, true } },
+        { "get", { get_value, true } },
+        { "remove", { remove_key, false } },
+        { "keys", { keys, false } },
+        { "values", { values, false } },
+        { "gc", { collect_garbage, false } },
+        { "gc_stats", { gc_stats, false } },
+        { "match", { match_pattern, true } },
+        { "find", { find_text, true } },
+        { "contains", { contains_text, true } },
+        { "starts_with", { starts_with, true } },
+        { "split", { split_text, false } },
+        { "replace", { replace_text, true } },
+        { "trim", { trim_text, true } },
+        { "lower", { lower_text, true } },
+        { "upper", { upper_text, true } },
+        { "rehash", { rehash, false } },
+        { "pipe_size", { set_pipe_size, false } }
+    };
+
+
+    static void export_value(const std::string& name, const Value& value);
+
+
+    // A global's name without its '$', as the environment knows it.
+    static inline std::string_view environment_name(const std::string& name) {
+        return std::string_view(name).substr(name.empty() || name.front() != '$' ? 0 : 1);
+    }
+
+
     void Registry::set_global(const std::string& name, Value value) {
-        this->global_variables[name] = value;
+        if (environment::exports(environment_name(name))) {
+            export_value(std::string(environment_name(name)), value);
+        }
+
+        if (!this->changed_names.empty() && this->changed_names.back().insert(name).second) {
+            auto variable = this->global_variables.find(name);
+            if (variable != this->global_variables.end()) {
+                this->changes.push_back(Change { name, std::move(variable->second) });
+                variable->second = std::move(value);
+                return;
+            }
+            this->changes.push_back(Change { name, std::nullopt });
+        }
+        this->global_variables[name] = std::move(value);
     }
 
 
     Value Registry::get_global(const std::string& name) const {
-        if (this->global_variables.count(name) == 0) {
+        auto variable = this->find_global(name);
+        if (variable == nullptr) {
             return undefined;
-        } else {
-            return this->global_variables.at(name);
         }
+        return *variable;
     }
 
-    static Value execute(const ast::BaseNode& statement);
-    static Value add(const ast::AdditionNode& node);
-    static Value subtract(const ast::SubtractionNode& node);
-    static Value multiply(const ast::MultiplicationNode& node);
-    static Value divide(const ast::DivisionNode& node);
-    static Value modulo(const ast::ModuloNode& node);
-    static Value echo(const ast::EchoStatementNode& node);
 
-    int execute_program(std::unique_ptr<ast::StatementListNode> program) {
-        for (const auto& statement : program->statements) {
-            auto result = execute(*statement);
+    const Value* Registry::find_global(const std::string& name) const {
+        auto variable = this->global_variables.find(name);
+        if (variable == this->global_variables.end()) {
+            return this->find_environment(name);
         }
-        return 0;
+        return &variable->second;
     }
 
 
-    static Value execute(const ast::BaseNode& statement) {
-        switch (statement.type) {
-            case ast::NodeType::AddExpression: {
-                return add(dynamic_cast<const ast::AdditionNode&>(statement));
+    const Value* Registry::find_environment(const std::string& name) const {
+        if (this->environment_version != environment::version()) {
+            this->environment_values.clear();
+            this->environment_version = environment::version();
+        }
+
+        auto cached = this->environment_values.find(name);
+        if (cached != this->environment_values.end()) {
+            return &cached->second;
+        }
+
+        auto value = environment::get(std::string(environment_name(name)));
+        if (value == nullptr) {
+            return nullptr;
+        }
+        return &this->environment_values.emplace(name, std::string(value)).first->second;
+    }
+
+
+    void Registry::define_function(std::shared_ptr<const ast::FunctionDefinitionNode> definition) {
+        auto function = std::make_shared<Function>();
+        function->definition = std::move(definition);
+
+        // A snapshot keeps the functions as they were.
+        if (this->functions.use_count() > 1) {
+            this->functions = std::make_shared<Functions>(*this->functions);
+        }
+
+        auto& entry = (*this->functions)[function->definition->name];
+        if (entry != nullptr) {
+            this->retired_functions.push_back(std::move(entry));
+        }
+        entry = function;
+
+        // Cached results may depend on the function that was just replaced.
+        for (auto& [name, other] : *this->functions) {
+            other->cache.clear();
+        }
+        this->function_version++;
+    }
+
+
+    std::shared_ptr<Function> Registry::get_function(const std::string& name) {
+        if (this->purity_version != this->function_version) {
+            this->analyze_purity();
+        }
+
+        auto function = this->functions->find(name);
+        if (function == this->functions->end()) {
+            return nullptr;
+        }
+        return function->second;
+    }
+
+
+    optimizer::FunctionTable Registry::function_table() const {
+        optimizer::FunctionTable table;
+        for (const auto& [name, function] : *this->functions) {
+            table[name] = function->definition;
+        }
+        return table;
+    }
+
+
+    void Registry::release_retired_functions() {
+        this->retired_functions.clear();
+    }
+
+
+    Registry::Snapshot Registry::snapshot() {
+        this->changed_names.emplace_back();
+        return Snapshot { this->changes.size(), this->functions };
+    }
+
+
+    void Registry::restore(Snapshot snapshot) {
+        while (this->changes.size() > snapshot.changes) {
+            auto& change = this->changes.back();
+            if (change.value.has_value()) {
+                this->global_variables[change.name] = std::move(*change.value);
+            } else {
+                this->global_variables.erase(change.name);
             }
+            this->changes.pop_back();
+        }
+        this->changed_names.pop_back();
 
-            case ast::NodeType::SubtractExpression: {
-                return subtract(dynamic_cast<const ast::SubtractionNode&>(statement));
+        if (this->functions == snapshot.functions) {
+            return;
+        }
+
+        // Cached results may depend on functions defined since, which are
+        // no longer running; call sites that found them see the new version.
+        this->functions = std::move(snapshot.functions);
+        for (auto& [name, function] : *this->functions) {
+            function->cache.clear();
+        }
+        this->function_version++;
+    }
+
+
+    static inline bool is_assignment(const ast::BaseNode& node) {
+        switch (node.type) {
+            case ast::NodeType::AssignmentExpression:
+            case ast::NodeType::PlusEqualExpression:
+            case ast::NodeType::MinusEqualExpression:
+            case ast::NodeType::TimesEqualExpression:
+            case ast::NodeType::DivideEqualExpression:
+            case ast::NodeType::ModuloEqualExpression: {
+                return true;
             }
 
-            case ast::NodeType::MultiplyExpression: {
-                return multiply(dynamic_cast<const ast::MultiplicationNode&>(statement));
+            default: {
+                return false;
             }
+        }
+    }
 
-            case ast::NodeType::DivideExpression: {
-                return divide(dynamic_cast<const ast::DivisionNode&>(statement));
+
+    /**
+     * Check a function body for local side effects, collecting the names it
+     * calls. A body is locally pure if it never echoes, defines functions,
+     * touches a variable other than its own parameters, creates or changes
+     * an array or dictionary, or creates or calls a function value.
+     */
+    static bool is_locally_pure(
+        const ast::BaseNode* node,
+        std::set<std::string>& callees
+    ) {
+        if (node == nullptr) {
+            return true;
+        }
+
+        switch (node->type) {
+            case ast::NodeType::EchoStatement:
+            case ast::NodeType::Command:
+            case ast::NodeType::Pipeline:
+            case ast::NodeType::Redirection:
+            case ast::NodeType::Substitution:
+            case ast::NodeType::Subshell:
+            case ast::NodeType::Background:
+            case ast::NodeType::Timed:
+            case ast::NodeType::Chain:
+            case ast::NodeType::FunctionDefinition:
+            case ast::NodeType::FunctionLiteral:
+            case ast::NodeType::Identifier:
+            case ast::NodeType::ValueCall:
+            case ast::NodeType::ArrayLiteral:
+            case ast::NodeType::DictionaryLiteral: {
+                return false;
             }
 
-            case ast::NodeType::ModuloExpression: {
-                return modulo(dynamic_cast<const ast::ModuloNode&>(statement));
+            case ast::NodeType::Variable: {
+                return dynamic_cast<const ast::VariableNode*>(node)->slot >= 0;
             }
 
-            case ast::NodeType::Number: {
-                return Value(dynamic_cast<const ast::NumberNode&>(statement).value);
+            case ast::NodeType::FunctionCall: {
+                auto call = dynamic_cast<const ast::FunctionCallNode*>(node);
+                callees.insert(call->name->name);
+                for (const auto& argument : call->arguments->arguments) {
+                    if (!is_locally_pure(argument.get(), callees)) {
+                        return false;
+                    }
+                }
+                return true;
             }
 
-            case ast::NodeType::EchoStatement: {
-                return echo(dynamic_cast<const ast::EchoStatementNode&>(statement));
+            case ast::NodeType::InlinedCall: {
+                auto inlined = dynamic_cast<const ast::InlinedCallNode*>(node);
+                return is_locally_pure(inlined->call.get(), callees)
+                    && is_locally_pure(inlined->body.get(), callees);
+            }
+
+            case ast::NodeType::Interpolation: {
+                for (const auto& value : dynamic_cast<const ast::InterpolationNode*>(node)->values) {
+                    if (!is_locally_pure(value.get(), callees)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            case ast::NodeType::StatementList: {
+                for (const auto& statement : dynamic_cast<const ast::StatementListNode*>(node)->statements) {
+                    if (!is_locally_pure(statement.get(), callees)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            case ast::NodeType::ForLoop: {
+                auto loop = dynamic_cast<const ast::ForLoopNode*>(node);
+                return is_locally_pure(loop->initialization.get(), callees)
+                    && is_locally_pure(loop->condition.get(), callees)
+                    && is_locally_pure(loop->update.get(), callees)
+                    && is_locally_pure(loop->body.get(), callees);
+            }
+
+            case ast::NodeType::ForEachLoop: {
+                auto loop = dynamic_cast<const ast::ForEachNode*>(node);
+                return is_locally_pure(loop->variable.get(), callees)
+                    && is_locally_pure(loop->iterable.get(), callees)
+                    && is_locally_pure(loop->body.get(), callees);
+            }
+
+            case ast::NodeType::IfStatement: {
+                auto branch = dynamic_cast<const ast::IfStatementNode*>(node);
+                return is_locally_pure(branch->condition.get(), callees)
+                    && is_locally_pure(branch->body.get(), callees)
+                    && is_locally_pure(branch->else_clause.get(), callees);
+            }
+
+            case ast::NodeType::ReturnStatement: {
+                auto statement = dynamic_cast<const ast::ReturnStatementNode*>(node);
+                return is_locally_pure(statement->argument.get(), callees);
+            }
+
+            case ast::NodeType::LogicalNegationExpression:
+            case ast::NodeType::ArithmeticNegationExpression: {
+                auto unary = dynamic_cast<const ast::UnaryExpressionNode*>(node);
+                return is_locally_pure(unary->argument.get(), callees);
             }
 
             default: {
-                return undefined;
+                auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(node);
+                if (binary == nullptr) {
+                    return true;
+                }
+
+                // Storing into an element changes a container the caller can see.
+                auto target = binary->left_argument.get();
+                if (is_assignment(*node) && target && target->type == ast::NodeType::IndexExpression) {
+                    return false;
+                }
+
+                return is_locally_pure(binary->left_argument.get(), callees)
+                    && is_locally_pure(binary->right_argument.get(), callees);
             }
         }
     }
 
 
-    static Value echo(const ast::EchoStatementNode& node) {
-        auto argument = execute(*node.argument);
-        
-        if (std::holds_alternative<double>(argument)) {
-            std::cout << std::get<double>(argument) << "\n";
-            return Value(undefined);
-        } 
+    /**
+     * Recompute which functions are pure. A function is pure if its body is
+     * locally pure and everything it calls is a pure function or builtin;
+     * impurity is propagated through the call graph until nothing changes,
+     * so (mutually) recursive functions stay pure unless some member is not.
+     */
+    void Registry::analyze_purity() {
+        std::map<std::string, std::set<std::string>> callees;
 
-        if (std::holds_alternative<std::string>(argument)) {
-            std::cout << std::get<std::string>(argument) << "\n";
-            return Value(undefined);
+        for (auto& [name, function] : *this->functions) {
+            function->is_pure = is_locally_pure(function->definition->body.get(), callees[name]);
         }
 
-        if (std::holds_alternative<undefined_t>(argument)) {
-            std::cout << "undefined" << "\n";
-            return Value(undefined);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto& [name, function] : *this->functions) {
+                if (!function->is_pure) {
+                    continue;
+                }
+
+                for (const auto& callee : callees[name]) {
+                    auto target = this->functions->find(callee);
+                    auto builtin = builtins.find(callee);
+                    auto callee_is_pure = target != this->functions->end()
+                        ? target->second->is_pure
+                        : builtin != builtins.end() && builtin->second.is_pure;
+
+                    if (!callee_is_pure) {
+                        function->is_pure = false;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
         }
 
-        return Value(undefined);
+        this->purity_version = this->function_version;
     }
 
 
-    static Value add(const ast::AdditionNode& node) {
-        auto left = execute(*node.left_argument);
-        auto right = execute(*node.right_argument);
+    std::size_t ArgumentsHash::operator()(const std::vector<Value>& arguments) const {
+        std::size_t seed = arguments.size();
+        for (const auto& argument : arguments) {
+            seed ^= std::hash<Value>()(argument) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+
 
-        if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-            return std::get<double>(left) + std::get<double>(right);
+    const Value* MemoCache::find(const std::vector<Value>& arguments) {
+        auto entry = this->entries.find(arguments);
+        if (entry == this->entries.end()) {
+            this->misses++;
+            return nullptr;
         }
-        
-        if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::string>(right)) {
-            return Value(std::get<std::string>(left) + std::get<std::string>(right));
+
+        this->hits++;
+        return &entry->second;
+    }
+
+
+    void MemoCache::insert(std::vector<Value>&& arguments, const Value& result) {
+        if (this->entries.size() >= capacity) {
+            this->entries.erase(this->entries.begin());
+            this->evictions++;
         }
+        this->entries.emplace(std::move(arguments), result);
+    }
 
-        if (std::holds_alternative<std::string>(left) && std::holds_alternative<double>(right)) {
-            std::stringstream stream;
-            stream << std::get<std::string>(left) << std::get<double>(right);
-            return Value(stream.str());
+
+    void MemoCache::clear() {
+        this->entries.clear();
+    }
+
+
+    static Result<Value> execute(const ast::BaseNode& statement);
+    static Result<Value> execute_block(const ast::StatementListNode& block);
+    static Result<Value> add(const ast::AdditionNode& node);
+    static Result<Value> add(const Value& left, const Value& right);
+    static Result<Value> subtract(const ast::SubtractionNode& node);
+    static Result<Value> subtract(const Value& left, const Value& right);
+    static Result<Value> multiply(const ast::MultiplicationNode& node);
+    static Result<Value> multiply(const Value& left, const Value& right);
+    static Result<Value> divide(const ast::DivisionNode& node);
+    static Result<Value> divide(const Value& left, const Value& right);
+    static Result<Value> modulo(const ast::ModuloNode& node);
+    static Result<Value> modulo(const Value& left, const Value& right);
+    static Result<Value> compare(const ast::BinaryExpressionNode& node);
+    static Result<Value> equals(const ast::BinaryExpressionNode& node);
+    static Result<Value> logical(const ast::BinaryExpressionNode& node);
+    static Result<Value> match(const ast::BinaryExpressionNode& node);
+    static Result<Value> assign(const ast::BinaryExpressionNode& node);
+    static Result<Value> assign_element(const ast::BinaryExpressionNode& node, const ast::IndexNode& target);
+    static Result<Value> index(const ast::IndexNode& node);
+    static Result<Value> array_literal(const ast::ArrayLiteralNode& node);
+    static Result<Value> interpolate(const ast::InterpolationNode& node);
+    static Result<Value> dictionary_literal(const ast::DictionaryLiteralNode& node);
+    static Result<Value> negate(const ast::UnaryExpressionNode& node);
+    static Result<Value> echo(const ast::EchoStatementNode& node);
+    static Result<Value> if_statement(const ast::IfStatementNode& node);
+    static Result<Value> for_loop(const ast::ForLoopNode& node);
+    static Result<Value> for_each_loop(const ast::ForEachNode& node);
+    static Result<Value> define_function(const ast::FunctionDefinitionNode& node);
+    static Result<Value> call(const ast::FunctionCallNode& node);
+    static Result<Value> call_function(Function& function, std::size_t base);
+    static Result<Value> call_value(const ast::ValueCallNode& node);
+    static Result<Value> call_closure(Closure& closure, std::size_t base);
+    static Result<Value> function_literal(const ast::FunctionLiteralNode& node);
+    static Result<Value> function_reference(const ast::IdentifierNode& node);
+    static Result<Value> return_statement(const ast::ReturnStatementNode& node);
+    static Result<Value> inlined_call(const ast::InlinedCallNode& node);
+    static Result<Value> run_command(const ast::CommandNode& node);
+    static Result<Value> run_pipeline(const ast::PipelineNode& node);
+    static Result<Value> run_redirected(const ast::RedirectionNode& node);
+    static Result<Value> substitute(const ast::SubstitutionNode& node);
+    static Result<Value> run_subshell(const ast::SubshellNode& node);
+    static Result<Value> run_in_background(const ast::BackgroundNode& node);
+    static Result<Value> run_timed(const ast::TimedNode& node);
+    static Result<Value> run_chain(const ast::ChainNode& node);
+    static Result<Value> capture_descriptor();
+    static void close_echo_file();
+
+    const optimizer::Report& optimizer_report() {
+        return last_report;
+    }
+
+
+    /**
+     * The status a line or subshell ends with: the number a top-level
+     * `return N` gave, or otherwise, as in a shell, that of the last command
+     * it ran.
+     */
+    static int exit_status(const Value& returned) {
+        if (std::holds_alternative<double>(returned)) {
+            return int(std::get<double>(returned));
         }
 
-        throw std::runtime_error("Invalid addition");
+        if (std::holds_alternative<std::int64_t>(returned)) {
+            return int(std::get<std::int64_t>(returned));
+        }
+        return last_status;
     }
 
 
-    static Value subtract(const ast::SubtractionNode& node) {
-        auto left = execute(*node.left_argument);
-        auto right = execute(*node.right_argument);
+    Result<int> execute_program(std::unique_ptr<ast::StatementListNode> program) {
+        std::size_t frame_size = 0;
+        last_report = optimizer::optimize(*program, registry.function_table(), frame_size);
+
+        current_program = std::move(program);
+        frames.clear();
+        frames.emplace_back();
+        stack.assign(frame_size, undefined);
+        last_status = 0;
+
+        auto result = execute_block(*current_program);
+        close_echo_file();
+
+        auto status = exit_status(frames.back().return_value);
+        current_program = nullptr;
+        registry.release_retired_functions();
+
+        if (result.is_error()) {
+            return result.get_error();
+        }
+        return status;
+    }
+
 
-        if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-            return std::get<double>(left) - std::get<double>(right);
+    /**
+     * Where a parameter, or a variable captured by the running closure, is
+     * stored: in a frame slot or a capture, or in the box either one holds.
+     */
+    static inline Value& local_variable(const ast::VariableNode& variable) {
+        auto& stored = variable.capture >= 0
+            ? frames.back().closure->captures[variable.capture]
+            : stack[frames.back().base + variable.slot];
+
+        if (variable.boxed) {
+            return std::get<std::shared_ptr<Box>>(stored)->value;
         }
+        return stored;
+    }
 
-        throw std::runtime_error("Invalid subtraction");
+
+    /**
+     * Parameters are local to the function that declares them and were given
+     * a frame slot by the parser, and function literals capture the ones
+     * they use; every other variable is global, as in a shell.
+     */
+    static inline Value load_variable(const ast::VariableNode& variable) {
+        if (variable.slot >= 0 || variable.capture >= 0) {
+            return local_variable(variable);
+        }
+        return registry.get_global(variable.name);
     }
 
 
-    static Value multiply(const ast::MultiplicationNode& node) {
-        auto left = execute(*node.left_argument);
-        auto right = execute(*node.right_argument);
+    static inline void store_variable(const ast::VariableNode& variable, const Value& value) {
+        if (variable.slot >= 0 || variable.capture >= 0) {
+            local_variable(variable) = value;
+            return;
+        }
+        registry.set_global(variable.name, value);
+    }
 
-        if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-            return std::get<double>(left) * std::get<double>(right);
+
+    // Where a variable is stored, or nullptr for a global that was never assigned.
+    static inline const Value* find_variable(const ast::VariableNode& variable) {
+        if (variable.slot >= 0 || variable.capture >= 0) {
+            return &local_variable(variable);
         }
+        return registry.find_global(variable.name);
+    }
 
-        throw std::runtime_error("Invalid multiplication");
+
+    static inline bool is_number(const Value& value) {
+        return std::holds_alternative<double>(value) || std::holds_alternative<std::int64_t>(value);
     }
 
 
-    static Value divide(const ast::DivisionNode& node) {
-        auto left = execute(*node.left_argument);
-        auto right = execute(*node.right_argument);
+    static inline bool are_integers(const Value& left, const Value& right) {
+        return std::holds_alternative<std::int64_t>(left) && std::holds_alternative<std::int64_t>(right);
+    }
+
+
+    static inline bool fits_in_32_bits(std::int64_t integer) {
+        return integer > std::numeric_limits<std::int32_t>::min() && integer <= std::numeric_limits<std::int32_t>::max();
+    }
+
+
+    static inline double to_double(const Value& value) {
+        if (std::holds_alternative<std::int64_t>(value)) {
+            return double(std::get<std::int64_t>(value));
+        }
+        return std::get<double>(value);
+    }
+
+
+    /**
+     * Order an integer against a double exactly, rather than rounding the
+     * integer to the nearest double first. NaN orders equal to everything,
+     * as it did when all numbers were doubles.
+     */
+    static int compare_mixed(std::int64_t integer, double number) {
+        // 2^63, the first double past the int64 range.
+        constexpr double integer_limit = 9223372036854775808.0;
+        if (std::isnan(number)) {
+            return 0;
+        }
+        if (number >= integer_limit) {
+            return -1;
+        }
+        if (number < -integer_limit) {
+            return 1;
+        }
+
+        auto whole = std::trunc(number);
+        auto whole_integer = std::int64_t(whole);
+        if (integer != whole_integer) {
+            return integer < whole_integer ? -1 : 1;
+        }
+        return whole < number ? -1 : (whole > number ? 1 : 0);
+    }
+
+
+    static int compare_numbers(const Value& left, const Value& right) {
+        if (are_integers(left, right)) {
+            auto a = std::get<std::int64_t>(left);
+            auto b = std::get<std::int64_t>(right);
+            return a < b ? -1 : (a > b ? 1 : 0);
+        }
+
+        if (std::holds_alternative<std::int64_t>(left)) {
+            return compare_mixed(std::get<std::int64_t>(left), std::get<double>(right));
+        }
+
+        if (std::holds_alternative<std::int64_t>(right)) {
+            return -compare_mixed(std::get<std::int64_t>(right), std::get<double>(left));
+        }
+
+        auto difference = std::get<double>(left) - std::get<double>(right);
+        return difference < 0 ? -1 : (difference > 0 ? 1 : 0);
+    }
+
+
+    static inline bool is_nan(const Value& value) {
+        return std::holds_alternative<double>(value) && std::isnan(std::get<double>(value));
+    }
+
+
+    /**
+     * Order two numbers or two strings; other values cannot be ordered.
+     */
+    static Result<int> order(const Value& left, const Value& right) {
+        if (is_number(left) && is_number(right)) {
+            return compare_numbers(left, right);
+        }
+
+        if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::string>(right)) {
+            return std::get<std::string>(left).compare(std::get<std::string>(right));
+        }
+
+        return Error("Invalid comparison");
+    }
+
 
-        if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-            if (std::get<double>(right) == 0) {
-                throw std::runtime_error("DivideByZeroError");
+    /**
+     * Numbers compare by value whatever their representation, so 1 == 1.0.
+     */
+    static bool values_equal(const Value& left, const Value& right) {
+        if (is_number(left) && is_number(right) && left.index() != right.index()) {
+            if (std::isnan(to_double(left)) || std::isnan(to_double(right))) {
+                return false;
             }
-            return std::get<double>(left) / std::get<double>(right);
+            return compare_numbers(left, right) == 0;
         }
+        return left == right;
+    }
+
 
-        throw std::runtime_error("Invalid division");
+    static inline bool is_reference(const Value& value) {
+        return std::holds_alternative<std::shared_ptr<Array>>(value)
+            || std::holds_alternative<std::shared_ptr<Dictionary>>(value)
+            || std::holds_alternative<std::shared_ptr<Closure>>(value);
     }
 
 
-    static Value modulo(const ast::ModuloNode& node) {
-        auto left = execute(*node.left_argument);
-        auto right = execute(*node.right_argument);
+    static bool is_truthy(const Value& value) {
+        if (std::holds_alternative<bool>(value)) {
+            return std::get<bool>(value);
+        }
+
+        if (std::holds_alternative<double>(value)) {
+            return std::get<double>(value) != 0;
+        }
+
+        if (std::holds_alternative<std::int64_t>(value)) {
+            return std::get<std::int64_t>(value) != 0;
+        }
+
+        if (std::holds_alternative<std::string>(value)) {
+            return !std::get<std::string>(value).empty();
+        }
+
+        if (std::holds_alternative<std::shared_ptr<Array>>(value)) {
+            return std::get<std::shared_ptr<Array>>(value)->size() != 0;
+        }
+
+        if (std::holds_alternative<std::shared_ptr<Dictionary>>(value)) {
+            return std::get<std::shared_ptr<Dictionary>>(value)->size() != 0;
+        }
+
+        return std::holds_alternative<std::shared_ptr<Closure>>(value);
+    }
+
 
-        if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-            if (std::get<double>(right) == 0) {
-                throw std::runtime_error("DivideByZeroError");
+    static Result<Value> execute_block(const ast::StatementListNode& block) {
+        for (const auto& statement : block.statements) {
+            auto result = execute(*statement);
+            if (result.is_error()) {
+                return result;
+            }
+
+            if (frames.back().returning) {
+                break;
             }
-            return double(int(std::get<double>(left)) % int(std::get<double>(right)));
         }
+        return undefined;
+    }
+
+
+    static Result<Value> execute(const ast::BaseNode& statement) {
+        switch (statement.type) {
+            case ast::NodeType::AddExpression: {
+                return add(dynamic_cast<const ast::AdditionNode&>(statement));
+            }
+
+            case ast::NodeType::SubtractExpression: {
+                return subtract(dynamic_cast<const ast::SubtractionNode&>(statement));
+            }
+
+            case ast::NodeType::MultiplyExpression: {
+                return multiply(dynamic_cast<const ast::MultiplicationNode&>(statement));
+            }
+
+            case ast::NodeType::DivideExpression: {
+                return divide(dynamic_cast<const ast::DivisionNode&>(statement));
+            }
+
+            case ast::NodeType::ModuloExpression: {
+                return modulo(dynamic_cast<const ast::ModuloNode&>(statement));
+            }
+
+            case ast::NodeType::LessExpression:
+            case ast::NodeType::LessEqualExpression:
+            case ast::NodeType::GreaterExpression:
+            case ast::NodeType::GreaterEqualExpression: {
+                return compare(dynamic_cast<const ast::BinaryExpressionNode&>(statement));
+            }
+
+            case ast::NodeType::EqualityExpression:
+            case ast::NodeType::InequalityExpression: {
+                return equals(dynamic_cast<const ast::BinaryExpressionNode&>(statement));
+            }
+
+            case ast::NodeType::MatchExpression: {
+                return match(dynamic_cast<const ast::BinaryExpressionNode&>(statement));
+            }
+
+            case ast::NodeType::AndExpression:
+            case ast::NodeType::OrExpression: {
+                return logical(dynamic_cast<const ast::BinaryExpressionNode&>(statement));
+            }
+
+            case ast::NodeType::AssignmentExpression:
+            case ast::NodeType::PlusEqualExpression:
+            case ast::NodeType::MinusEqualExpression:
+            case ast::NodeType::TimesEqualExpression:
+            case ast::NodeType::DivideEqualExpression:
+            case ast::NodeType::ModuloEqualExpression: {
+                return assign(dynamic_cast<const ast::BinaryExpressionNode&>(statement));
+            }
+
+            case ast::NodeType::LogicalNegationExpression:
+            case ast::NodeType::ArithmeticNegationExpression: {
+                return negate(dynamic_cast<const ast::UnaryExpressionNode&>(statement));
+            }
+
+            case ast::NodeType::IndexExpression: {
+                return index(dynamic_cast<const ast::IndexNode&>(statement));
+            }
+
+            case ast::NodeType::ArrayLiteral: {
+                return array_literal(dynamic_cast<const ast::ArrayLiteralNode&>(statement));
+            }
+
+            case ast::NodeType::DictionaryLiteral: {
+                return dictionary_literal(dynamic_cast<const ast::DictionaryLiteralNode&>(statement));
+            }
+
+            case ast::NodeType::Number: {
+                return Value(dynamic_cast<const ast::NumberNode&>(statement).value);
+            }
+
+            case ast::NodeType::Integer: {
+                return Value(dynamic_cast<const ast::IntegerNode&>(statement).value);
+            }
+
+            case ast::NodeType::String: {
+                return Value(dynamic_cast<const ast::StringNode&>(statement).value);
+            }
 
-        throw std::runtime_error("Invalid modulo");
+            case ast::NodeType::Interpolation: {
+                return interpolate(dynamic_cast<const ast::InterpolationNode&>(statement));
+            }
+
+            case ast::NodeType::Boolean: {
+                return Value(dynamic_cast<const ast::BooleanNode&>(statement).value);
+            }
+
+            case ast::NodeType::Variable: {
+                return load_variable(dynamic_cast<const ast::VariableNode&>(statement));
+            }
+
+            case ast::NodeType::StatementList: {
+                return execute_block(dynamic_cast<const ast::StatementListNode&>(statement));
+            }
+
+            case ast::NodeType::EchoStatement: {
+                return echo(dynamic_cast<const ast::EchoStatementNode&>(statement));
+            }
+
+            case ast::NodeType::IfStatement: {
+                return if_statement(dynamic_cast<const ast::IfStatementNode&>(statement));
+            }
+
+            case ast::NodeType::ForLoop: {
+                return for_loop(dynamic_cast<const ast::ForLoopNode&>(statement));
+            }
+
+            case ast::NodeType::ForEachLoop: {
+                return for_each_loop(dynamic_cast<const ast::ForEachNode&>(statement));
+            }
+
+            case ast::NodeType::FunctionDefinition: {
+                return define_function(dynamic_cast<const ast::FunctionDefinitionNode&>(statement));
+            }
+
+            case ast::NodeType::FunctionCall: {
+                return call(dynamic_cast<const ast::FunctionCallNode&>(statement));
+            }
+
+            case ast::NodeType::ValueCall: {
+                return call_value(dynamic_cast<const ast::ValueCallNode&>(statement));
+            }
+
+            case ast::NodeType::FunctionLiteral: {
+                return function_literal(dynamic_cast<const ast::FunctionLiteralNode&>(statement));
+            }
+
+            case ast::NodeType::Identifier: {
+                return function_reference(dynamic_cast<const ast::IdentifierNode&>(statement));
+            }
+
+            case ast::NodeType::ReturnStatement: {
+                return return_statement(dynamic_cast<const ast::ReturnStatementNode&>(statement));
+            }
+
+            case ast::NodeType::InlinedCall: {
+                return inlined_call(dynamic_cast<const ast::InlinedCallNode&>(statement));
+            }
+
+            case ast::NodeType::Command: {
+                return run_command(dynamic_cast<const ast::CommandNode&>(statement));
+            }
+
+            case ast::NodeType::Pipeline: {
+                return run_pipeline(dynamic_cast<const ast::PipelineNode&>(statement));
+            }
+
+            case ast::NodeType::Redirection: {
+                return run_redirected(dynamic_cast<const ast::RedirectionNode&>(statement));
+            }
+
+            case ast::NodeType::Substitution: {
+                return substitute(dynamic_cast<const ast::SubstitutionNode&>(statement));
+            }
+
+            case ast::NodeType::Subshell: {
+                return run_subshell(dynamic_cast<const ast::SubshellNode&>(statement));
+            }
+
+            case ast::NodeType::Background: {
+                return run_in_background(dynamic_cast<const ast::BackgroundNode&>(statement));
+            }
+
+            case ast::NodeType::Timed: {
+                return run_timed(dynamic_cast<const ast::TimedNode&>(statement));
+            }
+
+            case ast::NodeType::Chain: {
+                return run_chain(dynamic_cast<const ast::ChainNode&>(statement));
+            }
+
+            default: {
+                return undefined;
+            }
+        }
+    }
+
+
+    /**
+     * Write a value as echo shows it. Strings inside an array or dictionary
+     * are quoted, and a container that contains itself is shown as [...] or
+     * {...} where it recurs.
+     */
+    static void write_value(const Value& value, bool quote_strings, std::vector<const void*>& open_containers) {
+        if (std::holds_alternative<std::int64_t>(value)) {
+            output::write_number(std::get<std::int64_t>(value));
+        } else if (std::holds_alternative<double>(value)) {
+            output::write_number(std::get<double>(value));
+        } else if (std::holds_alternative<std::string>(value)) {
+            if (quote_strings) {
+                output::write("\"");
+            }
+            output::write(std::get<std::string>(value));
+            if (quote_strings) {
+                output::write("\"");
+            }
+        } else if (std::holds_alternative<bool>(value)) {
+            output::write(std::get<bool>(value) ? "true" : "false");
+        } else if (std::holds_alternative<std::shared_ptr<Array>>(value)) {
+            const auto* array = std::get<std::shared_ptr<Array>>(value).get();
+            if (std::find(open_containers.begin(), open_containers.end(), array) != open_containers.end()) {
+                output::write("[...]");
+                return;
+            }
+
+            open_containers.push_back(array);
+            output::write("[");
+            for (std::size_t i = 0; i < array->size(); i++) {
+                if (i != 0) {
+                    output::write(", ");
+                }
+                write_value(array->get(i), true, open_containers);
+            }
+            output::write("]");
+            open_containers.pop_back();
+        } else if (std::holds_alternative<std::shared_ptr<Dictionary>>(value)) {
+            const auto* dictionary = std::get<std::shared_ptr<Dictionary>>(value).get();
+            if (std::find(open_containers.begin(), open_containers.end(), dictionary) != open_containers.end()) {
+                output::write("{...}");
+                return;
+            }
+
+            open_containers.push_back(dictionary);
+            output::write("{");
+            auto first = true;
+            for (const auto& entry : dictionary->get_entries()) {
+                if (entry.removed) {
+                    continue;
+                }
+                if (!first) {
+                    output::write(", ");
+                }
+                first = false;
+                write_value(entry.key, true, open_containers);
+                output::write(": ");
+                write_value(entry.value, true, open_containers);
+            }
+            output::write("}");
+            open_containers.pop_back();
+        } else if (std::holds_alternative<std::shared_ptr<Closure>>(value)) {
+            const auto& name = std::get<std::shared_ptr<Closure>>(value)->definition->name;
+            output::write(name.empty() ? "<function>" : "<function " + name + ">");
+        } else {
+            output::write("undefined");
+        }
+    }
+
+
+    static Result<Value> echo(const ast::EchoStatementNode& node) {
+        auto result = execute(*node.argument);
+        if (result.is_error()) {
+            return result;
+        }
+
+        std::vector<const void*> open_containers;
+        write_value(*result, false, open_containers);
+        output::write("\n");
+        return Value(undefined);
+    }
+
+
+    static Result<Value> add(const ast::AdditionNode& node) {
+        auto left = execute(*node.left_argument);
+        if (left.is_error()) {
+            return left;
+        }
+
+        auto right = execute(*node.right_argument);
+        if (right.is_error()) {
+            return right;
+        }
+
+        return add(*left, *right);
+    }
+
+
+    static Result<Value> add(const Value& left, const Value& right) {
+        if (are_integers(left, right)) {
+            std::int64_t sum;
+            auto a = std::get<std::int64_t>(left), b = std::get<std::int64_t>(right);
+            if (!__builtin_add_overflow(a, b, &sum)) {
+                return sum;
+            }
+            return double(a) + double(b);
+        }
+
+        if (is_number(left) && is_number(right)) {
+            return to_double(left) + to_double(right);
+        }
+
+        if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::string>(right)) {
+            return Value(std::get<std::string>(left) + std::get<std::string>(right));
+        }
+
+        if (std::holds_alternative<std::string>(left) && std::holds_alternative<double>(right)) {
+            return Value(std::get<std::string>(left) + output::format_number(std::get<double>(right)));
+        }
+
+        if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::int64_t>(right)) {
+            return Value(std::get<std::string>(left) + output::format_number(std::get<std::int64_t>(right)));
+        }
+
+        return Error("Invalid addition");
+    }
+
+
+    static Result<Value> subtract(const ast::SubtractionNode& node) {
+        auto left = execute(*node.left_argument);
+        if (left.is_error()) {
+            return left;
+        }
+
+        auto right = execute(*node.right_argument);
+        if (right.is_error()) {
+            return right;
+        }
+
+        return subtract(*left, *right);
+    }
+
+
+    static Result<Value> subtract(const Value& left, const Value& right) {
+        if (are_integers(left, right)) {
+            std::int64_t difference;
+            auto a = std::get<std::int64_t>(left), b = std::get<std::int64_t>(right);
+            if (!__builtin_sub_overflow(a, b, &difference)) {
+                return difference;
+            }
+            return double(a) - double(b);
+        }
+
+        if (is_number(left) && is_number(right)) {
+            return to_double(left) - to_double(right);
+        }
+
+        return Error("Invalid subtraction");
+    }
+
+
+    static Result<Value> multiply(const ast::MultiplicationNode& node) {
+        auto left = execute(*node.left_argument);
+        if (left.is_error()) {
+            return left;
+        }
+
+        auto right = execute(*node.right_argument);
+        if (right.is_error()) {
+            return right;
+        }
+
+        return multiply(*left, *right);
+    }
+
+
+    static Result<Value> multiply(const Value& left, const Value& right) {
+        if (are_integers(left, right)) {
+            std::int64_t product;
+            auto a = std::get<std::int64_t>(left), b = std::get<std::int64_t>(right);
+            if (!__builtin_mul_overflow(a, b, &product)) {
+                return product;
+            }
+            return double(a) * double(b);
+        }
+
+        if (is_number(left) && is_number(right)) {
+            return to_double(left) * to_double(right);
+        }
+
+        return Error("Invalid multiplication");
+    }
+
+
+    static Result<Value> divide(const ast::DivisionNode& node) {
+        auto left = execute(*node.left_argument);
+        if (left.is_error()) {
+            return left;
+        }
+
+        auto right = execute(*node.right_argument);
+        if (right.is_error()) {
+            return right;
+        }
+
+        return divide(*left, *right);
+    }
+
+
+    static Result<Value> divide(const Value& left, const Value& right) {
+        if (!is_number(left) || !is_number(right)) {
+            return Error("Invalid division");
+        }
+
+        if (to_double(right) == 0) {
+            return Error("DivideByZeroError");
+        }
+
+        // Dividing integers stays exact when the quotient is whole, e.g. 6 / 3
+        // is 2 while 7 / 2 is 3.5.
+        if (are_integers(left, right)) {
+            auto a = std::get<std::int64_t>(left), b = std::get<std::int64_t>(right);
+            auto overflows = a == std::numeric_limits<std::int64_t>::min() && b == -1;
+            if (!overflows && a % b == 0) {
+                return a / b;
+            }
+        }
+
+        return to_double(left) / to_double(right);
+    }
+
+
+    static Result<Value> modulo(const ast::ModuloNode& node) {
+        auto left = execute(*node.left_argument);
+        if (left.is_error()) {
+            return left;
+        }
+
+        auto right = execute(*node.right_argument);
+        if (right.is_error()) {
+            return right;
+        }
+
+        return modulo(*left, *right);
+    }
+
+
+    static Result<Value> modulo(const Value& left, const Value& right) {
+        // Like C, the result takes the sign of the left operand.
+        if (are_integers(left, right)) {
+            auto a = std::get<std::int64_t>(left), b = std::get<std::int64_t>(right);
+            if (b == 0) {
+                return Error("DivideByZeroError");
+            }
+
+            // 32-bit division is several times cheaper than 64-bit division.
+            if (fits_in_32_bits(a) && fits_in_32_bits(b)) {
+                return std::int64_t(std::int32_t(a) % std::int32_t(b));
+            }
+            return b == -1 ? std::int64_t(0) : a % b;
+        }
+
+        if (!is_number(left) || !is_number(right)) {
+            return Error("Invalid modulo");
+        }
+
+        if (to_double(right) == 0) {
+            return Error("DivideByZeroError");
+        }
+
+        return std::fmod(to_double(left), to_double(right));
+    }
+
+
+    static Result<Value> compare(const ast::BinaryExpressionNode& node) {
+        auto left_result = execute(*node.left_argument);
+        if (left_result.is_error()) {
+            return left_result;
+        }
+
+        auto right_result = execute(*node.right_argument);
+        if (right_result.is_error()) {
+            return right_result;
+        }
+
+        auto ordering = order(*left_result, *right_result);
+        if (ordering.is_error()) {
+            return ordering.get_error();
+        }
+
+        switch (node.type) {
+            case ast::NodeType::LessExpression: return *ordering < 0;
+            case ast::NodeType::LessEqualExpression: return *ordering <= 0;
+            case ast::NodeType::GreaterExpression: return *ordering > 0;
+            default: return *ordering >= 0;
+        }
+    }
+
+
+    static Result<Value> equals(const ast::BinaryExpressionNode& node) {
+        auto left = execute(*node.left_argument);
+        if (left.is_error()) {
+            return left;
+        }
+
+        auto right = execute(*node.right_argument);
+        if (right.is_error()) {
+            return right;
+        }
+
+        auto is_equal = values_equal(*left, *right);
+        return node.type == ast::NodeType::EqualityExpression ? is_equal : !is_equal;
+    }
+
+
+    // Whether the pattern matches anywhere in the text. Each pattern is
+    // compiled the first time it is used.
+    static Result<Value> match(const ast::BinaryExpressionNode& node) {
+        auto text = execute(*node.left_argument);
+        if (text.is_error()) {
+            return text;
+        }
+
+        auto pattern = execute(*node.right_argument);
+        if (pattern.is_error()) {
+            return pattern;
+        }
+
+        const auto* text_string = std::get_if<std::string>(&*text);
+        const auto* pattern_string = std::get_if<std::string>(&*pattern);
+        if (text_string == nullptr || pattern_string == nullptr) {
+            return Error("Can only match a string against a string pattern");
+        }
+
+        auto regex = regex::cached(*pattern_string);
+        if (regex.is_error()) {
+            return regex.get_error();
+        }
+        return (*regex)->search(*text_string);
+    }
+
+
+    static Result<Value> logical(const ast::BinaryExpressionNode& node) {
+        auto left_result = execute(*node.left_argument);
+        if (left_result.is_error()) {
+            return left_result;
+        }
+
+        auto left = is_truthy(*left_result);
+
+        // Short-circuit: the right side only runs when it can change the outcome.
+        if (node.type == ast::NodeType::AndExpression && !left) {
+            return false;
+        }
+
+        if (node.type == ast::NodeType::OrExpression && left) {
+            return true;
+        }
+
+        auto right = execute(*node.right_argument);
+        if (right.is_error()) {
+            return right;
+        }
+        return is_truthy(*right);
+    }
+
+
+    /**
+     * Combine the current value of a variable with the right-hand side of a
+     * compound assignment.
+     */
+    static Result<Value> combine(ast::NodeType type, const Value& left, const Value& right) {
+        switch (type) {
+            case ast::NodeType::PlusEqualExpression: return add(left, right);
+            case ast::NodeType::MinusEqualExpression: return subtract(left, right);
+            case ast::NodeType::TimesEqualExpression: return multiply(left, right);
+            case ast::NodeType::DivideEqualExpression: return divide(left, right);
+            default: return modulo(left, right);
+        }
+    }
+
+
+    static Result<Value> assign(const ast::BinaryExpressionNode& node) {
+        if (node.left_argument != nullptr && node.left_argument->type == ast::NodeType::IndexExpression) {
+            return assign_element(node, dynamic_cast<const ast::IndexNode&>(*node.left_argument));
+        }
+
+        if (node.left_argument == nullptr || node.left_argument->type != ast::NodeType::Variable) {
+            return Error("Can only assign to a variable or an element");
+        }
+
+        const auto& name = dynamic_cast<const ast::VariableNode&>(*node.left_argument);
+        auto right = execute(*node.right_argument);
+        if (right.is_error()) {
+            return right;
+        }
+
+        if (node.type == ast::NodeType::AssignmentExpression) {
+            store_variable(name, *right);
+            return right;
+        }
+
+        auto value = combine(node.type, load_variable(name), *right);
+        if (!value.is_error()) {
+            store_variable(name, *value);
+        }
+        return value;
+    }
+
+
+    /**
+     * The position an index value refers to in an array of `size` elements.
+     */
+    static Result<std::size_t> element_position(const Value& index, std::size_t size) {
+        if (std::holds_alternative<std::int64_t>(index)) {
+            auto position = std::get<std::int64_t>(index);
+            if (position < 0 || std::uint64_t(position) >= size) {
+                return Error("Array index out of range");
+            }
+            return std::size_t(position);
+        }
+
+        if (!std::holds_alternative<double>(index) || std::trunc(std::get<double>(index)) != std::get<double>(index)) {
+            return Error("Array index must be an integer");
+        }
+
+        auto position = std::get<double>(index);
+        if (position < 0 || position >= double(size)) {
+            return Error("Array index out of range");
+        }
+        return std::size_t(position);
+    }
+
+
+    static Result<Value> assign_element(const ast::BinaryExpressionNode& node, const ast::IndexNode& target) {
+        // The value is computed before the container and the index, as with
+        // assignments to a variable.
+        auto right = execute(*node.right_argument);
+        if (right.is_error()) {
+            return right;
+        }
+
+        auto container = execute(*target.left_argument);
+        if (container.is_error()) {
+            return container;
+        }
+
+        auto position = execute(*target.right_argument);
+        if (position.is_error()) {
+            return position;
+        }
+
+        if (std::holds_alternative<std::shared_ptr<Dictionary>>(*container)) {
+            auto& dictionary = *std::get<std::shared_ptr<Dictionary>>(*container);
+            if (!Dictionary::is_key(*position)) {
+                return Error("Invalid dictionary key");
+            }
+
+            if (node.type == ast::NodeType::AssignmentExpression) {
+                dictionary.insert(*position) = *right;
+                return right;
+            }
+
+            auto* current = dictionary.find(*position);
+            if (current == nullptr) {
+                return Error("Key not found");
+            }
+
+            auto value = combine(node.type, *current, *right);
+            if (!value.is_error()) {
+                *current = *value;
+            }
+            return value;
+        }
+
+        if (!std::holds_alternative<std::shared_ptr<Array>>(*container)) {
+            return Error("Can only index an array or a dictionary");
+        }
+
+        auto& array = *std::get<std::shared_ptr<Array>>(*container);
+        auto offset = element_position(*position, array.size());
+        if (offset.is_error()) {
+            return offset.get_error();
+        }
+
+        if (node.type == ast::NodeType::AssignmentExpression) {
+            array.set(*offset, *right);
+            return right;
+        }
+
+        auto value = combine(node.type, array.get(*offset), *right);
+        if (!value.is_error()) {
+            array.set(*offset, *value);
+        }
+        return value;
+    }
+
+
+    static Result<Value> read_element(const Value& container, const Value& position) {
+        if (std::holds_alternative<std::shared_ptr<Array>>(container)) {
+            const auto& array = *std::get<std::shared_ptr<Array>>(container);
+            auto offset = element_position(position, array.size());
+            if (offset.is_error()) {
+                return offset.get_error();
+            }
+            return array.get(*offset);
+        }
+
+        if (std::holds_alternative<std::shared_ptr<Dictionary>>(container)) {
+            if (!Dictionary::is_key(position)) {
+                return Error("Invalid dictionary key");
+            }
+
+            const auto* value = std::get<std::shared_ptr<Dictionary>>(container)->find(position);
+            if (value == nullptr) {
+                return Error("Key not found");
+            }
+            return *value;
+        }
+
+        return Error("Can only index an array or a dictionary");
+    }
+
+
+    static Result<Value> index(const ast::IndexNode& node) {
+        // A plain variable is looked up after the index is computed, so the
+        // container can be read in place rather than through a copied reference.
+        if (node.left_argument && node.left_argument->type == ast::NodeType::Variable) {
+            auto position = execute(*node.right_argument);
+            if (position.is_error()) {
+                return position;
+            }
+
+            const auto* container = find_variable(dynamic_cast<const ast::VariableNode&>(*node.left_argument));
+            if (container == nullptr) {
+                return Error("Can only index an array or a dictionary");
+            }
+            return read_element(*container, *position);
+        }
+
+        auto container = execute(*node.left_argument);
+        if (container.is_error()) {
+            return container;
+        }
+
+        auto position = execute(*node.right_argument);
+        if (position.is_error()) {
+            return position;
+        }
+
+        return read_element(*container, *position);
+    }
+
+
+    static Result<Value> array_literal(const ast::ArrayLiteralNode& node) {
+        auto array = make_object<Array>();
+        array->reserve(node.elements.size());
+
+        for (const auto& element : node.elements) {
+            auto value = element ? execute(*element) : Value(undefined);
+            if (value.is_error()) {
+                return value;
+            }
+            array->push(*value);
+        }
+
+        return Value(std::move(array));
+    }
+
+
+    // The text a value contributes to an interpolated string. Numbers are
+    // formatted into `digits`, and read as they would be by echo.
+    static inline Result<std::string_view> interpolated_text(const Value& value, output::NumberDigits& digits) {
+        if (const auto* string = std::get_if<std::string>(&value)) {
+            return std::string_view(*string);
+        }
+
+        if (const auto* integer = std::get_if<std::int64_t>(&value)) {
+            return output::to_digits(*integer, digits);
+        }
+
+        if (const auto* number = std::get_if<double>(&value)) {
+            return output::to_digits(*number, digits);
+        }
+
+        if (const auto* boolean = std::get_if<bool>(&value)) {
+            return std::string_view(*boolean ? "true" : "false");
+        }
+
+        // As in a shell, a variable that was never set expands to nothing.
+        if (std::holds_alternative<undefined_t>(value)) {
+            return std::string_view();
+        }
+
+        return Error("Can only interpolate strings, numbers and booleans");
+    }
+
+
+    // Set an exported variable in the environment, as it would interpolate.
+    // Arrays, dictionaries and functions leave it as it was.
+    static void export_value(const std::string& name, const Value& value) {
+        output::NumberDigits digits;
+        auto text = interpolated_text(value, digits);
+        if (!text.is_error()) {
+            environment::set(name, std::string(*text));
+        }
+    }
+
+
+    static bool is_variable_name(std::string_view name) {
+        if (name.empty() || std::isdigit(static_cast<unsigned char>(name.front()))) {
+            return false;
+        }
+        return std::all_of(name.begin(), name.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        });
+    }
+
+
+    Result<int> export_variables(const std::vector<std::string>& arguments) {
+        if (arguments.size() == 1) {
+            for (auto entry = environment::block(); *entry != nullptr; entry++) {
+                output::write_line(*entry);
+            }
+            return 0;
+        }
+
+        int status = 0;
+        for (std::size_t i = 1; i < arguments.size(); i++) {
+            const auto& argument = arguments[i];
+            auto separator = argument.find('=');
+            auto name = argument.substr(0, separator);
+            if (!is_variable_name(name)) {
+                std::cerr << "export: " << name << ": not a valid name" << std::endl;
+                status = 1;
+                continue;
+            }
+
+            environment::export_variable(name);
+            if (separator != std::string::npos) {
+                registry.set_global("$" + name, Value(argument.substr(separator + 1)));
+            } else if (auto value = registry.find_global("$" + name); value != nullptr) {
+                export_value(name, *value);
+            }
+        }
+        return status;
+    }
+
+
+    /**
+     * Build an interpolated string in one allocation: the first pass adds up
+     * the length of every value, the second copies them into a buffer of
+     * exactly that size. `value(i)` is the result of expression i.
+     */
+    template <typename Values>
+    static Result<Value> concatenate(const ast::InterpolationNode& node, const Values& value) {
+        output::NumberDigits digits;
+        auto length = node.segments_length;
+        for (std::size_t i = 0; i < node.values.size(); i++) {
+            auto text = interpolated_text(value(i), digits);
+            if (text.is_error()) {
+                return text.get_error();
+            }
+            length += text->size();
+        }
+
+        std::string result;
+        result.reserve(length);
+        result += node.segments[0];
+        for (std::size_t i = 0; i < node.values.size(); i++) {
+            result += *interpolated_text(value(i), digits);
+            result += node.segments[i + 1];
+        }
+        return Value(std::move(result));
+    }
+
+
+    static Result<Value> interpolate(const ast::InterpolationNode& node) {
+        // Reading a variable cannot run code, so when every value is one they
+        // are read where they are stored rather than copied out first.
+        constexpr std::size_t in_place_limit = 8;
+        static const Value unassigned = undefined;
+        if (node.reads_only_variables && node.values.size() <= in_place_limit) {
+            std::array<const Value*, in_place_limit> values;
+            for (std::size_t i = 0; i < node.values.size(); i++) {
+                values[i] = find_variable(dynamic_cast<const ast::VariableNode&>(*node.values[i]));
+                if (values[i] == nullptr) {
+                    values[i] = &unassigned;
+                }
+            }
+            return concatenate(node, [&](std::size_t i) -> const Value& { return *values[i]; });
+        }
+
+        // Otherwise the values are computed left to right onto the stack.
+        auto base = stack.size();
+        for (const auto& value : node.values) {
+            auto result = execute(*value);
+            if (result.is_error()) {
+                stack.resize(base);
+                return result;
+            }
+            stack.push_back(std::move(*result));
+        }
+
+        auto result = concatenate(node, [&](std::size_t i) -> const Value& { return stack[base + i]; });
+        stack.resize(base);
+        return result;
+    }
+
+
+    // Keys and values are computed left to right; a repeated key keeps its
+    // first position and its last value.
+    static Result<Value> dictionary_literal(const ast::DictionaryLiteralNode& node) {
+        auto dictionary = make_object<Dictionary>();
+
+        for (std::size_t i = 0; i < node.keys.size(); i++) {
+            auto key = node.keys[i] ? execute(*node.keys[i]) : Value(undefined);
+            if (key.is_error()) {
+                return key;
+            }
+            if (!Dictionary::is_key(*key)) {
+                return Error("Invalid dictionary key");
+            }
+
+            auto value = node.values[i] ? execute(*node.values[i]) : Value(undefined);
+            if (value.is_error()) {
+                return value;
+            }
+            dictionary->insert(*key) = std::move(*value);
+        }
+
+        return Value(std::move(dictionary));
+    }
+
+
+    static Result<Value> negate(const ast::UnaryExpressionNode& node) {
+        auto result = execute(*node.argument);
+        if (result.is_error()) {
+            return result;
+        }
+
+        const auto& argument = *result;
+
+        if (node.type == ast::NodeType::LogicalNegationExpression) {
+            return !is_truthy(argument);
+        }
+
+        if (std::holds_alternative<double>(argument)) {
+            return -std::get<double>(argument);
+        }
+
+        if (std::holds_alternative<std::int64_t>(argument)) {
+            auto integer = std::get<std::int64_t>(argument);
+            if (integer == std::numeric_limits<std::int64_t>::min()) {
+                return -double(integer);
+            }
+            return -integer;
+        }
+
+        return Error("Invalid negation");
+    }
+
+
+    static Result<Value> if_statement(const ast::IfStatementNode& node) {
+        auto condition = execute(*node.condition);
+        if (condition.is_error()) {
+            return condition;
+        }
+
+        if (is_truthy(*condition)) {
+            return execute_block(*node.body);
+        }
+
+        if (node.else_clause) {
+            return execute(*node.else_clause);
+        }
+
+        return undefined;
+    }
+
+
+    /**
+     * Walk a subtree, reporting whether it reads or writes the variable `name`
+     * and whether it contains any function calls (which may touch globals).
+     */
+    static void scan_variable_uses(
+        const ast::BaseNode* node,
+        const std::string& name,
+        bool& reads,
+        bool& writes,
+        bool& calls
+    ) {
+        if (node == nullptr) {
+            return;
+        }
+
+        switch (node->type) {
+            case ast::NodeType::Variable: {
+                reads |= dynamic_cast<const ast::VariableNode*>(node)->name == name;
+                return;
+            }
+
+            case ast::NodeType::FunctionCall: {
+                calls = true;
+                auto call = dynamic_cast<const ast::FunctionCallNode*>(node);
+                for (const auto& argument : call->arguments->arguments) {
+                    scan_variable_uses(argument.get(), name, reads, writes, calls);
+                }
+                return;
+            }
+
+            case ast::NodeType::InlinedCall: {
+                auto inlined = dynamic_cast<const ast::InlinedCallNode*>(node);
+                scan_variable_uses(inlined->call.get(), name, reads, writes, calls);
+                scan_variable_uses(inlined->body.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::Command: {
+                // The command may be a script function.
+                calls = true;
+                for (const auto& argument : dynamic_cast<const ast::CommandNode*>(node)->arguments) {
+                    scan_variable_uses(argument.get(), name, reads, writes, calls);
+                }
+                return;
+            }
+
+            case ast::NodeType::Pipeline: {
+                for (const auto& stage : dynamic_cast<const ast::PipelineNode*>(node)->stages) {
+                    scan_variable_uses(stage.get(), name, reads, writes, calls);
+                }
+                return;
+            }
+
+            case ast::NodeType::Substitution: {
+                // It may run a command, which may be a script function.
+                calls = true;
+                scan_variable_uses(dynamic_cast<const ast::SubstitutionNode*>(node)->body.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::Subshell: {
+                calls = true;
+                scan_variable_uses(dynamic_cast<const ast::SubshellNode*>(node)->body.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::Background: {
+                calls = true;
+                scan_variable_uses(dynamic_cast<const ast::BackgroundNode*>(node)->statement.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::Timed: {
+                calls = true;
+                scan_variable_uses(dynamic_cast<const ast::TimedNode*>(node)->statement.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::Chain: {
+                auto chain = dynamic_cast<const ast::ChainNode*>(node);
+                calls = true;
+                scan_variable_uses(chain->left.get(), name, reads, writes, calls);
+                scan_variable_uses(chain->right.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::Redirection: {
+                auto redirected = dynamic_cast<const ast::RedirectionNode*>(node);
+                scan_variable_uses(redirected->statement.get(), name, reads, writes, calls);
+                for (const auto& redirection : redirected->redirections) {
+                    scan_variable_uses(redirection.target.get(), name, reads, writes, calls);
+                }
+                return;
+            }
+
+            case ast::NodeType::StatementList: {
+                for (const auto& statement : dynamic_cast<const ast::StatementListNode*>(node)->statements) {
+                    scan_variable_uses(statement.get(), name, reads, writes, calls);
+                }
+                return;
+            }
+
+            case ast::NodeType::ForLoop: {
+                auto loop = dynamic_cast<const ast::ForLoopNode*>(node);
+                scan_variable_uses(loop->initialization.get(), name, reads, writes, calls);
+                scan_variable_uses(loop->condition.get(), name, reads, writes, calls);
+                scan_variable_uses(loop->update.get(), name, reads, writes, calls);
+                scan_variable_uses(loop->body.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::ForEachLoop: {
+                auto loop = dynamic_cast<const ast::ForEachNode*>(node);
+                writes |= loop->variable->name == name;
+                scan_variable_uses(loop->iterable.get(), name, reads, writes, calls);
+                scan_variable_uses(loop->body.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::ArrayLiteral: {
+                for (const auto& element : dynamic_cast<const ast::ArrayLiteralNode*>(node)->elements) {
+                    scan_variable_uses(element.get(), name, reads, writes, calls);
+                }
+                return;
+            }
+
+            case ast::NodeType::Interpolation: {
+                for (const auto& value : dynamic_cast<const ast::InterpolationNode*>(node)->values) {
+                    scan_variable_uses(value.get(), name, reads, writes, calls);
+                }
+                return;
+            }
+
+            case ast::NodeType::DictionaryLiteral: {
+                auto literal = dynamic_cast<const ast::DictionaryLiteralNode*>(node);
+                for (std::size_t i = 0; i < literal->keys.size(); i++) {
+                    scan_variable_uses(literal->keys[i].get(), name, reads, writes, calls);
+                    scan_variable_uses(literal->values[i].get(), name, reads, writes, calls);
+                }
+                return;
+            }
+
+            case ast::NodeType::IfStatement: {
+                auto branch = dynamic_cast<const ast::IfStatementNode*>(node);
+                scan_variable_uses(branch->condition.get(), name, reads, writes, calls);
+                scan_variable_uses(branch->body.get(), name, reads, writes, calls);
+                scan_variable_uses(branch->else_clause.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::EchoStatement: {
+                auto echo = dynamic_cast<const ast::EchoStatementNode*>(node);
+                scan_variable_uses(echo->argument.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::ReturnStatement: {
+                auto statement = dynamic_cast<const ast::ReturnStatementNode*>(node);
+                scan_variable_uses(statement->argument.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::FunctionDefinition: {
+                // Defining a function does not run its body.
+                return;
+            }
+
+            case ast::NodeType::FunctionLiteral: {
+                // Creating a closure copies the variables it captures.
+                for (const auto& capture : dynamic_cast<const ast::FunctionLiteralNode*>(node)->captures) {
+                    reads |= capture.name == name;
+                }
+                return;
+            }
+
+            case ast::NodeType::ValueCall: {
+                calls = true;
+                auto call = dynamic_cast<const ast::ValueCallNode*>(node);
+                scan_variable_uses(call->callee.get(), name, reads, writes, calls);
+                for (const auto& argument : call->arguments->arguments) {
+                    scan_variable_uses(argument.get(), name, reads, writes, calls);
+                }
+                return;
+            }
+
+            case ast::NodeType::LogicalNegationExpression:
+            case ast::NodeType::ArithmeticNegationExpression: {
+                auto unary = dynamic_cast<const ast::UnaryExpressionNode*>(node);
+                scan_variable_uses(unary->argument.get(), name, reads, writes, calls);
+                return;
+            }
+
+            case ast::NodeType::AssignmentExpression:
+            case ast::NodeType::PlusEqualExpression:
+            case ast::NodeType::MinusEqualExpression:
+            case ast::NodeType::TimesEqualExpression:
+            case ast::NodeType::DivideEqualExpression:
+            case ast::NodeType::ModuloEqualExpression: {
+                auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(node);
+                auto target = binary->left_argument.get();
+                if (target && target->type == ast::NodeType::Variable) {
+                    writes |= dynamic_cast<const ast::VariableNode*>(target)->name == name;
+                    // Compound assignments read the old value as well.
+                    reads |= node->type != ast::NodeType::AssignmentExpression
+                        && dynamic_cast<const ast::VariableNode*>(target)->name == name;
+                } else {
+                    scan_variable_uses(target, name, reads, writes, calls);
+                }
+                scan_variable_uses(binary->right_argument.get(), name, reads, writes, calls);
+                return;
+            }
+
+            default: {
+                auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(node);
+                if (binary != nullptr) {
+                    scan_variable_uses(binary->left_argument.get(), name, reads, writes, calls);
+                    scan_variable_uses(binary->right_argument.get(), name, reads, writes, calls);
+                }
+                return;
+            }
+        }
+    }
+
+
+    static const std::string* variable_name(const ast::BaseNode* node) {
+        if (node == nullptr || node->type != ast::NodeType::Variable) {
+            return nullptr;
+        }
+        return &dynamic_cast<const ast::VariableNode*>(node)->name;
+    }
+
+
+    /**
+     * Match the update clause against `$i += c`, `$i -= c`, `$i = $i + c`,
+     * `$i = c + $i` or `$i = $i - c`, storing the signed step on success.
+     */
+    static bool match_step(const ast::BaseNode* update, const std::string& name, double& step, bool& is_integer) {
+        auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(update);
+        if (binary == nullptr) {
+            return false;
+        }
+
+        auto target = variable_name(binary->left_argument.get());
+        if (target == nullptr || *target != name) {
+            return false;
+        }
+
+        // Integer steps are kept only while a double holds them exactly.
+        constexpr std::int64_t largest_exact_step = std::int64_t(1) << 53;
+        auto constant = [&](const ast::BaseNode* node, double& value) {
+            if (node != nullptr && node->type == ast::NodeType::Number) {
+                value = dynamic_cast<const ast::NumberNode*>(node)->value;
+                is_integer = false;
+                return true;
+            }
+
+            if (node != nullptr && node->type == ast::NodeType::Integer) {
+                auto integer = dynamic_cast<const ast::IntegerNode*>(node)->value;
+                value = double(integer);
+                is_integer = true;
+                return integer < largest_exact_step && integer > -largest_exact_step;
+            }
+
+            return false;
+        };
+
+        double value = 0;
+        auto right = binary->right_argument.get();
+
+        if (update->type == ast::NodeType::PlusEqualExpression && constant(right, value)) {
+            step = value;
+        } else if (update->type == ast::NodeType::MinusEqualExpression && constant(right, value)) {
+            step = -value;
+        } else if (update->type == ast::NodeType::AssignmentExpression && right != nullptr) {
+            auto sum = dynamic_cast<const ast::BinaryExpressionNode*>(right);
+            if (sum == nullptr) {
+                return false;
+            }
+
+            auto left_name = variable_name(sum->left_argument.get());
+            auto right_name = variable_name(sum->right_argument.get());
+            auto left_is_induction = left_name && *left_name == name;
+            auto right_is_induction = right_name && *right_name == name;
+
+            if (right->type == ast::NodeType::AddExpression && left_is_induction
+                    && constant(sum->right_argument.get(), value)) {
+                step = value;
+            } else if (right->type == ast::NodeType::AddExpression && right_is_induction
+                    && constant(sum->left_argument.get(), value)) {
+                step = value;
+            } else if (right->type == ast::NodeType::SubtractExpression && left_is_induction
+                    && constant(sum->right_argument.get(), value)) {
+                step = -value;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+
+        return step != 0;
+    }
+
+
+    /**
+     * Decide whether a for-loop is a numeric induction loop: the initializer
+     * assigns the induction variable, the condition compares it against a
+     * loop-invariant bound and the update adds a constant to it.
+     */
+    static void analyze_loop(const ast::ForLoopNode& node) {
+        auto& loop = node.counted_loop;
+        loop.state = ast::CountedLoop::State::Generic;
+
+        auto initialization = dynamic_cast<const ast::BinaryExpressionNode*>(node.initialization.get());
+        if (initialization == nullptr || initialization->type != ast::NodeType::AssignmentExpression) {
+            return;
+        }
+
+        auto name = variable_name(initialization->left_argument.get());
+        if (name == nullptr || initialization->right_argument == nullptr) {
+            return;
+        }
+
+        auto condition = dynamic_cast<const ast::BinaryExpressionNode*>(node.condition.get());
+        if (condition == nullptr) {
+            return;
+        }
+
+        switch (condition->type) {
+            case ast::NodeType::LessExpression:
+            case ast::NodeType::LessEqualExpression:
+            case ast::NodeType::GreaterExpression:
+            case ast::NodeType::GreaterEqualExpression:
+            case ast::NodeType::InequalityExpression: {
+                break;
+            }
+
+            default: {
+                return;
+            }
+        }
+
+        auto compared = variable_name(condition->left_argument.get());
+        if (compared == nullptr || *compared != *name) {
+            return;
+        }
+
+        // The bound must be a literal or a variable the body never assigns.
+        auto bound = condition->right_argument.get();
+        if (bound == nullptr) {
+            return;
+        }
+
+        bool reads = false, writes = false, calls = false;
+        scan_variable_uses(node.body.get(), *name, reads, writes, calls);
+        if (writes) {
+            return;
+        }
+
+        if (bound->type == ast::NodeType::Variable) {
+            bool bound_reads = false, bound_writes = false, bound_calls = false;
+            scan_variable_uses(node.body.get(), *variable_name(bound), bound_reads, bound_writes, bound_calls);
+            if (bound_writes || *variable_name(bound) == *name) {
+                return;
+            }
+        } else if (bound->type != ast::NodeType::Number && bound->type != ast::NodeType::Integer) {
+            return;
+        }
+
+        double step = 0;
+        bool integer_step = false;
+        if (!match_step(node.update.get(), *name, step, integer_step)) {
+            return;
+        }
+
+        // A `!=` loop only terminates if the counter can land on the bound.
+        if (condition->type == ast::NodeType::InequalityExpression && step != 1 && step != -1) {
+            return;
+        }
+
+        loop.variable = dynamic_cast<const ast::VariableNode*>(initialization->left_argument.get());
+        loop.start = initialization->right_argument.get();
+        loop.bound = bound;
+        loop.comparison = condition->type;
+        loop.step = step;
+        loop.integer_step = integer_step;
+        loop.body_reads_variable = reads || calls;
+        loop.body_has_calls = calls;
+        loop.state = ast::CountedLoop::State::Counted;
+    }
+
+
+    /**
+     * Run a counted loop to completion, or return false if the body changed
+     * the counter or the bound behind its back, or an integer counter is
+     * about to overflow.
+     */
+    template <typename Number, typename Compare>
+    static Result<bool> run_counted_loop(const ast::ForLoopNode& node, Number counter, Number bound, Compare in_range) {
+        const auto& loop = node.counted_loop;
+        const auto& body = *node.body;
+        const auto step = Number(loop.step);
+
+        while (in_range(counter, bound)) {
+            if (loop.body_reads_variable) {
+                store_variable(*loop.variable, counter);
+            }
+
+            auto result = execute_block(body);
+            if (result.is_error()) {
+                return result.get_error();
+            }
+
+            if (frames.back().returning) {
+                store_variable(*loop.variable, counter);
+                return true;
+            }
+
+            // A called function may have reassigned the counter or the bound,
+            // in which case the rest of the loop runs on the generic path.
+            if (loop.body_has_calls) {
+                auto current = load_variable(*loop.variable);
+                auto current_bound = execute(*loop.bound);
+                if (current_bound.is_error()) {
+                    return current_bound.get_error();
+                }
+
+                if (current != Value(counter) || *current_bound != Value(bound)) {
+                    return false;
+                }
+            }
+
+            if constexpr (std::is_integral_v<Number>) {
+                // The generic path promotes the counter to a double.
+                Number next;
+                if (__builtin_add_overflow(counter, step, &next)) {
+                    store_variable(*loop.variable, counter);
+                    return false;
+                }
+                counter = next;
+            } else {
+                counter += step;
+            }
+        }
+
+        store_variable(*loop.variable, counter);
+        return true;
+    }
+
+
+    template <typename Number>
+    static Result<bool> run_counted_loop(const ast::ForLoopNode& node, Number counter, Number bound) {
+        switch (node.counted_loop.comparison) {
+            case ast::NodeType::LessExpression: {
+                return run_counted_loop(node, counter, bound, [](Number i, Number n) { return i < n; });
+            }
+
+            case ast::NodeType::LessEqualExpression: {
+                return run_counted_loop(node, counter, bound, [](Number i, Number n) { return i <= n; });
+            }
+
+            case ast::NodeType::GreaterExpression: {
+                return run_counted_loop(node, counter, bound, [](Number i, Number n) { return i > n; });
+            }
+
+            case ast::NodeType::GreaterEqualExpression: {
+                return run_counted_loop(node, counter, bound, [](Number i, Number n) { return i >= n; });
+            }
+
+            default: {
+                return run_counted_loop(node, counter, bound, [](Number i, Number n) { return i != n; });
+            }
+        }
+    }
+
+
+    static Result<Value> generic_for_loop(const ast::ForLoopNode& node, bool initialize) {
+        if (initialize && node.initialization) {
+            auto result = execute(*node.initialization);
+            if (result.is_error()) {
+                return result;
+            }
+        }
+
+        while (true) {
+            if (node.condition) {
+                auto condition = execute(*node.condition);
+                if (condition.is_error()) {
+                    return condition;
+                }
+
+                if (!is_truthy(*condition)) {
+                    break;
+                }
+            }
+
+            auto result = execute_block(*node.body);
+            if (result.is_error()) {
+                return result;
+            }
+
+            if (frames.back().returning) {
+                break;
+            }
+
+            if (node.update) {
+                auto update = execute(*node.update);
+                if (update.is_error()) {
+                    return update;
+                }
+            }
+        }
+
+        return undefined;
+    }
+
+
+    static Result<Value> for_loop(const ast::ForLoopNode& node) {
+        const auto& loop = node.counted_loop;
+        if (loop.state == ast::CountedLoop::State::Unanalyzed) {
+            analyze_loop(node);
+        }
+
+        if (loop.state != ast::CountedLoop::State::Counted) {
+            return generic_for_loop(node, true);
+        }
+
+        auto start = execute(*loop.start);
+        if (start.is_error()) {
+            return start;
+        }
+        store_variable(*loop.variable, *start);
+
+        auto bound_value = execute(*loop.bound);
+        if (bound_value.is_error()) {
+            return bound_value;
+        }
+
+        // An integer counter stays an integer only if every step and the
+        // bound are integers too; otherwise the loop counts in doubles.
+        Result<bool> completed = false;
+        auto integer_start = std::holds_alternative<std::int64_t>(*start);
+        if (are_integers(*start, *bound_value) && loop.integer_step) {
+            completed = run_counted_loop(node, std::get<std::int64_t>(*start), std::get<std::int64_t>(*bound_value));
+        } else if (is_number(*start) && is_number(*bound_value) && !(integer_start && loop.integer_step)) {
+            completed = run_counted_loop(node, to_double(*start), to_double(*bound_value));
+        } else {
+            return generic_for_loop(node, false);
+        }
+
+        if (completed.is_error()) {
+            return completed.get_error();
+        }
+
+        if (!*completed) {
+            // The registry holds the live counter; finish this iteration's
+            // update and continue generically from there.
+            if (node.update) {
+                auto update = execute(*node.update);
+                if (update.is_error()) {
+                    return update;
+                }
+            }
+            return generic_for_loop(node, false);
+        }
+
+        return undefined;
+    }
+
+
+    /**
+     * Run the body once per element. Elements the body appends are visited
+     * as well, since the length is checked before every iteration.
+     *
+     * Over a dictionary, the body runs once per key present when the loop
+     * starts, so it may add or remove keys freely.
+     */
+    static Result<Value> for_each_loop(const ast::ForEachNode& node) {
+        auto iterable = execute(*node.iterable);
+        if (iterable.is_error()) {
+            return iterable;
+        }
+
+        if (std::holds_alternative<std::shared_ptr<Dictionary>>(*iterable)) {
+            std::vector<Value> keys;
+            const auto& dictionary = *std::get<std::shared_ptr<Dictionary>>(*iterable);
+            keys.reserve(dictionary.size());
+            for (const auto& entry : dictionary.get_entries()) {
+                if (!entry.removed) {
+                    keys.push_back(entry.key);
+                }
+            }
+
+            for (const auto& key : keys) {
+                store_variable(*node.variable, key);
+
+                auto result = execute_block(*node.body);
+                if (result.is_error()) {
+                    return result;
+                }
+
+                if (frames.back().returning) {
+                    break;
+                }
+            }
+            return undefined;
+        }
+
+        if (!std::holds_alternative<std::shared_ptr<Array>>(*iterable)) {
+            return Error("Can only iterate over an array or a dictionary");
+        }
+
+        // Holding the reference keeps the array alive if the body reassigns
+        // the variable it came from.
+        auto array = std::get<std::shared_ptr<Array>>(*iterable);
+        for (std::size_t i = 0; i < array->size(); i++) {
+            store_variable(*node.variable, array->get(i));
+
+            auto result = execute_block(*node.body);
+            if (result.is_error()) {
+                return result;
+            }
+
+            if (frames.back().returning) {
+                break;
+            }
+        }
+
+        return undefined;
+    }
+
+
+    static Result<Value> define_function(const ast::FunctionDefinitionNode& node) {
+        // Inside a function literal, the definition belongs to the literal
+        // rather than to the program that happens to be running it.
+        auto closure = frames.back().closure;
+        if (closure != nullptr) {
+            registry.define_function(std::shared_ptr<const ast::FunctionDefinitionNode>(closure->definition, &node));
+            return undefined;
+        }
+
+        registry.define_function(
+            std::shared_ptr<const ast::FunctionDefinitionNode>(current_program, &node)
+        );
+        return undefined;
+    }
+
+
+    static Result<std::vector<Value>> evaluate_arguments(const ast::ArgListNode& node) {
+        std::vector<Value> arguments;
+        arguments.reserve(node.arguments.size());
+
+        for (const auto& argument : node.arguments) {
+            if (argument == nullptr) {
+                arguments.push_back(undefined);
+                continue;
+            }
+
+            auto value = execute(*argument);
+            if (value.is_error()) {
+                return value.get_error();
+            }
+            arguments.push_back(std::move(*value));
+        }
+
+        return arguments;
+    }
+
+
+    /**
+     * Resolve the callee of a call site and check its arity, caching the result
+     * until the next function definition.
+     */
+    static Result<const ast::CallSiteCache*> resolve_call(const ast::FunctionCallNode& node) {
+        auto& cache = node.cache;
+        const auto& name = node.name->name;
+        auto function = registry.get_function(name);
+
+        cache.function = nullptr;
+        cache.builtin = nullptr;
+
+        if (function == nullptr) {
+            auto builtin = builtins.find(name);
+            if (builtin == builtins.end()) {
+                return Error("Undefined function: " + name);
+            }
+            cache.builtin = &builtin->second;
+            cache.version = registry.version();
+            return &cache;
+        }
+
+        const auto& definition = *function->definition;
+        const auto& parameters = definition.parameters->parameters;
+        if (node.arguments->arguments.size() != parameters.size()) {
+            std::stringstream message;
+            message << name << " expects " << parameters.size() << " argument(s)";
+            return Error(message.str());
+        }
+
+        cache.function = function.get();
+        cache.frame_size = definition.frame_size;
+        cache.version = registry.version();
+        return &cache;
+    }
+
+
+    static Result<Value> call(const ast::FunctionCallNode& node) {
+        const auto& cache = node.cache;
+        if (cache.version != registry.version()) {
+            auto resolved = resolve_call(node);
+            if (resolved.is_error()) {
+                return resolved.get_error();
+            }
+        }
+
+        if (cache.builtin != nullptr) {
+            auto arguments = evaluate_arguments(*node.arguments);
+            if (arguments.is_error()) {
+                return arguments.get_error();
+            }
+            return cache.builtin->function(*arguments);
+        }
+
+        // Arguments are evaluated straight into the callee's parameter slots.
+        auto function = cache.function;
+        auto base = stack.size();
+        for (const auto& argument : node.arguments->arguments) {
+            if (argument == nullptr) {
+                stack.push_back(undefined);
+                continue;
+            }
+
+            auto value = execute(*argument);
+            if (value.is_error()) {
+                stack.resize(base);
+                return value;
+            }
+            stack.push_back(std::move(*value));
+        }
+
+        return call_function(*function, base);
+    }
+
+
+    /**
+     * Run a script function whose arguments have been pushed onto the stack
+     * from `base`. The stack is back at `base` when this returns.
+     */
+    static Result<Value> call_function(Function& function, std::size_t base) {
+        // Arrays, dictionaries and functions are compared by identity and
+        // may change between calls, so calls that pass one are never cached.
+        std::vector<Value> key;
+        auto memoize = function.is_memoized() && std::none_of(stack.begin() + base, stack.end(), is_reference);
+        if (memoize) {
+            key.assign(stack.begin() + base, stack.end());
+            auto cached = function.cache.find(key);
+            if (cached != nullptr) {
+                stack.resize(base);
+                return *cached;
+            }
+        }
+
+        if (frames.size() > max_call_depth) {
+            stack.resize(base);
+            return Error("Maximum recursion depth exceeded");
+        }
+
+        stack.resize(base + function.definition->frame_size, undefined);
+        for (auto slot : function.definition->boxed_slots) {
+            stack[base + slot] = make_object<Box>(std::move(stack[base + slot]));
+        }
+
+        frames.push_back(Frame { base, false, undefined });
+        auto body = execute_block(*function.definition->body);
+        auto result = std::move(frames.back().return_value);
+        frames.pop_back();
+        stack.resize(base);
+
+        if (body.is_error()) {
+            return body;
+        }
+
+        if (memoize) {
+            function.cache.insert(std::move(key), result);
+        }
+
+        return result;
+    }
+
+
+    /**
+     * Run a function value whose arguments have been pushed onto the stack
+     * from `base`. The stack is back at `base` when this returns.
+     */
+    static Result<Value> call_closure(Closure& closure, std::size_t base) {
+        const auto& definition = *closure.definition;
+        const auto& parameters = definition.parameters->parameters;
+        if (stack.size() - base != parameters.size()) {
+            stack.resize(base);
+            std::stringstream message;
+            message << (definition.name.empty() ? "function" : definition.name)
+                << " expects " << parameters.size() << " argument(s)";
+            return Error(message.str());
+        }
+
+        if (frames.size() > max_call_depth) {
+            stack.resize(base);
+            return Error("Maximum recursion depth exceeded");
+        }
+
+        stack.resize(base + definition.frame_size, undefined);
+        for (auto slot : definition.boxed_slots) {
+            stack[base + slot] = make_object<Box>(std::move(stack[base + slot]));
+        }
+
+        // The frame does not own the closure: the caller holds it until the
+        // call returns.
+        frames.push_back(Frame { base, false, undefined, &closure });
+        auto body = execute_block(*definition.body);
+        auto result = std::move(frames.back().return_value);
+        frames.pop_back();
+        stack.resize(base);
+
+        if (body.is_error()) {
+            return body;
+        }
+        return result;
+    }
+
+
+    static Result<Value> call_value(const ast::ValueCallNode& node) {
+        auto callee = execute(*node.callee);
+        if (callee.is_error()) {
+            return callee;
+        }
+
+        if (!std::holds_alternative<std::shared_ptr<Closure>>(*callee)) {
+            return Error("Can only call a function");
+        }
+
+        auto base = stack.size();
+        for (const auto& argument : node.arguments->arguments) {
+            if (argument == nullptr) {
+                stack.push_back(undefined);
+                continue;
+            }
+
+            auto value = execute(*argument);
+            if (value.is_error()) {
+                stack.resize(base);
+                return value;
+            }
+            stack.push_back(std::move(*value));
+        }
+
+        return call_closure(*std::get<std::shared_ptr<Closure>>(*callee), base);
+    }
+
+
+    static Result<Value> function_literal(const ast::FunctionLiteralNode& node) {
+        auto closure = make_object<Closure>(node.definition);
+        closure->captures.reserve(node.captures.size());
+
+        const auto& frame = frames.back();
+        for (const auto& capture : node.captures) {
+            closure->captures.push_back(
+                capture.from_capture ? frame.closure->captures[capture.index] : stack[frame.base + capture.index]
+            );
+        }
+
+        return Value(std::move(closure));
+    }
+
+
+    // A named function as a value. It keeps the definition current when it
+    // was taken, even if the name is later redefined.
+    static Result<Value> function_reference(const ast::IdentifierNode& node) {
+        auto function = registry.get_function(node.name);
+        if (function == nullptr) {
+            return Error("Undefined function: " + node.name);
+        }
+        return Value(make_object<Closure>(function->definition));
+    }
+
+
+    static Result<Value> return_statement(const ast::ReturnStatementNode& node) {
+        auto value = node.argument ? execute(*node.argument) : Value(undefined);
+        if (value.is_error()) {
+            return value;
+        }
+
+        frames.back().returning = true;
+        frames.back().return_value = *value;
+        return value;
+    }
+
+
+    static Result<Value> inlined_call(const ast::InlinedCallNode& node) {
+        if (node.version != registry.version()) {
+            auto function = registry.get_function(node.call->name->name);
+            node.callee_is_current = function && function->definition == node.callee;
+            node.version = registry.version();
+        }
+
+        if (!node.callee_is_current) {
+            return call(*node.call);
+        }
+
+        // Same order as a real call: every argument is evaluated, left to
+        // right, before the body starts.
+        auto base = frames.back().base + node.base_slot;
+        std::size_t index = 0;
+        for (const auto& argument : node.call->arguments->arguments) {
+            auto value = argument ? execute(*argument) : Value(undefined);
+            if (value.is_error()) {
+                return value;
+            }
+            stack[base + index++] = std::move(*value);
+        }
+
+        auto body = execute_block(*node.body);
+        if (body.is_error()) {
+            return body;
+        }
+
+        // A return inside the copied body only ends the copy.
+        auto& frame = frames.back();
+        if (!frame.returning) {
+            return undefined;
+        }
+
+        auto result = std::move(frame.return_value);
+        frame.returning = false;
+        frame.return_value = undefined;
+        return result;
+    }
+
+
+    /**
+     * Add a value to a command's arguments: an array adds one argument per
+     * element and an undefined value none, as an unset variable does in a
+     * shell. Returns false for a value that has no text.
+     */
+    static bool add_command_argument(const Value& value, std::vector<std::string>& arguments) {
+        output::NumberDigits digits;
+        if (const auto* array = std::get_if<std::shared_ptr<Array>>(&value)) {
+            for (std::size_t i = 0; i < (*array)->size(); i++) {
+                // The text may point into the element, so it is kept alive.
+                auto element = (*array)->get(i);
+                auto text = interpolated_text(element, digits);
+                if (text.is_error()) {
+                    return false;
+                }
+                arguments.emplace_back(*text);
+            }
+            return true;
+        }
+
+        if (std::holds_alternative<undefined_t>(value)) {
+            return true;
+        }
+
+        auto text = interpolated_text(value, digits);
+        if (text.is_error()) {
+            return false;
+        }
+        arguments.emplace_back(*text);
+        return true;
+    }
+
+
+    static Result<std::vector<std::string>> command_arguments(const ast::CommandNode& node) {
+        std::vector<std::string> arguments = { node.name };
+        for (const auto& argument : node.arguments) {
+            auto value = execute(*argument);
+            if (value.is_error()) {
+                return value.get_error();
+            }
+            if (!add_command_argument(*value, arguments)) {
+                return Error("Command arguments must be strings, numbers, booleans or arrays of them");
+            }
+        }
+        return arguments;
+    }
+
+
+    /**
+     * Run a script function as a command, with the arguments as strings. Its
+     * exit status is its return value if that is a number, and 0 otherwise.
+     */
+    static Result<int> call_command_function(Function& function, std::vector<std::string>& arguments) {
+        const auto& parameters = function.definition->parameters->parameters;
+        if (arguments.size() - 1 != parameters.size()) {
+            std::stringstream message;
+            message << arguments.front() << " expects " << parameters.size() << " argument(s)";
+            return Error(message.str());
+        }
+
+        auto base = stack.size();
+        for (std::size_t i = 1; i < arguments.size(); i++) {
+            stack.push_back(std::move(arguments[i]));
+        }
+
+        auto result = call_function(function, base);
+        if (result.is_error()) {
+            return result.get_error();
+        }
+
+        if (const auto* integer = std::get_if<std::int64_t>(&*result)) {
+            return int(*integer);
+        }
+        if (const auto* number = std::get_if<double>(&*result)) {
+            return int(*number);
+        }
+        return 0;
+    }
+
+
+    /**
+     * Run a command: the script function of that name, or else the builtin
+     * command, or else the program found on PATH. `redirections` are passed
+     * to a program as it starts, and applied to the shell's own descriptors
+     * while a function or builtin runs.
+     */
+    static Result<Value> run_command(const ast::CommandNode& node, const process::Redirections& redirections) {
+        auto arguments = command_arguments(node);
+        if (arguments.is_error()) {
+            return arguments.get_error();
+        }
+
+        auto function = registry.get_function(node.name);
+        auto builtin = function == nullptr ? commands::find(node.name) : nullptr;
+        auto in_shell = function != nullptr || builtin != nullptr;
+
+        // Without redirections, script functions and builtins write through
+        // the output buffer, or flush it first. Builtins may read a file the
+        // echo file buffer has not written yet.
+        if (in_shell && redirections.empty()) {
+            if (builtin != nullptr) {
+                close_echo_file();
+            }
+            auto status = function != nullptr ? call_command_function(*function, *arguments) : builtin(*arguments);
+            if (status.is_error()) {
+                return status.get_error();
+            }
+            last_status = *status;
+            return Value(std::int64_t(last_status));
+        }
+
+        // A substitution being collected needs descriptor 1 from here.
+        auto captured = capture_descriptor();
+        if (captured.is_error()) {
+            return captured;
+        }
+
+        // Whatever the script printed so far comes before the command's output.
+        close_echo_file();
+        output::flush();
+
+        Result<int> status = 0;
+        if (in_shell) {
+            process::Redirected redirected(redirections);
+            status = function != nullptr ? call_command_function(*function, *arguments) : builtin(*arguments);
+            output::flush();
+        } else {
+            auto started = accounting::Clock::now();
+            auto pid = process::start(*arguments, redirections);
+            if (pid.is_error()) {
+                return pid.get_error();
+            }
+            process::Usage usage;
+            status = process::wait(*pid, &usage);
+            accounting::record("command", *arguments, *status, usage, started);
+        }
+
+        if (status.is_error()) {
+            return status.get_error();
+        }
+        last_status = *status;
+        return Value(std::int64_t(last_status));
+    }
+
+
+    static Result<Value> run_command(const ast::CommandNode& node) {
+        return run_command(node, {});
+    }
+
+
+    // Write what is buffered for the echo file, and close it.
+    static void close_echo_file() {
+        if (echo_file.descriptor < 0) {
+            return;
+        }
+
+        output::flush();
+        process::close_descriptor(echo_file.descriptor);
+        echo_file.path.clear();
+    }
+
+
+    // The file a redirection names.
+    static Result<std::string> redirection_path(const ast::Redirection& redirection) {
+        auto value = execute(*redirection.target);
+        if (value.is_error()) {
+            return value.get_error();
+        }
+
+        output::NumberDigits digits;
+        auto text = interpolated_text(*value, digits);
+        if (text.is_error() || std::holds_alternative<undefined_t>(*value)) {
+            return Error("A redirection needs a file name");
+        }
+        return std::string(*text);
+    }
+
+
+    // Files opened for a redirected statement, closed once it has run.
+    struct RedirectionFiles {
+        std::vector<int> descriptors;
+
+        inline ~RedirectionFiles() {
+            for (auto& descriptor : this->descriptors) {
+                process::close_descriptor(descriptor);
+            }
+        }
+    };
+
+
+    // Open the files a statement is redirected to, and list the redirections
+    // in the order they are to be applied.
+    static Result<process::Redirections> open_redirections(
+        const ast::RedirectionNode& node,
+        RedirectionFiles& files
+    ) {
+        process::Redirections redirections;
+        for (const auto& redirection : node.redirections) {
+            if (redirection.kind == ast::Redirection::Kind::Duplicate) {
+                redirections.push_back(process::Redirection { redirection.descriptor, redirection.source });
+                continue;
+            }
+
+            auto path = redirection_path(redirection);
+            if (path.is_error()) {
+                return path.get_error();
+            }
+
+            auto flags = O_RDONLY;
+            if (redirection.kind == ast::Redirection::Kind::Output) {
+                flags = O_WRONLY | O_CREAT | O_TRUNC;
+            } else if (redirection.kind == ast::Redirection::Kind::Append) {
+                flags = O_WRONLY | O_CREAT | O_APPEND;
+            }
+
+            auto file = process::open_file(*path, flags);
+            if (file.is_error()) {
+                return file.get_error();
+            }
+            files.descriptors.push_back(*file);
+            redirections.push_back(process::Redirection { redirection.descriptor, *file });
+        }
+        return redirections;
+    }
+
+
+    /**
+     * Echo into a file through the output module's file buffer. Appending to
+     * the file the previous one wrote to reuses its descriptor and buffer;
+     * `>` starts the file over each time.
+     */
+    static Result<Value> echo_to_file(const ast::EchoStatementNode& node, const ast::Redirection& redirection) {
+        auto path = redirection_path(redirection);
+        if (path.is_error()) {
+            return path.get_error();
+        }
+
+        auto reusable = redirection.kind == ast::Redirection::Kind::Append
+            && echo_file.descriptor >= 0 && echo_file.path == *path;
+        if (!reusable) {
+            close_echo_file();
+            auto flags = redirection.kind == ast::Redirection::Kind::Append
+                ? O_WRONLY | O_CREAT | O_APPEND
+                : O_WRONLY | O_CREAT | O_TRUNC;
+            auto file = process::open_file(*path, flags);
+            if (file.is_error()) {
+                return file.get_error();
+            }
+            echo_file.path = std::move(*path);
+            echo_file.descriptor = *file;
+        }
+
+        output::write_to(echo_file.descriptor);
+        auto result = echo(node);
+        output::write_to_standard_output();
+        return result;
+    }
+
+
+    static Result<Value> run_redirected(const ast::RedirectionNode& node) {
+        const auto& statement = *node.statement;
+        if (statement.type == ast::NodeType::EchoStatement && node.redirections.size() == 1) {
+            const auto& redirection = node.redirections.front();
+            auto to_file = redirection.kind == ast::Redirection::Kind::Output
+                || redirection.kind == ast::Redirection::Kind::Append;
+            if (to_file && redirection.descriptor == STDOUT_FILENO) {
+                return echo_to_file(dynamic_cast<const ast::EchoStatementNode&>(statement), redirection);
+            }
+        }
+
+        // A command reports its own; anything else may redirect descriptor 1.
+        if (statement.type != ast::NodeType::Command) {
+            auto captured = capture_descriptor();
+            if (captured.is_error()) {
+                return captured;
+            }
+        }
+
+        close_echo_file();
+        RedirectionFiles files;
+        auto redirections = open_redirections(node, files);
+        if (redirections.is_error()) {
+            return redirections.get_error();
+        }
+
+        if (statement.type == ast::NodeType::Command) {
+            return run_command(dynamic_cast<const ast::CommandNode&>(statement), *redirections);
+        }
+
+        output::flush();
+        process::Redirected redirected(*redirections);
+        auto result = execute(statement);
+        output::flush();
+        return result;
+    }
+
+
+    // A pipeline stage without the redirections around it.
+    static const ast::BaseNode& unredirected(const ast::BaseNode& stage) {
+        if (stage.type == ast::NodeType::Redirection) {
+            return *dynamic_cast<const ast::RedirectionNode&>(stage).statement;
+        }
+        return stage;
+    }
+
+
+    // What a pipeline stage the shell runs is called in the resource log.
+    static std::string stage_name(const ast::BaseNode& stage) {
+        const auto& statement = unredirected(stage);
+        switch (statement.type) {
+            case ast::NodeType::Command:
+                return dynamic_cast<const ast::CommandNode&>(statement).name;
+            case ast::NodeType::EchoStatement:
+                return "echo";
+            case ast::NodeType::Subshell:
+                return "(...)";
+            default:
+                return "...";
+        }
+    }
+
+
+    // Whether a pipeline stage runs a program rather than script code or a
+    // builtin command.
+    static bool runs_program(const ast::BaseNode& stage) {
+        const auto& statement = unredirected(stage);
+        if (statement.type != ast::NodeType::Command) {
+            return false;
+        }
+
+        const auto& name = dynamic_cast<const ast::CommandNode&>(statement).name;
+        return registry.get_function(name) == nullptr && commands::find(name) == nullptr;
+    }
+
+
+    // Whether a stage that does not run a program is an echo or a builtin
+    // command, which wait on nothing but their own input and output.
+    static bool is_simple_stage(const ast::BaseNode& stage) {
+        const auto& statement = unredirected(stage);
+        if (statement.type != ast::NodeType::Command) {
+            return statement.type == ast::NodeType::EchoStatement;
+        }
+
+        const auto& name = dynamic_cast<const ast::CommandNode&>(statement).name;
+        return registry.get_function(name) == nullptr;
+    }
+
+
+    // Builtins that change an array or dictionary they are given, or the
+    // pipes opened after them, rather than only making new values.
+    static const std::set<std::string> changing_builtins = { "push", "sort", "remove", "pipe_size" };
+
+
+    static bool changes_in_place(const ast::BaseNode* node, std::set<std::string>& visited);
+
+
+    static bool function_changes_in_place(const std::string& name, std::set<std::string>& visited) {
+        if (!visited.insert(name).second) {
+            return false;
+        }
+
+        auto function = registry.get_function(name);
+        return function != nullptr && changes_in_place(function->definition->body.get(), visited);
+    }
+
+
+    /**
+     * Whether running `node` may change a value a copy of the registry
+     * still shares with the shell: an array or dictionary, by storing into
+     * an element or through a builtin that changes its argument, or
+     * anything at all, through a function value. Script functions it calls
+     * by name or as commands, or defines and may then call, are looked into
+     * once each.
+     */
+    static bool changes_in_place(const ast::BaseNode* node, std::set<std::string>& visited) {
+        if (node == nullptr) {
+            return false;
+        }
+
+        switch (node->type) {
+            case ast::NodeType::ValueCall: {
+                return true;
+            }
+
+            case ast::NodeType::FunctionLiteral: {
+                // Its body only runs through a call to the value.
+                return false;
+            }
+
+            case ast::NodeType::FunctionCall: {
+                auto call = dynamic_cast<const ast::FunctionCallNode*>(node);
+                const auto& name = call->name->name;
+                // map(array, function) calls the function for every element.
+                auto maps_function = name == "map" && call->arguments->arguments.size() < 3;
+                if (changing_builtins.count(name) || maps_function || function_changes_in_place(name, visited)) {
+                    return true;
+                }
+                break;
+            }
+
+            case ast::NodeType::Command: {
+                if (function_changes_in_place(dynamic_cast<const ast::CommandNode*>(node)->name, visited)) {
+                    return true;
+                }
+                break;
+            }
+
+            default: {
+                auto binary = dynamic_cast<const ast::BinaryExpressionNode*>(node);
+                auto target = binary != nullptr ? binary->left_argument.get() : nullptr;
+                if (is_assignment(*node) && target && target->type == ast::NodeType::IndexExpression) {
+                    return true;
+                }
+                break;
+            }
+        }
+
+        bool changes = false;
+        optimizer::for_each_child(*node, [&](const ast::BaseNode* child) {
+            changes = changes || changes_in_place(child, visited);
+        });
+        return changes;
+    }
+
+
+    // Whether a subshell or a command substitution must run in a child
+    // process, decided again only once functions have been (re)defined.
+    template <typename Node>
+    static bool needs_process(const Node& node) {
+        if (node.version != registry.version()) {
+            std::set<std::string> visited;
+            node.needs_process = changes_in_place(node.body.get(), visited);
+            node.version = registry.version();
+        }
+        return node.needs_process;
+    }
+
+
+    /**
+     * The frame slots and captures of the running function that `node` may
+     * assign to. Nested function bodies run in frames of their own.
+     */
+    static void collect_local_stores(const ast::BaseNode* node, std::set<int>& slots, std::set<int>& captures) {
+        if (node == nullptr || node->type == ast::NodeType::FunctionDefinition || node->type == ast::NodeType::FunctionLiteral) {
+            return;
+        }
+
+        const ast::VariableNode* target = nullptr;
+        if (is_assignment(*node)) {
+            target = dynamic_cast<const ast::VariableNode*>(dynamic_cast<const ast::BinaryExpressionNode*>(node)->left_argument.get());
+        } else if (node->type == ast::NodeType::ForEachLoop) {
+            target = dynamic_cast<const ast::ForEachNode*>(node)->variable.get();
+        }
+
+        if (target != nullptr && target->capture >= 0) {
+            captures.insert(target->capture);
+        } else if (target != nullptr && target->slot >= 0) {
+            slots.insert(target->slot);
+        }
+
+        optimizer::for_each_child(*node, [&](const ast::BaseNode* child) {
+            collect_local_stores(child, slots, captures);
+        });
+    }
+
+
+    /**
+     * What a subshell may change, saved as it starts and put back as it
+     * ends, so that it can run in the shell instead of a forked copy of it:
+     * the global variables and functions, the parameters of the running
+     * function and what its closure captured that the subshell assigns to,
+     * the working directory and the environment. Values are shared rather
+     * than copied where the subshell cannot change them in place, which is
+     * what needs_process() checks. Descriptors are put back by the
+     * redirections that changed them.
+     */
+    class SubshellState {
+        Registry::Snapshot tables;
+        // By index, since the stack may move as functions are called.
+        std::vector<std::pair<std::size_t, Value>> slots;
+        std::vector<std::pair<std::size_t, Value>> captures;
+        std::vector<std::pair<std::shared_ptr<Box>, Value>> boxes;
+        environment::Snapshot environment;
+        int directory = -1;
+
+        // A local that holds a box is assigned through it.
+        bool save_box(const Value& local) {
+            auto box = std::get_if<std::shared_ptr<Box>>(&local);
+            if (box != nullptr) {
+                this->boxes.emplace_back(*box, (*box)->value);
+            }
+            return box != nullptr;
+        }
+
+    public:
+        explicit SubshellState(const ast::BaseNode& code) : tables(registry.snapshot()) {
+            std::set<int> slots;
+            std::set<int> captures;
+            collect_local_stores(&code, slots, captures);
+
+            const auto& frame = frames.back();
+            for (auto slot : slots) {
+                auto index = frame.base + std::size_t(slot);
+                if (!this->save_box(stack[index])) {
+                    this->slots.emplace_back(index, stack[index]);
+                }
+            }
+            for (auto capture : captures) {
+                auto index = std::size_t(capture);
+                if (!this->save_box(frame.closure->captures[index])) {
+                    this->captures.emplace_back(index, frame.closure->captures[index]);
+                }
+            }
+
+            this->environment = environment::snapshot();
+            this->directory = ::open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+            close_echo_file();
+        }
+
+
+        ~SubshellState() {
+            // The echo file may have been named relative to another directory.
+            close_echo_file();
+            registry.restore(std::move(this->tables));
+
+            for (auto& [index, value] : this->slots) {
+                stack[index] = std::move(value);
+            }
+            for (auto& [index, value] : this->captures) {
+                frames.back().closure->captures[index] = std::move(value);
+            }
+            for (auto& [box, value] : this->boxes) {
+                box->value = std::move(value);
+            }
+
+            // `cd` changes PWD; relative directories on PATH may mean others.
+            if (environment::restore(std::move(this->environment))) {
+                process::forget_paths();
+            }
+
+            if (this->directory >= 0) {
+                if (::fchdir(this->directory) < 0) {
+                    std::cerr << "Cannot return to the working directory: " << std::strerror(errno) << std::endl;
+                }
+                ::close(this->directory);
+            }
+        }
+
+        SubshellState(const SubshellState&) = delete;
+        SubshellState& operator=(const SubshellState&) = delete;
+    };
+
+
+    // Show an error that ends a subshell or a forked stage rather than the line.
+    static void report_error(const Error& error) {
+        output::flush();
+        std::cerr << "\033[31merror\033[0m: " << error.message << std::endl;
+    }
+
+
+    /**
+     * Run a subshell's statements in the shell, putting back what they
+     * changed afterwards. As in a forked subshell, an error ends only the
+     * subshell, with status 1, and a return ends it with the status given.
+     */
+    static int run_in_subshell(const ast::StatementListNode& body) {
+        SubshellState saved(body);
+        auto result = execute_block(body);
+
+        auto& frame = frames.back();
+        auto status = frame.returning ? exit_status(frame.return_value) : last_status;
+        frame.returning = false;
+        frame.return_value = undefined;
+
+        if (result.is_error()) {
+            report_error(result.get_error());
+            return 1;
+        }
+        return status;
+    }
+
+
+    // Run a pipeline stage made of script code or a builtin command, in
+    // whatever process this is.
+    static Result<int> run_script_stage(const ast::BaseNode& stage) {
+        const auto& statement = unredirected(stage);
+        if (statement.type == ast::NodeType::EchoStatement) {
+            auto result = echo(dynamic_cast<const ast::EchoStatementNode&>(statement));
+            if (result.is_error()) {
+                return result.get_error();
+            }
+            return 0;
+        }
+
+        if (statement.type == ast::NodeType::Subshell) {
+            return run_in_subshell(*dynamic_cast<const ast::SubshellNode&>(statement).body);
+        }
+        if (statement.type == ast::NodeType::Substitution) {
+            return run_in_subshell(*dynamic_cast<const ast::SubstitutionNode&>(statement).body);
+        }
+
+        const auto& command = dynamic_cast<const ast::CommandNode&>(statement);
+        auto arguments = command_arguments(command);
+        if (arguments.is_error()) {
+            return arguments.get_error();
+        }
+
+        auto function = registry.get_function(command.name);
+        if (function == nullptr) {
+            return commands::find(command.name)(*arguments);
+        }
+        return call_command_function(*function, *arguments);
+    }
+
+
+    /**
+     * Run a script stage, a subshell or the statements of a command
+     * substitution in a child process, for code that
+     * could change what the shell shares with a copy of its state. The child
+     * keeps only its own ends of the pipes, so that every reader sees the
+     * end of its input.
+     */
+    static Result<pid_t> fork_script_stage(
+        const ast::BaseNode& stage,
+        const process::Redirections& redirections,
+        std::vector<process::Pipe>& pipes
+    ) {
+        auto pid = ::fork();
+        if (pid < 0) {
+            return Error(std::string("Cannot fork: ") + std::strerror(errno));
+        }
+        if (pid > 0) {
+            return pid;
+        }
+
+        jobs::leave();
+        std::signal(SIGPIPE, SIG_DFL);
+        for (const auto& redirection : redirections) {
+            ::dup2(redirection.source, redirection.target);
+        }
+        for (auto& pipe : pipes) {
+            process::close_descriptor(pipe.read);
+            process::close_descriptor(pipe.write);
+        }
+
+        auto status = run_script_stage(stage);
+        output::flush();
+        if (status.is_error()) {
+            report_error(status.get_error());
+        }
+        ::_exit(status.is_error() ? 1 : *status);
+    }
+
+
+    // Run a subshell, or a substitution's statements, in a forked child
+    // and return its status.
+    static Result<int> run_forked(const ast::BaseNode& node) {
+        auto captured = capture_descriptor();
+        if (captured.is_error()) {
+            return captured.get_error();
+        }
+
+        close_echo_file();
+        output::flush();
+        std::vector<process::Pipe> pipes;
+        auto pid = fork_script_stage(node, {}, pipes);
+        if (pid.is_error()) {
+            return pid.get_error();
+        }
+        process::Usage usage;
+        auto status = process::wait(*pid, &usage);
+        accounting::add(usage);
+        return status;
+    }
+
+
+    /**
+     * `(statements)`: run them in the shell with their own copy of its
+     * state, or in a forked child if they could change something that copy
+     * shares with the shell.
+     */
+    static Result<Value> run_subshell(const ast::SubshellNode& node) {
+        int status = 0;
+        if (!needs_process(node)) {
+            status = run_in_subshell(*node.body);
+        } else {
+            auto forked = run_forked(node);
+            if (forked.is_error()) {
+                return forked.get_error();
+            }
+            status = *forked;
+        }
+
+        last_status = status;
+        return Value(std::int64_t(status));
+    }
+
+
+    /**
+     * `statement &`: start it as a job, in a process group of its own, and
+     * go on. A program is spawned directly; anything else runs in a forked
+     * copy of the shell. Without a terminal, a job reads /dev/null rather
+     * than the shell's own input.
+     */
+    static Result<Value> run_in_background(const ast::BackgroundNode& node) {
+        const auto& statement = *node.statement;
+        auto captured = capture_descriptor();
+        if (captured.is_error()) {
+            return captured;
+        }
+
+        close_echo_file();
+        output::flush();
+
+        Result<pid_t> pid = -1;
+        if (runs_program(statement)) {
+            RedirectionFiles files;
+            process::Redirections redirections;
+            if (!jobs::interactive()) {
+                auto nothing = process::open_file("/dev/null", O_RDONLY);
+                if (nothing.is_error()) {
+                    return nothing.get_error();
+                }
+                files.descriptors.push_back(*nothing);
+                redirections.push_back(process::Redirection { STDIN_FILENO, *nothing });
+            }
+
+            if (statement.type == ast::NodeType::Redirection) {
+                auto own = open_redirections(dynamic_cast<const ast::RedirectionNode&>(statement), files);
+                if (own.is_error()) {
+                    return own.get_error();
+                }
+                redirections.insert(redirections.end(), own->begin(), own->end());
+            }
+
+            auto arguments = command_arguments(dynamic_cast<const ast::CommandNode&>(unredirected(statement)));
+            if (arguments.is_error()) {
+                return arguments.get_error();
+            }
+            pid = process::start_job(*arguments, redirections);
+        } else {
+            pid = ::fork();
+            if (*pid < 0) {
+                return Error(std::string("Cannot fork: ") + std::strerror(errno));
+            }
+
+            if (*pid == 0) {
+                ::setpgid(0, 0);
+                jobs::leave();
+                std::signal(SIGPIPE, SIG_DFL);
+                if (!jobs::interactive()) {
+                    auto nothing = ::open("/dev/null", O_RDONLY);
+                    ::dup2(nothing, STDIN_FILENO);
+                    ::close(nothing);
+                }
+
+                last_status = 0;
+                auto result = execute(statement);
+                output::flush();
+                if (result.is_error()) {
+                    report_error(result.get_error());
+                    ::_exit(1);
+                }
+                ::_exit(last_status);
+            }
+
+            // Also in the parent, so that the group exists whichever runs first.
+            ::setpgid(*pid, *pid);
+        }
+
+        if (pid.is_error()) {
+            return pid.get_error();
+        }
+        jobs::add(*pid, node.command);
+        last_status = 0;
+        return Value(std::int64_t(0));
+    }
+
+
+    /**
+     * `time statement`: run it, then report on standard error the time it
+     * took, the CPU time and context switches of the shell and of the
+     * programs it waited for, and the largest resident set among them.
+     */
+    static Result<Value> run_timed(const ast::TimedNode& node) {
+        accounting::Measurement measurement;
+        auto result = execute(*node.statement);
+        auto usage = measurement.finish();
+
+        output::flush();
+        std::cerr << "time: " << accounting::describe(usage) << std::endl;
+        return result;
+    }
+
+
+    // `left && right` or `left || right`: the right side runs only when the
+    // left one's status is, or is not, 0.
+    static Result<Value> run_chain(const ast::ChainNode& node) {
+        auto result = execute(*node.left);
+        if (result.is_error() || (last_status == 0) != node.on_success) {
+            return result;
+        }
+        return execute(*node.right);
+    }
+
+
+    /**
+     * A command substitution being collected. Script output is appended to
+     * `text` directly by the output module. Before anything writes to
+     * descriptor 1 itself, a program or a redirection, capture_descriptor()
+     * points descriptor 1 at a pipe, and a thread appends what comes out of
+     * it to the same string until every writer has closed it.
+     */
+    struct Capture {
+        std::string text;
+        std::thread reader;
+        std::unique_ptr<process::Redirected> redirected;
+    };
+
+    // The substitutions being collected, innermost last.
+    static std::vector<Capture*> captures;
+
+
+    static Result<Value> capture_descriptor() {
+        if (captures.empty() || captures.back()->reader.joinable()) {
+            return undefined;
+        }
+
+        auto pipe = process::open_pipe();
+        if (pipe.is_error()) {
+            return pipe.get_error();
+        }
+
+        // Whatever is buffered belongs to the enclosing output.
+        auto& capture = *captures.back();
+        output::flush();
+        output::capture(nullptr);
+        capture.redirected = std::make_unique<process::Redirected>(
+            process::Redirections { process::Redirection { STDOUT_FILENO, pipe->write } }
+        );
+        process::close_descriptor(pipe->write);
+
+        capture.reader = std::thread([descriptor = pipe->read, &text = capture.text]() mutable {
+            process::read_all(descriptor, text);
+            process::close_descriptor(descriptor);
+        });
+        return undefined;
+    }
+
+
+    /**
+     * Run `body` with what it writes to standard output collected into
+     * `text`, as the innermost capture.
+     */
+    template <typename Body>
+    static auto collect_output(std::string& text, Body body) {
+        Capture capture;
+        auto enclosing = output::capture(&capture.text);
+        captures.push_back(&capture);
+
+        auto result = body();
+
+        if (capture.reader.joinable()) {
+            output::flush();
+            capture.redirected.reset();
+            capture.reader.join();
+        }
+        captures.pop_back();
+        output::capture(enclosing);
+
+        text = std::move(capture.text);
+        return result;
+    }
+
+
+    /**
+     * Run a pipeline stage as a subshell in the shell, with its pipes and
+     * its own redirections in place of the shell's descriptors until it
+     * ends.
+     */
+    static Result<int> run_shell_stage(const ast::BaseNode& stage, const process::Redirections& redirections) {
+        SubshellState saved(stage);
+        process::Redirected redirected(redirections);
+        auto status = run_script_stage(stage);
+        output::flush();
+        return status;
+    }
+
+
+    /**
+     * Run the stages of a pipeline at the same time, each one's standard
+     * output connected to the next one's input by a pipe. Programs are
+     * started with the pipe ends as their standard streams, so their data
+     * never passes through the shell. Script code runs as a subshell in
+     * the shell itself where nothing after it waits on the shell: in the
+     * last stage, and in an echo or builtin followed only by programs, which
+     * are already running when it writes to its pipe. Any other script stage,
+     * and one that could change what such a subshell shares with the shell,
+     * runs in a forked child. A stage's own redirections apply after its
+     * pipes. The pipeline's status is that of its last stage.
+     */
+    static Result<Value> run_pipeline(const ast::PipelineNode& node) {
+        auto captured = capture_descriptor();
+        if (captured.is_error()) {
+            return captured;
+        }
+
+        close_echo_file();
+        output::flush();
+        auto started = accounting::Clock::now();
+        auto count = node.stages.size();
+        RedirectionFiles files;
+
+        // The pipeline as logged: the arguments of its programs, and the
+        // names of the commands the shell runs.
+        std::string text;
+
+        // pipes[i] carries the output of stage i to stage i + 1.
+        std::vector<process::Pipe> pipes;
+        std::vector<pid_t> children(count, -1);
+        std::vector<bool> in_shell(count, false);
+        std::vector<process::Redirections> streams(count);
+        Result<int> failure = 0;
+
+        for (std::size_t i = 0; i + 1 < count && !failure.is_error(); i++) {
+            auto pipe = process::open_pipe();
+            if (pipe.is_error()) {
+                failure = pipe.get_error();
+                break;
+            }
+            pipes.push_back(*pipe);
+            streams[i].push_back(process::Redirection { STDOUT_FILENO, pipe->write });
+            streams[i + 1].push_back(process::Redirection { STDIN_FILENO, pipe->read });
+        }
+
+        for (std::size_t i = 0; i < count && !failure.is_error(); i++) {
+            const auto& stage = *node.stages[i];
+            if (stage.type == ast::NodeType::Redirection) {
+                auto redirections = open_redirections(dynamic_cast<const ast::RedirectionNode&>(stage), files);
+                if (redirections.is_error()) {
+                    failure = redirections.get_error();
+                    break;
+                }
+                streams[i].insert(streams[i].end(), redirections->begin(), redirections->end());
+            }
+
+            if (runs_program(stage)) {
+                auto arguments = command_arguments(dynamic_cast<const ast::CommandNode&>(unredirected(stage)));
+                if (arguments.is_error()) {
+                    failure = arguments.get_error();
+                    break;
+                }
+                if (accounting::logging()) {
+                    for (const auto& argument : *arguments) {
+                        text += argument;
+                        text += ' ';
+                    }
+                    text += i + 1 < count ? "| " : "";
+                }
+
+                auto pid = process::start(*arguments, streams[i]);
+                if (pid.is_error()) {
+                    failure = pid.get_error();
+                    break;
+                }
+                children[i] = *pid;
+                continue;
+            }
+
+            if (accounting::logging()) {
+                text += stage_name(stage);
+                text += i + 1 < count ? " | " : "";
+            }
+
+            auto programs_follow = is_simple_stage(stage);
+            for (auto j = i + 1; j < count && programs_follow; j++) {
+                programs_follow = runs_program(*node.stages[j]);
+            }
+
+            std::set<std::string> visited;
+            if ((i + 1 == count || programs_follow) && !changes_in_place(&stage, visited)) {
+                in_shell[i] = true;
+                continue;
+            }
+
+            auto pid = fork_script_stage(stage, streams[i], pipes);
+            if (pid.is_error()) {
+                failure = pid.get_error();
+                break;
+            }
+            children[i] = *pid;
+        }
+
+        // The shell keeps only the pipe ends its own stages use.
+        for (std::size_t i = 0; i < pipes.size(); i++) {
+            if (!in_shell[i] || failure.is_error()) {
+                process::close_descriptor(pipes[i].write);
+            }
+            if (!in_shell[i + 1] || failure.is_error()) {
+                process::close_descriptor(pipes[i].read);
+            }
+        }
+
+        int status = 0;
+        for (std::size_t i = 0; i < count && !failure.is_error(); i++) {
+            if (!in_shell[i]) {
+                continue;
+            }
+
+            auto result = run_shell_stage(*node.stages[i], streams[i]);
+            if (result.is_error()) {
+                failure = result;
+            } else {
+                status = *result;
+            }
+
+            // Let the next stage see the end of its input.
+            if (i < pipes.size()) {
+                process::close_descriptor(pipes[i].write);
+            }
+            if (i > 0) {
+                process::close_descriptor(pipes[i - 1].read);
+            }
+        }
+
+        // The ends of stages an error kept from running.
+        for (auto& pipe : pipes) {
+            process::close_descriptor(pipe.read);
+            process::close_descriptor(pipe.write);
+        }
+
+        process::Usage usage;
+        for (std::size_t i = 0; i < count; i++) {
+            if (children[i] >= 0) {
+                process::Usage child_usage;
+                auto child_status = process::wait(children[i], &child_usage);
+                usage.add(child_usage);
+                if (i + 1 == count) {
+                    status = child_status;
+                }
+            }
+        }
+
+        if (failure.is_error()) {
+            accounting::add(usage);
+            return failure.get_error();
+        }
+        if (!text.empty() && text.back() == ' ') {
+            text.pop_back();
+        }
+        accounting::record("pipeline", text, status, usage, started);
+        last_status = status;
+        return Value(std::int64_t(status));
+    }
+
+
+    // `$(program arguments)`: the program writes into a pipe read here.
+    static Result<Value> capture_program(const ast::CommandNode& node) {
+        auto arguments = command_arguments(node);
+        if (arguments.is_error()) {
+            return arguments.get_error();
+        }
+
+        auto pipe = process::open_pipe();
+        if (pipe.is_error()) {
+            return pipe.get_error();
+        }
+
+        close_echo_file();
+        auto started = accounting::Clock::now();
+        auto pid = process::start(*arguments, { process::Redirection { STDOUT_FILENO, pipe->write } });
+        process::close_descriptor(pipe->write);
+        if (pid.is_error()) {
+            process::close_descriptor(pipe->read);
+            return pid.get_error();
+        }
+
+        std::string text;
+        process::read_all(pipe->read, text);
+        process::close_descriptor(pipe->read);
+        process::Usage usage;
+        last_status = process::wait(*pid, &usage);
+        accounting::record("command", *arguments, last_status, usage, started);
+
+        while (!text.empty() && text.back() == '\n') {
+            text.pop_back();
+        }
+        return Value(std::move(text));
+    }
+
+
+    /**
+     * Run the statements of `$(...)` as a subshell, collecting what they
+     * write to standard output as a string without its trailing newlines.
+     * In the shell, a return inside ends the substitution, not the
+     * enclosing function, and an error ends the line as it would outside.
+     */
+    static Result<Value> substitute(const ast::SubstitutionNode& node) {
+        const auto& statements = node.body->statements;
+        if (statements.size() == 1 && statements.front()->type == ast::NodeType::Command && runs_program(*statements.front())) {
+            return capture_program(dynamic_cast<const ast::CommandNode&>(*statements.front()));
+        }
+
+        std::string text;
+        auto result = collect_output(text, [&]() -> Result<Value> {
+            if (needs_process(node)) {
+                auto status = run_forked(node);
+                if (status.is_error()) {
+                    return status.get_error();
+                }
+                last_status = *status;
+                return undefined;
+            }
+
+            SubshellState saved(*node.body);
+            auto returning = frames.back().returning;
+            auto result = execute_block(*node.body);
+            if (!returning && frames.back().returning) {
+                frames.back().returning = false;
+                frames.back().return_value = undefined;
+            }
+            return result;
+        });
+
+        if (result.is_error()) {
+            return result;
+        }
+
+        while (!text.empty() && text.back() == '\n') {
+            text.pop_back();
+        }
+        return Value(std::move(text));
+    }
+
+
+    /**
+     * pipe_size(bytes): set the buffer size of the pipes between pipeline
+     * stages from now on, 0 meaning the kernel's default. pipe_size() returns
+     * the current setting.
+     */
+    static Result<Value> set_pipe_size(const std::vector<Value>& arguments) {
+        if (arguments.empty()) {
+            return Value(std::int64_t(process::get_pipe_size()));
+        }
+
+        if (arguments.size() != 1 || !std::holds_alternative<std::int64_t>(arguments[0]) || std::get<std::int64_t>(arguments[0]) < 0) {
+            return Error("pipe_size expects a size in bytes");
+        }
+
+        process::set_pipe_size(std::size_t(std::get<std::int64_t>(arguments[0])));
+        return Value(undefined);
+    }
+
+
+    /**
+     * memo_stats(name): report the memoization counters of a script function.
+     */
+    static Result<Value> memo_stats(const std::vector<Value>& arguments) {
+        if (arguments.size() != 1 || !std::holds_alternative<std::string>(arguments[0])) {
+            return Error("memo_stats expects a function name");
+        }
+
+        const auto& name = std::get<std::string>(arguments[0]);
+        auto function = registry.get_function(name);
+        if (function == nullptr) {
+            return Error("Undefined function: " + name);
+        }
+
+        const auto& cache = function->cache;
+        std::stringstream stream;
+        stream
+            << name
+            << (function->is_memoized() ? "" : " (not memoized)")
+            << ": hits=" << cache.hits
+            << " misses=" << cache.misses
+            << " evictions=" << cache.evictions
+            << " entries=" << cache.entries.size()
+            << "/" << MemoCache::capacity;
+        return Value(stream.str());
+    }
+
+
+    /**
+     * gc(): collect garbage cycles now, returning how many objects were freed.
+     */
+    static Result<Value> collect_garbage(const std::vector<Value>& arguments) {
+        if (!arguments.empty()) {
+            return Error("gc expects no arguments");
+        }
+        return std::int64_t(heap::collect());
+    }
+
+
+    /**
+     * gc_stats(): a dictionary of collector counters. Pauses are in
+     * milliseconds and the allocation rate in objects per second.
+     */
+    static Result<Value> gc_stats(const std::vector<Value>& arguments) {
+        if (!arguments.empty()) {
+            return Error("gc_stats expects no arguments");
+        }
+
+        auto statistics = heap::statistics();
+        auto result = make_object<Dictionary>();
+        result->insert(std::string("allocations")) = std::int64_t(statistics.allocations);
+        result->insert(std::string("allocation_rate")) = statistics.seconds_running > 0
+            ? double(statistics.allocations) / statistics.seconds_running
+            : 0.0;
+        result->insert(std::string("young_collections")) = std::int64_t(statistics.young_collections);
+        result->insert(std::string("full_collections")) = std::int64_t(statistics.full_collections);
+        result->insert(std::string("collected")) = std::int64_t(statistics.collected);
+        result->insert(std::string("promoted")) = std::int64_t(statistics.promoted);
+        result->insert(std::string("young_objects")) = std::int64_t(statistics.young_objects);
+        result->insert(std::string("old_objects")) = std::int64_t(statistics.old_objects);
+        result->insert(std::string("total_pause_ms")) = statistics.total_pause_ms;
+        result->insert(std::string("longest_pause_ms")) = statistics.longest_pause_ms;
+        return Value(std::move(result));
+    }
+
+
+    static inline Array* as_array(const Value& value) {
+        if (!std::holds_alternative<std::shared_ptr<Array>>(value)) {
+            return nullptr;
+        }
+        return std::get<std::shared_ptr<Array>>(value).get();
+    }
+
+
+    static inline Dictionary* as_dictionary(const Value& value) {
+        if (!std::holds_alternative<std::shared_ptr<Dictionary>>(value)) {
+            return nullptr;
+        }
+        return std::get<std::shared_ptr<Dictionary>>(value).get();
+    }
+
+
+    /**
+     * len(value): the number of elements of an array, keys of a dictionary
+     * or bytes of a string.
+     */
+    static Result<Value> length(const std::vector<Value>& arguments) {
+        if (arguments.size() == 1 && as_array(arguments[0]) != nullptr) {
+            return std::int64_t(as_array(arguments[0])->size());
+        }
+
+        if (arguments.size() == 1 && as_dictionary(arguments[0]) != nullptr) {
+            return std::int64_t(as_dictionary(arguments[0])->size());
+        }
+
+        if (arguments.size() == 1 && std::holds_alternative<std::string>(arguments[0])) {
+            return std::int64_t(std::get<std::string>(arguments[0]).size());
+        }
+
+        return Error("len expects an array, a dictionary or a string");
+    }
+
+
+    /**
+     * push(array, value, ...): append values to an array, returning its new
+     * length.
+     */
+    static Result<Value> push(const std::vector<Value>& arguments) {
+        auto array = arguments.size() >= 2 ? as_array(arguments[0]) : nullptr;
+        if (array == nullptr) {
+            return Error("push expects an array and at least one value");
+        }
+
+        for (std::size_t i = 1; i < arguments.size(); i++) {
+            array->push(arguments[i]);
+        }
+        return std::int64_t(array->size());
+    }
+
+
+    /**
+     * range(end) or range(start, end): a new array of the integers from
+     * start, or 0, up to but not including end.
+     */
+    static Result<Value> range(const std::vector<Value>& arguments) {
+        auto valid = !arguments.empty() && arguments.size() <= 2 && std::all_of(
+            arguments.begin(), arguments.end(),
+            [](const Value& argument) { return std::holds_alternative<std::int64_t>(argument); }
+        );
+        if (!valid) {
+            return Error("range expects one or two integers");
+        }
+
+        auto start = arguments.size() == 2 ? std::get<std::int64_t>(arguments[0]) : 0;
+        auto end = std::get<std::int64_t>(arguments.back());
+
+        std::vector<std::int64_t> integers;
+        if (end > start) {
+            integers.resize(std::uint64_t(end) - std::uint64_t(start));
+            std::iota(integers.begin(), integers.end(), start);
+        }
+        return Value(make_object<Array>(std::move(integers)));
+    }
+
+
+    /**
+     * sum(array): the total of the elements.
+     */
+    static Result<Value> sum(const std::vector<Value>& arguments) {
+        auto array = arguments.size() == 1 ? as_array(arguments[0]) : nullptr;
+        if (array == nullptr) {
+            return Error("sum expects an array");
+        }
+
+        switch (array->get_storage()) {
+            case Array::Storage::Integers: {
+                // Exact even if a running total would have overflowed; a
+                // total too large for an integer becomes a number.
+                std::int64_t total = 0;
+                double rounded = 0;
+                if (kernels::sum(array->get_integers(), total, rounded)) {
+                    return total;
+                }
+                return rounded;
+            }
+
+            case Array::Storage::Numbers: {
+                return kernels::sum(array->get_numbers());
+            }
+
+            default: {
+                Value total = std::int64_t(0);
+                for (const auto& element : array->get_values()) {
+                    auto next = add(total, element);
+                    if (next.is_error()) {
+                        return next;
+                    }
+                    total = std::move(*next);
+                }
+                return total;
+            }
+        }
+    }
+
+
+    /**
+     * The smallest or largest element of the array in `arguments`. NaN wins
+     * over every other number.
+     */
+    static Result<Value> extreme(const std::vector<Value>& arguments, bool find_maximum) {
+        std::string name = find_maximum ? "max" : "min";
+        auto array = arguments.size() == 1 ? as_array(arguments[0]) : nullptr;
+        if (array == nullptr) {
+            return Error(name + " expects an array");
+        }
+
+        if (array->size() == 0) {
+            return Error(name + " of an empty array");
+        }
+
+        switch (array->get_storage()) {
+            case Array::Storage::Integers: {
+                const auto& integers = array->get_integers();
+                return find_maximum ? kernels::maximum(integers) : kernels::minimum(integers);
+            }
+
+            case Array::Storage::Numbers: {
+                const auto& numbers = array->get_numbers();
+                return find_maximum ? kernels::maximum(numbers) : kernels::minimum(numbers);
+            }
+
+            default: {
+                const auto& values = array->get_values();
+                const Value* best = &values.front();
+                for (const auto& element : values) {
+                    auto ordering = order(element, *best);
+                    if (ordering.is_error()) {
+                        return ordering.get_error();
+                    }
+
+                    if (is_nan(element)) {
+                        return element;
+                    }
+
+                    if (find_maximum ? *ordering > 0 : *ordering < 0) {
+                        best = &element;
+                    }
+                }
+                return *best;
+            }
+        }
+    }
+
+
+    static Result<Value> minimum(const std::vector<Value>& arguments) {
+        return extreme(arguments, false);
+    }
+
+
+    static Result<Value> maximum(const std::vector<Value>& arguments) {
+        return extreme(arguments, true);
+    }
+
+
+    static Result<Value> apply_operator(kernels::Operation operation, const Value& left, const Value& right) {
+        switch (operation) {
+            case kernels::Operation::Add: return add(left, right);
+            case kernels::Operation::Subtract: return subtract(left, right);
+            case kernels::Operation::Multiply: return multiply(left, right);
+            case kernels::Operation::Divide: return divide(left, right);
+            default: return modulo(left, right);
+        }
+    }
+
+
+    /**
+     * map(array, function): a new array holding `function(element)` for every
+     * element that was present when the map started.
+     */
+    static Result<Value> map_with_function(const Array& array, Closure& function) {
+        auto count = array.size();
+        auto result = make_object<Array>();
+        result->reserve(count);
+
+        for (std::size_t i = 0; i < count && i < array.size(); i++) {
+            auto base = stack.size();
+            stack.push_back(array.get(i));
+
+            auto value = call_closure(function, base);
+            if (value.is_error()) {
+                return value;
+            }
+            result->push(*value);
+        }
+        return Value(std::move(result));
+    }
+
+
+    /**
+     * map(array, operator, operand): a new array holding `element <operator>
+     * operand` for every element, where the operator is one of + - * / %.
+     * Unboxed elements are computed in bulk; the results are the same as
+     * applying the operator to each element in turn.
+     */
+    static Result<Value> map_elements(const std::vector<Value>& arguments) {
+        if (arguments.size() == 2 && std::holds_alternative<std::shared_ptr<Closure>>(arguments[1])) {
+            auto array = as_array(arguments[0]);
+            if (array == nullptr) {
+                return Error("map expects an array and a function");
+            }
+            return map_with_function(*array, *std::get<std::shared_ptr<Closure>>(arguments[1]));
+        }
+
+        static const std::map<std::string, kernels::Operation> operations = {
+            { "+", kernels::Operation::Add },
+            { "-", kernels::Operation::Subtract },
+            { "*", kernels::Operation::Multiply },
+            { "/", kernels::Operation::Divide },
+            { "%", kernels::Operation::Modulo }
+        };
+
+        auto array = arguments.size() == 3 ? as_array(arguments[0]) : nullptr;
+        auto operation = array && std::holds_alternative<std::string>(arguments[1])
+            ? operations.find(std::get<std::string>(arguments[1]))
+            : operations.end();
+        if (operation == operations.end()) {
+            return Error("map expects an array, an operator and an operand");
+        }
+
+        const auto& operand = arguments[2];
+        auto storage = array->get_storage();
+        if (is_number(operand) && storage != Array::Storage::Values && array->size() != 0) {
+            auto divides = operation->second == kernels::Operation::Divide
+                || operation->second == kernels::Operation::Modulo;
+            if (divides && to_double(operand) == 0) {
+                return Error("DivideByZeroError");
+            }
+
+            // Integer by integer stays integer unless it overflows; dividing
+            // integers is left to the general rules, which keep whole
+            // quotients exact.
+            auto integer_operand = std::holds_alternative<std::int64_t>(operand);
+            if (storage == Array::Storage::Integers && integer_operand) {
+                std::vector<std::int64_t> results;
+                if (operation->second != kernels::Operation::Divide
+                        && kernels::apply(operation->second, array->get_integers(), std::get<std::int64_t>(operand), results)) {
+                    return Value(make_object<Array>(std::move(results)));
+                }
+            } else {
+                std::vector<double> converted;
+                if (storage == Array::Storage::Integers) {
+                    converted.assign(array->get_integers().begin(), array->get_integers().end());
+                }
+
+                const auto& numbers = storage == Array::Storage::Numbers ? array->get_numbers() : converted;
+                std::vector<double> results;
+                kernels::apply(operation->second, numbers, to_double(operand), results);
+                return Value(make_object<Array>(std::move(results)));
+            }
+        }
+
+        auto result = make_object<Array>();
+        result->reserve(array->size());
+        for (std::size_t i = 0; i < array->size(); i++) {
+            auto value = apply_operator(operation->second, array->get(i), operand);
+            if (value.is_error()) {
+                return value;
+            }
+            result->push(*value);
+        }
+        return Value(std::move(result));
+    }
+
+
+    /**
+     * sort(array): sort the elements in place in ascending order and return
+     * the array. Numbers and strings can be sorted, but not a mix of the two.
+     */
+    static Result<Value> sort_elements(const std::vector<Value>& arguments) {
+        auto array = arguments.size() == 1 ? as_array(arguments[0]) : nullptr;
+        if (array == nullptr) {
+            return Error("sort expects an array");
+        }
+
+        switch (array->get_storage()) {
+            case Array::Storage::Integers: {
+                kernels::sort(array->get_integers());
+                return arguments[0];
+            }
+
+            case Array::Storage::Numbers: {
+                kernels::sort(array->get_numbers());
+                return arguments[0];
+            }
+
+            default: {
+                break;
+            }
+        }
+
+        auto& values = array->get_values();
+        if (std::all_of(values.begin(), values.end(), is_number)) {
+            // As with unboxed numbers, NaN goes last.
+            std::sort(values.begin(), values.end(), [](const Value& left, const Value& right) {
+                if (is_nan(left) || is_nan(right)) {
+                    return !is_nan(left);
+                }
+                return compare_numbers(left, right) < 0;
+            });
+            return arguments[0];
+        }
+
+        auto is_string = [](const Value& value) { return std::holds_alternative<std::string>(value); };
+        if (std::all_of(values.begin(), values.end(), is_string)) {
+            std::sort(values.begin(), values.end(), [](const Value& left, const Value& right) {
+                return std::get<std::string>(left) < std::get<std::string>(right);
+            });
+            return arguments[0];
+        }
+
+        return Error("sort expects an array of numbers or of strings");
+    }
+
+
+    /**
+     * has(dictionary, key): whether the key is present.
+     */
+    static Result<Value> has_key(const std::vector<Value>& arguments) {
+        auto dictionary = arguments.size() == 2 ? as_dictionary(arguments[0]) : nullptr;
+        if (dictionary == nullptr) {
+            return Error("has expects a dictionary and a key");
+        }
+
+        return Dictionary::is_key(arguments[1]) && dictionary->find(arguments[1]) != nullptr;
+    }
+
+
+    /**
+     * get(dictionary, key, default): the value stored under the key, or the
+     * default if it is absent. `$d[$k] = get($d, $k, 0) + 1` counts.
+     */
+    static Result<Value> get_value(const std::vector<Value>& arguments) {
+        auto dictionary = arguments.size() == 3 ? as_dictionary(arguments[0]) : nullptr;
+        if (dictionary == nullptr) {
+            return Error("get expects a dictionary, a key and a default");
+        }
+
+        if (!Dictionary::is_key(arguments[1])) {
+            return arguments[2];
+        }
+
+        const auto* value = dictionary->find(arguments[1]);
+        return value != nullptr ? *value : arguments[2];
+    }
+
+
+    /**
+     * remove(dictionary, key): remove the key, returning whether it was present.
+     */
+    static Result<Value> remove_key(const std::vector<Value>& arguments) {
+        auto dictionary = arguments.size() == 2 ? as_dictionary(arguments[0]) : nullptr;
+        if (dictionary == nullptr) {
+            return Error("remove expects a dictionary and a key");
+        }
+
+        return Dictionary::is_key(arguments[1]) && dictionary->remove(arguments[1]);
+    }
+
+
+    /**
+     * keys(dictionary) and values(dictionary): a new array of the keys or
+     * of the values, in insertion order.
+     */
+    template <bool Keys>
+    static Result<Value> entries(const std::vector<Value>& arguments, const char* message) {
+        auto dictionary = arguments.size() == 1 ? as_dictionary(arguments[0]) : nullptr;
+        if (dictionary == nullptr) {
+            return Error(message);
+        }
+
+        auto array = make_object<Array>();
+        array->reserve(dictionary->size());
+        for (const auto& entry : dictionary->get_entries()) {
+            if (!entry.removed) {
+                array->push(Keys ? entry.key : entry.value);
+            }
+        }
+        return Value(std::move(array));
+    }
+
+
+    static Result<Value> keys(const std::vector<Value>& arguments) {
+        return entries<true>(arguments, "keys expects a dictionary");
+    }
+
+
+    static Result<Value> values(const std::vector<Value>& arguments) {
+        return entries<false>(arguments, "values expects a dictionary");
+    }
+
+
+    // The leftmost text the pattern matches, or undefined if there is none.
+    static Result<Value> match_pattern(const std::vector<Value>& arguments) {
+        const auto* text = arguments.size() == 2 ? std::get_if<std::string>(&arguments[0]) : nullptr;
+        const auto* pattern = arguments.size() == 2 ? std::get_if<std::string>(&arguments[1]) : nullptr;
+        if (text == nullptr || pattern == nullptr) {
+            return Error("match expects a string and a pattern");
+        }
+
+        auto regex = regex::cached(*pattern);
+        if (regex.is_error()) {
+            return regex.get_error();
+        }
+
+        std::size_t start = 0;
+        std::size_t end = 0;
+        if (!(*regex)->find(*text, start, end)) {
+            return undefined;
+        }
+        return Value(text->substr(start, end - start));
+    }
+
+
+    // Read exactly `count` string arguments into `strings`.
+    static inline bool string_arguments(
+        const std::vector<Value>& arguments,
+        std::size_t count,
+        std::array<std::string_view, 3>& strings
+    ) {
+        if (arguments.size() != count) {
+            return false;
+        }
+        for (std::size_t i = 0; i < count; i++) {
+            const auto* string = std::get_if<std::string>(&arguments[i]);
+            if (string == nullptr) {
+                return false;
+            }
+            strings[i] = *string;
+        }
+        return true;
+    }
+
+
+    // The byte offset of the first occurrence, or -1.
+    static Result<Value> find_text(const std::vector<Value>& arguments) {
+        std::array<std::string_view, 3> strings;
+        if (!string_arguments(arguments, 2, strings)) {
+            return Error("find expects a string and a string to look for");
+        }
+
+        auto found = text::find(strings[0], strings[1]);
+        return std::int64_t(found == std::string_view::npos ? -1 : std::int64_t(found));
+    }
+
+
+    static Result<Value> contains_text(const std::vector<Value>& arguments) {
+        std::array<std::string_view, 3> strings;
+        if (!string_arguments(arguments, 2, strings)) {
+            return Error("contains expects a string and a string to look for");
+        }
+        return text::find(strings[0], strings[1]) != std::string_view::npos;
+    }
+
+
+    static Result<Value> starts_with(const std::vector<Value>& arguments) {
+        std::array<std::string_view, 3> strings;
+        if (!string_arguments(arguments, 2, strings)) {
+            return Error("starts_with expects a string and a prefix");
+        }
+        return strings[0].substr(0, strings[1].size()) == strings[1];
+    }
+
+
+    static Result<Value> split_text(const std::vector<Value>& arguments) {
+        std::array<std::string_view, 3> strings;
+        if (!string_arguments(arguments, 2, strings) || strings[1].empty()) {
+            return Error("split expects a string and a non-empty separator");
+        }
+
+        auto pieces = text::split(strings[0], strings[1]);
+        std::vector<Value> values;
+        values.reserve(pieces.size());
+        for (auto piece : pieces) {
+            values.emplace_back(std::string(piece));
+        }
+        return Value(make_object<Array>(std::move(values)));
+    }
+
+
+    static Result<Value> replace_text(const std::vector<Value>& arguments) {
+        std::array<std::string_view, 3> strings;
+        if (!string_arguments(arguments, 3, strings) || strings[1].empty()) {
+            return Error("replace expects a string, a non-empty string to replace and its replacement");
+        }
+        return Value(text::replace(strings[0], strings[1], strings[2]));
+    }
+
+
+    static Result<Value> trim_text(const std::vector<Value>& arguments) {
+        std::array<std::string_view, 3> strings;
+        if (!string_arguments(arguments, 1, strings)) {
+            return Error("trim expects a string");
+        }
+
+        auto trimmed = text::trim(strings[0]);
+        if (trimmed.size() == strings[0].size()) {
+            return arguments[0];
+        }
+        return Value(std::string(trimmed));
+    }
+
+
+    static Result<Value> lower_text(const std::vector<Value>& arguments) {
+        std::array<std::string_view, 3> strings;
+        if (!string_arguments(arguments, 1, strings)) {
+            return Error("lower expects a string");
+        }
+        return Value(text::lower(strings[0]));
+    }
+
+
+    static Result<Value> upper_text(const std::vector<Value>& arguments) {
+        std::array<std::string_view, 3> strings;
+        if (!string_arguments(arguments, 1, strings)) {
+            return Error("upper expects a string");
+        }
+        return Value(text::upper(strings[0]));
+    }
+
+
+    /**
+     * rehash(): forget where commands were found on PATH, so that the next
+     * run of each searches for it again.
+     */
+    static Result<Value> rehash(const std::vector<Value>& arguments) {
+        if (!arguments.empty()) {
+            return Error("rehash expects no arguments");
+        }
+
+        process::forget_paths();
+        return Value(undefined);
     }
-}
\ No newline at end of file
+}
@@ -5,25 +5,176 @@
 #include <set>
 #include <string>
 #include <variant>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <cstdint>
+#include <unordered_map>
+#include "../result.hpp"
 #include "parser.hpp"
+#include "optimizer.hpp"
 
 namespace pshellscript::vm {
     using namespace parser;
 
+    class Array;
+    class Dictionary;
+    class Closure;
+    class Box;
+
     constexpr auto undefined = nullptr;
     using undefined_t = std::nullptr_t;
-    using Value = std::variant<double, std::string, bool, undefined_t>;
+
+    // Arrays, dictionaries and functions are shared by reference: assigning
+    // one to another variable or passing it to a function does not copy it.
+    // Boxes only ever sit in frame slots and closure captures; evaluating an
+    // expression never produces one.
+    using Value = std::variant<
+        double, std::string, bool, undefined_t, std::int64_t,
+        std::shared_ptr<Array>, std::shared_ptr<Dictionary>,
+        std::shared_ptr<Closure>, std::shared_ptr<Box>
+    >;
+
+
+    struct ArgumentsHash {
+        std::size_t operator()(const std::vector<Value>& arguments) const;
+    };
+
+
+    // Bounded cache of results for a function whose output depends only on
+    // its arguments. Once full, an arbitrary entry is evicted per insertion.
+    struct MemoCache {
+        static constexpr std::size_t capacity = 4096;
+
+        std::unordered_map<std::vector<Value>, Value, ArgumentsHash> entries;
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+
+        const Value* find(const std::vector<Value>& arguments);
+        void insert(std::vector<Value>&& arguments, const Value& result);
+        void clear();
+    };
+
+
+    struct Function {
+        // Aliases the program the definition was parsed from, keeping it alive
+        // for as long as the function is registered.
+        std::shared_ptr<const ast::FunctionDefinitionNode> definition;
+
+        // Whether the body is free of side effects and reads nothing but its
+        // parameters, as decided by the purity analysis.
+        bool is_pure = false;
+        MemoCache cache;
+
+        inline bool is_memoized() const {
+            return this->definition->memoize || this->is_pure;
+        }
+    };
+
+
+    struct Builtin {
+        Result<Value> (*function)(const std::vector<Value>& arguments);
+        bool is_pure;
+    };
+
+
+    // A running function. Its locals occupy the value stack from `base`
+    // onwards, parameters first. The bottom frame belongs to the top-level
+    // program and never holds locals. `closure` is set while a function
+    // value runs, and holds the variables its body captured.
+    struct Frame {
+        std::size_t base = 0;
+        bool returning = false;
+        Value return_value = undefined;
+        Closure* closure = nullptr;
+    };
+
 
     class Registry {
+    public:
+        using Functions = std::map<std::string, std::shared_ptr<Function>>;
+
+        // Where the variables and functions were at some point, to return
+        // to later. Snapshots are restored in the reverse order of taking.
+        struct Snapshot {
+            std::size_t changes;
+            std::shared_ptr<Functions> functions;
+        };
+
     private:
         std::map<std::string, Value> global_variables;
 
+        // Shared with the snapshots taken since it last changed, and copied
+        // before a change while they share it.
+        std::shared_ptr<Functions> functions = std::make_shared<Functions>();
+
+        // A global as it was before its first change since a snapshot, or
+        // nothing if it was not set. The names each open snapshot has seen
+        // change, so that each is saved once.
+        struct Change {
+            std::string name;
+            std::optional<Value> value;
+        };
+        std::vector<Change> changes;
+        std::vector<std::set<std::string>> changed_names;
+
+        // Replaced functions that may still be running or referenced by a
+        // stale call site; released once the program returns to the prompt.
+        std::vector<std::shared_ptr<Function>> retired_functions;
+
+        // Bumped whenever a function is (re)defined.
+        std::uint64_t function_version = 1;
+        std::uint64_t purity_version = 0;
+
+        // Globals never assigned read the environment; what was read is
+        // kept until it changes.
+        mutable std::unordered_map<std::string, Value> environment_values;
+        mutable std::uint64_t environment_version = 0;
+
+        void analyze_purity();
+        const Value* find_environment(const std::string& name) const;
+
     public:
         void set_global(const std::string& name, Value value);
         Value get_global(const std::string& name) const;
+
+        // The stored global itself, or the environment variable of that name
+        // if it was never assigned, or nullptr if there is none.
+        const Value* find_global(const std::string& name) const;
+
+        void define_function(std::shared_ptr<const ast::FunctionDefinitionNode> definition);
+        std::shared_ptr<Function> get_function(const std::string& name);
+        optimizer::FunctionTable function_table() const;
+        void release_retired_functions();
+
+        // Start saving what changes from here. This copies nothing: a global
+        // is saved when it is first set, and the functions are shared until
+        // one is (re)defined.
+        Snapshot snapshot();
+
+        // Go back to the variables and functions of the latest snapshot.
+        // Cached results are dropped if the functions differ, as after a
+        // redefinition.
+        void restore(Snapshot snapshot);
+
+        inline std::uint64_t version() const {
+            return this->function_version;
+        }
     };
 
-    int execute_program(std::unique_ptr<ast::StatementListNode> program);
+    Result<int> execute_program(std::unique_ptr<ast::StatementListNode> program);
+
+    // What the optimizer did to the most recently executed program.
+    const optimizer::Report& optimizer_report();
+
+    /**
+     * `export [name[=value]...]`: mark the names as exported, so that
+     * programs see the variables of those names, and assigning one sets
+     * it in their environment as well. A value is assigned first. Without
+     * names, list the environment.
+     */
+    Result<int> export_variables(const std::vector<std::string>& arguments);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,27 +1,91 @@
 #ifndef RESULT_HPP
 #define RESULT_HPP
 
-#include <memory>
 #include <string>
+#include <utility>
+#include <new>
+#include <type_traits>
 
 struct Error {
     std::string message;
-    inline Error(const std::string& message)
-        : message(message) {}
+    inline explicit Error(std::string message)
+        : message(std::move(message)) {}
 };
 
+
+/**
+ * Either a value or the error that prevented producing it. Both are stored
+ * inline, so returning a Result never allocates beyond what the value or the
+ * error message itself needs.
+ */
 template <typename T>
 class Result {
 private:
-    std::shared_ptr<Error> error;
-    std::shared_ptr<T> value;
+    bool failed;
+    union {
+        T value;
+        Error error;
+    };
+
+    inline void destroy() {
+        if (this->failed) {
+            this->error.~Error();
+        } else {
+            this->value.~T();
+        }
+    }
 
 public:
-    inline Result(const Error& error) : error(std::make_shared<Error>(error)), value(nullptr) {}
-    inline Result(const T& value) : error(nullptr), value(std::make_shared<T>(value)) {}
-    inline bool is_error() const { return this->error != nullptr; }
-    inline T& get_value() const { return *this->value; }
-    inline Error& get_error() const { return *this->error; }
+    inline Result(const Error& error) : failed(true), error(error) {}
+    inline Result(Error&& error) : failed(true), error(std::move(error)) {}
+
+    template <
+        typename U = T,
+        typename = std::enable_if_t<
+            std::is_constructible_v<T, U&&> &&
+            !std::is_same_v<std::decay_t<U>, Error> &&
+            !std::is_same_v<std::decay_t<U>, Result>
+        >
+    >
+    inline Result(U&& value) : failed(false), value(std::forward<U>(value)) {}
+
+    inline Result(const Result& other) : failed(other.failed) {
+        if (this->failed) {
+            new (&this->error) Error(other.error);
+        } else {
+            new (&this->value) T(other.value);
+        }
+    }
+
+    inline Result(Result&& other) noexcept : failed(other.failed) {
+        if (this->failed) {
+            new (&this->error) Error(std::move(other.error));
+        } else {
+            new (&this->value) T(std::move(other.value));
+        }
+    }
+
+    inline Result& operator=(Result other) noexcept {
+        this->destroy();
+        new (this) Result(std::move(other));
+        return *this;
+    }
+
+    inline ~Result() {
+        this->destroy();
+    }
+
+    inline bool is_error() const { return this->failed; }
+
+    inline T& get_value() { return this->value; }
+    inline const T& get_value() const { return this->value; }
+    inline Error& get_error() { return this->error; }
+    inline const Error& get_error() const { return this->error; }
+
+    inline T& operator*() { return this->value; }
+    inline const T& operator*() const { return this->value; }
+    inline T* operator->() { return &this->value; }
+    inline const T* operator->() const { return &this->value; }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,48 +1,111 @@
 #include <iostream>
 #include <string>
 #include <cstdlib>
+#include <climits>
+#include <csignal>
 #include <stack>
+#include <optional>
 #include "pshellscript/lexer.hpp"
 #include "pshellscript/tokens.hpp"
 #include "pshellscript/parser.hpp"
 #include "pshellscript/vm.hpp"
+#include "pshellscript/output.hpp"
+#include "pshellscript/jobs.hpp"
+#include "pshellscript/accounting.hpp"
 #include "debug.hpp"
 
 namespace config {
     static std::string prompt = "$ ";
+
+    // Print what the optimizer changed after each line.
+    static bool report_optimizations = std::getenv("PSH_OPTIMIZER_REPORT") != nullptr;
+
+    // Follow each line's status with the time and resources it used.
+    static bool report_resources = std::getenv("PSH_RESOURCE_REPORT") != nullptr;
+
+    // A file descriptor to log a JSON line to for each program and pipeline.
+    static const char* resource_log = std::getenv("PSH_RESOURCE_LOG_FD");
 }
 
+static void report_error(const Error& error) {
+    // Keep the error after whatever the line printed before failing.
+    pshellscript::output::flush();
+    std::cerr << "\033[31merror\033[0m: " << error.message << "\n";
+}
+
+
 static int process_line(const std::string& line) {
     using namespace pshellscript;
-    int exit_status = 0;
-    try {
-        auto tokens = lexer::scan_tokens(line);
-        auto parser = parser::Parser(tokens);
-        auto program = parser.parse();
-        exit_status = vm::execute_program(std::move(program));
-    } catch (std::runtime_error &error) {
-        std::cerr << "\033[31merror\033[0m: " << error.what() << "\n";
-        exit_status = 1;
+    auto tokens = lexer::scan_tokens(line);
+    if (tokens.is_error()) {
+        report_error(tokens.get_error());
+        return 1;
     }
 
-    return exit_status;
+    auto parser = parser::Parser(*tokens);
+    auto program = parser.parse();
+    if (program.is_error()) {
+        report_error(program.get_error());
+        return 1;
+    }
+
+    auto exit_status = vm::execute_program(std::move(*program));
+    if (exit_status.is_error()) {
+        report_error(exit_status.get_error());
+        return 1;
+    }
+
+    if (config::report_optimizations) {
+        output::flush();
+        debug::dump_optimizer_report(vm::optimizer_report());
+    }
+    return *exit_status;
 }
 
 
 int main() {
-    using namespace pshellscript::parser;
-    std::string path = std::getenv("PATH");
+    // A pipeline stage the shell runs itself may outlive its reader; the
+    // write then fails instead of ending the shell.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // The prompt waits in the event loop, which reaps background jobs as
+    // they finish; they are reported before the next prompt.
+    pshellscript::jobs::start();
+
+    if (config::resource_log != nullptr) {
+        char* end = nullptr;
+        auto descriptor = std::strtol(config::resource_log, &end, 10);
+        if (*config::resource_log == '\0' || *end != '\0' || descriptor < 0 || descriptor > INT_MAX
+                || !pshellscript::accounting::set_log(int(descriptor))) {
+            std::cerr << "PSH_RESOURCE_LOG_FD: " << config::resource_log << ": not an open file descriptor" << std::endl;
+        }
+    }
 
     std::string line;
     while (1) {
-        std::cout << config::prompt;
-        std::getline(std::cin, line);
+        pshellscript::jobs::report();
+        std::cout << config::prompt << std::flush;
+        if (!pshellscript::jobs::read_line(line)) {
+            break;
+        }
 
         if (line == "exit") {
             break;
         }
 
+        std::optional<pshellscript::accounting::Measurement> measurement;
+        if (config::report_resources) {
+            measurement.emplace();
+        }
+
         auto exit_status = process_line(line);
-        std::cout << "Exited with status " << exit_status << ".\n";
+        pshellscript::output::flush();
+        std::cout << "Exited with status " << exit_status;
+        if (measurement) {
+            std::cout << " (" << pshellscript::accounting::describe(measurement->finish()) << ")";
+        }
+        std::cout << ".\n";
     }
+
+    pshellscript::output::flush();
 }
\ No newline at end of file
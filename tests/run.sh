@@ -0,0 +1,31 @@
+#!/bin/sh
+# Run each tests/<name>.psh through the shell and compare what it prints,
+# standard error included, with tests/<name>.out. Variables listed in an
+# optional tests/<name>.env are set for the run.
+#
+# Usage: tests/run.sh path/to/shell
+
+shell=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+directory=$(cd "$(dirname "$0")" && pwd)
+actual=$(mktemp)
+trap 'rm -f "$actual"' EXIT
+failed=0
+
+for script in "$directory"/*.psh; do
+    name=$(basename "$script" .psh)
+    settings=
+    if [ -f "$directory/$name.env" ]; then
+        settings=$(cat "$directory/$name.env")
+    fi
+
+    (cd "$directory" && env $settings "$shell" < "$script" > "$actual" 2>&1)
+    if diff -u "$directory/$name.out" "$actual" > /dev/null; then
+        echo "[ ok ] $name"
+    else
+        echo "[FAIL] $name"
+        diff -u "$directory/$name.out" "$actual"
+        failed=$((failed + 1))
+    fi
+done
+
+[ "$failed" -eq 0 ]